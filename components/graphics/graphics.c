@@ -3,6 +3,7 @@
 #include <string.h>
 
 #include "graphics.h"
+#include "render_stats.h"
 
 
 void blit(gbuf_t *dst, rect_t dst_rect, gbuf_t *src, rect_t src_rect)
@@ -58,6 +59,10 @@ void blit(gbuf_t *dst, rect_t dst_rect, gbuf_t *src, rect_t src_rect)
         dst_rect.height -= (src_rect.y + dst_rect.height) - src->height;
     }
 
+    if (dst_rect.width > 0 && dst_rect.height > 0) {
+        RENDER_STATS_PIXELS(dst_rect.width * dst_rect.height);
+    }
+
     if (src->bytes_per_pixel == 2 && dst->bytes_per_pixel == 2) {
         if (src->endian == dst->endian) {
             for (short yoff = 0; yoff < dst_rect.height; yoff++) {
@@ -95,6 +100,8 @@ void draw_line(gbuf_t *g, point_t start, point_t end, draw_style_t style, uint16
     dx /= inc;
     dy /= inc;
 
+    RENDER_STATS_PIXELS(style == DRAW_STYLE_DOTTED ? inc/2 + 1 : inc + 1);
+
     if (style == DRAW_STYLE_DOTTED) {
         for (int i = 0; i <= inc; i += 2) {
             uint16_t *pixel = ((uint16_t *)g->data) + (start.y * g->width) + start.x;
@@ -176,6 +183,10 @@ void fill_rectangle(gbuf_t *g, rect_t rect, uint16_t color)
         color = color << 8 | color >> 8;
     }
 
+    if (rect.width > 0 && rect.height > 0) {
+        RENDER_STATS_PIXELS(rect.width * rect.height);
+    }
+
     for (short yoff = 0; yoff < rect.height; yoff++) {
         uint16_t *addr  = ((uint16_t *)g->data) + (rect.y + yoff) * g->width + rect.x;
         for (short xoff = 0; xoff < rect.width; xoff++) {
@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "qoi.h"
+#include "render_stats.h"
+
+#define QOI_OP_INDEX (0x00)
+#define QOI_OP_DIFF (0x40)
+#define QOI_OP_LUMA (0x80)
+#define QOI_OP_RUN (0xc0)
+#define QOI_OP_RGB (0xfe)
+#define QOI_OP_RGBA (0xff)
+#define QOI_MASK (0xc0)
+#define QOI_HEADER_LEN (14)
+#define QOI_END_LEN (8)
+
+#define QOI_HASH(px) (((px) >> 24) * 3 + (((px) >> 16) & 0xff) * 5 + (((px) >> 8) & 0xff) * 7 + ((px) & 0xff) * 11)
+
+
+static bool qoi_refill(qoi_t *q)
+{
+    q->len = fread(q->buf, 1, sizeof(q->buf), q->f);
+    q->pos = 0;
+    return q->len > 0;
+}
+
+static inline int qoi_byte(qoi_t *q)
+{
+    if (q->pos == q->len && !qoi_refill(q)) {
+        return -1;
+    }
+    return q->buf[q->pos++];
+}
+
+static inline uint16_t qoi_rgb565(uint32_t px, bool swap)
+{
+    uint16_t c = ((px >> 16) & 0xf800) | ((px >> 13) & 0x07e0) | ((px >> 11) & 0x001f);
+    return swap ? c << 8 | c >> 8 : c;
+}
+
+/* the bits of each channel repeated into the low ones, which qoi_rgb565
+ * drops again */
+static inline uint32_t qoi_rgba(uint16_t c, bool swap)
+{
+    c = swap ? c << 8 | c >> 8 : c;
+    uint8_t r = c >> 11, g = (c >> 5) & 0x3f, b = c & 0x1f;
+    r = r << 3 | r >> 2;
+    g = g << 2 | g >> 4;
+    b = b << 3 | b >> 2;
+    return (uint32_t)r << 24 | g << 16 | b << 8 | 0xff;
+}
+
+static void qoi_put32(uint8_t *out, uint32_t v)
+{
+    out[0] = v >> 24;
+    out[1] = v >> 16;
+    out[2] = v >> 8;
+    out[3] = v;
+}
+
+qoi_t *qoi_open(FILE *f)
+{
+    qoi_t *q = calloc(1, sizeof(qoi_t));
+    assert(q != NULL);
+    q->f = f;
+
+    uint8_t header[QOI_HEADER_LEN];
+    for (int i = 0; i < QOI_HEADER_LEN; i++) {
+        int c = qoi_byte(q);
+        if (c < 0) {
+            free(q);
+            return NULL;
+        }
+        header[i] = c;
+    }
+
+    uint32_t width = header[4] << 24 | header[5] << 16 | header[6] << 8 | header[7];
+    uint32_t height = header[8] << 24 | header[9] << 16 | header[10] << 8 | header[11];
+    if (memcmp(header, "qoif", 4) != 0 || width == 0 || height == 0 ||
+            width > UINT16_MAX || height > UINT16_MAX) {
+        free(q);
+        return NULL;
+    }
+
+    q->width = width;
+    q->height = height;
+    q->px = 0x000000ff;
+    return q;
+}
+
+void qoi_close(qoi_t *q)
+{
+    free(q);
+}
+
+/* decodes the next rows of the image into g with its top-left pixel at p,
+ * pixels falling outside g are decoded and dropped */
+bool qoi_decode_rows(qoi_t *q, gbuf_t *g, point_t p, int rows)
+{
+    bool swap = g->endian == BIG_ENDIAN;
+    uint32_t px = q->px;
+    uint16_t c = qoi_rgb565(px, swap);
+
+    /* columns of the image that land inside g */
+    int x0 = p.x < 0 ? -p.x : 0;
+    int x1 = g->width - p.x < q->width ? g->width - p.x : q->width;
+
+    for (int i = 0; i < rows && q->row < q->height; i++, q->row++) {
+        int y = p.y + i;
+        uint16_t *dst = NULL;
+        if (y >= 0 && y < g->height && x0 < x1) {
+            dst = ((uint16_t *)g->data) + y * g->width;
+            RENDER_STATS_PIXELS(x1 - x0);
+        }
+
+        for (int x = 0; x < q->width; x++) {
+            if (q->run > 0) {
+                q->run -= 1;
+            } else {
+                int b1 = qoi_byte(q);
+                if (b1 < 0) {
+                    q->px = px;
+                    return false;
+                }
+
+                if (b1 == QOI_OP_RGB || b1 == QOI_OP_RGBA) {
+                    int r = qoi_byte(q);
+                    int gr = qoi_byte(q);
+                    int b = qoi_byte(q);
+                    int a = b1 == QOI_OP_RGBA ? qoi_byte(q) : (int)(px & 0xff);
+                    if (r < 0 || gr < 0 || b < 0 || a < 0) {
+                        q->px = px;
+                        return false;
+                    }
+                    px = (uint32_t)r << 24 | gr << 16 | b << 8 | a;
+                } else if ((b1 & QOI_MASK) == QOI_OP_INDEX) {
+                    px = q->index[b1];
+                } else if ((b1 & QOI_MASK) == QOI_OP_DIFF) {
+                    uint8_t r = (px >> 24) + ((b1 >> 4) & 0x03) - 2;
+                    uint8_t gr = (px >> 16) + ((b1 >> 2) & 0x03) - 2;
+                    uint8_t b = (px >> 8) + (b1 & 0x03) - 2;
+                    px = (uint32_t)r << 24 | gr << 16 | b << 8 | (px & 0xff);
+                } else if ((b1 & QOI_MASK) == QOI_OP_LUMA) {
+                    int b2 = qoi_byte(q);
+                    if (b2 < 0) {
+                        q->px = px;
+                        return false;
+                    }
+                    int vg = (b1 & 0x3f) - 32;
+                    uint8_t r = (px >> 24) + vg - 8 + ((b2 >> 4) & 0x0f);
+                    uint8_t gr = (px >> 16) + vg;
+                    uint8_t b = (px >> 8) + vg - 8 + (b2 & 0x0f);
+                    px = (uint32_t)r << 24 | gr << 16 | b << 8 | (px & 0xff);
+                } else {
+                    /* QOI_OP_RUN, this pixel plus the rest of the run */
+                    q->run = b1 & 0x3f;
+                }
+
+                q->index[QOI_HASH(px) % 64] = px;
+                c = qoi_rgb565(px, swap);
+            }
+
+            if (dst && x >= x0 && x < x1) {
+                dst[p.x + x] = c;
+            }
+        }
+    }
+
+    q->px = px;
+    return true;
+}
+
+/* draws a whole .qoi file with its top-left pixel at p */
+bool qoi_draw(gbuf_t *g, point_t p, const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        return false;
+    }
+
+    qoi_t *q = qoi_open(f);
+    if (!q) {
+        fclose(f);
+        return false;
+    }
+
+    RENDER_STATS_BEGIN("qoi", filename);
+    bool result = qoi_decode_rows(q, g, p, q->height);
+    RENDER_STATS_END();
+
+    qoi_close(q);
+    fclose(f);
+    return result;
+}
+
+/* encodes all of g, returns the length of the image or 0 when it does not
+ * fit in size bytes */
+size_t qoi_encode(const gbuf_t *g, uint8_t *out, size_t size)
+{
+    bool swap = g->endian == BIG_ENDIAN;
+    const uint16_t *src = (const uint16_t *)g->data;
+    size_t count = g->width * g->height;
+    uint32_t index[64];
+    uint32_t prev = 0x000000ff;
+    int run = 0;
+
+    if (size < QOI_HEADER_LEN + QOI_END_LEN) {
+        return 0;
+    }
+    memcpy(out, "qoif", 4);
+    qoi_put32(out + 4, g->width);
+    qoi_put32(out + 8, g->height);
+    out[12] = 3;
+    out[13] = 0;
+    size_t n = QOI_HEADER_LEN;
+
+    memset(index, 0, sizeof(index));
+    for (size_t i = 0; i < count; i++) {
+        /* room for the longest op, a run before it and the end */
+        if (n + 5 + QOI_END_LEN > size) {
+            return 0;
+        }
+
+        uint32_t px = qoi_rgba(src[i], swap);
+        if (px == prev) {
+            run += 1;
+            if (run == 62 || i == count - 1) {
+                out[n++] = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out[n++] = QOI_OP_RUN | (run - 1);
+            run = 0;
+        }
+
+        int hash = QOI_HASH(px) % 64;
+        if (index[hash] == px) {
+            out[n++] = QOI_OP_INDEX | hash;
+        } else {
+            index[hash] = px;
+            int8_t vr = (px >> 24) - (prev >> 24);
+            int8_t vg = (px >> 16) - (prev >> 16);
+            int8_t vb = (px >> 8) - (prev >> 8);
+            int8_t vg_r = vr - vg;
+            int8_t vg_b = vb - vg;
+            if (vr >= -2 && vr <= 1 && vg >= -2 && vg <= 1 && vb >= -2 && vb <= 1) {
+                out[n++] = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+            } else if (vg >= -32 && vg <= 31 && vg_r >= -8 && vg_r <= 7 && vg_b >= -8 && vg_b <= 7) {
+                out[n++] = QOI_OP_LUMA | (vg + 32);
+                out[n++] = (vg_r + 8) << 4 | (vg_b + 8);
+            } else {
+                out[n++] = QOI_OP_RGB;
+                out[n++] = px >> 24;
+                out[n++] = px >> 16;
+                out[n++] = px >> 8;
+            }
+        }
+        prev = px;
+    }
+
+    memset(out + n, 0, QOI_END_LEN - 1);
+    out[n + QOI_END_LEN - 1] = 1;
+    return n + QOI_END_LEN;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "graphics.h"
+
+/*
+ * Streaming decoder for QOI images (https://qoiformat.org). Rows are
+ * decoded straight into RGB565 gbufs through a small read buffer, so a
+ * full screen image never has to be held in memory. The encoder widens
+ * RGB565 so that decoding gives back the same pixels.
+ */
+
+#define QOI_READ_BUFFER (1024)
+
+typedef struct qoi_t {
+    FILE *f;
+    uint16_t width;
+    uint16_t height;
+    uint16_t row;
+    uint32_t px;
+    uint32_t index[64];
+    int run;
+    size_t pos;
+    size_t len;
+    uint8_t buf[QOI_READ_BUFFER];
+} qoi_t;
+
+qoi_t *qoi_open(FILE *f);
+void qoi_close(qoi_t *q);
+bool qoi_decode_rows(qoi_t *q, gbuf_t *g, point_t p, int rows);
+bool qoi_draw(gbuf_t *g, point_t p, const char *filename);
+size_t qoi_encode(const gbuf_t *g, uint8_t *out, size_t size);
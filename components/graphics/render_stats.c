@@ -0,0 +1,140 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+
+#include "render_stats.h"
+
+#ifdef CONFIG_GRAPHICS_RENDER_STATS
+
+#define MAX_ENTRIES (32)
+#define MAX_DEPTH (4)
+
+typedef struct {
+    const char *kind;
+    const char *title;
+    render_counters_t counters;
+} render_entry_t;
+
+typedef struct {
+    render_entry_t *entry;
+    int64_t start;
+} render_context_t;
+
+static render_entry_t s_entries[MAX_ENTRIES];
+static size_t s_entry_count = 0;
+static render_entry_t s_other = { .kind = "other" };
+static render_context_t s_stack[MAX_DEPTH];
+static int s_depth = 0;
+
+
+static render_entry_t *find_entry(const char *kind, const char *title)
+{
+    for (size_t i = 0; i < s_entry_count; i++) {
+        render_entry_t *e = &s_entries[i];
+        if (strcmp(e->kind, kind) != 0) {
+            continue;
+        }
+        if (e->title == title || (e->title && title && strcmp(e->title, title) == 0)) {
+            return e;
+        }
+    }
+
+    if (s_entry_count >= MAX_ENTRIES) {
+        return &s_other;
+    }
+
+    /* titles are owned by dialogs that come and go, keep a copy */
+    render_entry_t *e = &s_entries[s_entry_count++];
+    e->kind = kind;
+    e->title = title ? strdup(title) : NULL;
+    memset(&e->counters, 0, sizeof(render_counters_t));
+    return e;
+}
+
+static render_entry_t *current_entry(void)
+{
+    return s_depth > 0 ? s_stack[s_depth - 1].entry : &s_other;
+}
+
+void render_stats_begin(const char *kind, const char *title)
+{
+    render_entry_t *e = find_entry(kind, title);
+    e->counters.invocations += 1;
+    if (s_depth < MAX_DEPTH) {
+        s_stack[s_depth].entry = e;
+        s_stack[s_depth].start = esp_timer_get_time();
+    }
+    s_depth += 1;
+}
+
+void render_stats_end(void)
+{
+    assert(s_depth > 0);
+    s_depth -= 1;
+    if (s_depth < MAX_DEPTH) {
+        render_context_t *c = &s_stack[s_depth];
+        c->entry->counters.time_us += esp_timer_get_time() - c->start;
+    }
+}
+
+void render_stats_pixels(uint32_t count)
+{
+    current_entry()->counters.pixels += count;
+}
+
+void render_stats_glyph(uint32_t pixels)
+{
+    render_entry_t *e = current_entry();
+    e->counters.glyphs += 1;
+    e->counters.pixels += pixels;
+}
+
+void render_stats_flush(const char *kind, const char *title, rect_t r)
+{
+    if (r.width > 0 && r.height > 0) {
+        find_entry(kind, title)->counters.bytes_flushed += r.width * r.height * 2;
+    }
+}
+
+render_counters_t render_stats_total(void)
+{
+    render_counters_t total = s_other.counters;
+    for (size_t i = 0; i < s_entry_count; i++) {
+        render_counters_t *c = &s_entries[i].counters;
+        total.invocations += c->invocations;
+        total.pixels += c->pixels;
+        total.glyphs += c->glyphs;
+        total.bytes_flushed += c->bytes_flushed;
+        total.time_us += c->time_us;
+    }
+    return total;
+}
+
+static void dump_entry(FILE *f, const render_entry_t *e)
+{
+    fprintf(f, "%-8s %-24.24s %8u %10u %8u %11u %10llu\n", e->kind, e->title ? e->title : "-",
+            e->counters.invocations, e->counters.pixels, e->counters.glyphs,
+            e->counters.bytes_flushed, (unsigned long long)e->counters.time_us);
+}
+
+void render_stats_dump(FILE *f)
+{
+    fprintf(f, "%-8s %-24s %8s %10s %8s %11s %10s\n", "kind", "dialog", "draws", "pixels", "glyphs", "flushed", "time_us");
+    for (size_t i = 0; i < s_entry_count; i++) {
+        dump_entry(f, &s_entries[i]);
+    }
+    dump_entry(f, &s_other);
+}
+
+void render_stats_reset(void)
+{
+    for (size_t i = 0; i < s_entry_count; i++) {
+        free((char *)s_entries[i].title);
+    }
+    s_entry_count = 0;
+    memset(&s_other.counters, 0, sizeof(render_counters_t));
+}
+
+#endif
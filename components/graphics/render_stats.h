@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sdkconfig.h"
+
+#include "rect.h"
+
+/*
+ * Render instrumentation. Drawing is attributed to the innermost open
+ * context, a (kind, title) pair such as ("list", "App List"). With
+ * CONFIG_GRAPHICS_RENDER_STATS disabled every hook compiles to nothing.
+ */
+
+typedef struct render_counters_t {
+    uint32_t invocations;
+    uint32_t pixels;
+    uint32_t glyphs;
+    uint32_t bytes_flushed;
+    uint64_t time_us;
+} render_counters_t;
+
+#ifdef CONFIG_GRAPHICS_RENDER_STATS
+
+void render_stats_begin(const char *kind, const char *title);
+void render_stats_end(void);
+void render_stats_pixels(uint32_t count);
+void render_stats_glyph(uint32_t pixels);
+void render_stats_flush(const char *kind, const char *title, rect_t r);
+render_counters_t render_stats_total(void);
+void render_stats_dump(FILE *f);
+void render_stats_reset(void);
+
+#define RENDER_STATS_BEGIN(kind, title) render_stats_begin(kind, title)
+#define RENDER_STATS_END() render_stats_end()
+#define RENDER_STATS_PIXELS(count) render_stats_pixels(count)
+#define RENDER_STATS_GLYPH(pixels) render_stats_glyph(pixels)
+#define RENDER_STATS_FLUSH(kind, title, r) render_stats_flush(kind, title, r)
+
+#else
+
+#define RENDER_STATS_BEGIN(kind, title) do { } while (0)
+#define RENDER_STATS_END() do { } while (0)
+#define RENDER_STATS_PIXELS(count) do { } while (0)
+#define RENDER_STATS_GLYPH(pixels) do { } while (0)
+#define RENDER_STATS_FLUSH(kind, title, r) do { } while (0)
+
+#endif
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "render_stats.h"
 #include "tf.h"
 
 
@@ -156,6 +157,8 @@ short tf_draw_glyph(gbuf_t *g, tf_t *tf, char c, point_t p)
 
     const unsigned char *glyph = tf->font->p + ((tf->font->width + 7) / 8) * tf->font->height * (c - tf->font->first);
 
+    RENDER_STATS_GLYPH(xend > xstart && yend > ystart ? (xend - xstart) * (yend - ystart) : 0);
+
     for (short yoff = ystart; yoff < yend; yoff++) {
         uint16_t *pixel = ((uint16_t *)g->data) + (p.y + yoff) * g->width + p.x;
         for (short xoff = xstart; xoff < xend; xoff++) {
@@ -0,0 +1,125 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_freertos_hooks.h"
+#include "esp_timer.h"
+#include "xtensa/core-macros.h"
+
+#include "trace.h"
+
+#ifdef CONFIG_TRACE
+
+#define CYCLES_PER_US (CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ)
+
+typedef struct trace_record_t {
+    uint64_t cycles;
+    const char *name;
+    TaskHandle_t task;
+    uint32_t arg;
+    uint8_t type;
+} trace_record_t;
+
+/* written only from its own core, with interrupts masked there, so that
+ * neither a task switch nor an interrupt can come in between */
+typedef struct trace_ring_t {
+    trace_record_t *records;
+    /* events recorded; the last CONFIG_TRACE_EVENTS are kept */
+    uint32_t count;
+    /* the 32-bit counter extended, it wraps every 17.9 s at 240 MHz */
+    uint32_t last;
+    uint32_t wraps;
+    /* the cycles at esp_timer time 0, as the counters of the two cores
+     * did not start together */
+    uint64_t base;
+    bool synced;
+} trace_ring_t;
+
+static trace_ring_t s_rings[portNUM_PROCESSORS];
+static volatile bool s_enabled = false;
+
+
+static IRAM_ATTR uint64_t ring_cycles(trace_ring_t *ring)
+{
+    uint32_t now = XTHAL_GET_CCOUNT();
+    if (now < ring->last) {
+        ring->wraps += 1;
+    }
+    ring->last = now;
+    return (uint64_t)ring->wraps << 32 | now;
+}
+
+/* reads the counter every tick, so that no wrap goes unseen on a core
+ * that records nothing for a while */
+static IRAM_ATTR void tick_hook(void)
+{
+    trace_ring_t *ring = &s_rings[xPortGetCoreID()];
+    UBaseType_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    uint64_t cycles = ring_cycles(ring);
+    if (!ring->synced) {
+        ring->base = cycles - esp_timer_get_time() * CYCLES_PER_US;
+        ring->synced = true;
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+}
+
+/* first thing in app_main, events before are dropped */
+void trace_init(void)
+{
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        s_rings[i].records = calloc(CONFIG_TRACE_EVENTS, sizeof(trace_record_t));
+        assert(s_rings[i].records != NULL);
+        ESP_ERROR_CHECK(esp_register_freertos_tick_hook_for_cpu(tick_hook, i));
+    }
+    s_enabled = true;
+}
+
+void trace_event(trace_type_t type, const char *name, uint32_t arg)
+{
+    if (!s_enabled) {
+        return;
+    }
+
+    UBaseType_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    trace_ring_t *ring = &s_rings[xPortGetCoreID()];
+    trace_record_t *record = &ring->records[ring->count % CONFIG_TRACE_EVENTS];
+    record->cycles = ring_cycles(ring);
+    record->name = name;
+    record->task = xTaskGetCurrentTaskHandle();
+    record->arg = arg;
+    record->type = type;
+    ring->count += 1;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+}
+
+/* one line per event, core by core:
+ *   type core us task arg name
+ * recording stops meanwhile, so the rings stay put */
+void trace_dump(FILE *f)
+{
+    s_enabled = false;
+    /* for an event being recorded on the other core */
+    vTaskDelay(1);
+
+    fprintf(f, "# trace %d %d\n", portNUM_PROCESSORS, CYCLES_PER_US);
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        trace_ring_t *ring = &s_rings[i];
+        if (!ring->synced) {
+            continue;
+        }
+        uint32_t first = ring->count > CONFIG_TRACE_EVENTS ? ring->count - CONFIG_TRACE_EVENTS : 0;
+        for (uint32_t n = first; n < ring->count; n++) {
+            trace_record_t *record = &ring->records[n % CONFIG_TRACE_EVENTS];
+            fprintf(f, "%c %d %.3f %p %u %s\n", record->type, i,
+                    (double)(int64_t)(record->cycles - ring->base) / CYCLES_PER_US, (void *)record->task,
+                    (unsigned)record->arg, record->name);
+        }
+    }
+
+    s_enabled = true;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sdkconfig.h"
+
+/*
+ * Timeline trace. Begin, end and instant events go into a ring per core,
+ * stamped with that core's cycle counter, so recording takes no lock.
+ * Names must be string literals or otherwise outlive the trace, only the
+ * pointer is kept. trace_dump writes the rings as text, which
+ * tools/trace2json.py turns into a Chrome trace. With CONFIG_TRACE
+ * disabled every hook compiles to nothing.
+ */
+
+typedef enum {
+    TRACE_TYPE_BEGIN = 'B',
+    TRACE_TYPE_END = 'E',
+    TRACE_TYPE_INSTANT = 'I',
+} trace_type_t;
+
+#ifdef CONFIG_TRACE
+
+void trace_init(void);
+void trace_event(trace_type_t type, const char *name, uint32_t arg);
+void trace_dump(FILE *f);
+
+#define TRACE_BEGIN(name) trace_event(TRACE_TYPE_BEGIN, name, 0)
+#define TRACE_END(name) trace_event(TRACE_TYPE_END, name, 0)
+#define TRACE_INSTANT(name, arg) trace_event(TRACE_TYPE_INSTANT, name, arg)
+
+#else
+
+#define TRACE_BEGIN(name) do { } while (0)
+#define TRACE_END(name) do { } while (0)
+#define TRACE_INSTANT(name, arg) do { } while (0)
+
+#endif
@@ -1,14 +1,19 @@
+#include <ctype.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "display.h"
 #include "keypad.h"
 #include "OpenSans_Regular_11X12.h"
 #include "periodic.h"
+#include "render_stats.h"
 #include "tf.h"
+#include "trace.h"
 #include "ui_controls.h"
 #include "ui_dialog.h"
 #include "ui_osk.h"
 #include "ui_theme.h"
+#include "ui_wm.h"
 
 #define BORDER (1)
 
@@ -19,6 +24,10 @@ static void button_draw(ui_control_t *control)
 {
     ui_button_t *button = (ui_button_t *)control;
 
+    gbuf_t *g = button->d->window.g;
+
+    RENDER_STATS_BEGIN("button", button->d->title);
+
     button->tf->clip = button->r;
     button->tf->clip.x += button->d->cr.x + BORDER;
     button->tf->clip.y += button->d->cr.y + BORDER;
@@ -29,10 +38,10 @@ static void button_draw(ui_control_t *control)
     rb.x += button->d->cr.x;
     rb.y += button->d->cr.y;
 
-    fill_rectangle(fb, button->tf->clip, ui_theme->button_color);
-    draw_rectangle3d(fb, rb, ui_theme->border3d_light_color, ui_theme->border3d_dark_color);
+    fill_rectangle(g, button->tf->clip, ui_theme->button_color);
+    draw_rectangle3d(g, rb, ui_theme->border3d_light_color, ui_theme->border3d_dark_color);
     if (control == control->d->active) {
-        draw_rectangle(fb, button->tf->clip, DRAW_STYLE_DOTTED, ui_theme->selection_color);
+        draw_rectangle(g, button->tf->clip, DRAW_STYLE_DOTTED, ui_theme->selection_color);
     }
 
     if (button->text) {
@@ -41,10 +50,12 @@ static void button_draw(ui_control_t *control)
             .x = button->d->cr.x + button->r.x + ui_theme->padding,
             .y = button->d->cr.y + button->r.y + button->r.height/2 - m.height/2 + 1,
         };
-        tf_draw_str(fb, button->tf, button->text, p);
+        tf_draw_str(g, button->tf, button->text, p);
     }
 
     button->dirty = true;
+
+    RENDER_STATS_END();
 }
 
 static void button_free(ui_control_t *control)
@@ -84,6 +95,10 @@ static void edit_draw(ui_control_t *control)
 {
     ui_edit_t *edit = (ui_edit_t *)control;
 
+    gbuf_t *g = edit->d->window.g;
+
+    RENDER_STATS_BEGIN("edit", edit->d->title);
+
     edit->tf->clip = edit->r;
     edit->tf->clip.x += edit->d->cr.x + BORDER;
     edit->tf->clip.y += edit->d->cr.y + BORDER;
@@ -94,10 +109,10 @@ static void edit_draw(ui_control_t *control)
     rb.x += edit->d->cr.x;
     rb.y += edit->d->cr.y;
 
-    fill_rectangle(fb, edit->tf->clip, ui_theme->control_color);
-    draw_rectangle3d(fb, rb, ui_theme->border3d_dark_color, ui_theme->border3d_light_color);
+    fill_rectangle(g, edit->tf->clip, ui_theme->control_color);
+    draw_rectangle3d(g, rb, ui_theme->border3d_dark_color, ui_theme->border3d_light_color);
     if (control == control->d->active) {
-        draw_rectangle(fb, edit->tf->clip, DRAW_STYLE_DOTTED, ui_theme->selection_color);
+        draw_rectangle(g, edit->tf->clip, DRAW_STYLE_DOTTED, ui_theme->selection_color);
     }
 
     if (edit->text) {
@@ -110,13 +125,15 @@ static void edit_draw(ui_control_t *control)
             char s[len + 1];
             memset(s, '*', len);
             s[len] = '\0';
-            tf_draw_str(fb, edit->tf, s, p);
+            tf_draw_str(g, edit->tf, s, p);
         } else {
-            tf_draw_str(fb, edit->tf, edit->text, p);
+            tf_draw_str(g, edit->tf, edit->text, p);
         }
     }
 
     edit->dirty = true;
+
+    RENDER_STATS_END();
 }
 
 static void edit_onselect(ui_control_t *control, void *arg)
@@ -128,7 +145,9 @@ static void edit_onselect(ui_control_t *control, void *arg)
     ui_osk_free(osk);
 
     control->draw(control);
-    display_update_rect(control->d->cr);
+    ui_dialog_damage(control->d, control->r);
+    control->dirty = false;
+    ui_wm_flush();
 }
 
 static void edit_free(ui_control_t *control)
@@ -165,21 +184,27 @@ static void label_draw(ui_control_t *control)
 {
     ui_label_t *label = (ui_label_t *)control;
 
+    gbuf_t *g = label->d->window.g;
+
+    RENDER_STATS_BEGIN("label", label->d->title);
+
     label->tf->clip = label->r;
     label->tf->clip.x += label->d->cr.x;
     label->tf->clip.y += label->d->cr.y;
 
-    fill_rectangle(fb, label->tf->clip, ui_theme->window_color);
+    fill_rectangle(g, label->tf->clip, ui_theme->window_color);
     if (label->text) {
         tf_metrics_t m = tf_get_str_metrics(label->tf, label->text);
         point_t p = {
             .x = label->d->cr.x + label->r.x + ui_theme->padding,
             .y = label->d->cr.y + label->r.y + label->r.height/2 - m.height/2,
         };
-        tf_draw_str(fb, label->tf, label->text, p);
+        tf_draw_str(g, label->tf, label->text, p);
     }
 
     label->dirty = true;
+
+    RENDER_STATS_END();
 }
 
 static void label_free(ui_control_t *control)
@@ -221,30 +246,444 @@ void ui_label_set_text(ui_label_t *label, const char *text)
     if (text) {
         label->text = strdup(text);
     }
-    if (label->d == ui_dialog_get_top()) {
-        label->draw((ui_control_t *)label);
-        label->dirty = true;
+    /* the label draws into its dialog's surface, the wm only shows the
+     * part that is not covered */
+    label->draw((ui_control_t *)label);
+    ui_dialog_damage(label->d, label->r);
+}
+
+/* ui_progress */
+
+static void progress_draw(ui_control_t *control)
+{
+    ui_progress_t *progress = (ui_progress_t *)control;
+
+    gbuf_t *g = progress->d->window.g;
+
+    RENDER_STATS_BEGIN("progress", progress->d->title);
+
+    rect_t rb = progress->r;
+    rb.x += progress->d->cr.x;
+    rb.y += progress->d->cr.y;
+
+    rect_t r = rb;
+    r.x += BORDER;
+    r.y += BORDER;
+    r.width -= 2*BORDER;
+    r.height -= 2*BORDER;
+
+    fill_rectangle(g, r, ui_theme->control_color);
+    draw_rectangle3d(g, rb, ui_theme->border3d_dark_color, ui_theme->border3d_light_color);
+
+    if (progress->max > 0 && progress->value > 0) {
+        size_t value = progress->value < progress->max ? progress->value : progress->max;
+        /* 64 bit, a 2M partition in bytes times the width overflows */
+        r.width = (uint64_t)r.width * value / progress->max;
+        if (r.width > 0) {
+            fill_rectangle(g, r, ui_theme->active_highlight_color);
+        }
     }
+
+    progress->dirty = true;
+
+    RENDER_STATS_END();
+}
+
+static void progress_free(ui_control_t *control)
+{
+    free(control);
 }
 
+/* a bar that is filled value/max of the way, it cannot be focused */
+ui_progress_t *ui_dialog_add_progress(ui_dialog_t *d, rect_t r)
+{
+    ui_progress_t *progress = calloc(1, sizeof(ui_progress_t));
+
+    progress->type = CONTROL_PROGRESS;
+    progress->d = d;
+    progress->r = r;
+    progress->draw = progress_draw;
+    progress->free = progress_free;
+
+    ui_dialog_add_control(d, (ui_control_t *)progress);
+
+    return progress;
+}
+
+void ui_progress_set(ui_progress_t *progress, size_t value, size_t max)
+{
+    progress->value = value;
+    progress->max = max;
+    progress->draw((ui_control_t *)progress);
+    ui_dialog_damage(progress->d, progress->r);
+}
+
+
 /* ui_list */
 
-static int list_find_index(ui_list_t *list, ui_list_item_t *item)
+static const char filter_chars[] = "abcdefghijklmnopqrstuvwxyz0123456789 ";
+
+#define LIST_NO_FOLD ((size_t)-1)
+
+static void list_index_free(ui_list_t *list)
+{
+    if (list->fold_arena) {
+        free(list->fold_arena);
+        list->fold_arena = NULL;
+    }
+    if (list->fold) {
+        free(list->fold);
+        list->fold = NULL;
+    }
+    if (list->depth) {
+        free(list->depth);
+        list->depth = NULL;
+    }
+    if (list->view) {
+        free(list->view);
+        list->view = NULL;
+    }
+    list->fold_len = 0;
+    list->fold_size = 0;
+    list->view_count = 0;
+    list->index_size = 0;
+}
+
+/* the case-folded text of item i, NULL for separators */
+static const char *list_fold(ui_list_t *list, int i)
+{
+    return list->fold[i] == LIST_NO_FOLD ? NULL : list->fold_arena + list->fold[i];
+}
+
+/* appends the case-folded copy of an item's text to the arena */
+static size_t list_fold_add(ui_list_t *list, const ui_list_item_t *item)
 {
+    if (item->type != LIST_ITEM_TEXT || !item->text) {
+        return LIST_NO_FOLD;
+    }
+
+    size_t len = strlen(item->text) + 1;
+    if (list->fold_len + len > list->fold_size) {
+        list->fold_size = list->fold_size ? list->fold_size * 2 : 256;
+        while (list->fold_len + len > list->fold_size) {
+            list->fold_size *= 2;
+        }
+        list->fold_arena = realloc(list->fold_arena, list->fold_size);
+        assert(list->fold_arena != NULL);
+    }
+
+    size_t offset = list->fold_len;
+    char *p = list->fold_arena + offset;
+    for (const char *q = item->text; *q; q++) {
+        *p++ = tolower((unsigned char)*q);
+    }
+    *p = '\0';
+    list->fold_len += len;
+    return offset;
+}
+
+/* builds the case-folded copy of every item's text, used by the filter */
+static void list_index_build(ui_list_t *list)
+{
+    size_t arena_len = 0;
+    for (int i = 0; i < list->item_count; i++) {
+        if (list->items[i]->type == LIST_ITEM_TEXT && list->items[i]->text) {
+            arena_len += strlen(list->items[i]->text) + 1;
+        }
+    }
+
+    list->index_size = list->item_count > 0 ? list->item_count : 1;
+    list->fold_size = arena_len > 0 ? arena_len : 1;
+    list->fold_len = 0;
+    list->fold_arena = malloc(list->fold_size);
+    list->fold = malloc(sizeof(size_t) * list->index_size);
+    list->depth = calloc(list->index_size, sizeof(unsigned char));
+    list->view = malloc(sizeof(int) * list->index_size);
+    assert(list->fold_arena != NULL && list->fold != NULL && list->depth != NULL && list->view != NULL);
+    list->view_count = 0;
+
+    for (int i = 0; i < list->item_count; i++) {
+        list->fold[i] = list_fold_add(list, list->items[i]);
+    }
+}
+
+/* folds an item inserted at index into the index and, when it matches the
+ * filter, into the view, without going over the other items again */
+static void list_index_insert(ui_list_t *list, int index)
+{
+    if (list->item_count > list->index_size) {
+        list->index_size *= 2;
+        list->fold = realloc(list->fold, sizeof(size_t) * list->index_size);
+        list->depth = realloc(list->depth, sizeof(unsigned char) * list->index_size);
+        list->view = realloc(list->view, sizeof(int) * list->index_size);
+        assert(list->fold != NULL && list->depth != NULL && list->view != NULL);
+    }
+
+    size_t after = list->item_count - 1 - index;
+    memmove(&list->fold[index + 1], &list->fold[index], sizeof(size_t) * after);
+    memmove(&list->depth[index + 1], &list->depth[index], sizeof(unsigned char) * after);
+    list->fold[index] = list_fold_add(list, list->items[index]);
+
+    /* the longest prefix of the filter the item contains */
+    const char *fold = list_fold(list, index);
+    unsigned char depth = 0;
+    char prefix[sizeof(list->filter)];
+    while (fold && depth < list->filter_len) {
+        memcpy(prefix, list->filter, depth + 1);
+        prefix[depth + 1] = '\0';
+        if (!strstr(fold, prefix)) {
+            break;
+        }
+        depth += 1;
+    }
+    list->depth[index] = depth;
+
+    size_t pos = list->view_count;
+    for (size_t j = 0; j < list->view_count; j++) {
+        if (list->view[j] >= index) {
+            if (pos == list->view_count) {
+                pos = j;
+            }
+            list->view[j] += 1;
+        }
+    }
+    if (depth == list->filter_len) {
+        memmove(&list->view[pos + 1], &list->view[pos], sizeof(int) * (list->view_count - pos));
+        list->view[pos] = index;
+        list->view_count += 1;
+    }
+}
+
+/* item depth is the longest filter prefix the item is known to contain, so
+ * dropping characters from the filter needs no string matching at all */
+static void list_filter_shrink(ui_list_t *list, size_t len)
+{
+    list->filter_len = len;
+    list->filter[len] = '\0';
+    list->view_count = 0;
+    if (len == 0) {
+        return;
+    }
+
     for (int i = 0; i < list->item_count; i++) {
-        if (list->items[i] == item) {
+        if (list_fold(list, i) && list->depth[i] >= len) {
+            list->view[list->view_count++] = i;
+        }
+    }
+}
+
+/* appending a character only needs to search the previous result set */
+static void list_filter_extend(ui_list_t *list, char c)
+{
+    if (list->filter_len >= sizeof(list->filter) - 1) {
+        return;
+    }
+
+    list->filter[list->filter_len++] = tolower((unsigned char)c);
+    list->filter[list->filter_len] = '\0';
+
+    size_t count = 0;
+    if (list->filter_len == 1) {
+        for (int i = 0; i < list->item_count; i++) {
+            const char *fold = list_fold(list, i);
+            if (!fold) {
+                continue;
+            }
+            if (strchr(fold, list->filter[0])) {
+                list->depth[i] = 1;
+                list->view[count++] = i;
+            } else {
+                list->depth[i] = 0;
+            }
+        }
+    } else {
+        for (size_t j = 0; j < list->view_count; j++) {
+            int i = list->view[j];
+            if (strstr(list_fold(list, i), list->filter)) {
+                list->depth[i] = list->filter_len;
+                list->view[count++] = i;
+            } else {
+                list->depth[i] = list->filter_len - 1;
+            }
+        }
+    }
+    list->view_count = count;
+}
+
+/* rebuilds the index and reapplies the filter after an item was removed */
+static void list_filter_refresh(ui_list_t *list)
+{
+    if (list->filter_len == 0 || list->fold_arena) {
+        return;
+    }
+
+    char filter[sizeof(list->filter)];
+    strcpy(filter, list->filter);
+    list->filter_len = 0;
+    list->filter[0] = '\0';
+    ui_list_set_filter(list, filter);
+}
+
+void ui_list_set_filter(ui_list_t *list, const char *filter)
+{
+    if (!filter || !*filter) {
+        list_index_free(list);
+        list->filter_len = 0;
+        list->filter[0] = '\0';
+        list->dirty = true;
+        return;
+    }
+
+    if (!list->fold_arena) {
+        list_index_free(list);
+        list_index_build(list);
+        list->filter_len = 0;
+        list->filter[0] = '\0';
+    }
+
+    size_t common = 0;
+    while (common < list->filter_len && filter[common] &&
+            list->filter[common] == tolower((unsigned char)filter[common])) {
+        common++;
+    }
+    if (common < list->filter_len) {
+        list_filter_shrink(list, common);
+    }
+    for (const char *p = filter + common; *p; p++) {
+        list_filter_extend(list, *p);
+    }
+
+    list->dirty = true;
+}
+
+void ui_list_set_status(ui_list_t *list, const char *status)
+{
+    if (list->status) {
+        free(list->status);
+        list->status = NULL;
+    }
+    if (status) {
+        list->status = strdup(status);
+    }
+    list->dirty = true;
+}
+
+static size_t list_view_count(ui_list_t *list)
+{
+    return list->filter_len > 0 ? list->view_count : list->item_count;
+}
+
+static ui_list_item_t *list_view_item(ui_list_t *list, int i)
+{
+    return list->filter_len > 0 ? list->items[list->view[i]] : list->items[i];
+}
+
+static int list_find_index(ui_list_t *list, ui_list_item_t *item)
+{
+    size_t count = list_view_count(list);
+    for (int i = 0; i < count; i++) {
+        if (list_view_item(list, i) == item) {
             return i;
         }
     }
     return -1;
 }
 
+static void list_filter_cycle(ui_list_t *list, int step)
+{
+    char filter[sizeof(list->filter)];
+    strcpy(filter, list->filter);
+
+    size_t len = strlen(filter);
+    int n = sizeof(filter_chars) - 1;
+    int i;
+    if (len == 0) {
+        i = step > 0 ? 0 : n - 1;
+        len = 1;
+    } else {
+        const char *p = strchr(filter_chars, filter[len - 1]);
+        i = p ? (p - filter_chars + step + n) % n : 0;
+    }
+    filter[len - 1] = filter_chars[i];
+    filter[len] = '\0';
+    ui_list_set_filter(list, filter);
+}
+
+static void list_filter_osk(ui_list_t *list)
+{
+    char filter[sizeof(list->filter)];
+    strcpy(filter, list->filter);
+
+    ui_edit_t edit = {
+        .type = CONTROL_EDIT,
+        .d = list->d,
+        .text = filter,
+        .text_len = sizeof(filter),
+    };
+    ui_osk_t *osk = ui_osk_new(&edit);
+    if (ui_osk_showmodal(osk)) {
+        ui_list_set_filter(list, filter);
+    }
+    ui_osk_free(osk);
+}
+
+/* draws an icon, or a placeholder while it is not available, clipped to
+ * the list */
+static void list_draw_icon(ui_list_t *list, gbuf_t *g, rect_t r, gbuf_t *icon)
+{
+    rect_t clip = list->tf->clip;
+    rect_t src = {
+        .x = 0,
+        .y = 0,
+        .width = r.width,
+        .height = r.height,
+    };
+
+    if (r.y < clip.y) {
+        src.y += clip.y - r.y;
+        r.height -= clip.y - r.y;
+        r.y = clip.y;
+    }
+    if (r.y + r.height > clip.y + clip.height) {
+        r.height = clip.y + clip.height - r.y;
+    }
+    if (r.height <= 0) {
+        return;
+    }
+    src.height = r.height;
+
+    if (icon) {
+        blit(g, r, icon, src);
+    } else {
+        fill_rectangle(g, r, ui_theme->control_color);
+        /* draw_line cannot draw a single point */
+        if (r.height > 1) {
+            draw_rectangle(g, r, DRAW_STYLE_DOTTED, ui_theme->border3d_dark_color);
+        }
+    }
+}
+
 static void list_draw(ui_control_t *control)
 {
     ui_list_t *list = (ui_list_t *)control;
 
-    int item_height = list->tf->font->height + 2*ui_theme->padding;
-    int rows = (list->r.height - 2*BORDER + item_height - 1) / item_height;
+    gbuf_t *g = list->d->window.g;
+
+    RENDER_STATS_BEGIN("list", list->d->title);
+    TRACE_BEGIN("list_draw");
+
+    list_filter_refresh(list);
+
+    int text_height = list->tf->font->height + 2*ui_theme->padding;
+    bool icons = list->icon && list->show_icons;
+    int item_height = icons ? list->icon_size + 2*ui_theme->padding : text_height;
+    bool footer = list->filter_len > 0 || list->status;
+    short height = list->r.height;
+    if (footer) {
+        height -= text_height;
+    }
+    int rows = (height - 2*BORDER + item_height - 1) / item_height;
+    size_t count = list_view_count(list);
 
     list->tf->clip = list->r;
     list->tf->clip.x += list->d->cr.x + BORDER;
@@ -256,39 +695,44 @@ static void list_draw(ui_control_t *control)
     rb.x += list->d->cr.x;
     rb.y += list->d->cr.y;
 
-    fill_rectangle(fb, list->tf->clip, ui_theme->control_color);
-    draw_rectangle3d(fb, rb, ui_theme->border3d_dark_color, ui_theme->border3d_light_color);
+    fill_rectangle(g, list->tf->clip, ui_theme->control_color);
+    draw_rectangle3d(g, rb, ui_theme->border3d_dark_color, ui_theme->border3d_light_color);
     if (control == control->d->active && !list->selected) {
-        draw_rectangle(fb, list->tf->clip, DRAW_STYLE_DOTTED, ui_theme->selection_color);
+        draw_rectangle(g, list->tf->clip, DRAW_STYLE_DOTTED, ui_theme->selection_color);
     }
 
     int index = list_find_index(list, list->active);
-    if (index < 0 && list->item_count > 0) {
-        list->active = list->items[0];
+    if (index < 0 && count > 0) {
+        list->active = list_view_item(list, 0);
         index = 0;
     }
+    if (index < 0) {
+        /* nothing matches the filter */
+        list->first_index = 0;
+        list->shift = 0;
+    }
 
     if (index > list->first_index + rows - 1) {
         list->first_index = index - rows + 1;
     }
-    if (index < list->first_index) {
+    if (index >= 0 && index < list->first_index) {
         list->first_index = index;
     }
     if (index < list->first_index + 1) {
         list->shift = 0;
     }
     if (index >= list->first_index + rows - 1) {
-        list->shift = item_height - (list->r.height - 2*BORDER) % item_height;
+        list->shift = item_height - (height - 2*BORDER) % item_height;
         if (list->shift >= item_height) {
             list->shift = 0;
         }
     }
 
     for (unsigned int row = 0; row < rows; row++) {
-        if (row >= list->item_count) {
+        if (list->first_index + row >= count) {
             break;
         }
-        ui_list_item_t *item = list->items[list->first_index + row];
+        ui_list_item_t *item = list_view_item(list, list->first_index + row);
 
         rect_t r = list->r;
         r.x += list->d->cr.x + BORDER + 1;
@@ -302,11 +746,21 @@ static void list_draw(ui_control_t *control)
         };
 
         if (list->first_index + row == index) {
-            fill_rectangle(fb, r, list->selected ? ui_theme->active_highlight_color : ui_theme->inactive_highlight_color);
+            fill_rectangle(g, r, list->selected ? ui_theme->active_highlight_color : ui_theme->inactive_highlight_color);
         }
         switch (item->type) {
             case LIST_ITEM_TEXT:
-                tf_draw_str(fb, list->tf, item->text, p);
+                if (icons) {
+                    rect_t ir = {
+                        .x = r.x + ui_theme->padding,
+                        .y = r.y + r.height/2 - list->icon_size/2,
+                        .width = list->icon_size,
+                        .height = list->icon_size,
+                    };
+                    list_draw_icon(list, g, ir, list->icon(item));
+                    p.x += list->icon_size + ui_theme->padding;
+                }
+                tf_draw_str(g, list->tf, item->text, p);
                 break;
 
             case LIST_ITEM_SEPARATOR: {
@@ -319,14 +773,39 @@ static void list_draw(ui_control_t *control)
                     .y = r.y + item_height/2,
                 };
                 if (start.y < list->d->cr.y + list->r.y + list->r.height - 2*BORDER - 1) {
-                    draw_line(fb, start, end, DRAW_STYLE_SOLID, ui_theme->text_color);
+                    draw_line(g, start, end, DRAW_STYLE_SOLID, ui_theme->text_color);
                 }
                 break;
             }
         }
     }
 
+    if (footer) {
+        rect_t r = list->r;
+        r.x += list->d->cr.x + BORDER;
+        r.y += list->d->cr.y + list->r.height - BORDER - text_height;
+        r.width -= 2*BORDER;
+        r.height = text_height;
+        fill_rectangle(g, r, ui_theme->inactive_highlight_color);
+
+        char s[sizeof(list->filter) + 64];
+        if (list->filter_len > 0) {
+            snprintf(s, sizeof(s), "Filter: %s (%d)%s%s", list->filter, (int)count,
+                    list->status ? " " : "", list->status ? list->status : "");
+        } else {
+            snprintf(s, sizeof(s), "%s", list->status);
+        }
+        point_t p = {
+            .x = r.x + ui_theme->padding,
+            .y = r.y + r.height/2 - list->tf->font->height/2 + 1,
+        };
+        tf_draw_str(g, list->tf, s, p);
+    }
+
     control->dirty = true;
+
+    TRACE_END("list_draw");
+    RENDER_STATS_END();
 }
 
 static void list_free(ui_control_t *control)
@@ -336,6 +815,10 @@ static void list_free(ui_control_t *control)
     while (list->item_count > 0) {
         ui_list_remove(list, -1);
     }
+    list_index_free(list);
+    if (list->status) {
+        free(list->status);
+    }
     tf_free(list->tf);
     free(list);
 }
@@ -344,48 +827,72 @@ static void list_onselect(ui_control_t *control, void *arg)
 {
     ui_list_t *list = (ui_list_t *)control;
 
-    rect_t r = {
-        .x = list->d->cr.x + list->r.x,
-        .y = list->d->cr.y + list->r.y,
-        .width = list->r.width,
-        .height = list->r.height,
-    };
-
     list->selected = true;
     list->draw(control);
-    display_update_rect(r);
+    ui_dialog_damage(list->d, list->r);
+    list->dirty = false;
+    ui_wm_flush();
 
     keypad_info_t keys;
     while (!list->hide) {
         if (keypad_queue_receive(list->d->keypad, &keys, 50/portTICK_RATE_MS)) {
+            list_filter_refresh(list);
             int index = list_find_index(list, list->active);
+            size_t count = list_view_count(list);
 
             if (keys.pressed & KEYPAD_UP) {
                 int i;
                 for (i = index - 1; i >= 0; i--) {
-                    if (list->items[i]->type == LIST_ITEM_TEXT) {
+                    if (list_view_item(list, i)->type == LIST_ITEM_TEXT) {
                         break;
                     }
                 }
                 if (i >= 0) {
-                    list->active = list->items[i];
+                    list->active = list_view_item(list, i);
                     list->dirty = true;
                 }
             }
 
             if (keys.pressed & KEYPAD_DOWN) {
                 int i;
-                for (i = index + 1; i < list->item_count; i++) {
-                    if (list->items[i]->type == LIST_ITEM_TEXT) {
+                for (i = index + 1; i < count; i++) {
+                    if (list_view_item(list, i)->type == LIST_ITEM_TEXT) {
                         break;
                     }
                 }
-                if (i < list->item_count) {
-                    list->active = list->items[i];
+                if (i < count) {
+                    list->active = list_view_item(list, i);
                     list->dirty = true;
                 }
             }
 
+            if (keys.pressed & KEYPAD_START && list->icon && list->filter_len == 0) {
+                list->show_icons = !list->show_icons;
+                list->dirty = true;
+            }
+
+            if (list->filterable) {
+                if (keys.pressed & KEYPAD_RIGHT) {
+                    list_filter_cycle(list, 1);
+                }
+
+                if (keys.pressed & KEYPAD_LEFT) {
+                    list_filter_cycle(list, -1);
+                }
+
+                if (keys.pressed & KEYPAD_START && list->filter_len > 0 && list->filter_len < sizeof(list->filter) - 1) {
+                    char filter[sizeof(list->filter)];
+                    strcpy(filter, list->filter);
+                    filter[list->filter_len] = filter_chars[0];
+                    filter[list->filter_len + 1] = '\0';
+                    ui_list_set_filter(list, filter);
+                }
+
+                if (keys.pressed & KEYPAD_SELECT) {
+                    list_filter_osk(list);
+                }
+            }
+
             if (keys.pressed & KEYPAD_A) {
                 if (index >= 0 && list->active->onselect) {
                     list->active->onselect(list->active, list->active->arg);
@@ -393,7 +900,11 @@ static void list_onselect(ui_control_t *control, void *arg)
             }
 
             if (keys.pressed & KEYPAD_B) {
-                break;
+                if (list->filter_len > 0) {
+                    ui_list_set_filter(list, NULL);
+                } else {
+                    break;
+                }
             }
 
             if (keys.pressed & KEYPAD_MENU) {
@@ -403,9 +914,10 @@ static void list_onselect(ui_control_t *control, void *arg)
         }
         if (list->dirty) {
             list->draw(control);
-            display_update_rect(r);
+            ui_dialog_damage(list->d, list->r);
             list->dirty = false;
         }
+        ui_wm_flush();
         periodic_tick();
     }
 
@@ -431,7 +943,7 @@ ui_list_t *ui_dialog_add_list(ui_dialog_t *d, rect_t r)
     return list;
 }
 
-static ui_list_item_t *list_insert_new(ui_list_t *list, int index)
+static ui_list_item_t *list_insert_new(ui_list_t *list, int index, ui_list_item_type_t type, char *text)
 {
     if (index < 0) {
         index = list->item_count + index;
@@ -446,18 +958,23 @@ static ui_list_item_t *list_insert_new(ui_list_t *list, int index)
     }
 
     ui_list_item_t *item = calloc(1, sizeof(ui_list_item_t));
+    item->type = type;
+    item->list = list;
+    if (text) {
+        item->text = strdup(text);
+    }
 
     list->items[index] = item;
     list->item_count += 1;
+    if (list->fold_arena) {
+        list_index_insert(list, index);
+    }
     return item;
 }
 
 ui_list_item_t *ui_list_insert_text(ui_list_t *list, int index, char *text, ui_list_item_onselect_t onselect, void *arg)
 {
-    ui_list_item_t *item = list_insert_new(list, index);
-    item->type = LIST_ITEM_TEXT;
-    item->list = list;
-    item->text = strdup(text);
+    ui_list_item_t *item = list_insert_new(list, index, LIST_ITEM_TEXT, text);
     item->onselect = onselect;
     item->arg = arg;
     list->dirty = true;
@@ -472,9 +989,7 @@ ui_list_item_t *ui_list_append_text(ui_list_t *list, char *text, ui_list_item_on
 
 ui_list_item_t *ui_list_insert_separator(ui_list_t *list, int index)
 {
-    ui_list_item_t *item = list_insert_new(list, index);
-    item->type = LIST_ITEM_SEPARATOR;
-    item->list = list;
+    ui_list_item_t *item = list_insert_new(list, index, LIST_ITEM_SEPARATOR, NULL);
     list->dirty = true;
 
     return item;
@@ -504,6 +1019,7 @@ void ui_list_remove(ui_list_t *list, int index)
             break;
     }
 
+    list_index_free(list);
     free(list->items[index]);
     if (list->item_count == 1) {
         free(list->items);
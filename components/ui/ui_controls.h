@@ -19,6 +19,7 @@ typedef enum {
     CONTROL_EDIT,
     CONTROL_LABEL,
     CONTROL_LIST,
+    CONTROL_PROGRESS,
 } ui_control_type_t;
 
 typedef struct ui_control_t {
@@ -32,6 +33,7 @@ typedef struct ui_control_t {
     ui_control_onselect_t onselect;
     ui_control_free_t free;
     void *arg;
+    int slot;
 } ui_control_t;
 
 
@@ -48,6 +50,7 @@ typedef struct ui_button_t {
     ui_control_onselect_t onselect;
     ui_control_free_t free;
     void *arg;
+    int slot;
 
     char *text;
 } ui_button_t;
@@ -68,6 +71,7 @@ typedef struct ui_edit_t {
     ui_control_onselect_t onselect;
     ui_control_free_t free;
     void *arg;
+    int slot;
 
     char *text;
     size_t text_len;
@@ -92,6 +96,7 @@ typedef struct ui_label_t {
     ui_control_onselect_t onselect;
     ui_control_free_t free;
     void *arg;
+    int slot;
 
     char *text;
 } ui_label_t;
@@ -100,11 +105,35 @@ ui_label_t *ui_dialog_add_label(ui_dialog_t *d, rect_t r, const char *text);
 void ui_label_set_text(ui_label_t *label, const char *text);
 
 
+/* ui_progress */
+
+typedef struct ui_progress_t {
+    ui_control_type_t type;
+    ui_dialog_t *d;
+    rect_t r;
+    tf_t *tf;
+    bool dirty;
+    bool hide;
+    ui_control_draw_t draw;
+    ui_control_onselect_t onselect;
+    ui_control_free_t free;
+    void *arg;
+    int slot;
+
+    size_t value;
+    size_t max;
+} ui_progress_t;
+
+ui_progress_t *ui_dialog_add_progress(ui_dialog_t *d, rect_t r);
+void ui_progress_set(ui_progress_t *progress, size_t value, size_t max);
+
+
 /* ui_list */
 
 typedef struct ui_list_t ui_list_t;
 typedef struct ui_list_item_t ui_list_item_t;
 typedef void (*ui_list_item_onselect_t)(ui_list_item_t *item, void *arg);
+typedef gbuf_t *(*ui_list_icon_t)(ui_list_item_t *item);
 
 typedef struct ui_list_t {
     ui_control_type_t type;
@@ -117,6 +146,7 @@ typedef struct ui_list_t {
     ui_control_onselect_t onselect;
     ui_control_free_t free;
     void *arg;
+    int slot;
 
     bool selected;
     ui_list_item_t **items;
@@ -124,6 +154,28 @@ typedef struct ui_list_t {
     size_t item_count;
     int first_index;
     int shift;
+
+    bool filterable;
+    char filter[32];
+    size_t filter_len;
+    /* folded texts, as offsets into the arena; the arrays of the index
+     * have room for index_size items */
+    char *fold_arena;
+    size_t fold_len;
+    size_t fold_size;
+    size_t *fold;
+    unsigned char *depth;
+    int *view;
+    size_t view_count;
+    size_t index_size;
+
+    /* returns the icon for an item, NULL draws a placeholder */
+    ui_list_icon_t icon;
+    short icon_size;
+    bool show_icons;
+
+    /* shown in the footer, e.g. while items are still being added */
+    char *status;
 } ui_list_t;
 
 typedef enum {
@@ -145,3 +197,5 @@ ui_list_item_t *ui_list_append_text(ui_list_t *list, char *text, ui_list_item_on
 ui_list_item_t *ui_list_insert_separator(ui_list_t *list, int index);
 ui_list_item_t *ui_list_append_separator(ui_list_t *list);
 void ui_list_remove(ui_list_t *list, int index);
+void ui_list_set_filter(ui_list_t *list, const char *filter);
+void ui_list_set_status(ui_list_t *list, const char *status);
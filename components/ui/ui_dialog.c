@@ -1,4 +1,3 @@
-#include <math.h>
 #include <string.h>
 
 #include "keypad.h"
@@ -7,25 +6,43 @@
 
 #include "OpenSans_Regular_11X12.h"
 #include "periodic.h"
+#include "render_stats.h"
 #include "tf.h"
+#include "trace.h"
 #include "ui_dialog.h"
 #include "ui_theme.h"
+#include "ui_wm.h"
 
 
-static ui_dialog_t *top = NULL;
+static void dialog_build_nav(ui_dialog_t *d);
+
+/* labels and progress bars only show things */
+static bool control_focusable(ui_control_t *control)
+{
+    return control->type != CONTROL_LABEL && control->type != CONTROL_PROGRESS;
+}
+
+static void dialog_close(ui_window_t *w)
+{
+    ui_dialog_t *d = (ui_dialog_t *)w;
+
+    d->hide = true;
+    if (d->active) {
+        d->active->hide = true;
+    }
+}
 
 ui_dialog_t *ui_dialog_new(ui_dialog_t *parent, rect_t r, const char *title)
 {
     ui_dialog_t *d = calloc(1, sizeof(ui_dialog_t));
     d->parent = parent;
-    d->r = r;
-    d->g = gbuf_new(r.width, r.height, fb->bytes_per_pixel, fb->endian);
     if (parent) {
         d->keypad = parent->keypad;
     }
     if (title) {
         d->title = strdup(title);
     }
+    ui_wm_window_init(&d->window, r, d->title, dialog_close);
     ui_dialog_layout(d);
     return d;
 }
@@ -38,19 +55,28 @@ void ui_dialog_destroy(ui_dialog_t *d)
             control->free(control);
         }
     }
-    gbuf_free(d->g);
+    ui_wm_window_deinit(&d->window);
     if (d->tf) {
         tf_free(d->tf);
     }
+    if (d->controls) {
+        free(d->controls);
+    }
+    if (d->nav) {
+        free(d->nav);
+    }
     free(d);
 }
 
 void ui_dialog_layout(ui_dialog_t *d)
 {
-    d->cr.x = d->r.x + 1;
-    d->cr.y = d->r.y + 1;
-    d->cr.width = d->r.width - 2;
-    d->cr.height = d->r.height - 2;
+    ui_dialog_invalidate_nav(d);
+
+    /* the client area is relative to the dialog surface */
+    d->cr.x = 1;
+    d->cr.y = 1;
+    d->cr.width = d->window.r.width - 2;
+    d->cr.height = d->window.r.height - 2;
 
     if (d->title) {
         if (!d->tf) {
@@ -66,15 +92,25 @@ void ui_dialog_draw(ui_dialog_t *d)
 {
     assert(d->visible);
 
-    fill_rectangle(fb, d->r, ui_theme->window_color);
-    draw_rectangle3d(fb, d->r, ui_theme->border3d_light_color, ui_theme->border3d_dark_color);
+    RENDER_STATS_BEGIN("dialog", d->title);
+
+    gbuf_t *g = d->window.g;
+    rect_t wr = {
+        .x = 0,
+        .y = 0,
+        .width = d->window.r.width,
+        .height = d->window.r.height,
+    };
+
+    fill_rectangle(g, wr, ui_theme->window_color);
+    draw_rectangle3d(g, wr, ui_theme->border3d_light_color, ui_theme->border3d_dark_color);
 
     if (d->title) {
         tf_metrics_t m = tf_get_str_metrics(d->tf, d->title);
         rect_t r = d->cr;
-        r.y = d->r.y + 1;
+        r.y = 1;
         r.height = m.height + 2*ui_theme->padding;
-        fill_rectangle(fb, r, ui_theme->active_highlight_color);
+        fill_rectangle(g, r, ui_theme->active_highlight_color);
 
         point_t start = {
             .x = r.x,
@@ -84,64 +120,91 @@ void ui_dialog_draw(ui_dialog_t *d)
             .x = r.x + r.width,
             .y = r.y + r.height,
         };
-        draw_line(fb, start, end, DRAW_STYLE_SOLID, ui_theme->border3d_light_color);
+        draw_line(g, start, end, DRAW_STYLE_SOLID, ui_theme->border3d_light_color);
 
         point_t p = {
-            .x = d->r.x + ui_theme->padding,
-            .y = d->r.y + ui_theme->padding + 1,
+            .x = ui_theme->padding,
+            .y = ui_theme->padding + 1,
         };
-        tf_draw_str(fb, d->tf, d->title, p);
+        tf_draw_str(g, d->tf, d->title, p);
     }
+
+    RENDER_STATS_END();
 }
 
-void ui_dialog_showmodal(ui_dialog_t *d)
+/* damages every control drawn since the last pass */
+static void dialog_damage_dirty(ui_dialog_t *d)
 {
-    d->hide = false;
-
-    rect_t r = {
-        .x = 0,
-        .y = 0,
-        .width = d->r.width,
-        .height = d->r.height,
-    };
-    blit(d->g, r, fb, d->r);
+    for (int i = 0; i < d->controls_size; i++) {
+        ui_control_t *control = d->controls[i];
+        if (control == NULL) {
+            continue;
+        }
+        if (control->dirty) {
+            ui_dialog_damage(d, control->r);
+            control->dirty = false;
+        }
+    }
+}
 
+/* draws the dialog and its controls and maps it */
+static void dialog_map(ui_dialog_t *d)
+{
     d->hide = false;
     d->visible = true;
     ui_dialog_draw(d);
 
-    d->parent = top;
-    top = d;
+    for (int i = 0; i < d->controls_size; i++) {
+        ui_control_t *control = d->controls[i];
+        if (control == NULL) {
+            continue;
+        }
+        control->draw(control);
+        control->dirty = false;
+    }
+
+    ui_wm_show(&d->window);
+    ui_wm_flush();
+}
 
+void ui_dialog_showmodal(ui_dialog_t *d)
+{
+    TRACE_BEGIN("ui_dialog_showmodal");
     size_t count = 0;
     for (int i = 0; i < d->controls_size; i++) {
         ui_control_t *control = d->controls[i];
         if (control == NULL) {
             continue;
         }
-        if (control->type != CONTROL_LABEL) {
+        if (control_focusable(control)) {
             count += 1;
             if (!d->active) {
                 d->active = control;
             }
         }
-        control->draw(control);
-        control->dirty = false;
+    }
+
+    if (!d->nav_valid) {
+        dialog_build_nav(d);
     }
 
     if (count == 1 && d->active->type == CONTROL_LIST) {
         ((ui_list_t *)d->active)->selected = true;
-        d->active->draw(d->active);
-        display_update_rect(d->r);
+    }
+
+    TRACE_BEGIN("dialog map");
+    dialog_map(d);
+    TRACE_END("dialog map");
+
+    if (count == 1 && d->active->type == CONTROL_LIST) {
         d->active->onselect(d->active, d->active->arg);
         d->hide = true;
-    } else {
-        display_update_rect(d->r);
     }
 
     keypad_info_t keys;
     while (!d->hide) {
         if (keypad_queue_receive(d->keypad, &keys, 50/portTICK_RATE_MS)) {
+            TRACE_INSTANT("key", keys.pressed);
             if (keys.pressed & KEYPAD_MENU) {
                 ui_dialog_unwind();
                 break;
@@ -172,45 +235,36 @@ void ui_dialog_showmodal(ui_dialog_t *d)
             if (keys.pressed & KEYPAD_B) {
                 break;
             }
-
-            bool dirty = false;
-            for (int i = 0; i < d->controls_size; i++) {
-                ui_control_t *control = d->controls[i];
-                if (control == NULL) {
-                    continue;
-                }
-                if (control->dirty) {
-                    dirty = true;
-                    control->dirty = false;
-                }
-            }
-            if (dirty) {
-                display_update_rect(d->r);
-            }
         }
 
-        bool dirty = false;
-        for (int i = 0; i < d->controls_size; i++) {
-            ui_control_t *control = d->controls[i];
-            if (control == NULL) {
-                continue;
-            }
-            if (control->dirty) {
-                dirty = true;
-                control->dirty = false;
-            }
-        }
-        if (dirty) {
-            display_update_rect(d->r);
-        }
+        dialog_damage_dirty(d);
+        ui_wm_flush();
 
         periodic_tick();
     }
 
-    blit(fb, d->r, d->g, r);
-    display_update_rect(d->r);
+    ui_dialog_close(d);
+    TRACE_END("ui_dialog_showmodal");
+}
+
+/* shows a dialog without taking keys, for progress while the caller works;
+ * changes are put on screen with ui_dialog_update */
+void ui_dialog_show(ui_dialog_t *d)
+{
+    dialog_map(d);
+}
+
+void ui_dialog_update(ui_dialog_t *d)
+{
+    dialog_damage_dirty(d);
+    ui_wm_flush();
+}
+
+void ui_dialog_close(ui_dialog_t *d)
+{
+    ui_wm_hide(&d->window);
+    ui_wm_flush();
 
-    top = d->parent;
     d->visible = false;
 }
 
@@ -221,21 +275,24 @@ void ui_dialog_hide(ui_dialog_t *d)
 
 void ui_dialog_unwind(void)
 {
-    ui_dialog_t *d = top;
-    while (d) {
-        d->hide = true;
-        if (d->active) {
-            d->active->hide = true;
-        }
-        d = d->parent;
-    }
+    ui_wm_unwind();
+}
+
+void ui_dialog_damage(ui_dialog_t *d, rect_t r)
+{
+    r.x += d->cr.x;
+    r.y += d->cr.y;
+    ui_wm_damage(&d->window, r);
 }
 
 void ui_dialog_add_control(ui_dialog_t *d, ui_control_t *control)
 {
+    ui_dialog_invalidate_nav(d);
+
     for (int i = 0; i < d->controls_size; i++) {
         if (d->controls[i] == NULL) {
             d->controls[i] = control;
+            control->slot = i;
             return;
         }
     }
@@ -244,46 +301,86 @@ void ui_dialog_add_control(ui_dialog_t *d, ui_control_t *control)
     d->controls = realloc(d->controls, sizeof(ui_control_t *) * d->controls_size);
     assert(d->controls != NULL);
     d->controls[d->controls_size - 1] = control;
+    control->slot = d->controls_size - 1;
 }
 
-ui_control_t *ui_dialog_find_control(ui_dialog_t *d, direction_t dir)
+static ui_control_t *dialog_nearest_control(ui_dialog_t *d, ui_control_t *from, direction_t dir)
 {
-    ui_control_t *active = d->active;
-    ui_control_t *hidest = NULL;
-    float hidest_distance = INFINITY;
+    ui_control_t *nearest = NULL;
+    int nearest_distance = 0;
 
-    if (!active) {
-        return NULL;
-    }
-
-    short active_cx = active->r.x + active->r.width/2;
-    short active_cy = active->r.y + active->r.height/2;
+    int from_cx = from->r.x + from->r.width/2;
+    int from_cy = from->r.y + from->r.height/2;
 
     for (size_t i = 0; i < d->controls_size; i++) {
         ui_control_t *control = d->controls[i];
-        if (!control || control == active || control->type == CONTROL_LABEL) {
+        if (!control || control == from || !control_focusable(control)) {
             continue;
         }
-        short control_cx = control->r.x + control->r.width/2;
-        short control_cy = control->r.y + control->r.height/2;
-
-        if ((dir == DIRECTION_LEFT  && control->r.x + control->r.width - 1 < active->r.x) ||
-            (dir == DIRECTION_RIGHT && control->r.x > active->r.x + active->r.width - 1) ||
-            (dir == DIRECTION_UP    && control->r.y + control->r.height - 1 < active->r.y) ||
-            (dir == DIRECTION_DOWN  && control->r.y > active->r.y + active->r.height - 1)) {
-            short dx = abs(active_cx - control_cx);
-            short dy = abs(active_cy - control_cy);
-            float distance = sqrtf(dx * dx + dy * dy);
-            if (hidest == NULL || distance < hidest_distance) {
-                hidest = control;
-                hidest_distance = distance;
+        int control_cx = control->r.x + control->r.width/2;
+        int control_cy = control->r.y + control->r.height/2;
+
+        if ((dir == DIRECTION_LEFT  && control->r.x + control->r.width - 1 < from->r.x) ||
+            (dir == DIRECTION_RIGHT && control->r.x > from->r.x + from->r.width - 1) ||
+            (dir == DIRECTION_UP    && control->r.y + control->r.height - 1 < from->r.y) ||
+            (dir == DIRECTION_DOWN  && control->r.y > from->r.y + from->r.height - 1)) {
+            int dx = from_cx - control_cx;
+            int dy = from_cy - control_cy;
+            /* squared distance orders the same as the real distance */
+            int distance = dx * dx + dy * dy;
+            if (nearest == NULL || distance < nearest_distance) {
+                nearest = control;
+                nearest_distance = distance;
             }
         }
     }
-    return hidest;
+    return nearest;
+}
+
+/* precomputes the up/down/left/right neighbor of every focusable control,
+ * indexed by control slot, so key handling is a table lookup */
+static void dialog_build_nav(ui_dialog_t *d)
+{
+    d->nav = realloc(d->nav, sizeof(ui_control_t *) * 4 * (d->controls_size > 0 ? d->controls_size : 1));
+    assert(d->nav != NULL);
+
+    for (size_t i = 0; i < d->controls_size; i++) {
+        ui_control_t *control = d->controls[i];
+        for (int dir = DIRECTION_UP; dir <= DIRECTION_RIGHT; dir++) {
+            ui_control_t *neighbor = NULL;
+            if (control && control_focusable(control)) {
+                neighbor = dialog_nearest_control(d, control, dir);
+            }
+            d->nav[i * 4 + dir] = neighbor;
+        }
+    }
+    d->nav_valid = true;
+}
+
+void ui_dialog_invalidate_nav(ui_dialog_t *d)
+{
+    d->nav_valid = false;
+}
+
+ui_control_t *ui_dialog_find_control(ui_dialog_t *d, direction_t dir)
+{
+    if (!d->active) {
+        return NULL;
+    }
+
+    if (!d->nav_valid) {
+        dialog_build_nav(d);
+    }
+
+    return d->nav[d->active->slot * 4 + dir];
 }
 
 ui_dialog_t *ui_dialog_get_top(void)
 {
-    return top;
+    for (ui_window_t *w = ui_wm_top(); w; w = w->below) {
+        if (w->close == dialog_close) {
+            return (ui_dialog_t *)w;
+        }
+    }
+    return NULL;
 }
@@ -6,6 +6,7 @@
 #include "freertos/queue.h"
 
 #include "ui_controls.h"
+#include "ui_wm.h"
 #include "graphics.h"
 #include "tf.h"
 
@@ -21,9 +22,8 @@ typedef enum direction_t {
 } direction_t;
 
 typedef struct ui_dialog_t {
+    ui_window_t window;
     ui_dialog_t *parent;
-    rect_t r;
-    gbuf_t *g;
     tf_t *tf;
     QueueHandle_t keypad;
     const char *title;
@@ -33,6 +33,8 @@ typedef struct ui_dialog_t {
     ui_control_t **controls;
     size_t controls_size;
     ui_control_t *active;
+    ui_control_t **nav;
+    bool nav_valid;
 } ui_dialog_t;
 
 ui_dialog_t *ui_dialog_new(ui_dialog_t *parent, rect_t r, const char *title);
@@ -40,8 +42,13 @@ void ui_dialog_layout(ui_dialog_t *d);
 void ui_dialog_destroy(ui_dialog_t *d);
 void ui_dialog_draw(ui_dialog_t *d);
 void ui_dialog_showmodal(ui_dialog_t *d);
+void ui_dialog_show(ui_dialog_t *d);
+void ui_dialog_update(ui_dialog_t *d);
+void ui_dialog_close(ui_dialog_t *d);
 void ui_dialog_hide(ui_dialog_t *d);
 void ui_dialog_unwind(void);
 void ui_dialog_add_control(ui_dialog_t *d, ui_control_t *control);
+void ui_dialog_damage(ui_dialog_t *d, rect_t r);
 ui_control_t *ui_dialog_find_control(ui_dialog_t *d, direction_t dir);
+void ui_dialog_invalidate_nav(ui_dialog_t *d);
 ui_dialog_t *ui_dialog_get_top(void);
@@ -8,9 +8,11 @@
 #include "keypad.h"
 #include "OpenSans_Regular_11X12.h"
 #include "periodic.h"
+#include "render_stats.h"
 #include "ui_dialog.h"
 #include "ui_osk.h"
 #include "ui_theme.h"
+#include "ui_wm.h"
 
 
 const char keyboards[3][4][11] = {
@@ -35,6 +37,13 @@ const char keyboards[3][4][11] = {
 
 };
 
+static void osk_close(ui_window_t *w)
+{
+    ui_osk_t *osk = (ui_osk_t *)w;
+
+    osk->hide = true;
+}
+
 ui_osk_t *ui_osk_new(ui_edit_t *edit)
 {
     ui_osk_t *osk = calloc(1, sizeof(ui_osk_t));
@@ -44,11 +53,14 @@ ui_osk_t *ui_osk_new(ui_edit_t *edit)
     osk->button_width = fb->width / 12;
     osk->button_height = osk->tf->font->height + 5;
     osk->r.x = 0;
-    osk->r.y = fb->height - (osk->button_height * 6);
+    osk->r.y = 0;
     osk->r.width = fb->width;
     osk->r.height = osk->button_height * 6;
 
-    osk->g = gbuf_new(osk->r.width, osk->r.height, 2, BIG_ENDIAN);
+    /* the osk draws in its own surface, docked to the bottom of the screen */
+    rect_t wr = osk->r;
+    wr.y = fb->height - osk->r.height;
+    ui_wm_window_init(&osk->window, wr, edit->d->title, osk_close);
 
     /* home position */
     osk->row = 1;
@@ -61,32 +73,134 @@ ui_osk_t *ui_osk_new(ui_edit_t *edit)
 
 void ui_osk_free(ui_osk_t *osk)
 {
-    gbuf_free(osk->g);
+    ui_wm_window_deinit(&osk->window);
+    for (size_t keyboard = 0; keyboard < 3; keyboard++) {
+        if (osk->layers[keyboard]) {
+            gbuf_free(osk->layers[keyboard]);
+        }
+    }
     tf_free(osk->tf);
     free(osk);
 }
 
-static void osk_draw(ui_osk_t *osk)
+/* describes the key whose top-left cell is at row, col */
+static bool osk_key(ui_osk_t *osk, size_t keyboard, short row, short col, rect_t *r, char *s)
 {
-    fill_rectangle(fb, osk->r, ui_theme->window_color);
+    short rows = 1;
+    short cols = 1;
+
+    if (col < 11 && row < 4) {
+        s[0] = keyboards[keyboard][row][col];
+        s[1] = '\0';
+    } else if (row == 0 && col == 11) {
+        strcpy(s, "<--");
+    } else if (row == 1 && col == 11) {
+        rows = 4;
+        strcpy(s, "OK");
+    } else if (row == 4 && col == 0) {
+        cols = 2;
+        strcpy(s, "Shift");
+    } else if (row == 4 && col == 2) {
+        strcpy(s, "Sym");
+    } else if (row == 4 && col == 3) {
+        cols = 8;
+        s[0] = '\0';
+    } else {
+        return false;
+    }
 
     short cx = osk->r.width / 2 - osk->button_width * 12 / 2;
     short cy = osk->r.height / 2 - osk->button_height * 6 / 2;
 
-    point_t start = {
+    r->x = osk->r.x + cx + osk->button_width * col;
+    r->y = osk->r.y + cy + osk->button_height * (row + 1) + 1;
+    r->width = osk->button_width * cols - 1;
+    r->height = osk->button_height * rows - 1;
+    return true;
+}
+
+/* area of the osk surface covered by the keyboard layers */
+static rect_t osk_layer_rect(ui_osk_t *osk)
+{
+    short cy = osk->r.height / 2 - osk->button_height * 6 / 2;
+
+    rect_t r = {
         .x = osk->r.x,
-        .y = osk->r.y + cy,
+        .y = osk->r.y + cy + osk->button_height,
+        .width = osk->r.width,
+        .height = osk->r.height - cy - osk->button_height,
     };
-    point_t end = {
-        .x = osk->r.x + osk->r.width - 1,
-        .y = osk->r.y + cy,
+    return r;
+}
+
+static rect_t osk_text_rect(ui_osk_t *osk)
+{
+    short cy = osk->r.height / 2 - osk->button_height * 6 / 2;
+
+    rect_t r = {
+        .x = osk->r.x,
+        .y = osk->r.y + cy + 1,
+        .width = osk->r.width,
+        .height = osk->button_height - 1,
     };
-    draw_line(fb, start, end, DRAW_STYLE_SOLID, ui_theme->border3d_light_color);
+    return r;
+}
+
+/* the layer of the keyboard shown, rendered the first time it is */
+static gbuf_t *osk_layer(ui_osk_t *osk)
+{
+    size_t keyboard = osk->keyboard;
+    if (osk->layers[keyboard]) {
+        return osk->layers[keyboard];
+    }
+
+    rect_t lr = osk_layer_rect(osk);
+    gbuf_t *g = gbuf_new(lr.width, lr.height, fb->bytes_per_pixel, fb->endian);
+    assert(g != NULL);
+
+    rect_t gr = {
+        .x = 0,
+        .y = 0,
+        .width = lr.width,
+        .height = lr.height,
+    };
+    fill_rectangle(g, gr, ui_theme->window_color);
 
+    for (short row = 0; row < 5; row++) {
+        for (short col = 0; col < 12; col++) {
+            rect_t r;
+            char s[6];
+            if (!osk_key(osk, keyboard, row, col, &r, s)) {
+                continue;
+            }
+            r.x -= lr.x;
+            r.y -= lr.y;
+
+            fill_rectangle(g, r, ui_theme->button_color);
+            tf_metrics_t m = tf_get_str_metrics(osk->tf, s);
+            point_t bp = {
+                .x = r.x + r.width / 2 - m.width / 2,
+                .y = r.y + r.height / 2 - m.height / 2 + 1,
+            };
+            tf_draw_str(g, osk->tf, s, bp);
+        }
+    }
+
+    osk->layers[keyboard] = g;
+    return g;
+}
+
+static void osk_draw_text(ui_osk_t *osk)
+{
+    rect_t r = osk_text_rect(osk);
+
+    RENDER_STATS_BEGIN("osk", osk->edit->d->title);
+
+    fill_rectangle(osk->window.g, r, ui_theme->window_color);
     if (osk->edit->text) {
         point_t p = {
-            .x = osk->r.x + 2,
-            .y = osk->r.y + cy + (osk->button_height - 1) / 2 - osk->tf->font->height / 2 + 1,
+            .x = r.x + 2,
+            .y = r.y - 1 + (osk->button_height - 1) / 2 - osk->tf->font->height / 2 + 1,
         };
 
         if (osk->edit->password) {
@@ -94,62 +208,85 @@ static void osk_draw(ui_osk_t *osk)
             char s[len + 1];
             memset(s, '*', len);
             s[len] = '\0';
-            tf_draw_str(fb, osk->tf, s, p);
+            tf_draw_str(osk->window.g, osk->tf, s, p);
         } else {
-            tf_draw_str(fb, osk->tf, osk->edit->text, p);
+            tf_draw_str(osk->window.g, osk->tf, osk->edit->text, p);
         }
     }
 
-    for (short row = 0; row < 5; row++) {
-        for (short col = 0; col < 12; col++) {
-            bool draw = false;
-            short rows = 1;
-            short cols = 1;
+    RENDER_STATS_END();
+}
 
-            char s[6];
-            if (col < 11 && row < 4) {
-                s[0] = keyboards[osk->keyboard][row][col];
-                s[1] = '\0';
-                draw = true;
-            } else if (row == 0) {
-                strcpy(s, "<--");
-                draw = true;
-            } else if (row == 1) {
-                rows = 4;
-                strcpy(s, "OK");
-                draw = true;
-            } else if (row == 4 && col == 0) {
-                cols = 2;
-                strcpy(s, "Shift");
-                draw = true;
-            } else if (row == 4 && col == 2) {
-                strcpy(s, "Sym");
-                draw = true;
-            } else if (row == 4 && col == 3) {
-                cols = 8;
-                s[0] = '\0';
-                draw = true;
-            }
-            if (draw) {
-                rect_t r = {
-                    .x = osk->r.x + cx + osk->button_width * col,
-                    .y = osk->r.y + cy + osk->button_height * (row + 1) + 1,
-                    .width = osk->button_width * cols - 1,
-                    .height = osk->button_height * rows - 1,
-                };
-
-                fill_rectangle(fb, r, ui_theme->button_color);
-                if (row == osk->row && col == osk->col) {
-                    draw_rectangle(fb, r, DRAW_STYLE_SOLID, ui_theme->selection_color);
-                }
-                tf_metrics_t m = tf_get_str_metrics(osk->tf, s);
-                point_t bp = {
-                    .x = r.x + r.width / 2 - m.width / 2,
-                    .y = r.y + r.height / 2 - m.height / 2 + 1,
-                };
-                tf_draw_str(fb, osk->tf, s, bp);
-            }
-        }
+/* restores one key from the layer, with the cursor if selected */
+static rect_t osk_draw_key(ui_osk_t *osk, short row, short col, bool selected)
+{
+    rect_t r;
+    char s[6];
+    if (!osk_key(osk, osk->keyboard, row, col, &r, s)) {
+        memset(&r, 0, sizeof(rect_t));
+        return r;
+    }
+
+    RENDER_STATS_BEGIN("osk", osk->edit->d->title);
+
+    rect_t lr = osk_layer_rect(osk);
+    rect_t src = r;
+    src.x -= lr.x;
+    src.y -= lr.y;
+    blit(osk->window.g, r, osk_layer(osk), src);
+    if (selected) {
+        draw_rectangle(osk->window.g, r, DRAW_STYLE_SOLID, ui_theme->selection_color);
+    }
+
+    RENDER_STATS_END();
+    return r;
+}
+
+static void osk_draw_layer(ui_osk_t *osk)
+{
+    rect_t lr = osk_layer_rect(osk);
+    rect_t src = {
+        .x = 0,
+        .y = 0,
+        .width = lr.width,
+        .height = lr.height,
+    };
+
+    RENDER_STATS_BEGIN("osk", osk->edit->d->title);
+    blit(osk->window.g, lr, osk_layer(osk), src);
+    RENDER_STATS_END();
+
+    osk_draw_key(osk, osk->row, osk->col, true);
+}
+
+static void osk_draw(ui_osk_t *osk)
+{
+    short cy = osk->r.height / 2 - osk->button_height * 6 / 2;
+
+    RENDER_STATS_BEGIN("osk", osk->edit->d->title);
+
+    fill_rectangle(osk->window.g, osk->r, ui_theme->window_color);
+
+    point_t start = {
+        .x = osk->r.x,
+        .y = osk->r.y + cy,
+    };
+    point_t end = {
+        .x = osk->r.x + osk->r.width - 1,
+        .y = osk->r.y + cy,
+    };
+    draw_line(osk->window.g, start, end, DRAW_STYLE_SOLID, ui_theme->border3d_light_color);
+
+    RENDER_STATS_END();
+
+    osk_draw_text(osk);
+    osk_draw_layer(osk);
+}
+
+static void osk_damage(ui_osk_t *osk, rect_t r)
+{
+    if (r.width > 0 && r.height > 0) {
+        ui_wm_damage(&osk->window, r);
     }
 }
 
@@ -276,43 +413,38 @@ static bool osk_a(ui_osk_t *osk)
 
 bool ui_osk_showmodal(ui_osk_t *osk)
 {
-    osk->g = gbuf_new(osk->r.width, osk->r.height, 2, BIG_ENDIAN);
-
-    rect_t r = {
-        .x = 0,
-        .y = 0,
-        .width = osk->r.width,
-        .height = osk->r.height,
-    };
-
-    blit(osk->g, r, fb, osk->r);
     osk_draw(osk);
-    display_update_rect(osk->r);
+    ui_wm_show(&osk->window);
+    ui_wm_flush();
 
     bool result = false;
     osk->hide = false;
     keypad_info_t keys;
     while (true) {
         if (keypad_queue_receive(osk->edit->d->keypad, &keys, 250 / portTICK_RATE_MS)) {
-            bool dirty = false;
+            short row = osk->row;
+            short col = osk->col;
+            size_t keyboard = osk->keyboard;
+            size_t len = strlen(osk->edit->text);
+
             if (keys.pressed & KEYPAD_UP) {
-                dirty |= osk_up(osk);
+                osk_up(osk);
             }
 
             if (keys.pressed & KEYPAD_RIGHT) {
-                dirty |= osk_right(osk);
+                osk_right(osk);
             }
 
             if (keys.pressed & KEYPAD_DOWN) {
-                dirty |= osk_down(osk);
+                osk_down(osk);
             }
 
             if (keys.pressed & KEYPAD_LEFT) {
-                dirty |= osk_left(osk);
+                osk_left(osk);
             }
 
             if (keys.pressed & KEYPAD_A) {
-                dirty |= osk_a(osk);
+                osk_a(osk);
                 if (osk->hide) {
                     result = true;
                     break;
@@ -328,16 +460,27 @@ bool ui_osk_showmodal(ui_osk_t *osk)
                 break;
             }
 
-            if (dirty) {
-                osk_draw(osk);
-                display_update_rect(osk->r);
+            /* only touch what changed: the layer, the two cursor cells or
+             * the text line */
+            if (osk->keyboard != keyboard) {
+                osk_draw_layer(osk);
+                osk_damage(osk, osk_layer_rect(osk));
+            } else if (osk->row != row || osk->col != col) {
+                osk_damage(osk, osk_draw_key(osk, row, col, false));
+                osk_damage(osk, osk_draw_key(osk, osk->row, osk->col, true));
+            }
+
+            if (strlen(osk->edit->text) != len) {
+                osk_draw_text(osk);
+                osk_damage(osk, osk_text_rect(osk));
             }
         }
+        ui_wm_flush();
         periodic_tick();
     }
 
-    blit(fb, osk->r, osk->g, r);
-    display_update_rect(osk->r);
+    ui_wm_hide(&osk->window);
+    ui_wm_flush();
 
     osk->edit->dirty = true;
 
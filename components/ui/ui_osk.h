@@ -4,13 +4,14 @@
 #include <stddef.h>
 
 #include "ui_controls.h"
+#include "ui_wm.h"
 #include "graphics.h"
 #include "tf.h"
 
 
 typedef struct ui_osk_t {
+    ui_window_t window;
     ui_edit_t *edit;
-    gbuf_t *g;
     rect_t r;
     tf_t *tf;
     short button_width;
@@ -18,6 +19,8 @@ typedef struct ui_osk_t {
     short row;
     short col;
     size_t keyboard;
+    /* the keys of each keyboard, rendered when it is first shown */
+    gbuf_t *layers[3];
     bool hide;
 } ui_osk_t;
 
@@ -0,0 +1,329 @@
+#include <string.h>
+
+#include "display.h"
+#include "gbuf.h"
+
+#include "render_stats.h"
+#include "trace.h"
+#include "ui_wm.h"
+
+#define MAX_DAMAGE (8)
+#define MAX_PIECES (64)
+
+
+static ui_window_t *s_top = NULL;
+static gbuf_t *s_desktop = NULL;
+static rect_t s_damage[MAX_DAMAGE];
+static const char *s_damage_title[MAX_DAMAGE];
+static size_t s_damage_count = 0;
+
+static bool rect_intersect(rect_t a, rect_t b, rect_t *out)
+{
+    short x0 = a.x > b.x ? a.x : b.x;
+    short y0 = a.y > b.y ? a.y : b.y;
+    short x1 = a.x + a.width < b.x + b.width ? a.x + a.width : b.x + b.width;
+    short y1 = a.y + a.height < b.y + b.height ? a.y + a.height : b.y + b.height;
+
+    if (x1 <= x0 || y1 <= y0) {
+        return false;
+    }
+
+    out->x = x0;
+    out->y = y0;
+    out->width = x1 - x0;
+    out->height = y1 - y0;
+    return true;
+}
+
+/* splits a minus i, where i lies inside a, into at most four bands */
+static size_t rect_subtract(rect_t a, rect_t i, rect_t *out)
+{
+    size_t count = 0;
+
+    if (i.y > a.y) {
+        rect_t r = {
+            .x = a.x,
+            .y = a.y,
+            .width = a.width,
+            .height = i.y - a.y,
+        };
+        out[count++] = r;
+    }
+    if (i.y + i.height < a.y + a.height) {
+        rect_t r = {
+            .x = a.x,
+            .y = i.y + i.height,
+            .width = a.width,
+            .height = a.y + a.height - i.y - i.height,
+        };
+        out[count++] = r;
+    }
+    if (i.x > a.x) {
+        rect_t r = {
+            .x = a.x,
+            .y = i.y,
+            .width = i.x - a.x,
+            .height = i.height,
+        };
+        out[count++] = r;
+    }
+    if (i.x + i.width < a.x + a.width) {
+        rect_t r = {
+            .x = i.x + i.width,
+            .y = i.y,
+            .width = a.x + a.width - i.x - i.width,
+            .height = i.height,
+        };
+        out[count++] = r;
+    }
+
+    return count;
+}
+
+/* removes the area covered by the windows from top down to, but not
+ * including, stop from the pieces */
+static size_t wm_occlude(rect_t *pieces, size_t count, ui_window_t *stop)
+{
+    for (ui_window_t *w = s_top; w != stop && count > 0; w = w->below) {
+        rect_t next[MAX_PIECES];
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+            rect_t overlap;
+            if (!rect_intersect(pieces[i], w->r, &overlap)) {
+                next[n++] = pieces[i];
+                continue;
+            }
+            assert(n + 4 <= MAX_PIECES);
+            n += rect_subtract(pieces[i], overlap, &next[n]);
+        }
+        memcpy(pieces, next, sizeof(rect_t) * n);
+        count = n;
+    }
+    return count;
+}
+
+static void wm_compose(rect_t r);
+
+/* composes and sends the pending damage */
+static void wm_flush_damage(void)
+{
+    for (size_t i = 0; i < s_damage_count; i++) {
+        RENDER_STATS_BEGIN("wm", s_damage_title[i]);
+        wm_compose(s_damage[i]);
+        RENDER_STATS_END();
+
+        RENDER_STATS_FLUSH("wm", s_damage_title[i], s_damage[i]);
+        TRACE_BEGIN("display flush");
+        display_update_rect(s_damage[i]);
+        TRACE_END("display flush");
+    }
+    s_damage_count = 0;
+}
+
+/*
+ * Damage is kept as it was given, less what is already pending, so no
+ * pixel is composed twice. It is never grown to a bounding box: that
+ * could take in desktop no window was shown over, which s_desktop does
+ * not hold. When the list is full, what is pending is flushed first.
+ */
+static void wm_add_damage(rect_t r, const char *title)
+{
+    rect_t pieces[MAX_PIECES];
+    size_t count = 1;
+    pieces[0] = r;
+
+    for (size_t i = 0; i < s_damage_count && count > 0; i++) {
+        rect_t next[MAX_PIECES];
+        size_t n = 0;
+        for (size_t j = 0; j < count; j++) {
+            rect_t overlap;
+            if (!rect_intersect(pieces[j], s_damage[i], &overlap)) {
+                next[n++] = pieces[j];
+                continue;
+            }
+            assert(n + 4 <= MAX_PIECES);
+            n += rect_subtract(pieces[j], overlap, &next[n]);
+        }
+        memcpy(pieces, next, sizeof(rect_t) * n);
+        count = n;
+    }
+
+    if (s_damage_count + count > MAX_DAMAGE) {
+        wm_flush_damage();
+        count = 1;
+        pieces[0] = r;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        s_damage[s_damage_count] = pieces[i];
+        s_damage_title[s_damage_count] = title;
+        s_damage_count += 1;
+    }
+}
+
+/* damages the parts of r, in screen coordinates, not hidden by the
+ * windows above stop */
+static void wm_damage_visible(ui_window_t *stop, rect_t r, const char *title)
+{
+    rect_t screen = {
+        .x = 0,
+        .y = 0,
+        .width = fb->width,
+        .height = fb->height,
+    };
+    rect_t pieces[MAX_PIECES];
+    if (!rect_intersect(r, screen, &pieces[0])) {
+        return;
+    }
+
+    size_t count = wm_occlude(pieces, 1, stop);
+    for (size_t i = 0; i < count; i++) {
+        wm_add_damage(pieces[i], title);
+    }
+}
+
+static void wm_compose(rect_t r)
+{
+    rect_t pieces[MAX_PIECES];
+    size_t count = 1;
+    pieces[0] = r;
+
+    for (ui_window_t *w = s_top; w && count > 0; w = w->below) {
+        rect_t next[MAX_PIECES];
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+            rect_t overlap;
+            if (!rect_intersect(pieces[i], w->r, &overlap)) {
+                next[n++] = pieces[i];
+                continue;
+            }
+            rect_t src = {
+                .x = overlap.x - w->r.x,
+                .y = overlap.y - w->r.y,
+                .width = overlap.width,
+                .height = overlap.height,
+            };
+            blit(fb, overlap, w->g, src);
+            assert(n + 4 <= MAX_PIECES);
+            n += rect_subtract(pieces[i], overlap, &next[n]);
+        }
+        memcpy(pieces, next, sizeof(rect_t) * n);
+        count = n;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        blit(fb, pieces[i], s_desktop, pieces[i]);
+    }
+}
+
+void ui_wm_window_init(ui_window_t *w, rect_t r, const char *title, ui_window_close_t close)
+{
+    memset(w, 0, sizeof(ui_window_t));
+    w->r = r;
+    w->g = gbuf_new(r.width, r.height, fb->bytes_per_pixel, fb->endian);
+    assert(w->g != NULL);
+    w->title = title;
+    w->close = close;
+}
+
+void ui_wm_window_deinit(ui_window_t *w)
+{
+    if (w->mapped) {
+        ui_wm_hide(w);
+        ui_wm_flush();
+    }
+    gbuf_free(w->g);
+    w->g = NULL;
+}
+
+void ui_wm_show(ui_window_t *w)
+{
+    assert(!w->mapped);
+
+    if (!s_desktop) {
+        s_desktop = gbuf_new(fb->width, fb->height, fb->bytes_per_pixel, fb->endian);
+        assert(s_desktop != NULL);
+    }
+
+    /* whatever is on screen outside the mapped windows is desktop, keep
+     * the part this window is about to cover */
+    rect_t screen = {
+        .x = 0,
+        .y = 0,
+        .width = fb->width,
+        .height = fb->height,
+    };
+    rect_t pieces[MAX_PIECES];
+    if (rect_intersect(w->r, screen, &pieces[0])) {
+        size_t count = wm_occlude(pieces, 1, NULL);
+        for (size_t i = 0; i < count; i++) {
+            blit(s_desktop, pieces[i], fb, pieces[i]);
+        }
+    }
+
+    w->below = s_top;
+    s_top = w;
+    w->mapped = true;
+
+    wm_damage_visible(w, w->r, w->title);
+}
+
+void ui_wm_hide(ui_window_t *w)
+{
+    assert(w->mapped);
+
+    /* unlinked first, as damage may be flushed while it is added */
+    ui_window_t **link = &s_top;
+    while (*link != w) {
+        link = &(*link)->below;
+    }
+    *link = w->below;
+    w->mapped = false;
+
+    wm_damage_visible(w->below, w->r, w->title);
+    w->below = NULL;
+}
+
+void ui_wm_damage(ui_window_t *w, rect_t r)
+{
+    if (!w->mapped) {
+        return;
+    }
+
+    rect_t bounds = {
+        .x = 0,
+        .y = 0,
+        .width = w->r.width,
+        .height = w->r.height,
+    };
+    if (!rect_intersect(r, bounds, &r)) {
+        return;
+    }
+    r.x += w->r.x;
+    r.y += w->r.y;
+    wm_damage_visible(w, r, w->title);
+}
+
+void ui_wm_flush(void)
+{
+    wm_flush_damage();
+
+    if (!s_top && s_desktop) {
+        gbuf_free(s_desktop);
+        s_desktop = NULL;
+    }
+}
+
+void ui_wm_unwind(void)
+{
+    for (ui_window_t *w = s_top; w; w = w->below) {
+        if (w->close) {
+            w->close(w);
+        }
+    }
+}
+
+ui_window_t *ui_wm_top(void)
+{
+    return s_top;
+}
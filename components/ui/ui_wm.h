@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "graphics.h"
+
+
+/*
+ * Window manager. Every dialog and the osk render into their own surface;
+ * the wm keeps the mapped windows in z-order and composes damaged screen
+ * regions from whichever surface is visible there, falling back to a copy
+ * of the desktop taken as windows are mapped over it.
+ */
+
+typedef struct ui_window_t ui_window_t;
+
+typedef void (*ui_window_close_t)(ui_window_t *w);
+
+typedef struct ui_window_t {
+    ui_window_t *below;
+    rect_t r;
+    gbuf_t *g;
+    const char *title;
+    bool mapped;
+    ui_window_close_t close;
+} ui_window_t;
+
+void ui_wm_window_init(ui_window_t *w, rect_t r, const char *title, ui_window_close_t close);
+void ui_wm_window_deinit(ui_window_t *w);
+void ui_wm_show(ui_window_t *w);
+void ui_wm_hide(ui_window_t *w);
+void ui_wm_damage(ui_window_t *w, rect_t r);
+void ui_wm_flush(void);
+void ui_wm_unwind(void);
+ui_window_t *ui_wm_top(void);
@@ -0,0 +1,43 @@
+#include <stddef.h>
+
+#include "host.h"
+
+/* Interposes the libc allocator so the harness can count allocations made
+ * anywhere in the process, including inside strdup. */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+host_alloc_stats_t host_alloc_stats;
+
+
+void *malloc(size_t size)
+{
+    __atomic_add_fetch(&host_alloc_stats.allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&host_alloc_stats.bytes, size, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    __atomic_add_fetch(&host_alloc_stats.allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&host_alloc_stats.bytes, nmemb * size, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    __atomic_add_fetch(&host_alloc_stats.allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&host_alloc_stats.bytes, size, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    if (ptr) {
+        __atomic_add_fetch(&host_alloc_stats.frees, 1, __ATOMIC_RELAXED);
+    }
+    __libc_free(ptr);
+}
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "app.h"
+
+#include "host.h"
+
+/* Stand-in for app.c that reports a synthetic catalog, so the dialogs can be
+ * driven without NVS, SPIFFS or an SD card. */
+
+size_t host_app_count = 20;
+
+struct app_scan_t {
+    QueueHandle_t queue;
+    SemaphoreHandle_t done;
+    volatile bool cancel;
+    volatile bool finished;
+};
+
+
+static void fake_info(size_t i, struct app_info_t *info)
+{
+    memset(info, 0, sizeof(struct app_info_t));
+    snprintf(info->name, sizeof(info->name), "App %04zu", i);
+    info->slot_num = i % 6 + 1;
+    info->installed = i % 3 == 0;
+    info->available = true;
+    info->upgradable = info->installed && i % 7 == 0;
+}
+
+struct app_info_t *app_enumerate(size_t *count)
+{
+    struct app_info_t *info = malloc(sizeof(struct app_info_t) * (host_app_count > 0 ? host_app_count : 1));
+    assert(info != NULL);
+    for (size_t i = 0; i < host_app_count; i++) {
+        fake_info(i, &info[i]);
+    }
+    *count = host_app_count;
+    return info;
+}
+
+/* installed apps first, then the rest in a scrambled "directory" order */
+static void scan_task(void *arg)
+{
+    app_scan_t *scan = (app_scan_t *)arg;
+
+    for (int pass = 0; pass < 2 && !scan->cancel; pass++) {
+        for (size_t k = 0; k < host_app_count && !scan->cancel; k++) {
+            struct app_info_t info;
+            fake_info(k * 7919 % host_app_count, &info);
+            if (info.installed != (pass == 0)) {
+                continue;
+            }
+            while (!scan->cancel && xQueueSend(scan->queue, &info, 50) != pdTRUE) {
+            }
+        }
+    }
+
+    scan->finished = true;
+    xSemaphoreGive(scan->done);
+    vTaskDelete(NULL);
+}
+
+app_scan_t *app_scan_start(void)
+{
+    app_scan_t *scan = calloc(1, sizeof(app_scan_t));
+    assert(scan != NULL);
+    scan->queue = xQueueCreate(32, sizeof(struct app_info_t));
+    scan->done = xSemaphoreCreateBinary();
+    xTaskCreate(scan_task, "scan", 8192, scan, 4, NULL);
+    return scan;
+}
+
+bool app_scan_receive(app_scan_t *scan, struct app_info_t *info)
+{
+    return xQueueReceive(scan->queue, info, 0) == pdTRUE;
+}
+
+bool app_scan_finished(app_scan_t *scan)
+{
+    return scan->finished && uxQueueMessagesWaiting(scan->queue) == 0;
+}
+
+void app_scan_stop(app_scan_t *scan)
+{
+    struct app_info_t info;
+
+    /* the task may be waiting for room in the queue */
+    scan->cancel = true;
+    do {
+        while (xQueueReceive(scan->queue, &info, 0) == pdTRUE) {
+        }
+    } while (xSemaphoreTake(scan->done, 10/portTICK_PERIOD_MS) != pdTRUE);
+    vSemaphoreDelete(scan->done);
+    vQueueDelete(scan->queue);
+    free(scan);
+}
+
+int app_get_slot(const char *name, bool *installed)
+{
+    struct app_info_t info;
+    app_info(name, &info);
+    if (installed) {
+        *installed = info.installed;
+    }
+    return info.slot_num;
+}
+
+void app_info(const char *name, struct app_info_t *info)
+{
+    size_t i = 0;
+    sscanf(name, "App %zu", &i);
+    fake_info(i, info);
+}
+
+/* walks through the phases of a 1 MB install */
+bool app_install(const char *name, int slot, app_progress_cb_t progress, void *arg)
+{
+    app_progress_t event = {
+        .total = 1024 * 1024,
+    };
+
+    for (event.phase = APP_PROGRESS_PREPARE; event.phase <= APP_PROGRESS_DONE; event.phase++) {
+        int steps = event.phase == APP_PROGRESS_WRITE ? 8 : 1;
+        for (int i = 0; i < steps; i++) {
+            if (event.phase == APP_PROGRESS_WRITE) {
+                event.done = event.total * (i + 1) / steps;
+                event.written = event.done;
+                event.kbps = 400;
+            }
+            if (progress) {
+                progress(&event, arg);
+            }
+        }
+    }
+    return false;
+}
+
+/* walks each app through the phases of a 256 KB install */
+size_t app_install_queue(const char *const *names, size_t count, app_progress_cb_t progress, void *arg,
+        app_queue_stats_t *stats)
+{
+    app_progress_t event = {
+        .total = count * 256 * 1024,
+        .apps = count,
+    };
+
+    for (event.app = 0; event.app < count; event.app++) {
+        event.phase = APP_PROGRESS_PREPARE;
+        if (progress) {
+            progress(&event, arg);
+        }
+    }
+    for (event.app = 0; event.app < count; event.app++) {
+        for (event.phase = APP_PROGRESS_ERASE; event.phase < APP_PROGRESS_DONE; event.phase++) {
+            int steps = event.phase == APP_PROGRESS_WRITE ? 4 : 1;
+            for (int i = 0; i < steps; i++) {
+                if (event.phase == APP_PROGRESS_WRITE) {
+                    event.done += 64 * 1024;
+                    event.written = event.done;
+                    event.kbps = 400;
+                }
+                if (progress) {
+                    progress(&event, arg);
+                }
+            }
+        }
+    }
+    event.app = count > 0 ? count - 1 : 0;
+    event.phase = APP_PROGRESS_DONE;
+    if (progress) {
+        progress(&event, arg);
+    }
+
+    if (stats) {
+        *stats = (app_queue_stats_t) {
+            .installed = count,
+            .bytes = event.total,
+            .written = event.written,
+            .ms = count * 640,
+            .kbps = 400,
+        };
+    }
+    return count;
+}
+
+void app_uninstall(const char *name)
+{
+}
+
+void app_run(const char *name, bool upgrade, app_progress_cb_t progress, void *arg)
+{
+    printf("run %s%s\n", name, upgrade ? " (upgrade)" : "");
+}
+
+/* a gradient per app, every fifth app has no icon */
+bool app_read_icon(const struct app_info_t *info, void *buf)
+{
+    size_t i = 0;
+    sscanf(info->name, "App %zu", &i);
+    if (i % 5 == 4) {
+        return false;
+    }
+
+    uint8_t *p = buf;
+    for (int y = 0; y < APP_ICON_SIZE; y++) {
+        for (int x = 0; x < APP_ICON_SIZE; x++) {
+            uint16_t c = ((x * 31 / APP_ICON_SIZE) << 11) | ((y * 63 / APP_ICON_SIZE) << 5) | (i * 7 % 32);
+            /* big endian, like fb */
+            *p++ = c >> 8;
+            *p++ = c & 0xff;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,344 @@
+#include <assert.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nvs_flash.h"
+
+#include "app.h"
+#include "app_data.h"
+#include "app_store.h"
+
+#include "host.h"
+
+/* Times app_enumerate over a synthetic apps directory: cold (no catalog),
+ * after a reboot (catalog in SPIFFS only), warm (catalog in RAM) and after a
+ * few .app files were replaced. Next to the host times are the file system
+ * calls, which are what the SD card and SPIFFS make slow on the device. */
+
+#define INSTALLED (6)
+#define CHANGED (10)
+
+struct app_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_len;
+    uint32_t json_len;
+    uint32_t icon_len;
+    uint32_t binary_len;
+};
+
+static int s_count = 1000;
+static int s_iterations = 20;
+
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* a new minor version changes the size, as FAT only keeps mtime to 2s */
+static void write_app(int i, int minor)
+{
+    char filename[PATH_MAX], json[256];
+    static uint8_t icon[APP_ICON_LEN];
+
+    snprintf(json, sizeof(json), "{\"name\": \"App %04d\", \"version\": \"1.%d.%d\", \"description\": \"Synthetic app\"}",
+            i, minor, i % 10);
+    struct app_header_t header = {
+        .magic = 0x21505041,
+        .version = 1,
+        .header_len = sizeof(struct app_header_t),
+        .json_len = strlen(json),
+        .icon_len = sizeof(icon),
+        .binary_len = 0,
+    };
+
+    snprintf(filename, sizeof(filename), "/sdcard/apps/App %04d.app", i);
+    FILE *f = fopen(filename, "wb");
+    assert(f != NULL);
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(json, header.json_len, 1, f);
+    fwrite(icon, sizeof(icon), 1, f);
+    fclose(f);
+}
+
+static void write_file(const char *filename, const char *str)
+{
+    FILE *f = fopen(filename, "w");
+    assert(f != NULL);
+    fputs(str, f);
+    fclose(f);
+}
+
+/* the installed apps fit with room to spare */
+static int no_victim(const bool *candidates, void *arg)
+{
+    return 0;
+}
+
+static void setup(void)
+{
+    char filename[PATH_MAX];
+
+    snprintf(filename, sizeof(filename), "%s", host_fs_root);
+    mkdir(filename, 0755);
+    mkdir("/sdcard", 0755);
+    mkdir("/sdcard/apps", 0755);
+    mkdir("/spiffs", 0755);
+    mkdir("/spiffs/appdata", 0755);
+
+    /* start from an empty apps directory */
+    snprintf(filename, sizeof(filename), "%s/sdcard/apps", host_fs_root);
+    DIR *dir = opendir(filename);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "/sdcard/apps/%s", entry->d_name);
+            unlink(path);
+        }
+    }
+    if (dir) {
+        closedir(dir);
+    }
+    unlink("/spiffs/appdata/catalog.idx");
+    unlink("/spiffs/appdata/layout");
+
+    for (int i = 0; i < s_count; i++) {
+        write_app(i, 0);
+    }
+
+    /* the first slots hold apps from the card, one of them out of date,
+     * and the last one an app whose file is gone; their appdata is that of
+     * older launchers, packed at boot */
+    nvs_handle nvs;
+    nvs_open("nvs", NVS_READWRITE, &nvs);
+    for (int slot = 1; slot <= INSTALLED; slot++) {
+        char name[32], json[128];
+        bool evicted[APP_STORE_SLOTS];
+        if (slot < INSTALLED) {
+            snprintf(name, sizeof(name), "App %04d", slot * 7);
+        } else {
+            snprintf(name, sizeof(name), "Removed");
+        }
+        app_store_reserve(slot, 512 * 1024, evicted, no_victim, NULL);
+        app_store_commit(slot, name, 512 * 1024);
+        snprintf(json, sizeof(json), "{\"name\": \"%s\", \"version\": \"%s\"}", name, slot == 2 ? "0.9.0" : "1.0.9");
+        snprintf(filename, sizeof(filename), "/spiffs/appdata/app%d.json", slot);
+        write_file(filename, json);
+    }
+    nvs_set_str(nvs, "mru", "654321");
+    nvs_commit(nvs);
+    nvs_close(nvs);
+    app_data_boot_check();
+}
+
+static struct app_info_t *catalog_enumerate(size_t *count)
+{
+    return app_enumerate(count);
+}
+
+/* what app_enumerate did before the catalog: app_info on every file */
+static struct app_info_t *baseline_enumerate(size_t *count)
+{
+    struct app_info_t *info = NULL;
+    char path[PATH_MAX];
+    *count = 0;
+
+    snprintf(path, sizeof(path), "%s/sdcard/apps", host_fs_root);
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) != NULL) {
+        host_fs_stats.dirents += 1;
+        size_t len = strlen(entry->d_name);
+        if (len < 4 || strcmp(entry->d_name + len - 4, ".app") != 0) {
+            continue;
+        }
+        entry->d_name[len - 4] = '\0';
+        info = realloc(info, sizeof(struct app_info_t) * (*count + 1));
+        app_info(entry->d_name, &info[*count]);
+        *count += 1;
+    }
+    if (dir) {
+        closedir(dir);
+    }
+    return info;
+}
+
+static void measure(const char *label, struct app_info_t *(*enumerate)(size_t *count), int iterations)
+{
+    memset(&host_fs_stats, 0, sizeof(host_fs_stats));
+    memset(&host_nvs_stats, 0, sizeof(host_nvs_stats));
+
+    double start = now_us();
+    size_t count = 0;
+    for (int i = 0; i < iterations; i++) {
+        free(enumerate(&count));
+    }
+    double us = (now_us() - start) / iterations;
+
+    printf("%-10s %6zu %10.2f %8.1f %8.1f %8.1f %10.1f %8.1f %8.1f\n", label, count, us / 1000,
+            (double)host_fs_stats.opens / iterations,
+            (double)host_fs_stats.stats / iterations,
+            (double)host_fs_stats.dirents / iterations,
+            (double)host_fs_stats.bytes_read / iterations / 1024,
+            (double)host_fs_stats.bytes_written / iterations / 1024,
+            (double)host_nvs_stats.reads / iterations);
+}
+
+/* how soon the first and the last app reach a list filled by app_scan */
+static void measure_scan(const char *label)
+{
+    struct app_info_t info;
+    double first = 0;
+    size_t count = 0;
+
+    double start = now_us();
+    app_scan_t *scan = app_scan_start();
+    while (!app_scan_finished(scan)) {
+        if (!app_scan_receive(scan, &info)) {
+            usleep(100);
+            continue;
+        }
+        if (count++ == 0) {
+            first = now_us() - start;
+        }
+    }
+    double all = now_us() - start;
+    app_scan_stop(scan);
+
+    printf("%-10s %6zu %10.2f ms to the first app, %.2f ms to the last\n", label, count, first / 1000, all / 1000);
+}
+
+/* the catalog must agree with app_info, which reads everything again */
+static void verify(void)
+{
+    size_t count;
+    struct app_info_t *info = app_enumerate(&count);
+
+    for (size_t i = 0; i < count; i++) {
+        struct app_info_t expected;
+        app_info(info[i].name, &expected);
+        if (memcmp(&expected, &info[i], sizeof(expected)) != 0) {
+            fprintf(stderr, "%s: catalog and app_info differ\n", info[i].name);
+            exit(1);
+        }
+        if (i > 0 && strcasecmp(info[i - 1].name, info[i].name) > 0) {
+            fprintf(stderr, "%s: out of order\n", info[i].name);
+            exit(1);
+        }
+    }
+    /* plus the removed app and installed apps beyond the card */
+    size_t expected = s_count + 1;
+    for (int slot = 1; slot < INSTALLED; slot++) {
+        expected += slot * 7 >= s_count;
+    }
+    if (count != expected) {
+        fprintf(stderr, "%zu apps listed, expected %zu\n", count, expected);
+        exit(1);
+    }
+    free(info);
+}
+
+/* each phase starts from a fresh process, like a reboot */
+static void run(void (*phase)(void))
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        phase();
+        fflush(stdout);
+        _exit(0);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        exit(1);
+    }
+}
+
+static void cold(void)
+{
+    measure("app_info", baseline_enumerate, 1);
+    measure("cold", catalog_enumerate, 1);
+    verify();
+}
+
+static void warm(void)
+{
+    measure("boot", catalog_enumerate, 1);
+    measure("warm", catalog_enumerate, s_iterations);
+    verify();
+
+    for (int i = 0; i < CHANGED && s_count > 0; i++) {
+        write_app(i * 13 % s_count, 10);
+    }
+    measure("changed", catalog_enumerate, 1);
+    verify();
+}
+
+/* a header that asks for more than the file holds, so the catalog is
+ * built again from the card */
+static void damaged(void)
+{
+    uint32_t sizes[2] = {0x10000000, 0xfffffff0};
+    FILE *f = fopen("/spiffs/appdata/catalog.idx", "r+b");
+    assert(f != NULL);
+    fseek(f, 2 * sizeof(uint32_t), SEEK_SET);
+    fwrite(sizes, sizeof(sizes), 1, f);
+    fclose(f);
+
+    measure("damaged", catalog_enumerate, 1);
+    verify();
+}
+
+static void scan(void)
+{
+    unlink("/spiffs/appdata/catalog.idx");
+    measure_scan("scan cold");
+    measure_scan("scan warm");
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "d:n:r:")) != -1) {
+        switch (opt) {
+            case 'd':
+                host_fs_root = optarg;
+                break;
+            case 'n':
+                s_count = strtol(optarg, NULL, 10);
+                break;
+            case 'r':
+                s_iterations = strtol(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-d dir] [-n apps] [-r iterations]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    setup();
+
+    printf("%-10s %6s %10s %8s %8s %8s %10s %8s %8s\n", "open", "apps", "ms", "fopen", "stat",
+            "dirents", "KB read", "KB wr", "nvs");
+    run(cold);
+    run(warm);
+    run(damaged);
+    run(scan);
+    printf("app_info is the per-file scan the catalog replaces; cold has no catalog,\n"
+            "boot has it in spiffs only, warm in RAM; changed replaces %d files and\n"
+            "damaged has a header asking for more than the file holds\n", CHANGED);
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <string.h>
+#include <machine/endian.h>
+
+#include "backlight.h"
+#include "display.h"
+
+#include "host.h"
+
+/* Virtual framebuffer. Flushes only count and optionally log the update
+ * rect, nothing is presented. */
+
+gbuf_t *fb = NULL;
+host_display_stats_t host_display_stats;
+bool host_display_verbose = false;
+
+
+void display_init(void)
+{
+    fb = gbuf_new(DISPLAY_WIDTH, DISPLAY_HEIGHT, 2, BIG_ENDIAN);
+    assert(fb != NULL);
+}
+
+/* always on */
+void backlight_init(void)
+{
+}
+
+void display_update_rect(rect_t r)
+{
+    if (r.x < 0) {
+        r.width += r.x;
+        r.x = 0;
+    }
+    if (r.y < 0) {
+        r.height += r.y;
+        r.y = 0;
+    }
+    if (r.x + r.width > fb->width) {
+        r.width = fb->width - r.x;
+    }
+    if (r.y + r.height > fb->height) {
+        r.height = fb->height - r.y;
+    }
+    if (r.width <= 0 || r.height <= 0) {
+        return;
+    }
+
+    host_display_stats.updates += 1;
+    host_display_stats.pixels_flushed += r.width * r.height;
+    if (host_display_verbose) {
+        printf("  update %d,%d %dx%d\n", r.x, r.y, r.width, r.height);
+    }
+}
+
+void display_update(void)
+{
+    rect_t r = {
+        .x = 0,
+        .y = 0,
+        .width = DISPLAY_WIDTH,
+        .height = DISPLAY_HEIGHT,
+    };
+    display_update_rect(r);
+}
+
+static void pixel_rgb(int i, uint8_t rgb[3])
+{
+    uint16_t c = ((uint16_t *)fb->data)[i];
+    if (fb->endian == BIG_ENDIAN) {
+        c = c << 8 | c >> 8;
+    }
+    rgb[0] = (c >> 11 & 0x1f) * 255 / 31;
+    rgb[1] = (c >> 5 & 0x3f) * 255 / 63;
+    rgb[2] = (c & 0x1f) * 255 / 31;
+}
+
+bool host_display_dump_ppm(const char *filename)
+{
+    FILE *f = fopen(filename, "wb");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", fb->width, fb->height);
+    for (int i = 0; i < fb->width * fb->height; i++) {
+        uint8_t rgb[3];
+        pixel_rgb(i, rgb);
+        fwrite(rgb, sizeof(rgb), 1, f);
+    }
+    fclose(f);
+    return true;
+}
+
+/* returns the number of differing pixels, or -1 if the file is unusable */
+long host_display_compare_ppm(const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        return -1;
+    }
+    int width, height, maxval;
+    if (fscanf(f, "P6 %d %d %d", &width, &height, &maxval) != 3 ||
+            width != fb->width || height != fb->height || maxval != 255 ||
+            fgetc(f) == EOF) {
+        fclose(f);
+        return -1;
+    }
+
+    long diff = 0;
+    for (int i = 0; i < fb->width * fb->height; i++) {
+        uint8_t rgb[3], expect[3];
+        if (fread(expect, sizeof(expect), 1, f) != 1) {
+            fclose(f);
+            return -1;
+        }
+        pixel_rgb(i, rgb);
+        if (memcmp(rgb, expect, sizeof(rgb)) != 0) {
+            diff += 1;
+        }
+    }
+    fclose(f);
+    return diff;
+}
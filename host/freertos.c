@@ -0,0 +1,361 @@
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_freertos_hooks.h"
+
+#include "host.h"
+
+
+struct host_queue_t {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t *data;
+    UBaseType_t len;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+struct host_sem_t {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int count;
+};
+
+struct host_event_group_t {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    EventBits_t bits;
+};
+
+typedef struct host_task_args_t {
+    TaskFunction_t fn;
+    void *arg;
+} host_task_args_t;
+
+static TickType_t s_ticks_offset = 0;
+static pthread_mutex_t s_interrupt_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static uint64_t monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void deadline(struct timespec *ts, TickType_t wait)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += wait / 1000;
+    ts->tv_nsec += (long)(wait % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec += 1;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+/* waits on cond until pred() holds or the wait expires, lock held */
+static bool wait_until(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t wait, bool (*pred)(void *), void *arg)
+{
+    struct timespec ts;
+    if (wait != portMAX_DELAY) {
+        deadline(&ts, wait);
+    }
+    while (!pred(arg)) {
+        if (wait == 0) {
+            return false;
+        }
+        if (wait == portMAX_DELAY) {
+            pthread_cond_wait(cond, lock);
+        } else if (pthread_cond_timedwait(cond, lock, &ts) == ETIMEDOUT) {
+            return pred(arg);
+        }
+    }
+    return true;
+}
+
+void host_ticks_advance(TickType_t ticks)
+{
+    __atomic_add_fetch(&s_ticks_offset, ticks, __ATOMIC_RELAXED);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    static uint64_t start = 0;
+    if (start == 0) {
+        start = monotonic_ms();
+    }
+    return (TickType_t)(monotonic_ms() - start) + __atomic_load_n(&s_ticks_offset, __ATOMIC_RELAXED);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep(ticks * 1000);
+}
+
+static void *task_entry(void *p)
+{
+    host_task_args_t args = *(host_task_args_t *)p;
+    free(p);
+    args.fn(args.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle, BaseType_t core)
+{
+    host_task_args_t *args = malloc(sizeof(host_task_args_t));
+    assert(args != NULL);
+    args->fn = fn;
+    args->arg = arg;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, task_entry, args) != 0) {
+        free(args);
+        return pdFALSE;
+    }
+    pthread_detach(thread);
+    if (handle) {
+        *handle = (TaskHandle_t)thread;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    assert(handle == NULL);
+    pthread_exit(NULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return (TaskHandle_t)pthread_self();
+}
+
+UBaseType_t host_interrupt_mask(void)
+{
+    pthread_mutex_lock(&s_interrupt_lock);
+    return 0;
+}
+
+void host_interrupt_unmask(UBaseType_t state)
+{
+    pthread_mutex_unlock(&s_interrupt_lock);
+}
+
+static void *tick_entry(void *p)
+{
+    esp_freertos_tick_cb_t cb = (esp_freertos_tick_cb_t)p;
+    while (true) {
+        usleep(1000);
+        cb();
+    }
+    return NULL;
+}
+
+esp_err_t esp_register_freertos_tick_hook_for_cpu(esp_freertos_tick_cb_t cb, UBaseType_t cpu)
+{
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, tick_entry, (void *)cb) != 0) {
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_detach(thread);
+    return ESP_OK;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size)
+{
+    QueueHandle_t q = calloc(1, sizeof(struct host_queue_t));
+    assert(q != NULL);
+    q->data = malloc(len * item_size);
+    assert(q->data != NULL);
+    q->len = len;
+    q->item_size = item_size;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t q)
+{
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->cond);
+    free(q->data);
+    free(q);
+}
+
+static bool queue_not_full(void *arg)
+{
+    QueueHandle_t q = arg;
+    return q->count < q->len;
+}
+
+static bool queue_not_empty(void *arg)
+{
+    QueueHandle_t q = arg;
+    return q->count > 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait)
+{
+    pthread_mutex_lock(&q->lock);
+    if (!wait_until(&q->cond, &q->lock, wait, queue_not_full, q)) {
+        pthread_mutex_unlock(&q->lock);
+        return pdFALSE;
+    }
+    memcpy(q->data + ((q->head + q->count) % q->len) * q->item_size, item, q->item_size);
+    q->count += 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait)
+{
+    pthread_mutex_lock(&q->lock);
+    if (!wait_until(&q->cond, &q->lock, wait, queue_not_empty, q)) {
+        pthread_mutex_unlock(&q->lock);
+        return pdFALSE;
+    }
+    memcpy(item, q->data + q->head * q->item_size, q->item_size);
+    q->head = (q->head + 1) % q->len;
+    q->count -= 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t count = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return count;
+}
+
+static SemaphoreHandle_t semaphore_new(int count)
+{
+    SemaphoreHandle_t s = calloc(1, sizeof(struct host_sem_t));
+    assert(s != NULL);
+    s->count = count;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return semaphore_new(1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return semaphore_new(0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t s)
+{
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s);
+}
+
+static bool semaphore_available(void *arg)
+{
+    SemaphoreHandle_t s = arg;
+    return s->count > 0;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait)
+{
+    pthread_mutex_lock(&s->lock);
+    if (!wait_until(&s->cond, &s->lock, wait, semaphore_available, s)) {
+        pthread_mutex_unlock(&s->lock);
+        return pdFALSE;
+    }
+    s->count -= 1;
+    pthread_mutex_unlock(&s->lock);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+    pthread_mutex_lock(&s->lock);
+    s->count = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    return pdTRUE;
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    EventGroupHandle_t group = calloc(1, sizeof(struct host_event_group_t));
+    assert(group != NULL);
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->cond, NULL);
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    EventBits_t now = group->bits;
+    pthread_cond_broadcast(&group->cond);
+    pthread_mutex_unlock(&group->lock);
+    return now;
+}
+
+/* the bits before they were cleared */
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t before = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return before;
+}
+
+typedef struct {
+    EventGroupHandle_t group;
+    EventBits_t bits;
+    bool all;
+} event_wait_t;
+
+static bool event_bits_set(void *arg)
+{
+    event_wait_t *w = arg;
+    EventBits_t set = w->group->bits & w->bits;
+    return w->all ? set == w->bits : set != 0;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear, BaseType_t all,
+        TickType_t wait)
+{
+    event_wait_t w = {
+        .group = group,
+        .bits = bits,
+        .all = all,
+    };
+    pthread_mutex_lock(&group->lock);
+    bool set = wait_until(&group->cond, &group->lock, wait, event_bits_set, &w);
+    EventBits_t now = group->bits;
+    if (set && clear) {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->lock);
+    return now;
+}
@@ -0,0 +1,121 @@
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esp_spiffs.h"
+
+#include "host.h"
+
+/* Redirects the /sdcard and /spiffs mount points into host_fs_root and
+ * counts the file system calls; reads take as long as host_fs_read_kbps
+ * says, and opening or looking up a file host_fs_lookup_us more. Programs using it are linked with HOST_FS_WRAP, see the Makefile. */
+
+const char *host_fs_root = "/tmp/launcher";
+uint32_t host_fs_read_kbps = 0;
+uint32_t host_fs_lookup_us = 0;
+host_fs_stats_t host_fs_stats;
+
+FILE *__real_fopen(const char *path, const char *mode);
+size_t __real_fread(void *ptr, size_t size, size_t nmemb, FILE *f);
+size_t __real_fwrite(const void *ptr, size_t size, size_t nmemb, FILE *f);
+int __real_stat(const char *path, struct stat *st);
+DIR *__real_opendir(const char *path);
+int __real_readdir_r(DIR *dir, struct dirent *entry, struct dirent **result);
+int __real_unlink(const char *path);
+int __real_rename(const char *from, const char *to);
+int __real_mkdir(const char *path, mode_t mode);
+
+
+static const char *host_path(const char *path, char *buf)
+{
+    if (strncmp(path, "/sdcard", 7) == 0 || strncmp(path, "/spiffs", 7) == 0) {
+        snprintf(buf, PATH_MAX, "%s%s", host_fs_root, path);
+        return buf;
+    }
+    return path;
+}
+
+FILE *__wrap_fopen(const char *path, const char *mode)
+{
+    char buf[PATH_MAX];
+    host_fs_stats.opens += 1;
+    if (host_fs_lookup_us) {
+        usleep(host_fs_lookup_us);
+    }
+    return __real_fopen(host_path(path, buf), mode);
+}
+
+size_t __wrap_fread(void *ptr, size_t size, size_t nmemb, FILE *f)
+{
+    size_t n = __real_fread(ptr, size, nmemb, f);
+    if (host_fs_read_kbps) {
+        usleep((uint64_t)n * size * 1000000 / 1024 / host_fs_read_kbps);
+    }
+    host_fs_stats.bytes_read += n * size;
+    return n;
+}
+
+size_t __wrap_fwrite(const void *ptr, size_t size, size_t nmemb, FILE *f)
+{
+    size_t n = __real_fwrite(ptr, size, nmemb, f);
+    host_fs_stats.bytes_written += n * size;
+    return n;
+}
+
+int __wrap_stat(const char *path, struct stat *st)
+{
+    char buf[PATH_MAX];
+    host_fs_stats.stats += 1;
+    if (host_fs_lookup_us) {
+        usleep(host_fs_lookup_us);
+    }
+    return __real_stat(host_path(path, buf), st);
+}
+
+DIR *__wrap_opendir(const char *path)
+{
+    char buf[PATH_MAX];
+    return __real_opendir(host_path(path, buf));
+}
+
+int __wrap_readdir_r(DIR *dir, struct dirent *entry, struct dirent **result)
+{
+    int ret = __real_readdir_r(dir, entry, result);
+    if (ret == 0 && *result) {
+        host_fs_stats.dirents += 1;
+    }
+    return ret;
+}
+
+int __wrap_unlink(const char *path)
+{
+    char buf[PATH_MAX];
+    host_fs_stats.unlinks += 1;
+    return __real_unlink(host_path(path, buf));
+}
+
+int __wrap_rename(const char *from, const char *to)
+{
+    char buf1[PATH_MAX], buf2[PATH_MAX];
+    return __real_rename(host_path(from, buf1), host_path(to, buf2));
+}
+
+int __wrap_mkdir(const char *path, mode_t mode)
+{
+    char buf[PATH_MAX];
+    return __real_mkdir(host_path(path, buf), mode);
+}
+
+/* the partition is the directory, there from the first write on */
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf)
+{
+    char buf[PATH_MAX];
+    if (__real_mkdir(host_path(conf->base_path, buf), 0755) != 0 && errno != EEXIST) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,23 @@
+#include <stdlib.h>
+
+#include "gbuf.h"
+
+
+gbuf_t *gbuf_new(uint16_t width, uint16_t height, uint16_t bytes_per_pixel, uint16_t endian)
+{
+    gbuf_t *g = calloc(1, sizeof(gbuf_t) + width * height * bytes_per_pixel);
+    if (!g) {
+        return NULL;
+    }
+    g->width = width;
+    g->height = height;
+    g->bytes_per_pixel = bytes_per_pixel;
+    g->endian = endian;
+    g->data = (uint8_t *)(g + 1);
+    return g;
+}
+
+void gbuf_free(gbuf_t *g)
+{
+    free(g);
+}
@@ -0,0 +1,483 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "display.h"
+#include "keypad.h"
+
+#include "app_dialog.h"
+#include "app_icons.h"
+#include "periodic.h"
+#include "render_stats.h"
+#include "statusbar.h"
+#include "ui_dialog.h"
+#include "ui_wm.h"
+#include "wifi_dialog.h"
+
+#include "host.h"
+
+/*
+ * Headless scenario runner. The scenario file is a list of commands, one
+ * per line, replayed through the keypad queue:
+ *
+ *   # comment
+ *   apps 200            number of apps reported by the stub catalog
+ *   press DOWN [count]  press a key, optionally repeated
+ *   wait 500            let the UI idle for that many milliseconds
+ *   dump name.ppm       write the framebuffer as a PPM image
+ *   expect name.ppm     compare the framebuffer against a PPM image
+ *   stats               print and reset the render statistics
+ *   windows 9           show that many small windows side by side over a
+ *                       patterned desktop, hide them in one flush and
+ *                       check the desktop between and under them
+ *
+ * Every key press is measured from the moment it is delivered until the UI
+ * asks for the next key.
+ */
+
+typedef enum {
+    STEP_PRESS,
+    STEP_WAIT,
+    STEP_DUMP,
+    STEP_EXPECT,
+    STEP_STATS,
+    STEP_WINDOWS,
+} step_type_t;
+
+typedef struct {
+    step_type_t type;
+    uint16_t key;
+    int count;
+    char arg[256];
+    int line;
+} step_t;
+
+typedef struct {
+    struct timespec start;
+    host_display_stats_t display;
+    host_alloc_stats_t alloc;
+    render_counters_t render;
+    const char *key_name;
+} keystroke_t;
+
+static const struct {
+    const char *name;
+    uint16_t key;
+} s_keys[] = {
+    {"UP", KEYPAD_UP},
+    {"RIGHT", KEYPAD_RIGHT},
+    {"DOWN", KEYPAD_DOWN},
+    {"LEFT", KEYPAD_LEFT},
+    {"SELECT", KEYPAD_SELECT},
+    {"START", KEYPAD_START},
+    {"A", KEYPAD_A},
+    {"B", KEYPAD_B},
+    {"MENU", KEYPAD_MENU},
+    {"VOLUME", KEYPAD_VOLUME},
+};
+
+static step_t *s_steps = NULL;
+static size_t s_step_count = 0;
+static size_t s_step = 0;
+static int s_step_done = 0;
+
+static const char *s_frame_dir = NULL;
+static bool s_quiet = false;
+static int s_failures = 0;
+
+static bool s_in_flight = false;
+static keystroke_t s_keystroke;
+static uint16_t *s_before = NULL;
+
+static unsigned long s_presses = 0;
+static double s_total_us = 0;
+static double s_max_us = 0;
+static uint64_t s_total_drawn = 0;
+static uint64_t s_total_changed = 0;
+static uint64_t s_total_flushed = 0;
+static uint64_t s_total_allocs = 0;
+
+
+static const char *key_name(uint16_t key)
+{
+    for (size_t i = 0; i < sizeof(s_keys) / sizeof(s_keys[0]); i++) {
+        if (s_keys[i].key == key) {
+            return s_keys[i].name;
+        }
+    }
+    return "?";
+}
+
+static bool load_scenario(const char *filename)
+{
+    FILE *f = fopen(filename, "r");
+    if (!f) {
+        perror(filename);
+        return false;
+    }
+
+    char line[512];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *p = strchr(line, '#');
+        if (p) {
+            *p = '\0';
+        }
+
+        char cmd[32], arg[256];
+        int count = 1;
+        int n = sscanf(line, "%31s %255s %d", cmd, arg, &count);
+        if (n <= 0) {
+            continue;
+        }
+
+        step_t step = { .count = 1, .line = lineno };
+        if (strcmp(cmd, "apps") == 0 && n >= 2) {
+            host_app_count = strtoul(arg, NULL, 10);
+            continue;
+        } else if (strcmp(cmd, "press") == 0 && n >= 2) {
+            step.type = STEP_PRESS;
+            step.count = count;
+            for (size_t i = 0; i < sizeof(s_keys) / sizeof(s_keys[0]); i++) {
+                if (strcasecmp(arg, s_keys[i].name) == 0) {
+                    step.key = s_keys[i].key;
+                }
+            }
+            if (!step.key) {
+                fprintf(stderr, "%s:%d: unknown key %s\n", filename, lineno, arg);
+                fclose(f);
+                return false;
+            }
+        } else if (strcmp(cmd, "wait") == 0 && n >= 2) {
+            step.type = STEP_WAIT;
+            step.count = strtol(arg, NULL, 10);
+        } else if (strcmp(cmd, "dump") == 0 && n >= 2) {
+            step.type = STEP_DUMP;
+            strcpy(step.arg, arg);
+        } else if (strcmp(cmd, "expect") == 0 && n >= 2) {
+            step.type = STEP_EXPECT;
+            strcpy(step.arg, arg);
+        } else if (strcmp(cmd, "stats") == 0) {
+            step.type = STEP_STATS;
+        } else if (strcmp(cmd, "windows") == 0 && n >= 2) {
+            step.type = STEP_WINDOWS;
+            step.count = strtol(arg, NULL, 10);
+        } else {
+            fprintf(stderr, "%s:%d: bad command\n", filename, lineno);
+            fclose(f);
+            return false;
+        }
+
+        s_steps = realloc(s_steps, sizeof(step_t) * (s_step_count + 1));
+        assert(s_steps != NULL);
+        s_steps[s_step_count++] = step;
+    }
+
+    fclose(f);
+    return true;
+}
+
+static void keystroke_begin(uint16_t key)
+{
+    s_in_flight = true;
+    s_keystroke.key_name = key_name(key);
+    s_keystroke.display = host_display_stats;
+    s_keystroke.alloc = host_alloc_stats;
+    s_keystroke.render = render_stats_total();
+    memcpy(s_before, fb->data, fb->width * fb->height * fb->bytes_per_pixel);
+    clock_gettime(CLOCK_MONOTONIC, &s_keystroke.start);
+}
+
+static void keystroke_end(void)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    s_in_flight = false;
+
+    double us = (end.tv_sec - s_keystroke.start.tv_sec) * 1e6 + (end.tv_nsec - s_keystroke.start.tv_nsec) / 1e3;
+    uint64_t changed = 0;
+    for (int i = 0; i < fb->width * fb->height; i++) {
+        if (s_before[i] != ((uint16_t *)fb->data)[i]) {
+            changed += 1;
+        }
+    }
+    uint64_t flushed = host_display_stats.pixels_flushed - s_keystroke.display.pixels_flushed;
+    uint64_t updates = host_display_stats.updates - s_keystroke.display.updates;
+    uint64_t allocs = host_alloc_stats.allocs - s_keystroke.alloc.allocs;
+    uint64_t drawn = render_stats_total().pixels - s_keystroke.render.pixels;
+
+    s_presses += 1;
+    s_total_us += us;
+    if (us > s_max_us) {
+        s_max_us = us;
+    }
+    s_total_drawn += drawn;
+    s_total_changed += changed;
+    s_total_flushed += flushed;
+    s_total_allocs += allocs;
+
+    if (!s_quiet) {
+        printf("%6lu %-7s %10.1f %9lu %9lu %9lu %6lu %7lu\n", s_presses, s_keystroke.key_name, us,
+                (unsigned long)drawn, (unsigned long)changed, (unsigned long)flushed,
+                (unsigned long)updates, (unsigned long)allocs);
+    }
+
+    if (s_frame_dir) {
+        char filename[512];
+        snprintf(filename, sizeof(filename), "%s/%04lu.ppm", s_frame_dir, s_presses);
+        host_display_dump_ppm(filename);
+    }
+}
+
+/*
+ * The windows go in a row along the top of the screen, above the menu
+ * dialog, so the gaps between them are desktop no window was shown over.
+ * Returns how many pixels differ from the desktop once they are hidden.
+ */
+static long check_windows(int count)
+{
+    const short size = 10;
+    const short gap = 6;
+    size_t len = fb->width * fb->height * fb->bytes_per_pixel;
+
+    rect_t strip = {
+        .x = 0,
+        .y = 0,
+        .width = fb->width,
+        .height = size + 2 * gap,
+    };
+    assert(count * (size + gap) + gap <= strip.width);
+    for (short x = 0; x < strip.width; x++) {
+        rect_t column = {
+            .x = x,
+            .y = 0,
+            .width = 1,
+            .height = strip.height,
+        };
+        fill_rectangle(fb, column, x * 0x0841 + 0x1234);
+    }
+    display_update_rect(strip);
+
+    uint16_t *desktop = malloc(len);
+    assert(desktop != NULL);
+    memcpy(desktop, fb->data, len);
+
+    ui_window_t *windows = calloc(count, sizeof(ui_window_t));
+    assert(windows != NULL);
+    for (int i = 0; i < count; i++) {
+        rect_t r = {
+            .x = gap + i * (size + gap),
+            .y = gap,
+            .width = size,
+            .height = size,
+        };
+        ui_wm_window_init(&windows[i], r, "windows", NULL);
+        rect_t all = {
+            .x = 0,
+            .y = 0,
+            .width = size,
+            .height = size,
+        };
+        fill_rectangle(windows[i].g, all, 0xf800);
+        ui_wm_show(&windows[i]);
+    }
+    ui_wm_flush();
+
+    for (int i = 0; i < count; i++) {
+        ui_wm_hide(&windows[i]);
+    }
+    ui_wm_flush();
+
+    long diff = 0;
+    for (size_t i = 0; i < len / 2; i++) {
+        if (((uint16_t *)fb->data)[i] != desktop[i]) {
+            diff += 1;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        ui_wm_window_deinit(&windows[i]);
+    }
+    free(windows);
+    free(desktop);
+    return diff;
+}
+
+static void finish(void)
+{
+    printf("keys %lu, render us total %.1f mean %.1f max %.1f\n", s_presses, s_total_us,
+            s_presses ? s_total_us / s_presses : 0.0, s_max_us);
+    printf("pixels drawn %lu, changed %lu, flushed %lu, allocations %lu\n",
+            (unsigned long)s_total_drawn, (unsigned long)s_total_changed,
+            (unsigned long)s_total_flushed, (unsigned long)s_total_allocs);
+    fflush(stdout);
+    _exit(s_failures ? 1 : 0);
+}
+
+void keypad_init(void)
+{
+}
+
+QueueHandle_t keypad_get_queue(void)
+{
+    return NULL;
+}
+
+bool keypad_queue_receive(QueueHandle_t q, keypad_info_t *info, TickType_t wait)
+{
+    if (s_in_flight) {
+        keystroke_end();
+    }
+
+    while (s_step < s_step_count) {
+        step_t *step = &s_steps[s_step];
+        switch (step->type) {
+            case STEP_PRESS:
+                if (s_step_done++ >= step->count - 1) {
+                    s_step += 1;
+                    s_step_done = 0;
+                }
+                memset(info, 0, sizeof(keypad_info_t));
+                info->pressed = step->key;
+                info->state = step->key;
+                keystroke_begin(step->key);
+                return true;
+
+            case STEP_WAIT:
+                if (s_step_done >= step->count) {
+                    break;
+                }
+                TickType_t ticks = wait < step->count - s_step_done ? wait : step->count - s_step_done;
+                if (ticks == 0) {
+                    ticks = step->count - s_step_done;
+                }
+                s_step_done += ticks;
+                host_ticks_advance(ticks);
+                /* virtual time is free, but background tasks need real
+                 * time to get anything done */
+                usleep(1000);
+                return false;
+
+            case STEP_DUMP:
+                if (!host_display_dump_ppm(step->arg)) {
+                    fprintf(stderr, "line %d: cannot write %s\n", step->line, step->arg);
+                    s_failures += 1;
+                }
+                break;
+
+            case STEP_STATS:
+                render_stats_dump(stdout);
+                render_stats_reset();
+                break;
+
+            case STEP_WINDOWS: {
+                long diff = check_windows(step->count);
+                if (diff != 0) {
+                    fprintf(stderr, "line %d: %ld desktop pixels differ\n", step->line, diff);
+                    s_failures += 1;
+                }
+                break;
+            }
+
+            case STEP_EXPECT: {
+                long diff = host_display_compare_ppm(step->arg);
+                if (diff != 0) {
+                    fprintf(stderr, "line %d: %s: ", step->line, step->arg);
+                    if (diff < 0) {
+                        fprintf(stderr, "cannot read image\n");
+                    } else {
+                        fprintf(stderr, "%ld pixels differ\n", diff);
+                    }
+                    s_failures += 1;
+                }
+                break;
+            }
+        }
+        s_step += 1;
+        s_step_done = 0;
+    }
+
+    finish();
+    return false;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-q] [-v] [-d framedir] scenario\n", argv0);
+    fprintf(stderr, "  -q  only print the summary\n");
+    fprintf(stderr, "  -v  log every display update rect\n");
+    fprintf(stderr, "  -d  dump a PPM frame after every key press\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "qvd:")) != -1) {
+        switch (opt) {
+            case 'q':
+                s_quiet = true;
+                break;
+            case 'v':
+                host_display_verbose = true;
+                break;
+            case 'd':
+                s_frame_dir = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (!load_scenario(argv[optind])) {
+        return 2;
+    }
+
+    display_init();
+    keypad_init();
+    statusbar_init();
+    app_icons_init();
+    s_before = malloc(fb->width * fb->height * fb->bytes_per_pixel);
+    assert(s_before != NULL);
+
+    if (!s_quiet) {
+        printf("%6s %-7s %10s %9s %9s %9s %6s %7s\n", "step", "key", "time_us", "drawn", "changed", "flushed", "rects", "allocs");
+    }
+
+    /* same menu as launcher_task */
+    while (true) {
+        rect_t r = {
+            .x = DISPLAY_WIDTH/2 - 240/2,
+            .y = DISPLAY_HEIGHT/2 - 180/2,
+            .width = 240,
+            .height = 180,
+        };
+
+        ui_dialog_t *d = ui_dialog_new(NULL, r, NULL);
+        d->keypad = keypad_get_queue();
+        rect_t lr = {
+            .x = 0,
+            .y = 0,
+            .width = 240 - 2,
+            .height = 180 - 2,
+        };
+        ui_list_t *list = ui_dialog_add_list(d, lr);
+        ui_list_append_text(list, "App List", app_list_dialog, NULL);
+        ui_list_append_text(list, "Wi-Fi Configuration", wifi_configuration_dialog, NULL);
+        ui_dialog_showmodal(d);
+        ui_dialog_destroy(d);
+
+        /* the launcher waits for Menu here; give the script a chance to end */
+        keypad_info_t keys;
+        while (!keypad_queue_receive(NULL, &keys, 50) || !(keys.pressed & KEYPAD_MENU)) {
+            periodic_tick();
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "rect.h"
+
+
+/* freertos.c */
+void host_ticks_advance(TickType_t ticks);
+
+/* display.c */
+typedef struct host_display_stats_t {
+    uint64_t updates;
+    uint64_t pixels_flushed;
+} host_display_stats_t;
+
+extern host_display_stats_t host_display_stats;
+extern bool host_display_verbose;
+bool host_display_dump_ppm(const char *filename);
+long host_display_compare_ppm(const char *filename);
+
+/* alloc.c */
+typedef struct host_alloc_stats_t {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t bytes;
+} host_alloc_stats_t;
+
+extern host_alloc_stats_t host_alloc_stats;
+
+/* app_stub.c */
+extern size_t host_app_count;
+
+/* nvs.c */
+typedef struct host_nvs_stats_t {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t commits;
+} host_nvs_stats_t;
+
+extern host_nvs_stats_t host_nvs_stats;
+extern const char *host_nvs_file;
+
+/* ota.c */
+typedef struct host_ota_stats_t {
+    uint64_t bytes_read;
+    uint64_t bytes_erased;
+    uint64_t bytes_written;
+    /* a copy, as app_run passes one of the app store's */
+    esp_partition_t boot_partition;
+    bool boot_set;
+} host_ota_stats_t;
+
+extern host_ota_stats_t host_ota_stats;
+extern const char *host_flash_dir;
+extern uint32_t host_flash_kbps;
+/* called by esp_restart, which exits when it returns */
+extern void (*host_restart)(void);
+
+/* fs.c */
+typedef struct host_fs_stats_t {
+    uint64_t opens;
+    uint64_t stats;
+    uint64_t dirents;
+    uint64_t unlinks;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+} host_fs_stats_t;
+
+extern const char *host_fs_root;
+extern uint32_t host_fs_read_kbps;
+extern uint32_t host_fs_lookup_us;
+extern host_fs_stats_t host_fs_stats;
@@ -0,0 +1,3 @@
+#pragma once
+
+void backlight_init(void);
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "gbuf.h"
+#include "rect.h"
+
+#define DISPLAY_WIDTH (320)
+#define DISPLAY_HEIGHT (240)
+
+extern gbuf_t *fb;
+
+void display_init(void);
+void display_update(void);
+void display_update_rect(rect_t r);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#define ESP_PARTITION_TABLE_OFFSET (0x8000)
+#define ESP_PARTITION_TABLE_MAX_LEN (0xC00)
+#define ESP_PARTITION_MAGIC (0x50AA)
+#define ESP_PARTITION_MAGIC_MD5 (0xEBEB)
+
+#define PART_TYPE_APP (0x00)
+#define PART_TYPE_DATA (0x01)
+#define PART_SUBTYPE_FACTORY (0x00)
+#define PART_SUBTYPE_OTA_FLAG (0x10)
+
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} esp_partition_pos_t;
+
+typedef struct {
+    uint16_t magic;
+    uint8_t type;
+    uint8_t subtype;
+    esp_partition_pos_t pos;
+    uint8_t label[16];
+    uint32_t flags;
+} esp_partition_info_t;
+
+#define ESP_PARTITION_TABLE_MAX_ENTRIES (ESP_PARTITION_TABLE_MAX_LEN / sizeof(esp_partition_info_t))
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+typedef void (*esp_freertos_tick_cb_t)(void);
+
+/* called every tick, from a thread of its own */
+esp_err_t esp_register_freertos_tick_hook_for_cpu(esp_freertos_tick_cb_t cb, UBaseType_t cpu);
@@ -0,0 +1,32 @@
+#pragma once
+
+/* Minimal FreeRTOS shim for host builds, backed by pthreads. One tick is one
+ * millisecond. */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define portTICK_RATE_MS (1)
+#define portTICK_PERIOD_MS (1)
+#define portMAX_DELAY ((TickType_t)-1)
+#define pdTRUE (1)
+#define pdFALSE (0)
+#define pdPASS (1)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY (0x7FFFFFFF)
+
+/* one core; with the host's threads running side by side, masking
+ * interrupts takes a lock */
+#define portNUM_PROCESSORS (1)
+#define xPortGetCoreID() (0)
+#define portSET_INTERRUPT_MASK_FROM_ISR() host_interrupt_mask()
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(state) host_interrupt_unmask(state)
+
+UBaseType_t host_interrupt_mask(void);
+void host_interrupt_unmask(UBaseType_t state);
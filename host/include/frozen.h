@@ -0,0 +1,7 @@
+#pragma once
+
+/* The subset of frozen (https://github.com/cesanta/frozen) used by app.c:
+ * top level "key: %Q" and "key: %d" conversions only. */
+
+char *json_fread(const char *path);
+int json_scanf(const char *str, int len, const char *fmt, ...);
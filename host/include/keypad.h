@@ -0,0 +1,25 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+enum {
+    KEYPAD_UP = 1,
+    KEYPAD_RIGHT = 2,
+    KEYPAD_DOWN = 4,
+    KEYPAD_LEFT = 8,
+    KEYPAD_SELECT = 16,
+    KEYPAD_START = 32,
+    KEYPAD_A = 64,
+    KEYPAD_B = 128,
+    KEYPAD_MENU = 256,
+    KEYPAD_VOLUME = 512,
+};
+typedef struct keypad_info_t {
+    uint16_t state;
+    uint16_t pressed;
+    uint16_t released;
+} keypad_info_t;
+void keypad_init(void);
+QueueHandle_t keypad_get_queue(void);
+bool keypad_queue_receive(QueueHandle_t q, keypad_info_t *info, TickType_t wait);
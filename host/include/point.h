@@ -0,0 +1,5 @@
+#pragma once
+typedef struct point_t {
+    short x;
+    short y;
+} point_t;
@@ -0,0 +1,7 @@
+#pragma once
+typedef struct rect_t {
+    short x;
+    short y;
+    short width;
+    short height;
+} rect_t;
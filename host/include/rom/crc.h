@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <zlib.h>
+
+/* The ROM's little endian CRC-32, over zlib */
+
+static inline uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    return crc32(crc, buf, len);
+}
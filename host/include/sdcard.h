@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdbool.h>
+
+void sdcard_init(const char *base_path);
+bool sdcard_present(void);
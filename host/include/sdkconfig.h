@@ -0,0 +1,9 @@
+#pragma once
+
+/* Configuration for host builds, see sdkconfig for the device. */
+
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ 240
+#define CONFIG_GRAPHICS_RENDER_STATS 1
+#define CONFIG_LAUNCHER_SLOT_POLICY_WEIGHTED 1
+#define CONFIG_TRACE 1
+#define CONFIG_TRACE_EVENTS 4096
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "esp_wifi.h"
+
+typedef enum {
+    WIFI_STATE_DISABLED,
+    WIFI_STATE_DISCONNECTED,
+    WIFI_STATE_SCANNING,
+    WIFI_STATE_CONNECTING,
+    WIFI_STATE_CONNECTED,
+} wifi_state_t;
+
+typedef struct wifi_network_t {
+    char ssid[33];
+    char password[65];
+    wifi_auth_mode_t authmode;
+} wifi_network_t;
+
+typedef void (*wifi_scan_done_callback_t)(void *arg);
+
+extern wifi_network_t **wifi_networks;
+extern size_t wifi_network_count;
+
+void wifi_init(void);
+void wifi_enable(void);
+void wifi_disable(void);
+wifi_state_t wifi_get_state(void);
+ip4_addr_t wifi_get_ip(void);
+size_t wifi_network_add(wifi_network_t *network);
+int wifi_network_delete(wifi_network_t *network);
+void wifi_connect_network(wifi_network_t *network);
+void wifi_register_scan_done_callback(wifi_scan_done_callback_t callback, void *arg);
+void wifi_backup_config(void);
+void wifi_restore_config(void);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include "sdkconfig.h"
+
+/* the cycle counter of a CPU at CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, 32 bits
+ * wide as on the device */
+static inline uint32_t host_ccount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    return (uint32_t)(ns * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ / 1000);
+}
+
+#define XTHAL_GET_CCOUNT() host_ccount()
@@ -0,0 +1,798 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "mbedtls/sha256.h"
+#include "nvs_flash.h"
+
+#include "app.h"
+#include "app_data.h"
+#include "app_file.h"
+#include "app_slots.h"
+#include "app_store.h"
+#include "esp_spi_flash.h"
+
+#include "host.h"
+
+/* Installs a synthetic .app with the SD card and the flash slowed down to
+ * given throughputs, and checks the partition, appdata, NVS and progress
+ * reports afterwards. The app is installed fresh, again unchanged, and as
+ * an upgrade with a few sectors changed, from a version 1 .app and from
+ * deflated version 2 ones with and without a checksum; truncated and
+ * corrupt .app files must fail, and a binary that does not match its
+ * checksum must leave the partition unbootable. The fresh install is
+ * compared with reading the whole binary and then writing it, which is what
+ * a copy that does not overlap the two would take, and the checksum with
+ * what hashing the binary costs on its own. Launching the installed app is
+ * timed from app_run to the restart, as is and asking for an upgrade,
+ * which reads what every launch once read. Then come the file system calls
+ * of appdata: uninstalling, installing, and packing the files older
+ * launchers kept into one per slot. Last, a few smaller apps are installed
+ * one by one and as one queue, and upgraded as one.
+ *
+ * The synthetic binary is made to deflate about as well as app binaries
+ * do; -b installs a real one instead. */
+
+typedef struct progress_log_t {
+    app_progress_phase_t phases[512];
+    size_t count;
+    size_t last_app;
+    size_t last_done;
+    size_t last_written;
+    uint32_t last_kbps;
+    bool monotonic;
+} progress_log_t;
+
+#define CHANGED_SECTORS (16)
+
+/* where partitions.csv puts the first region of the app store */
+#define APP_POOL_ADDRESS (0x200000)
+
+static const char *s_binary_file = NULL;
+static size_t s_size = 1536 * 1024;
+static uint32_t s_sd_kbps = 1024;
+static uint32_t s_flash_kbps = 384;
+static uint32_t s_lookup_us = 2000;
+static int s_failures = 0;
+
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void check(bool ok, const char *what)
+{
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        s_failures += 1;
+    }
+}
+
+/* three byte "instructions" from a small set with random operands, and
+ * every so often a copy of an earlier stretch, as inlined code and tables
+ * repeat */
+static uint8_t *make_binary(size_t len)
+{
+    uint8_t *binary = malloc(len);
+    assert(binary != NULL);
+    srand(1);
+
+    uint8_t ops[512][2];
+    for (int i = 0; i < 512; i++) {
+        ops[i][0] = rand();
+        ops[i][1] = rand();
+    }
+
+    size_t i = 0;
+    while (i < len) {
+        if (i > 4096 && rand() % 6 == 0) {
+            size_t from = i - 1 - rand() % 4096;
+            size_t n = 4 + rand() % 24;
+            for (size_t j = 0; j < n && i < len; j++) {
+                binary[i++] = binary[from + j];
+            }
+        } else {
+            int op = rand() % 64 < 48 ? rand() % 32 : rand() % 512;
+            uint8_t insn[3] = {ops[op][0], ops[op][1], rand() % 2 ? rand() % 16 : rand()};
+            for (int j = 0; j < 3 && i < len; j++) {
+                binary[i++] = insn[j];
+            }
+        }
+    }
+    return binary;
+}
+
+static uint8_t *read_binary(const char *filename, size_t *len)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        fprintf(stderr, "cannot read %s\n", filename);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *binary = malloc(*len);
+    assert(binary != NULL);
+    if (fread(binary, *len, 1, f) != 1) {
+        fprintf(stderr, "cannot read %s\n", filename);
+        exit(1);
+    }
+    fclose(f);
+    return binary;
+}
+
+static const char *s_json = "{\"name\": \"Big\", \"version\": \"1.0.0\", \"description\": \"Synthetic app\"}";
+static uint8_t s_icons[APP_ICON_LEN * 2];
+
+/* writes a section deflated when compress is set, as tools/mkapp.py does,
+ * and returns the bytes written */
+static size_t write_section(FILE *f, const void *data, size_t len, bool compress)
+{
+    if (!compress) {
+        fwrite(data, len, 1, f);
+        return len;
+    }
+
+    uLongf stored_len = compressBound(len);
+    uint8_t *stored = malloc(stored_len);
+    assert(stored != NULL);
+    compress2(stored, &stored_len, data, len, 9);
+    fwrite(stored, stored_len, 1, f);
+    free(stored);
+    return stored_len;
+}
+
+static void sha256_of(const uint8_t *data, size_t len, uint8_t *sha256)
+{
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    mbedtls_sha256_update(&sha, data, len);
+    mbedtls_sha256_finish(&sha, sha256);
+    mbedtls_sha256_free(&sha);
+}
+
+/* binary_len may claim more than is written, for a truncated file; a
+ * compressed file carries sha256 unless that is NULL, which it need not
+ * match */
+static void write_app(const char *name, const char *json, const uint8_t *icons, size_t icon_len,
+        const uint8_t *binary, size_t binary_len, size_t written, bool compress, const uint8_t *sha256)
+{
+    char filename[PATH_MAX];
+    struct app_header_t header = {
+        .magic = APP_HEADER_MAGIC,
+        .version = compress ? 2 : 1,
+        .header_len = !compress ? offsetof(struct app_header_t, stored) :
+                      !sha256 ? offsetof(struct app_header_t, flags) : sizeof(struct app_header_t),
+        .json_len = strlen(json),
+        .icon_len = icon_len,
+        .binary_len = binary_len,
+    };
+    if (compress && sha256) {
+        header.flags = APP_HEADER_SHA256;
+        memcpy(header.binary_sha256, sha256, sizeof(header.binary_sha256));
+    }
+
+    snprintf(filename, sizeof(filename), "/sdcard/apps/%s.app", name);
+    FILE *f = fopen(filename, "wb");
+    assert(f != NULL);
+    fseek(f, header.header_len, SEEK_SET);
+    header.stored[APP_SECTION_JSON].stored_len = write_section(f, json, header.json_len, compress);
+    header.stored[APP_SECTION_ICONS].stored_len = write_section(f, icons, icon_len, compress);
+    header.stored[APP_SECTION_BINARY].stored_len = write_section(f, binary, written, compress);
+    for (int i = 0; i < APP_SECTIONS; i++) {
+        header.stored[i].compression = compress ? APP_COMPRESSION_DEFLATE : APP_COMPRESSION_NONE;
+    }
+    fseek(f, 0, SEEK_SET);
+    fwrite(&header, header.header_len, 1, f);
+    fclose(f);
+}
+
+/* a section of the slot's appdata holds exactly data */
+static bool data_equals(int slot, int id, const void *data, size_t len)
+{
+    size_t section_len;
+    FILE *f = app_data_open(slot, id, &section_len);
+    if (!f) {
+        return false;
+    }
+    uint8_t *buf = malloc(len + 1);
+    assert(buf != NULL);
+    bool equal = section_len == len && fread(buf, 1, len, f) == len && memcmp(buf, data, len) == 0;
+    free(buf);
+    fclose(f);
+    return equal;
+}
+
+/* the slot's region starts with data, whatever follows */
+static bool partition_equals(int slot, const void *data, size_t len)
+{
+    esp_partition_t part;
+    if (!app_store_partition(slot, &part) || part.size < len) {
+        return false;
+    }
+    uint8_t *buf = malloc(len);
+    assert(buf != NULL);
+    bool equal = esp_partition_read(&part, 0, buf, len) == ESP_OK && memcmp(buf, data, len) == 0;
+    free(buf);
+    return equal;
+}
+
+/* what the slot policy knows the slot to hold */
+static bool slot_table_holds(int slot, const char *name)
+{
+    struct app_slot_table_t table;
+    app_slots_snapshot(&table);
+    return table.slots[slot - 1].name_hash == app_slots_hash(name);
+}
+
+static bool store_names(int slot, const char *value)
+{
+    char buf[APP_STORE_NAME_LEN];
+    return app_store_name(slot, buf, sizeof(buf)) && strcmp(buf, value) == 0;
+}
+
+static void log_progress(const app_progress_t *progress, void *arg)
+{
+    progress_log_t *log = (progress_log_t *)arg;
+
+    /* a queue prepares every app and then copies every app, so the phases
+     * start over with each app, but it never prepares again */
+    app_progress_phase_t last = log->count > 0 ? log->phases[log->count - 1] : APP_PROGRESS_PREPARE;
+    bool same_app = progress->app == log->last_app;
+    if ((same_app && progress->phase < last) ||
+            (progress->phase == APP_PROGRESS_PREPARE && last != APP_PROGRESS_PREPARE) ||
+            progress->done < log->last_done) {
+        log->monotonic = false;
+    }
+    if (log->count < sizeof(log->phases) / sizeof(log->phases[0])) {
+        log->phases[log->count++] = progress->phase;
+    }
+    log->last_app = progress->app;
+    log->last_done = progress->done;
+    log->last_written = progress->written;
+    log->last_kbps = progress->kbps;
+}
+
+static bool has_phase(const progress_log_t *log, app_progress_phase_t phase)
+{
+    for (size_t i = 0; i < log->count; i++) {
+        if (log->phases[i] == phase) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void setup(void)
+{
+    char filename[PATH_MAX + 16];
+
+    mkdir(host_fs_root, 0755);
+    mkdir("/sdcard", 0755);
+    mkdir("/sdcard/apps", 0755);
+    mkdir("/spiffs", 0755);
+    mkdir("/spiffs/appdata", 0755);
+
+    static char flash_dir[PATH_MAX];
+    snprintf(flash_dir, sizeof(flash_dir), "%s/flash", host_fs_root);
+    mkdir(flash_dir, 0755);
+    host_flash_dir = flash_dir;
+
+    /* an empty store, with regions that held something else before */
+    snprintf(filename, sizeof(filename), "%s/flash.bin", flash_dir);
+    FILE *f = fopen(filename, "wb");
+    assert(f != NULL);
+    fseek(f, APP_POOL_ADDRESS, SEEK_SET);
+    for (size_t i = 0; i < 2 * (s_size + APP_STORE_ALIGN); i++) {
+        fputc(i * 13, f);
+    }
+    fclose(f);
+    for (int slot = 1; slot <= APP_STORE_SLOTS; slot++) {
+        app_data_remove(slot);
+    }
+    unlink("/spiffs/appdata/catalog.idx");
+
+    for (size_t i = 0; i < sizeof(s_icons); i++) {
+        s_icons[i] = i * 7;
+    }
+}
+
+/* installs Big into slot 1 at the simulated speeds, checks the result and
+ * prints a row */
+static void install(const char *what, const uint8_t *binary, size_t len, progress_log_t *log)
+{
+    host_ota_stats_t before = host_ota_stats;
+    host_fs_stats_t fs_before = host_fs_stats;
+
+    memset(log, 0, sizeof(progress_log_t));
+    log->monotonic = true;
+    host_fs_read_kbps = s_sd_kbps;
+    host_flash_kbps = s_flash_kbps;
+    double start = now_ms();
+    bool failed = app_install("Big", 1, log_progress, log);
+    double elapsed = now_ms() - start;
+    host_fs_read_kbps = 0;
+    host_flash_kbps = 0;
+
+    printf("%-14s %10.0f %10u %10u %10u %10u\n", what, elapsed,
+            (unsigned)((host_fs_stats.bytes_read - fs_before.bytes_read) / 1024),
+            (unsigned)((host_ota_stats.bytes_erased - before.bytes_erased) / 1024),
+            (unsigned)((host_ota_stats.bytes_written - before.bytes_written) / 1024),
+            (unsigned)(log->last_written / 1024));
+
+    check(!failed, "install reports success");
+    check(partition_equals(1, binary, len), "partition holds the binary");
+    check(data_equals(1, APP_DATA_JSON, s_json, strlen(s_json)), "manifest copied to appdata");
+    check(data_equals(1, APP_DATA_ICONS, s_icons, sizeof(s_icons)), "icons copied to appdata");
+    check(store_names(1, "Big"), "slot 1 names the app");
+    check(slot_table_holds(1, "Big"), "slot table has Big in slot 1");
+    check(log->monotonic, "progress never goes back");
+    check(log->count > 0 && log->phases[log->count - 1] == APP_PROGRESS_DONE, "progress ends with done");
+    check(log->last_done == len, "progress ends at the binary size");
+}
+
+static void bench_install(const uint8_t *binary, bool compress, bool checksum)
+{
+    progress_log_t log;
+    uint8_t sha256[32];
+    const char *format = !compress ? "v1" : !checksum ? "v2" : "v2+sha";
+    char what[32];
+
+    /* start from a partition that held another app */
+    app_data_remove(1);
+
+    sha256_of(binary, s_size, sha256);
+    write_app("Big", s_json, s_icons, sizeof(s_icons), binary, s_size, s_size, compress, checksum ? sha256 : NULL);
+    snprintf(what, sizeof(what), "%s fresh", format);
+    install(what, binary, s_size, &log);
+    check(has_phase(&log, APP_PROGRESS_ERASE) && has_phase(&log, APP_PROGRESS_WRITE) &&
+          has_phase(&log, APP_PROGRESS_VERIFY), "fresh install erases, writes and verifies");
+    check(log.last_written == s_size, "fresh install writes everything");
+
+    if (checksum) {
+        /* copied again, say: the checksum still tells it is the same */
+        struct timespec times[2] = {{.tv_nsec = UTIME_OMIT}, {.tv_sec = time(NULL) + 60}};
+        utimensat(AT_FDCWD, "/sdcard/apps/Big.app", times, 0);
+    }
+    snprintf(what, sizeof(what), "%s same", format);
+    install(what, binary, s_size, &log);
+    check(!has_phase(&log, APP_PROGRESS_WRITE), "unchanged install is skipped");
+    check(log.last_written == 0, "unchanged install writes nothing");
+
+    /* an upgrade changing a few sectors, and growing, so that the file's
+     * size changes even within FAT's 2s mtime resolution */
+    size_t len = s_size + 100;
+    uint8_t *upgrade = malloc(len);
+    assert(upgrade != NULL);
+    memcpy(upgrade, binary, s_size);
+    memset(upgrade + s_size, 0x5a, len - s_size);
+    size_t sectors = (s_size + 4095) / 4096;
+    for (int i = 0; i < CHANGED_SECTORS; i++) {
+        upgrade[(i * sectors / CHANGED_SECTORS) * 4096 + 100] ^= 0xff;
+    }
+    sha256_of(upgrade, len, sha256);
+    write_app("Big", s_json, s_icons, sizeof(s_icons), upgrade, len, len, compress, checksum ? sha256 : NULL);
+    snprintf(what, sizeof(what), "%s upgrade", format);
+    install(what, upgrade, len, &log);
+    check(log.last_written <= (CHANGED_SECTORS + 1) * 4096, "upgrade writes only the changed sectors");
+    free(upgrade);
+}
+
+/* app_run restarts, so it runs in a child that reports from exit */
+static int s_run_fd;
+static double s_run_start;
+static const char *s_run_label;
+static esp_partition_t s_run_part;
+
+/* the slot table is in RAM by now, a launch writes it back once */
+static void run_exited(void)
+{
+    bool booted = host_ota_stats.boot_set && host_ota_stats.boot_partition.address == s_run_part.address;
+    bool nvs = host_nvs_stats.reads == 0 && host_nvs_stats.writes == 1 && host_nvs_stats.commits == 1;
+    dprintf(s_run_fd, "%-14s %10.1f %10u %10u %10u %10u %10u %10u\n", s_run_label, now_ms() - s_run_start,
+            (unsigned)host_fs_stats.opens, (unsigned)host_fs_stats.stats, (unsigned)(host_fs_stats.bytes_read),
+            (unsigned)host_nvs_stats.reads, (unsigned)host_nvs_stats.writes, (unsigned)host_nvs_stats.commits);
+    if (!booted || !nvs) {
+        _exit(1);
+    }
+}
+
+/* from pressing Run to the restart, with every file lookup on the card
+ * slowed down as well */
+static void bench_run(const char *label, bool upgrade)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        s_run_fd = dup(STDOUT_FILENO);
+        s_run_label = label;
+        app_store_partition(1, &s_run_part);
+        freopen("/dev/null", "w", stdout);
+        memset(&host_fs_stats, 0, sizeof(host_fs_stats));
+        memset(&host_nvs_stats, 0, sizeof(host_nvs_stats));
+        host_fs_read_kbps = s_sd_kbps;
+        host_fs_lookup_us = s_lookup_us;
+        atexit(run_exited);
+        s_run_start = now_ms();
+        app_run("Big", upgrade, NULL, NULL);
+        _exit(1);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    check(WIFEXITED(status) && WEXITSTATUS(status) == 0, "app_run restarts into the partition of slot 1 with one nvs commit");
+}
+
+/* the slot table must follow the store after a restart: slot 1 holds Big
+ * there and slot 2 nothing, whatever the table says */
+static void slot_table_repaired(void)
+{
+    struct app_slot_table_t table;
+
+    app_slots_installed(1, "Stale");
+    app_slots_installed(2, "Gone");
+    memset(&host_nvs_stats, 0, sizeof(host_nvs_stats));
+    app_slots_boot_check();
+    app_slots_snapshot(&table);
+
+    check(table.slots[0].name_hash == app_slots_hash("Big"), "boot check gives slot 1 back to Big");
+    check(table.slots[1].name_hash == 0, "boot check empties slot 2");
+    check(table.ghosts[0].name_hash == app_slots_hash("Gone") &&
+          table.ghosts[1].name_hash == app_slots_hash("Stale"), "boot check keeps their history");
+    check(host_nvs_stats.reads == 0 && host_nvs_stats.writes == 1 && host_nvs_stats.commits == 1,
+          "boot check writes the table back once");
+
+    memset(&host_nvs_stats, 0, sizeof(host_nvs_stats));
+    app_slots_boot_check();
+    check(host_nvs_stats.writes == 0, "boot check leaves a good table alone");
+}
+
+/* the slot must stay free after each of these */
+static void install_fails(const char *what, progress_log_t *log)
+{
+    memset(log, 0, sizeof(progress_log_t));
+    bool failed = app_install("Short", 2, log_progress, log);
+
+    esp_partition_t part;
+    bool named = app_store_partition(2, &part);
+
+    size_t len;
+    char message[128];
+    snprintf(message, sizeof(message), "%s install reports failure", what);
+    check(failed, message);
+    snprintf(message, sizeof(message), "%s install leaves slot 2 free", what);
+    check(!named, message);
+    snprintf(message, sizeof(message), "%s install ends with failed", what);
+    check(log->count > 0 && log->phases[log->count - 1] == APP_PROGRESS_FAILED, message);
+    snprintf(message, sizeof(message), "%s install leaves no appdata", what);
+    FILE *f = app_data_open(2, APP_DATA_RECORD, &len);
+    check(f == NULL, message);
+    if (f) {
+        fclose(f);
+    }
+    check(store_names(1, "Big"), "slot 1 is untouched");
+}
+
+/* what is left of a partition that must not boot: slot 2 went to the
+ * smallest region the binary fits in other than slot 1's, as it would again */
+static bool partition_erased(void)
+{
+    esp_partition_t big;
+    const esp_partition_t *part = NULL;
+    uint8_t sector[SPI_FLASH_SEC_SIZE];
+
+    if (!app_store_partition(1, &big)) {
+        return false;
+    }
+    for (int n = 1; n <= APP_STORE_SLOTS; n++) {
+        const esp_partition_t *p = esp_partition_find_first(ESP_PARTITION_TYPE_APP,
+                ESP_PARTITION_SUBTYPE_APP_OTA_0 + n, NULL);
+        if (p && p->address != big.address && p->size >= s_size && (!part || p->size < part->size)) {
+            part = p;
+        }
+    }
+    if (!part || esp_partition_read(part, 0, sector, sizeof(sector)) != ESP_OK) {
+        return false;
+    }
+    bool erased = true;
+    for (size_t i = 0; erased && i < sizeof(sector); i++) {
+        erased = sector[i] == 0xff;
+    }
+    return erased;
+}
+
+static void bench_broken(const uint8_t *binary)
+{
+    progress_log_t log;
+    uint8_t sha256[32];
+
+    write_app("Short", "{\"name\": \"Short\"}", NULL, 0, binary, s_size, s_size / 2, false, NULL);
+    install_fails("truncated", &log);
+
+    write_app("Short", "{\"name\": \"Short\"}", NULL, 0, binary, s_size, s_size / 2, true, NULL);
+    install_fails("short deflated", &log);
+
+    /* a binary that inflates fine but is not the one the header vouches
+     * for, as a bad build or a bit flipped before it was packed */
+    uint8_t *bad = malloc(s_size);
+    assert(bad != NULL);
+    memcpy(bad, binary, s_size);
+    bad[s_size - 1000] ^= 0x01;
+    sha256_of(binary, s_size, sha256);
+    write_app("Short", "{\"name\": \"Short\"}", NULL, 0, bad, s_size, s_size, true, sha256);
+    free(bad);
+    install_fails("mismatched", &log);
+    check(has_phase(&log, APP_PROGRESS_VERIFY), "mismatched install is caught verifying");
+    check(partition_erased(), "mismatched install leaves slot 2 unbootable");
+
+    /* a flipped bit in the middle of the deflated binary */
+    write_app("Short", "{\"name\": \"Short\"}", NULL, 0, binary, s_size, s_size, true, NULL);
+    FILE *f = fopen("/sdcard/apps/Short.app", "r+b");
+    assert(f != NULL);
+    fseek(f, 0, SEEK_END);
+    long middle = ftell(f) / 2;
+    fseek(f, middle, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, middle, SEEK_SET);
+    fputc(c ^ 0x10, f);
+    fclose(f);
+    install_fails("corrupt", &log);
+}
+
+static void write_file(const char *filename, const void *data, size_t len)
+{
+    FILE *f = fopen(filename, "wb");
+    assert(f != NULL);
+    fwrite(data, len, 1, f);
+    fclose(f);
+}
+
+static void appdata_row(const char *label, const host_fs_stats_t *before)
+{
+    printf("%-14s %10u %10u %10u %10u %10.1f\n", label,
+            (unsigned)(host_fs_stats.opens - before->opens),
+            (unsigned)(host_fs_stats.stats - before->stats),
+            (unsigned)(host_fs_stats.dirents - before->dirents),
+            (unsigned)(host_fs_stats.unlinks - before->unlinks),
+            (host_fs_stats.bytes_written - before->bytes_written) / 1024.0);
+}
+
+/* the file system calls appdata costs, with slot 1 holding Big to begin
+ * with and again at the end; installs also open and stat the .app file */
+static void bench_appdata(void)
+{
+    progress_log_t log;
+    size_t len;
+    uint8_t record[1024];
+
+    FILE *f = app_data_open(1, APP_DATA_RECORD, &len);
+    assert(f != NULL && len <= sizeof(record));
+    check(fread(record, len, 1, f) == 1, "slot 1 has a record");
+    fclose(f);
+
+    printf("\n%-14s %10s %10s %10s %10s %10s\n", "appdata", "opens", "stats", "dirents", "unlinks", "KB written");
+    host_fs_stats_t before = host_fs_stats;
+    app_uninstall("Big");
+    appdata_row("uninstall", &before);
+    check(!app_data_open(1, APP_DATA_JSON, &len) && !store_names(1, "Big"), "uninstall leaves slot 1 empty");
+
+    before = host_fs_stats;
+    app_install("Big", 1, log_progress, &log);
+    appdata_row("install", &before);
+
+    /* what an older launcher had for slot 1, and files it left behind */
+    app_data_remove(1);
+    write_file("/spiffs/appdata/slot1.sha", record, len);
+    write_file("/spiffs/appdata/app1.json", s_json, strlen(s_json));
+    write_file("/spiffs/appdata/app1.icons", s_icons, sizeof(s_icons));
+    write_file("/spiffs/appdata/app7.json", s_json, strlen(s_json));
+    write_file("/spiffs/appdata/slot9.sha", record, len);
+    unlink("/spiffs/appdata/layout");
+
+    before = host_fs_stats;
+    app_data_boot_check();
+    appdata_row("migrate", &before);
+    before = host_fs_stats;
+    app_data_boot_check();
+    appdata_row("boot", &before);
+
+    struct stat st;
+    check(data_equals(1, APP_DATA_RECORD, record, len) &&
+          data_equals(1, APP_DATA_JSON, s_json, strlen(s_json)) &&
+          data_equals(1, APP_DATA_ICONS, s_icons, sizeof(s_icons)), "migration packs slot 1");
+    check(stat("/spiffs/appdata/app1.json", &st) != 0 && stat("/spiffs/appdata/app7.json", &st) != 0 &&
+          stat("/spiffs/appdata/slot9.sha", &st) != 0, "migration leaves no old files");
+
+    /* the migrated record still tells the partition holds the app */
+    before = host_fs_stats;
+    app_install("Big", 1, log_progress, &log);
+    appdata_row("install same", &before);
+    check(log.last_written == 0, "install after migration writes nothing");
+}
+
+#define QUEUE_APPS (4)
+
+static const char *s_queue_names[QUEUE_APPS] = {"Q1", "Q2", "Q3", "Q4"};
+
+/* installs the queue apps one by one, or as one queue, and prints a row */
+static void queue_row(const char *label, bool queued, uint8_t *const *binaries, size_t len, progress_log_t *log)
+{
+    app_queue_stats_t stats = {0};
+    host_ota_stats_t before = host_ota_stats;
+    host_nvs_stats_t nvs_before = host_nvs_stats;
+
+    memset(log, 0, sizeof(progress_log_t));
+    log->monotonic = true;
+    host_fs_read_kbps = s_sd_kbps;
+    host_flash_kbps = s_flash_kbps;
+    double start = now_ms();
+    size_t installed = 0;
+    bool monotonic = true;
+    if (queued) {
+        installed = app_install_queue(s_queue_names, QUEUE_APPS, log_progress, log, &stats);
+        monotonic = log->monotonic;
+    } else {
+        for (int i = 0; i < QUEUE_APPS; i++) {
+            memset(log, 0, sizeof(progress_log_t));
+            log->monotonic = true;
+            int slot = app_get_slot(s_queue_names[i], NULL);
+            installed += slot > 0 && !app_install(s_queue_names[i], slot, log_progress, log);
+            monotonic &= log->monotonic;
+        }
+    }
+    double elapsed = now_ms() - start;
+    host_fs_read_kbps = 0;
+    host_flash_kbps = 0;
+
+    printf("%-14s %10.0f %10u %10u %10u\n", label, elapsed,
+            (unsigned)((host_ota_stats.bytes_written - before.bytes_written) / 1024),
+            (unsigned)(host_nvs_stats.commits - nvs_before.commits),
+            (unsigned)(QUEUE_APPS * len / 1024 * 1000 / elapsed));
+
+    check(installed == QUEUE_APPS, "every app of the queue is installed");
+    for (int i = 0; i < QUEUE_APPS; i++) {
+        bool installed;
+        int slot = app_get_slot(s_queue_names[i], &installed);
+        check(installed && partition_equals(slot, binaries[i], len), "queued partition holds its binary");
+        check(data_equals(slot, APP_DATA_JSON, s_json, strlen(s_json)), "queued manifest copied to appdata");
+        check(slot_table_holds(slot, s_queue_names[i]), "slot table has the queued app");
+    }
+    check(monotonic, "queue progress never goes back");
+    check(log->count > 0 && log->phases[log->count - 1] == APP_PROGRESS_DONE, "queue progress ends with done");
+    if (queued) {
+        check(host_nvs_stats.commits - nvs_before.commits == 1, "a queue commits the slot table once");
+        check(stats.installed == QUEUE_APPS && stats.failed == 0 && stats.bytes == QUEUE_APPS * len,
+              "queue stats count every app");
+        check(log->last_done == QUEUE_APPS * len, "queue progress ends at the size of all binaries");
+    }
+}
+
+/* a few smaller apps installed one by one and then as one queue, where
+ * the card is read for the next while the flash is written for one, and
+ * then upgraded as one queue */
+static void bench_queue(const uint8_t *binary)
+{
+    progress_log_t log;
+    uint8_t *binaries[QUEUE_APPS];
+    size_t len = (s_size / QUEUE_APPS) & ~4095;
+
+    app_uninstall("Big");
+    for (int i = 0; i < QUEUE_APPS; i++) {
+        binaries[i] = malloc(len);
+        assert(binaries[i] != NULL);
+        memcpy(binaries[i], binary + i * len, len);
+        write_app(s_queue_names[i], s_json, s_icons, sizeof(s_icons), binaries[i], len, len, true, NULL);
+    }
+
+    printf("\n%-14s %10s %10s %10s %10s\n", "queue", "ms", "written KB", "commits", "KB/s");
+    queue_row("one by one", false, binaries, len, &log);
+    for (int i = 0; i < QUEUE_APPS; i++) {
+        app_uninstall(s_queue_names[i]);
+    }
+    queue_row("queued", true, binaries, len, &log);
+    check(has_phase(&log, APP_PROGRESS_WRITE) && !has_phase(&log, APP_PROGRESS_FAILED),
+          "queue writes without failing");
+
+    /* a changed sector each, and a size that tells the file changed */
+    for (int i = 0; i < QUEUE_APPS; i++) {
+        binaries[i][len / 2] ^= 0xff;
+        write_app(s_queue_names[i], s_json, s_icons, sizeof(s_icons), binaries[i], len, len, true, NULL);
+        struct timespec times[2] = {{.tv_nsec = UTIME_OMIT}, {.tv_sec = time(NULL) + 60 + i}};
+        char filename[PATH_MAX];
+        snprintf(filename, sizeof(filename), "/sdcard/apps/%s.app", s_queue_names[i]);
+        utimensat(AT_FDCWD, filename, times, 0);
+    }
+    queue_row("queued upgrade", true, binaries, len, &log);
+    check(log.last_written <= QUEUE_APPS * 4096, "queued upgrade writes only the changed sectors");
+
+    for (int i = 0; i < QUEUE_APPS; i++) {
+        free(binaries[i]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "b:d:l:s:r:w:")) != -1) {
+        switch (opt) {
+            case 'b':
+                s_binary_file = optarg;
+                break;
+            case 'd':
+                host_fs_root = optarg;
+                break;
+            case 'l':
+                s_lookup_us = strtol(optarg, NULL, 10);
+                break;
+            case 's':
+                s_size = strtol(optarg, NULL, 10) * 1024;
+                break;
+            case 'r':
+                s_sd_kbps = strtol(optarg, NULL, 10);
+                break;
+            case 'w':
+                s_flash_kbps = strtol(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b binary] [-d dir] [-l lookup us] [-s binary KB] [-r sd KB/s] [-w flash KB/s]\n", argv[0]);
+                return 2;
+        }
+    }
+    uint8_t *binary = s_binary_file ? read_binary(s_binary_file, &s_size) : make_binary(s_size);
+    if (s_size < 64 * 1024 || s_sd_kbps == 0 || s_flash_kbps == 0) {
+        fprintf(stderr, "the binary must be at least 64 KB and throughputs not 0\n");
+        return 2;
+    }
+    setup();
+    printf("%-14s %10s %10s %10s %10s %10s\n", "install", "ms", "sd KB", "erased KB", "written KB", "reported");
+    bench_install(binary, false, false);
+    bench_install(binary, true, false);
+    bench_install(binary, true, true);
+
+    double sd_ms = s_size / 1024.0 * 1000 / s_sd_kbps;
+    double flash_ms = s_size / 1024.0 * 1000 / s_flash_kbps;
+    printf("a fresh install reading and then writing would take %.0f ms plus the erase,\n"
+           "the slower of the two alone %.0f ms\n", sd_ms + flash_ms, sd_ms > flash_ms ? sd_ms : flash_ms);
+
+    /* the writer hashes each buffer while the reader fills the next, so
+     * this only shows when it is slower than the flash */
+    uint8_t sha256[32];
+    double start = now_ms();
+    for (int i = 0; i < 8; i++) {
+        sha256_of(binary, s_size, sha256);
+    }
+    double sha_ms = (now_ms() - start) / 8;
+    printf("hashing the binary alone takes %.1f ms (%.0f MB/s), writing it %.0f ms\n",
+           sha_ms, s_size / 1048576.0 / (sha_ms / 1000), flash_ms);
+
+    printf("\n%-14s %10s %10s %10s %10s %10s %10s %10s\n", "run", "ms", "opens", "stats", "bytes read",
+            "nvs reads", "nvs writes", "commits");
+    bench_run("installed", false);
+    bench_run("upgrade check", true);
+
+    bench_broken(binary);
+    slot_table_repaired();
+    bench_appdata();
+    bench_queue(binary);
+    free(binary);
+
+    if (s_failures) {
+        fprintf(stderr, "%d checks failed\n", s_failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
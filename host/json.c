@@ -0,0 +1,143 @@
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frozen.h"
+
+/* Just enough of frozen for flat objects such as the .app manifests. As in
+ * frozen, a key that is not found leaves its argument untouched. */
+
+
+char *json_fread(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char *buf = malloc(len + 1);
+    if (buf && fread(buf, 1, len, f) != (size_t)len) {
+        free(buf);
+        buf = NULL;
+    }
+    if (buf) {
+        buf[len] = '\0';
+    }
+    fclose(f);
+    return buf;
+}
+
+/* finds the value of a top level key, returns its start or NULL */
+static const char *find_value(const char *str, int len, const char *key, size_t key_len)
+{
+    const char *end = str + len;
+    int depth = 0;
+
+    for (const char *p = str; p < end; p++) {
+        if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            depth--;
+        } else if (*p == '"') {
+            const char *s = ++p;
+            while (p < end && *p != '"') {
+                p += *p == '\\' ? 2 : 1;
+            }
+            if (p >= end) {
+                return NULL;
+            }
+            if (depth != 1 || (size_t)(p - s) != key_len || strncmp(s, key, key_len) != 0) {
+                continue;
+            }
+
+            const char *q = p + 1;
+            while (q < end && isspace((unsigned char)*q)) {
+                q++;
+            }
+            if (q < end && *q == ':') {
+                q++;
+                while (q < end && isspace((unsigned char)*q)) {
+                    q++;
+                }
+                return q < end ? q : NULL;
+            }
+        }
+    }
+    return NULL;
+}
+
+int json_scanf(const char *str, int len, const char *fmt, ...)
+{
+    va_list ap;
+    int found = 0;
+
+    va_start(ap, fmt);
+    const char *f = fmt;
+    while (*f) {
+        /* key */
+        while (*f && (*f == '{' || *f == '}' || *f == ',' || isspace((unsigned char)*f))) {
+            f++;
+        }
+        if (!*f) {
+            break;
+        }
+        const char *key = f;
+        while (*f && *f != ':') {
+            f++;
+        }
+        size_t key_len = f - key;
+        while (*f && *f != '%') {
+            f++;
+        }
+        if (!*f || !f[1]) {
+            break;
+        }
+        char conv = f[1];
+        f += 2;
+
+        const char *v = find_value(str, len, key, key_len);
+        const char *end = str + len;
+
+        if (conv == 'Q') {
+            char **out = va_arg(ap, char **);
+            if (!v || *v != '"') {
+                continue;
+            }
+            const char *s = ++v;
+            while (v < end && *v != '"') {
+                v += *v == '\\' ? 2 : 1;
+            }
+            if (v > end) {
+                continue;
+            }
+            char *value = malloc(v - s + 1);
+            size_t n = 0;
+            for (const char *p = s; p < v; p++) {
+                if (*p == '\\' && p + 1 < v) {
+                    p++;
+                }
+                value[n++] = *p;
+            }
+            value[n] = '\0';
+            *out = value;
+            found++;
+        } else if (conv == 'd') {
+            int *out = va_arg(ap, int *);
+            if (!v) {
+                continue;
+            }
+            *out = strtol(v, NULL, 10);
+            found++;
+        } else {
+            (void)va_arg(ap, void *);
+        }
+    }
+    va_end(ap);
+    return found;
+}
@@ -0,0 +1,473 @@
+#include <assert.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "app_manifest.h"
+#include "frozen.h"
+
+#include "host.h"
+
+/* Times parsing the manifests of a corpus directory and comparing their
+ * versions, counting allocations, against what app.c did before: json_fread
+ * into a buffer, json_scanf with %Q and a versioncmp that copies and
+ * tokenizes both strings each time. frozen itself is a submodule the host
+ * build does without: json.c stands in for it, and it only searches for the
+ * one key, checking and copying nothing else, where frozen tokenizes the
+ * whole object. The json_scanf row is a floor for the old way, not its
+ * time, and app_manifest, which checks every byte and keeps three strings,
+ * is slower than that floor. Corpus files named bad-* must fail to parse,
+ * the others must not.
+ *
+ * With -f it fuzzes instead: corpus files are mutated and parsed both whole
+ * and in random chunks, which must agree, and random versions are compared
+ * with a plain semver precedence that works on the strings. */
+
+#define MAX_FILES (64)
+#define MAX_LEN (4096)
+#define VERSIONS (64)
+
+typedef struct corpus_file_t {
+    char name[64];
+    char *data;
+    size_t len;
+} corpus_file_t;
+
+static corpus_file_t s_files[MAX_FILES];
+static size_t s_count = 0;
+static int s_failures = 0;
+
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void check(bool ok, const char *what, const char *name)
+{
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s: %s\n", name, what);
+        s_failures += 1;
+    }
+}
+
+static void load_corpus(const char *dir)
+{
+    DIR *d = opendir(dir);
+    struct dirent *entry;
+    if (!d) {
+        fprintf(stderr, "cannot read %s\n", dir);
+        exit(2);
+    }
+    while ((entry = readdir(d)) != NULL && s_count < MAX_FILES) {
+        char path[PATH_MAX];
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        FILE *f = fopen(path, "rb");
+        if (!f) {
+            continue;
+        }
+        corpus_file_t *file = &s_files[s_count++];
+        snprintf(file->name, sizeof(file->name), "%.63s", entry->d_name);
+        file->data = malloc(MAX_LEN + 1);
+        assert(file->data != NULL);
+        file->len = fread(file->data, 1, MAX_LEN, f);
+        file->data[file->len] = '\0';
+        fclose(f);
+    }
+    closedir(d);
+}
+
+/* what app.c did before app_manifest.c */
+static int old_versioncmp(const char *left, const char *right)
+{
+    int lmajor = 0, lminor = 0, lpatch = 0;
+    int rmajor = 0, rminor = 0, rpatch = 0;
+    char *lpre = NULL, *rpre = NULL;
+
+    bool l_semver = !!strchr(left, '.');
+    bool r_semver = !!strchr(right, '.');
+    if (!l_semver && !r_semver) {
+        return strcmp(left, right);
+    } else if (!l_semver || !r_semver) {
+        return -1;
+    }
+
+    char *ls = strdup(left);
+    char *rs = strdup(right);
+    assert(ls != NULL && rs != NULL);
+
+    char *rest = ls;
+    char *p = strtok_r(rest, ".", &rest);
+    if (p) {
+        lmajor = strtol(p, NULL, 10);
+        if ((p = strtok_r(rest, ".", &rest))) {
+            lminor = strtol(p, NULL, 10);
+            if ((p = strtok_r(rest, "-+", &rest))) {
+                lpatch = strtol(p, NULL, 10);
+                lpre = strtok_r(rest, "+", &rest);
+            }
+        }
+    }
+    rest = rs;
+    p = strtok_r(rest, ".", &rest);
+    if (p) {
+        rmajor = strtol(p, NULL, 10);
+        if ((p = strtok_r(rest, ".", &rest))) {
+            rminor = strtol(p, NULL, 10);
+            if ((p = strtok_r(rest, "-+", &rest))) {
+                rpatch = strtol(p, NULL, 10);
+                rpre = strtok_r(rest, "+", &rest);
+            }
+        }
+    }
+
+    int cmp = (lmajor > rmajor) - (lmajor < rmajor);
+    cmp = cmp ? cmp : (lminor > rminor) - (lminor < rminor);
+    cmp = cmp ? cmp : (lpatch > rpatch) - (lpatch < rpatch);
+    if (!cmp && (lpre || rpre)) {
+        cmp = !lpre ? 1 : !rpre ? -1 : strcmp(lpre, rpre);
+    }
+    free(ls);
+    free(rs);
+    return cmp;
+}
+
+static bool old_parse(const char *json, size_t len, char **version)
+{
+    /* the buffer json_fread returned */
+    char *buf = malloc(len + 1);
+    assert(buf != NULL);
+    memcpy(buf, json, len + 1);
+
+    *version = NULL;
+    bool ok = json_scanf(buf, len, "{version: %Q}", version) >= 0;
+    free(buf);
+    return ok;
+}
+
+/* the corpus must parse as named, both ways the same */
+static void verify_corpus(void)
+{
+    for (size_t i = 0; i < s_count; i++) {
+        const corpus_file_t *file = &s_files[i];
+        struct app_manifest_t m;
+        bool bad = strncmp(file->name, "bad-", 4) == 0;
+        bool ok = app_manifest_parse(&m, file->data, file->len);
+        check(ok != bad, bad ? "parses" : "does not parse", file->name);
+    }
+
+    struct app_manifest_t m;
+    const char *json = "{\"name\": \"A\\u00e9\", \"version\": \"1.0\", \"description\": \"x\", \"name\": \"B\"}";
+    bool ok = app_manifest_parse(&m, json, strlen(json));
+    check(ok && strcmp(app_manifest_string(&m, m.name), "B") == 0, "the last name wins", "inline");
+    check(ok && strcmp(app_manifest_string(&m, m.version), "1.0") == 0, "version read", "inline");
+}
+
+static void bench_parse(int iterations)
+{
+    host_alloc_stats_t before = host_alloc_stats;
+    double start = now_ns();
+    size_t parses = 0;
+    for (int r = 0; r < iterations; r++) {
+        for (size_t i = 0; i < s_count; i++) {
+            char *version;
+            if (old_parse(s_files[i].data, s_files[i].len, &version)) {
+                free(version);
+            }
+            parses += 1;
+        }
+    }
+    double old_ns = (now_ns() - start) / parses;
+    double old_allocs = (double)(host_alloc_stats.allocs - before.allocs) / parses;
+
+    before = host_alloc_stats;
+    start = now_ns();
+    for (int r = 0; r < iterations; r++) {
+        for (size_t i = 0; i < s_count; i++) {
+            struct app_manifest_t m;
+            app_manifest_parse(&m, s_files[i].data, s_files[i].len);
+        }
+    }
+    double new_ns = (now_ns() - start) / parses;
+    double new_allocs = (double)(host_alloc_stats.allocs - before.allocs) / parses;
+
+    printf("%-16s %10s %10s\n", "parse", "ns", "allocs");
+    printf("%-16s %10.0f %10.2f\n", "json_scanf", old_ns, old_allocs);
+    printf("%-16s %10.0f %10.2f\n", "app_manifest", new_ns, new_allocs);
+    printf("json_scanf is json.c, which only looks for the key, not frozen\n");
+}
+
+static void random_version(char *buf, size_t len)
+{
+    int n = snprintf(buf, len, "%d.%d.%d", rand() % 3, rand() % 12, rand() % 12);
+    int ids = rand() % 3;
+    for (int i = 0; i < ids; i++) {
+        n += snprintf(buf + n, len - n, i == 0 ? "-" : ".");
+        if (rand() % 2) {
+            n += snprintf(buf + n, len - n, "%d", rand() % 20);
+        } else {
+            int chars = 1 + rand() % 4;
+            for (int c = 0; c < chars; c++) {
+                buf[n++] = "abrcAZ-"[rand() % 7];
+            }
+            buf[n] = '\0';
+        }
+    }
+    if (rand() % 4 == 0) {
+        snprintf(buf + n, len - n, "+build.%d", rand() % 10);
+    }
+}
+
+static void bench_compare(int iterations)
+{
+    char versions[VERSIONS][32];
+    app_version_t keys[VERSIONS];
+    for (int i = 0; i < VERSIONS; i++) {
+        random_version(versions[i], sizeof(versions[i]));
+    }
+
+    volatile int sink = 0;
+    host_alloc_stats_t before = host_alloc_stats;
+    double start = now_ns();
+    for (int r = 0; r < iterations; r++) {
+        for (int i = 0; i < VERSIONS; i++) {
+            sink += old_versioncmp(versions[i], versions[(i + r) % VERSIONS]);
+        }
+    }
+    size_t compares = (size_t)iterations * VERSIONS;
+    double old_ns = (now_ns() - start) / compares;
+    double old_allocs = (double)(host_alloc_stats.allocs - before.allocs) / compares;
+
+    start = now_ns();
+    for (int r = 0; r < iterations; r++) {
+        for (int i = 0; i < VERSIONS; i++) {
+            app_version_parse(versions[i], &keys[i]);
+        }
+    }
+    double parse_ns = (now_ns() - start) / compares;
+
+    before = host_alloc_stats;
+    start = now_ns();
+    for (int r = 0; r < iterations; r++) {
+        for (int i = 0; i < VERSIONS; i++) {
+            sink += app_version_cmp(&keys[i], &keys[(i + r) % VERSIONS]);
+        }
+    }
+    double new_ns = (now_ns() - start) / compares;
+    double new_allocs = (double)(host_alloc_stats.allocs - before.allocs) / compares;
+
+    printf("%-16s %10s %10s\n", "compare", "ns", "allocs");
+    printf("%-16s %10.1f %10.2f\n", "versioncmp", old_ns, old_allocs);
+    printf("%-16s %10.1f %10.2f\n", "app_version_cmp", new_ns, new_allocs);
+    printf("%-16s %10.1f %10s\n", "  its parse", parse_ns, "");
+}
+
+/* semver precedence on the strings, for versions with a patch */
+static int ref_identifier_cmp(const char *a, size_t alen, const char *b, size_t blen)
+{
+    bool anum = strspn(a, "0123456789") >= alen;
+    bool bnum = strspn(b, "0123456789") >= blen;
+    if (anum && bnum) {
+        long x = strtol(a, NULL, 10), y = strtol(b, NULL, 10);
+        return (x > y) - (x < y);
+    } else if (anum != bnum) {
+        return anum ? -1 : 1;
+    }
+    int cmp = strncmp(a, b, alen < blen ? alen : blen);
+    return cmp ? (cmp > 0) - (cmp < 0) : (alen > blen) - (alen < blen);
+}
+
+static int ref_cmp(const char *left, const char *right)
+{
+    int l[3], r[3];
+    sscanf(left, "%d.%d.%d", &l[0], &l[1], &l[2]);
+    sscanf(right, "%d.%d.%d", &r[0], &r[1], &r[2]);
+    for (int i = 0; i < 3; i++) {
+        if (l[i] != r[i]) {
+            return l[i] < r[i] ? -1 : 1;
+        }
+    }
+
+    size_t llen = strcspn(left, "+"), rlen = strcspn(right, "+");
+    const char *lp = memchr(left, '-', llen), *rp = memchr(right, '-', rlen);
+    if (!lp || !rp) {
+        return !lp && !rp ? 0 : !lp ? 1 : -1;
+    }
+    lp++;
+    rp++;
+    const char *lend = left + llen, *rend = right + rlen;
+    while (lp < lend && rp < rend) {
+        size_t a = strcspn(lp, ".+"), b = strcspn(rp, ".+");
+        int cmp = ref_identifier_cmp(lp, a, rp, b);
+        if (cmp) {
+            return cmp;
+        }
+        lp += a + (lp[a] == '.');
+        rp += b + (rp[b] == '.');
+    }
+    return (lp < lend) - (rp < rend);
+}
+
+static bool manifests_equal(bool a_ok, const struct app_manifest_t *a, bool b_ok, const struct app_manifest_t *b)
+{
+    if (a_ok != b_ok) {
+        return false;
+    }
+    if (!a_ok) {
+        return true;
+    }
+    const uint16_t fa[] = {a->name, a->version, a->description};
+    const uint16_t fb[] = {b->name, b->version, b->description};
+    for (int i = 0; i < 3; i++) {
+        const char *sa = app_manifest_string(a, fa[i]), *sb = app_manifest_string(b, fb[i]);
+        if ((!sa) != (!sb) || (sa && strcmp(sa, sb) != 0)) {
+            return false;
+        }
+        if (sa && (fa[i] >= a->arena_len || memchr(sa, '\0', a->arena_len - fa[i]) == NULL)) {
+            return false;
+        }
+    }
+    return app_version_cmp(&a->version_key, &b->version_key) == 0;
+}
+
+static void mutate(char *buf, size_t *len)
+{
+    static const char tokens[] = "{}[]:,\"\\ u0a.-+";
+    int mutations = 1 + rand() % 4;
+    for (int m = 0; m < mutations; m++) {
+        size_t pos = *len ? rand() % *len : 0;
+        switch (rand() % 5) {
+            case 0:
+                if (*len) {
+                    buf[pos] ^= 1 << (rand() % 8);
+                }
+                break;
+            case 1:
+                if (*len < MAX_LEN) {
+                    memmove(buf + pos + 1, buf + pos, *len - pos);
+                    buf[pos] = tokens[rand() % (sizeof(tokens) - 1)];
+                    *len += 1;
+                }
+                break;
+            case 2: {
+                size_t n = rand() % 8;
+                n = pos + n > *len ? *len - pos : n;
+                memmove(buf + pos, buf + pos + n, *len - pos - n);
+                *len -= n;
+                break;
+            }
+            case 3: {
+                size_t n = rand() % 16;
+                n = pos + n > *len ? *len - pos : n;
+                if (*len + n <= MAX_LEN) {
+                    memmove(buf + pos + n, buf + pos, *len - pos);
+                    *len += n;
+                }
+                break;
+            }
+            default:
+                *len = pos;
+                break;
+        }
+    }
+}
+
+static void fuzz(long iterations)
+{
+    char *buf = malloc(MAX_LEN + 1);
+    assert(buf != NULL);
+    size_t parsed = 0;
+
+    for (long it = 0; it < iterations && s_count > 0; it++) {
+        const corpus_file_t *file = &s_files[rand() % s_count];
+        size_t len = file->len;
+        memcpy(buf, file->data, len);
+        mutate(buf, &len);
+
+        struct app_manifest_t whole, chunked;
+        bool whole_ok = app_manifest_parse(&whole, buf, len);
+
+        app_manifest_parser_t parser;
+        app_manifest_begin(&parser, &chunked);
+        for (size_t pos = 0; pos < len;) {
+            size_t n = 1 + rand() % 32;
+            n = pos + n > len ? len - pos : n;
+            app_manifest_feed(&parser, buf + pos, n);
+            pos += n;
+        }
+        bool chunked_ok = app_manifest_end(&parser);
+        parsed += whole_ok;
+
+        if (!manifests_equal(whole_ok, &whole, chunked_ok, &chunked)) {
+            fprintf(stderr, "FAIL: whole and chunked parses differ on %.*s\n", (int)len, buf);
+            s_failures += 1;
+        }
+    }
+    free(buf);
+
+    for (long it = 0; it < iterations; it++) {
+        char a[32], b[32];
+        app_version_t ka, kb;
+        random_version(a, sizeof(a));
+        random_version(b, sizeof(b));
+        app_version_parse(a, &ka);
+        app_version_parse(b, &kb);
+        int cmp = app_version_cmp(&ka, &kb);
+        if (cmp != ref_cmp(a, b) || cmp != -app_version_cmp(&kb, &ka)) {
+            fprintf(stderr, "FAIL: %s vs %s compares %d, semver says %d\n", a, b, cmp, ref_cmp(a, b));
+            s_failures += 1;
+        }
+    }
+    printf("fuzzed %ld manifests, %zu still valid, and %ld version pairs\n", iterations, parsed, iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = "corpus/manifest";
+    long fuzz_iterations = 0;
+    int iterations = 2000;
+    int opt;
+
+    srand(1);
+    while ((opt = getopt(argc, argv, "c:f:r:")) != -1) {
+        switch (opt) {
+            case 'c':
+                dir = optarg;
+                break;
+            case 'f':
+                fuzz_iterations = strtol(optarg, NULL, 10);
+                break;
+            case 'r':
+                iterations = strtol(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-c corpus] [-f fuzz iterations] [-r iterations]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    load_corpus(dir);
+    verify_corpus();
+    if (fuzz_iterations > 0) {
+        fuzz(fuzz_iterations);
+    } else {
+        bench_parse(iterations);
+        bench_compare(iterations);
+    }
+
+    if (s_failures) {
+        fprintf(stderr, "%d checks failed\n", s_failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <string.h>
+
+#include "rom/miniz.h"
+
+/* tinfl_decompress on zlib's inflate. zlib keeps its own window, so output
+ * simply goes where tinfl would put it; the stream is set up on the first
+ * call after tinfl_init and ended once it is done or failed. A stream left
+ * before its end is never freed, tinfl has nothing to free it with. */
+
+enum {
+    STATE_NEW,
+    STATE_INFLATING,
+    STATE_ENDED,
+};
+
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_buf_next, size_t *pIn_buf_size,
+        mz_uint8 *pOut_buf_start, mz_uint8 *pOut_buf_next, size_t *pOut_buf_size, const mz_uint32 decomp_flags)
+{
+    if (r->state == STATE_ENDED) {
+        *pIn_buf_size = *pOut_buf_size = 0;
+        return TINFL_STATUS_FAILED;
+    }
+    if (r->state == STATE_NEW) {
+        memset(&r->stream, 0, sizeof(z_stream));
+        int window = decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER ? 15 : -15;
+        if (inflateInit2(&r->stream, window) != Z_OK) {
+            *pIn_buf_size = *pOut_buf_size = 0;
+            return TINFL_STATUS_BAD_PARAM;
+        }
+        r->state = STATE_INFLATING;
+    }
+
+    r->stream.next_in = (mz_uint8 *)pIn_buf_next;
+    r->stream.avail_in = *pIn_buf_size;
+    r->stream.next_out = pOut_buf_next;
+    r->stream.avail_out = *pOut_buf_size;
+    int ret = inflate(&r->stream, Z_NO_FLUSH);
+    *pIn_buf_size -= r->stream.avail_in;
+    *pOut_buf_size -= r->stream.avail_out;
+
+    tinfl_status status;
+    if (ret == Z_STREAM_END) {
+        status = TINFL_STATUS_DONE;
+    } else if (ret == Z_DATA_ERROR) {
+        status = r->stream.msg && strstr(r->stream.msg, "check") ? TINFL_STATUS_ADLER32_MISMATCH : TINFL_STATUS_FAILED;
+    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        status = TINFL_STATUS_FAILED;
+    } else if (r->stream.avail_out == 0) {
+        status = TINFL_STATUS_HAS_MORE_OUTPUT;
+    } else if (decomp_flags & TINFL_FLAG_HAS_MORE_INPUT) {
+        status = TINFL_STATUS_NEEDS_MORE_INPUT;
+    } else {
+        /* the input ended in the middle of the stream */
+        status = TINFL_STATUS_FAILED;
+    }
+
+    if (status <= TINFL_STATUS_DONE) {
+        inflateEnd(&r->stream);
+        r->state = STATE_ENDED;
+    }
+    return status;
+}
@@ -0,0 +1,177 @@
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nvs_flash.h"
+
+#include "host.h"
+
+/* A single in-memory namespace standing in for the nvs partition. With
+ * host_nvs_file set it is read from that file by nvs_flash_init and written
+ * back whole by every commit, through raw descriptors so that fs.c neither
+ * counts nor slows it. */
+
+#define MAX_KEYS (64)
+
+/* strings keep their NUL in len; blobs are as large as the slot table */
+struct nvs_entry_t {
+    char key[16];
+    char value[512];
+    size_t len;
+};
+
+host_nvs_stats_t host_nvs_stats;
+const char *host_nvs_file = NULL;
+
+static struct nvs_entry_t s_entries[MAX_KEYS];
+static size_t s_count = 0;
+
+
+static struct nvs_entry_t *find(const char *key)
+{
+    for (size_t i = 0; i < s_count; i++) {
+        if (strcmp(s_entries[i].key, key) == 0) {
+            return &s_entries[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    if (!host_nvs_file) {
+        return ESP_OK;
+    }
+
+    int fd = open(host_nvs_file, O_RDONLY);
+    if (fd < 0) {
+        return ESP_OK;
+    }
+    size_t count;
+    if (read(fd, &count, sizeof(count)) == sizeof(count) && count <= MAX_KEYS &&
+            read(fd, s_entries, count * sizeof(struct nvs_entry_t)) == (ssize_t)(count * sizeof(struct nvs_entry_t))) {
+        s_count = count;
+    }
+    close(fd);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode, nvs_handle *out_handle)
+{
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_str(nvs_handle handle, const char *key, char *out_value, size_t *length)
+{
+    host_nvs_stats.reads += 1;
+
+    struct nvs_entry_t *e = find(key);
+    if (!e) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    size_t len = strlen(e->value) + 1;
+    if (out_value) {
+        if (*length < len) {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        memcpy(out_value, e->value, len);
+    }
+    *length = len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_str(nvs_handle handle, const char *key, const char *value)
+{
+    host_nvs_stats.writes += 1;
+
+    if (strlen(key) >= sizeof(s_entries[0].key) || strlen(value) >= sizeof(s_entries[0].value)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct nvs_entry_t *e = find(key);
+    if (!e) {
+        if (s_count == MAX_KEYS) {
+            return ESP_ERR_NO_MEM;
+        }
+        e = &s_entries[s_count++];
+        strcpy(e->key, key);
+    }
+    strcpy(e->value, value);
+    e->len = strlen(value) + 1;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *out_value, size_t *length)
+{
+    host_nvs_stats.reads += 1;
+
+    struct nvs_entry_t *e = find(key);
+    if (!e) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    if (out_value) {
+        if (*length < e->len) {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        memcpy(out_value, e->value, e->len);
+    }
+    *length = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t length)
+{
+    host_nvs_stats.writes += 1;
+
+    if (strlen(key) >= sizeof(s_entries[0].key) || length > sizeof(s_entries[0].value)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct nvs_entry_t *e = find(key);
+    if (!e) {
+        if (s_count == MAX_KEYS) {
+            return ESP_ERR_NO_MEM;
+        }
+        e = &s_entries[s_count++];
+        strcpy(e->key, key);
+    }
+    memcpy(e->value, value, length);
+    e->len = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle handle, const char *key)
+{
+    host_nvs_stats.writes += 1;
+
+    struct nvs_entry_t *e = find(key);
+    if (!e) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *e = s_entries[--s_count];
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle handle)
+{
+    host_nvs_stats.commits += 1;
+    if (!host_nvs_file) {
+        return ESP_OK;
+    }
+
+    int fd = open(host_nvs_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    bool ok = write(fd, &s_count, sizeof(s_count)) == sizeof(s_count) &&
+              write(fd, s_entries, s_count * sizeof(struct nvs_entry_t)) == (ssize_t)(s_count * sizeof(struct nvs_entry_t));
+    close(fd);
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+void nvs_close(nvs_handle handle)
+{
+}
@@ -0,0 +1,279 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_flash_data_types.h"
+#include "esp_image_format.h"
+#include "esp_ota_ops.h"
+#include "esp_spi_flash.h"
+#include "esp_system.h"
+
+#include "host.h"
+
+/* A 16M flash, the file flash.bin in host_flash_dir or else a temporary
+ * one, which behaves like NOR flash: erased bytes read as 0xff and writes
+ * can only clear bits. With host_flash_kbps set, writes take that long and erases as
+ * long as on a typical SPI flash. Partitions are those of the table at
+ * 0x8000 when the boot found one there, or else of partitions.csv. */
+
+#define FLASH_SIZE (0x1000000)
+#define MAX_PARTITIONS (32)
+#define SECTOR_ERASE_US (45000)
+#define BLOCK_ERASE_US (150000)
+#define BLOCK_SIZE (0x10000)
+
+host_ota_stats_t host_ota_stats;
+const char *host_flash_dir = NULL;
+uint32_t host_flash_kbps = 0;
+void (*host_restart)(void) = NULL;
+
+/* a raw descriptor, so fs.c neither counts nor slows flash access */
+static int s_fd = -1;
+
+static esp_partition_t s_partitions[MAX_PARTITIONS];
+static size_t s_partition_count = 0;
+static bool s_partitions_loaded = false;
+
+static const esp_partition_info_t s_default_table[] = {
+    {ESP_PARTITION_MAGIC, PART_TYPE_DATA, 0x02, {0x9000, 0x4000}, "nvs"},
+    {ESP_PARTITION_MAGIC, PART_TYPE_DATA, 0x00, {0xd000, 0x2000}, "otadata"},
+    {ESP_PARTITION_MAGIC, PART_TYPE_DATA, 0x01, {0xf000, 0x1000}, "phy_init"},
+    {ESP_PARTITION_MAGIC, PART_TYPE_APP, PART_SUBTYPE_OTA_FLAG, {0x10000, 1792 * 1024}, "launcher"},
+    {ESP_PARTITION_MAGIC, PART_TYPE_DATA, 0x41, {0x1d0000, 0x30000}, "splash"},
+    {ESP_PARTITION_MAGIC, PART_TYPE_APP, PART_SUBTYPE_OTA_FLAG + 1, {0x200000, 2624 * 1024}, "app1"},
+    {ESP_PARTITION_MAGIC, PART_TYPE_APP, PART_SUBTYPE_OTA_FLAG + 2, {0x490000, 1728 * 1024}, "app2"},
+    {ESP_PARTITION_MAGIC, PART_TYPE_APP, PART_SUBTYPE_OTA_FLAG + 3, {0x640000, 1088 * 1024}, "app3"},
+    {ESP_PARTITION_MAGIC, PART_TYPE_APP, PART_SUBTYPE_OTA_FLAG + 4, {0x750000, 704 * 1024}, "app4"},
+    {ESP_PARTITION_MAGIC, PART_TYPE_APP, PART_SUBTYPE_OTA_FLAG + 5, {0x800000, 2624 * 1024}, "app5"},
+    {ESP_PARTITION_MAGIC, PART_TYPE_APP, PART_SUBTYPE_OTA_FLAG + 6, {0xa90000, 1728 * 1024}, "app6"},
+    {ESP_PARTITION_MAGIC, PART_TYPE_APP, PART_SUBTYPE_OTA_FLAG + 7, {0xc40000, 1728 * 1024}, "app7"},
+    {ESP_PARTITION_MAGIC, PART_TYPE_DATA, 0x40, {0xdf0000, 0x10000}, "appstore"},
+    {ESP_PARTITION_MAGIC, PART_TYPE_DATA, 0x82, {0xe00000, 0x200000}, "storage"},
+};
+
+
+static int flash_fd(void)
+{
+    if (s_fd < 0 && host_flash_dir) {
+        char filename[512];
+        snprintf(filename, sizeof(filename), "%s/flash.bin", host_flash_dir);
+        s_fd = open(filename, O_RDWR | O_CREAT, 0644);
+    } else if (s_fd < 0) {
+        FILE *f = tmpfile();
+        s_fd = f ? fileno(f) : -1;
+    }
+    return s_fd;
+}
+
+/* bytes past the end of the file read as erased */
+static void flash_read(size_t addr, void *dst, size_t size)
+{
+    memset(dst, 0xff, size);
+    if (flash_fd() >= 0) {
+        pread(s_fd, dst, size, addr);
+    }
+}
+
+static esp_err_t flash_write(size_t addr, const void *src, size_t size)
+{
+    if (addr + size > FLASH_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (flash_fd() >= 0) {
+        uint8_t *buf = malloc(size);
+        assert(buf != NULL);
+        flash_read(addr, buf, size);
+        for (size_t i = 0; i < size; i++) {
+            buf[i] &= ((const uint8_t *)src)[i];
+        }
+        bool ok = pwrite(s_fd, buf, size, addr) == size;
+        free(buf);
+        if (!ok) {
+            return ESP_FAIL;
+        }
+    }
+    if (host_flash_kbps) {
+        usleep((uint64_t)size * 1000000 / 1024 / host_flash_kbps);
+    }
+    host_ota_stats.bytes_written += size;
+    return ESP_OK;
+}
+
+/* 64K blocks where the range covers them, like spi_flash_erase_range */
+static esp_err_t flash_erase(size_t addr, size_t size)
+{
+    if (addr % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE || addr + size > FLASH_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (flash_fd() >= 0) {
+        uint8_t erased[SPI_FLASH_SEC_SIZE];
+        memset(erased, 0xff, sizeof(erased));
+        for (size_t pos = 0; pos < size; pos += SPI_FLASH_SEC_SIZE) {
+            if (pwrite(s_fd, erased, sizeof(erased), addr + pos) != sizeof(erased)) {
+                return ESP_FAIL;
+            }
+        }
+    }
+
+    size_t end = addr + size;
+    while (addr < end) {
+        size_t n = addr % BLOCK_SIZE == 0 && end - addr >= BLOCK_SIZE ? BLOCK_SIZE : SPI_FLASH_SEC_SIZE;
+        if (host_flash_kbps) {
+            usleep(n == BLOCK_SIZE ? BLOCK_ERASE_US : SECTOR_ERASE_US);
+        }
+        addr += n;
+    }
+    host_ota_stats.bytes_erased += size;
+    return ESP_OK;
+}
+
+static void add_partition(const esp_partition_info_t *info)
+{
+    if (s_partition_count == MAX_PARTITIONS) {
+        return;
+    }
+    esp_partition_t *part = &s_partitions[s_partition_count++];
+    memset(part, 0, sizeof(esp_partition_t));
+    part->type = info->type;
+    part->subtype = info->subtype;
+    part->address = info->pos.offset;
+    part->size = info->pos.size;
+    memcpy(part->label, info->label, sizeof(info->label));
+}
+
+/* read once, as the partition table is at boot */
+static void load_partitions(void)
+{
+    esp_partition_info_t table[ESP_PARTITION_TABLE_MAX_ENTRIES];
+
+    s_partitions_loaded = true;
+    flash_read(ESP_PARTITION_TABLE_OFFSET, table, sizeof(table));
+    for (size_t i = 0; i < ESP_PARTITION_TABLE_MAX_ENTRIES && table[i].magic == ESP_PARTITION_MAGIC; i++) {
+        add_partition(&table[i]);
+    }
+    if (s_partition_count > 0) {
+        return;
+    }
+
+    /* as flashed from partitions.csv */
+    memset(table, 0xff, sizeof(table));
+    memcpy(table, s_default_table, sizeof(s_default_table));
+    for (size_t i = 0; i < sizeof(s_default_table) / sizeof(s_default_table[0]); i++) {
+        add_partition(&s_default_table[i]);
+    }
+    if (flash_fd() >= 0) {
+        pwrite(s_fd, table, sizeof(table), ESP_PARTITION_TABLE_OFFSET);
+    }
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+        esp_partition_subtype_t subtype, const char *label)
+{
+    if (!s_partitions_loaded) {
+        load_partitions();
+    }
+    for (size_t i = 0; i < s_partition_count; i++) {
+        const esp_partition_t *part = &s_partitions[i];
+        if (part->type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || part->subtype == subtype) &&
+                (!label || strcmp(part->label, label) == 0)) {
+            return part;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t src_offset, void *dst, size_t size)
+{
+    if (src_offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    flash_read(part->address + src_offset, dst, size);
+    host_ota_stats.bytes_read += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t dst_offset, const void *src, size_t size)
+{
+    if (dst_offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return flash_write(part->address + dst_offset, src, size);
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t start_addr, size_t size)
+{
+    if (start_addr + size > part->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return flash_erase(part->address + start_addr, size);
+}
+
+esp_err_t spi_flash_read(size_t src_addr, void *dest, size_t size)
+{
+    if (src_addr + size > FLASH_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    flash_read(src_addr, dest, size);
+    host_ota_stats.bytes_read += size;
+    return ESP_OK;
+}
+
+esp_err_t spi_flash_write(size_t dest_addr, const void *src, size_t size)
+{
+    return flash_write(dest_addr, src, size);
+}
+
+esp_err_t spi_flash_erase_sector(size_t sector)
+{
+    return flash_erase(sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE);
+}
+
+/* any data that does not start erased is an image, as long as up to its
+ * last byte that is not 0xff */
+esp_err_t esp_image_verify(esp_image_load_mode_t mode, const esp_partition_pos_t *part, esp_image_metadata_t *data)
+{
+    uint8_t buf[SPI_FLASH_SEC_SIZE];
+
+    memset(data, 0, sizeof(esp_image_metadata_t));
+    data->start_addr = part->offset;
+    flash_read(part->offset, buf, 1);
+    if (buf[0] == 0xff) {
+        return ESP_ERR_IMAGE_INVALID;
+    }
+
+    size_t end = part->size;
+    while (end > 0) {
+        size_t n = end < sizeof(buf) ? end : sizeof(buf);
+        flash_read(part->offset + end - n, buf, n);
+        while (n > 0 && buf[n - 1] == 0xff) {
+            n--;
+            end--;
+        }
+        if (n > 0) {
+            break;
+        }
+    }
+    data->image_len = end;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    host_ota_stats.boot_partition = *partition;
+    host_ota_stats.boot_set = true;
+    return ESP_OK;
+}
+
+void esp_restart(void)
+{
+    printf("restart into %s\n", host_ota_stats.boot_set ? host_ota_stats.boot_partition.label : "launcher");
+    if (host_restart) {
+        host_restart();
+    }
+    exit(0);
+}
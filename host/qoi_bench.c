@@ -0,0 +1,257 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gbuf.h"
+#include "qoi.h"
+
+/* Compares drawing a full screen image from a .qoi file against reading
+ * the same image as raw RGB565. The SD card, not the CPU, is what limits
+ * the raw path on the device, so next to the host times the bytes read are
+ * converted to time at a given card throughput. Also times qoi_encode of
+ * the framebuffer, which must give the bytes tools/png2qoi.py does. */
+
+#define WIDTH (320)
+#define HEIGHT (240)
+
+static double s_sd_mbps = 1.0;
+static int s_iterations = 50;
+
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* same reduction as tools/png2qoi.py */
+static void to_rgb565(uint8_t *px)
+{
+    px[0] = (px[0] & 0xf8) | (px[0] >> 5);
+    px[1] = (px[1] & 0xfc) | (px[1] >> 6);
+    px[2] = (px[2] & 0xf8) | (px[2] >> 5);
+}
+
+static uint8_t (*make_image(int kind))[3]
+{
+    uint8_t (*rgb)[3] = malloc(WIDTH * HEIGHT * 3);
+    assert(rgb != NULL);
+    srand(kind + 1);
+
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            uint8_t *px = rgb[y * WIDTH + x];
+            switch (kind) {
+                case 0:
+                    /* wallpaper-like gradient */
+                    px[0] = x * 255 / WIDTH;
+                    px[1] = y * 255 / HEIGHT;
+                    px[2] = 128 + (x - y) / 4;
+                    break;
+
+                case 1:
+                    /* splash-like: flat background, a few boxes and speckle */
+                    px[0] = px[1] = px[2] = 16;
+                    if (x > 60 && x < 260 && y > 80 && y < 160) {
+                        px[0] = 32;
+                        px[1] = 64;
+                        px[2] = 192;
+                    }
+                    if ((x / 8 + y / 12) % 7 == 0 && y > 180 && y < 200) {
+                        px[0] = px[1] = px[2] = 255;
+                    }
+                    break;
+
+                default:
+                    /* photo-like noise, the worst case */
+                    px[0] = rand();
+                    px[1] = rand();
+                    px[2] = rand();
+                    break;
+            }
+            to_rgb565(px);
+        }
+    }
+    return rgb;
+}
+
+/* mirror of the encoder in tools/png2qoi.py */
+static size_t encode_rgb(uint8_t (*rgb)[3], uint8_t *out)
+{
+    uint8_t index[64][3] = {{0}};
+    uint8_t prev[3] = {0, 0, 0};
+    size_t len = 0;
+    int run = 0;
+
+    memcpy(out, "qoif", 4);
+    uint8_t header[10] = {0, 0, WIDTH >> 8, WIDTH & 0xff, 0, 0, HEIGHT >> 8, HEIGHT & 0xff, 3, 0};
+    memcpy(out + 4, header, sizeof(header));
+    len = 14;
+
+    for (int i = 0; i < WIDTH * HEIGHT; i++) {
+        uint8_t *px = rgb[i];
+        if (memcmp(px, prev, 3) == 0) {
+            run += 1;
+            if (run == 62 || i == WIDTH * HEIGHT - 1) {
+                out[len++] = 0xc0 | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out[len++] = 0xc0 | (run - 1);
+            run = 0;
+        }
+
+        int h = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64;
+        if (memcmp(index[h], px, 3) == 0) {
+            out[len++] = h;
+        } else {
+            memcpy(index[h], px, 3);
+            int vr = (int8_t)(px[0] - prev[0]);
+            int vg = (int8_t)(px[1] - prev[1]);
+            int vb = (int8_t)(px[2] - prev[2]);
+            int vg_r = vr - vg;
+            int vg_b = vb - vg;
+            if (vr >= -2 && vr <= 1 && vg >= -2 && vg <= 1 && vb >= -2 && vb <= 1) {
+                out[len++] = 0x40 | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+            } else if (vg >= -32 && vg <= 31 && vg_r >= -8 && vg_r <= 7 && vg_b >= -8 && vg_b <= 7) {
+                out[len++] = 0x80 | (vg + 32);
+                out[len++] = (vg_r + 8) << 4 | (vg_b + 8);
+            } else {
+                out[len++] = 0xfe;
+                memcpy(out + len, px, 3);
+                len += 3;
+            }
+        }
+        memcpy(prev, px, 3);
+    }
+
+    memcpy(out + len, "\0\0\0\0\0\0\0\1", 8);
+    return len + 8;
+}
+
+static void write_file(const char *filename, const void *data, size_t len)
+{
+    FILE *f = fopen(filename, "wb");
+    if (!f || fwrite(data, len, 1, f) != 1) {
+        fprintf(stderr, "cannot write %s\n", filename);
+        exit(1);
+    }
+    fclose(f);
+}
+
+static void bench(const char *dir, const char *name, uint8_t (*rgb)[3], gbuf_t *g)
+{
+    char raw_name[512], qoi_name[512];
+    snprintf(raw_name, sizeof(raw_name), "%s/%s.raw", dir, name);
+    snprintf(qoi_name, sizeof(qoi_name), "%s/%s.qoi", dir, name);
+
+    /* raw RGB565 in fb byte order, as icons are stored today */
+    uint8_t *raw = malloc(WIDTH * HEIGHT * 2);
+    assert(raw != NULL);
+    for (int i = 0; i < WIDTH * HEIGHT; i++) {
+        uint16_t c = (rgb[i][0] & 0xf8) << 8 | (rgb[i][1] & 0xfc) << 3 | rgb[i][2] >> 3;
+        raw[i * 2] = c >> 8;
+        raw[i * 2 + 1] = c & 0xff;
+    }
+    write_file(raw_name, raw, WIDTH * HEIGHT * 2);
+
+    uint8_t *qoi = malloc(WIDTH * HEIGHT * 4 + 32);
+    assert(qoi != NULL);
+    size_t qoi_len = encode_rgb(rgb, qoi);
+    write_file(qoi_name, qoi, qoi_len);
+
+    /* the decoder must reproduce the raw image exactly */
+    point_t origin = {0, 0};
+    memset(g->data, 0, WIDTH * HEIGHT * 2);
+    if (!qoi_draw(g, origin, qoi_name) || memcmp(g->data, raw, WIDTH * HEIGHT * 2) != 0) {
+        fprintf(stderr, "%s: decoded image differs\n", name);
+        exit(1);
+    }
+
+    double start = now_us();
+    for (int i = 0; i < s_iterations; i++) {
+        FILE *f = fopen(raw_name, "rb");
+        if (fread(g->data, WIDTH * HEIGHT * 2, 1, f) != 1) {
+            fprintf(stderr, "cannot read %s\n", raw_name);
+            exit(1);
+        }
+        fclose(f);
+    }
+    double raw_us = (now_us() - start) / s_iterations;
+
+    start = now_us();
+    for (int i = 0; i < s_iterations; i++) {
+        qoi_draw(g, origin, qoi_name);
+    }
+    double qoi_us = (now_us() - start) / s_iterations;
+
+    uint8_t *encoded = malloc(WIDTH * HEIGHT * 4 + 32);
+    assert(encoded != NULL);
+    start = now_us();
+    size_t encoded_len = 0;
+    for (int i = 0; i < s_iterations; i++) {
+        encoded_len = qoi_encode(g, encoded, WIDTH * HEIGHT * 4 + 32);
+    }
+    double encode_us = (now_us() - start) / s_iterations;
+    if (encoded_len != qoi_len || memcmp(encoded, qoi, qoi_len) != 0) {
+        fprintf(stderr, "%s: qoi_encode differs from png2qoi\n", name);
+        exit(1);
+    }
+    if (qoi_encode(g, encoded, qoi_len - 1) != 0) {
+        fprintf(stderr, "%s: qoi_encode overran its buffer\n", name);
+        exit(1);
+    }
+    free(encoded);
+
+    double raw_sd_ms = WIDTH * HEIGHT * 2 / (s_sd_mbps * 1000.0);
+    double qoi_sd_ms = qoi_len / (s_sd_mbps * 1000.0);
+    printf("%-10s %9d %9zu %6.1f%% %10.1f %10.1f %10.1f %10.1f %10.1f\n", name,
+            WIDTH * HEIGHT * 2, qoi_len, 100.0 * qoi_len / (WIDTH * HEIGHT * 2),
+            raw_us, qoi_us, raw_sd_ms, qoi_sd_ms, encode_us);
+
+    free(raw);
+    free(qoi);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = "/tmp";
+    int opt;
+    while ((opt = getopt(argc, argv, "d:n:r:")) != -1) {
+        switch (opt) {
+            case 'd':
+                dir = optarg;
+                break;
+            case 'n':
+                s_iterations = strtol(optarg, NULL, 10);
+                break;
+            case 'r':
+                s_sd_mbps = strtod(optarg, NULL);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-d dir] [-n iterations] [-r sd MB/s]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    gbuf_t *g = gbuf_new(WIDTH, HEIGHT, 2, BIG_ENDIAN);
+
+    printf("%-10s %9s %9s %7s %10s %10s %10s %10s %10s\n", "image", "raw B", "qoi B", "ratio",
+            "raw us", "qoi us", "raw sd ms", "qoi sd ms", "encode us");
+    const char *names[] = {"gradient", "splash", "noise"};
+    for (int kind = 0; kind < 3; kind++) {
+        uint8_t (*rgb)[3] = make_image(kind);
+        bench(dir, names[kind], rgb, g);
+        free(rgb);
+    }
+    printf("host decode times; sd columns are the bytes read at %.1f MB/s\n", s_sd_mbps);
+
+    gbuf_free(g);
+    return 0;
+}
@@ -0,0 +1,11 @@
+#include "sdcard.h"
+
+
+void sdcard_init(const char *base_path)
+{
+}
+
+bool sdcard_present(void)
+{
+    return true;
+}
@@ -0,0 +1,336 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "display.h"
+#include "keypad.h"
+
+#include "host.h"
+
+/*
+ * The launcher as a Linux program: app_main runs as on the device, against
+ * the stand-ins of this directory. /sdcard and /spiffs are directories
+ * under the root given with -d, the flash is flash.bin there and NVS
+ * nvs.bin, so what one run installs the next one finds. The keypad is fed
+ * from a script, or from stdin, one command per line:
+ *
+ *   # comment
+ *   press DOWN [count]  press a key, once the launcher waits for one
+ *   wait 500            let it run for that many milliseconds
+ *   dump name.ppm       write the framebuffer as a PPM image
+ *   quit                exit, as does the end of the input
+ *
+ * Unlike the harness, the launcher starts on its home screen, so scripts
+ * open the menu with MENU first; apps commands are ignored.
+ * Time is real, so the scan, the icon loader and installs run as they do
+ * on the device, with the card and the flash slowed down by -r, -w and -l
+ * when given. Boot is timed until the launcher first waits for a key, and
+ * every press until it waits for the next one. Unlike the harness it leaves
+ * the allocator alone, for valgrind's tools.
+ */
+
+#define KEYPAD_QUEUE_LENGTH (8)
+
+typedef struct {
+    struct timespec start;
+    host_fs_stats_t fs;
+    host_ota_stats_t ota;
+    host_nvs_stats_t nvs;
+    host_display_stats_t display;
+} sample_t;
+
+static const struct {
+    const char *name;
+    uint16_t key;
+} s_keys[] = {
+    {"UP", KEYPAD_UP},
+    {"RIGHT", KEYPAD_RIGHT},
+    {"DOWN", KEYPAD_DOWN},
+    {"LEFT", KEYPAD_LEFT},
+    {"SELECT", KEYPAD_SELECT},
+    {"START", KEYPAD_START},
+    {"A", KEYPAD_A},
+    {"B", KEYPAD_B},
+    {"MENU", KEYPAD_MENU},
+    {"VOLUME", KEYPAD_VOLUME},
+};
+
+static QueueHandle_t s_queue = NULL;
+static FILE *s_script = NULL;
+static const char *s_frame_dir = NULL;
+static bool s_quiet = false;
+
+/* keys sent and taken, and whether the launcher asked for the next one
+ * since it took the last, when it first did */
+static unsigned long s_sent = 0;
+static unsigned long s_taken = 0;
+static bool s_idle = false;
+static struct timespec s_idle_since;
+
+static char **s_argv = NULL;
+
+static unsigned long s_presses = 0;
+static double s_boot_ms = 0;
+static double s_total_ms = 0;
+static double s_max_ms = 0;
+
+extern void app_main(void);
+
+
+static double elapsed_ms(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void sample(sample_t *s)
+{
+    clock_gettime(CLOCK_MONOTONIC, &s->start);
+    s->fs = host_fs_stats;
+    s->ota = host_ota_stats;
+    s->nvs = host_nvs_stats;
+    s->display = host_display_stats;
+}
+
+/* until the launcher took every key and asked for the next; returns the
+ * ms from start to when it asked */
+static double settle(const struct timespec *start)
+{
+    while (__atomic_load_n(&s_taken, __ATOMIC_ACQUIRE) != s_sent || !__atomic_load_n(&s_idle, __ATOMIC_ACQUIRE)) {
+        usleep(1000);
+    }
+    return start ? elapsed_ms(start, &s_idle_since) : 0;
+}
+
+static void report(const char *what, const sample_t *before, double ms)
+{
+    if (!s_quiet) {
+        printf("%-8s %10.1f %7lu %9lu %9lu %7lu %9lu\n", what, ms,
+                (unsigned long)(host_fs_stats.opens - before->fs.opens),
+                (unsigned long)((host_fs_stats.bytes_read - before->fs.bytes_read) / 1024),
+                (unsigned long)((host_ota_stats.bytes_written - before->ota.bytes_written) / 1024),
+                (unsigned long)(host_nvs_stats.commits - before->nvs.commits),
+                (unsigned long)(host_display_stats.pixels_flushed - before->display.pixels_flushed));
+        fflush(stdout);
+    }
+}
+
+static void press(uint16_t key, const char *name)
+{
+    sample_t before;
+    sample(&before);
+
+    keypad_info_t info = {
+        .state = key,
+        .pressed = key,
+    };
+    s_sent += 1;
+    xQueueSend(s_queue, &info, portMAX_DELAY);
+    double ms = settle(&before.start);
+
+    s_presses += 1;
+    s_total_ms += ms;
+    if (ms > s_max_ms) {
+        s_max_ms = ms;
+    }
+    report(name, &before, ms);
+
+    if (s_frame_dir) {
+        char filename[PATH_MAX];
+        snprintf(filename, sizeof(filename), "%s/%04lu.ppm", s_frame_dir, s_presses);
+        host_display_dump_ppm(filename);
+    }
+}
+
+static void finish(int status)
+{
+    printf("boot ms %.1f, keys %lu, press ms total %.1f mean %.1f max %.1f\n", s_boot_ms, s_presses,
+            s_total_ms, s_presses ? s_total_ms / s_presses : 0.0, s_max_ms);
+    printf("card opens %lu, KB read %lu, flash KB written %lu, nvs commits %lu\n",
+            (unsigned long)host_fs_stats.opens, (unsigned long)(host_fs_stats.bytes_read / 1024),
+            (unsigned long)(host_ota_stats.bytes_written / 1024), (unsigned long)host_nvs_stats.commits);
+    fflush(stdout);
+    exit(status);
+}
+
+/* plays the script, as the keypad task does key presses on the device */
+static void script_task(void *arg)
+{
+    sample_t boot = *(sample_t *)arg;
+    s_boot_ms = settle(&boot.start);
+    report("boot", &boot, s_boot_ms);
+
+    char line[512];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), s_script)) {
+        lineno++;
+        char *p = strchr(line, '#');
+        if (p) {
+            *p = '\0';
+        }
+
+        char cmd[32], arg[256];
+        int count = 1;
+        int n = sscanf(line, "%31s %255s %d", cmd, arg, &count);
+        if (n <= 0) {
+            continue;
+        }
+
+        if (strcmp(cmd, "apps") == 0) {
+            /* for the harness's stub catalog, the card holds what it holds */
+            continue;
+        } else if (strcmp(cmd, "press") == 0 && n >= 2) {
+            uint16_t key = 0;
+            const char *name = NULL;
+            for (size_t i = 0; i < sizeof(s_keys) / sizeof(s_keys[0]); i++) {
+                if (strcasecmp(arg, s_keys[i].name) == 0) {
+                    key = s_keys[i].key;
+                    name = s_keys[i].name;
+                }
+            }
+            if (!key) {
+                fprintf(stderr, "line %d: unknown key %s\n", lineno, arg);
+                continue;
+            }
+            for (int i = 0; i < count; i++) {
+                press(key, name);
+            }
+        } else if (strcmp(cmd, "wait") == 0 && n >= 2) {
+            vTaskDelay(strtol(arg, NULL, 10) / portTICK_PERIOD_MS);
+        } else if (strcmp(cmd, "dump") == 0 && n >= 2) {
+            settle(NULL);
+            if (!host_display_dump_ppm(arg)) {
+                fprintf(stderr, "line %d: cannot write %s\n", lineno, arg);
+            }
+        } else if (strcmp(cmd, "quit") == 0) {
+            break;
+        } else {
+            fprintf(stderr, "line %d: bad command\n", lineno);
+        }
+    }
+
+    settle(NULL);
+    finish(0);
+}
+
+/* the launcher restarting into itself, after it rewrote the partition
+ * table, boots again from the start; leaving for an app ends the run */
+static void restart(void)
+{
+    if (!host_ota_stats.boot_set) {
+        fflush(stdout);
+        execv("/proc/self/exe", s_argv);
+    }
+    finish(0);
+}
+
+void keypad_init(void)
+{
+    s_queue = xQueueCreate(KEYPAD_QUEUE_LENGTH, sizeof(keypad_info_t));
+    assert(s_queue != NULL);
+}
+
+QueueHandle_t keypad_get_queue(void)
+{
+    return s_queue;
+}
+
+bool keypad_queue_receive(QueueHandle_t q, keypad_info_t *info, TickType_t wait)
+{
+    if (!s_idle) {
+        clock_gettime(CLOCK_MONOTONIC, &s_idle_since);
+        __atomic_store_n(&s_idle, true, __ATOMIC_RELEASE);
+    }
+    bool received = xQueueReceive(s_queue, info, wait) == pdTRUE;
+    if (received) {
+        __atomic_store_n(&s_idle, false, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&s_taken, 1, __ATOMIC_RELEASE);
+    }
+    return received;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-q] [-d root] [-f framedir] [-l lookup us] [-r sd KB/s] [-w flash KB/s] [script]\n", argv0);
+    fprintf(stderr, "  -q  only print the summary\n");
+    fprintf(stderr, "  -d  directory holding sdcard/, spiffs/, flash.bin and nvs.bin\n");
+    fprintf(stderr, "  -f  dump a PPM frame after every key press\n");
+    fprintf(stderr, "  without a script, commands are read from stdin\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "qd:f:l:r:w:")) != -1) {
+        switch (opt) {
+            case 'q':
+                s_quiet = true;
+                break;
+            case 'd':
+                host_fs_root = optarg;
+                break;
+            case 'f':
+                s_frame_dir = optarg;
+                break;
+            case 'l':
+                host_fs_lookup_us = strtol(optarg, NULL, 10);
+                break;
+            case 'r':
+                host_fs_read_kbps = strtol(optarg, NULL, 10);
+                break;
+            case 'w':
+                host_flash_kbps = strtol(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind < argc - 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    s_script = optind < argc ? fopen(argv[optind], "r") : stdin;
+    if (!s_script) {
+        perror(argv[optind]);
+        return 2;
+    }
+
+    static char sdcard[PATH_MAX], nvs[PATH_MAX];
+    snprintf(sdcard, sizeof(sdcard), "%s/sdcard", host_fs_root);
+    snprintf(nvs, sizeof(nvs), "%s/nvs.bin", host_fs_root);
+    if ((mkdir(host_fs_root, 0755) != 0 && errno != EEXIST) ||
+            (mkdir(sdcard, 0755) != 0 && errno != EEXIST)) {
+        perror(host_fs_root);
+        return 2;
+    }
+    host_flash_dir = host_fs_root;
+    host_nvs_file = nvs;
+    host_restart = restart;
+    s_argv = argv;
+
+    if (!s_quiet) {
+        printf("%-8s %10s %7s %9s %9s %7s %9s\n", "key", "ms", "opens", "KB read", "KB flash", "commits", "flushed");
+    }
+
+    /* the script waits for the launcher to come up, as on the device the
+     * keypad does for app_main */
+    sample_t boot;
+    sample(&boot);
+    xTaskCreate(script_task, "script", 4096, &boot, 5, NULL);
+    app_main();
+
+    while (true) {
+        pause();
+    }
+}
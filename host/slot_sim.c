@@ -0,0 +1,431 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "app_slots.h"
+#include "app_store.h"
+
+/* Replays launch traces against each slot policy, both on the six 2M
+ * partitions of older launchers and on the app store's regions of the same
+ * flash, and prints how many launches needed the app installed first, how
+ * many could not run it at all, how many apps stayed installed on average
+ * and how many MB the store moved between regions per 1000 launches.
+ * Belady's optimum (evict the app launched again last) is there for
+ * reference.
+ *
+ * The traces are synthetic unless -t names a file with one app name per
+ * line, optionally followed by a tab and its binary size; all start with
+ * nothing installed. Apps without a size get a random one: a quarter are
+ * small emulators of 300-700K, most are 0.9-1.7M and some over 2M.
+ *
+ * The regions are those of partitions.csv unless -r gives other sizes in K,
+ * as "2624,1728,1728", to try a layout before changing it. */
+
+#define TRACE_LEN (5000)
+#define MAX_APPS (64)
+#define LEGACY_SLOTS (6)
+#define LEGACY_SLOT_SIZE (0x200000)
+#define K (1024)
+
+typedef struct trace_t {
+    const char *name;
+    int *launches;
+    size_t len;
+    char **apps;
+    size_t *sizes;
+    size_t app_count;
+} trace_t;
+
+typedef struct result_t {
+    size_t installs;
+    size_t failed;
+    size_t resident;
+    size_t moved;
+} result_t;
+
+/* what the callbacks of app_store_place need */
+typedef struct replay_t {
+    const trace_t *t;
+    size_t pos;
+    const app_slot_policy_t *policy;
+    struct app_slot_table_t *table;
+    const int *held;
+    size_t moved;
+} replay_t;
+
+static size_t s_len = TRACE_LEN;
+/* the ota_1.. partitions of partitions.csv */
+static uint32_t s_regions[APP_STORE_SLOTS] = {
+    2624 * K, 1728 * K, 1088 * K, 704 * K, 2624 * K, 1728 * K, 1728 * K,
+};
+static size_t s_region_count = 7;
+
+
+static char **app_names(size_t count)
+{
+    char **apps = malloc(count * sizeof(char *));
+    assert(apps != NULL);
+    for (size_t i = 0; i < count; i++) {
+        apps[i] = malloc(16);
+        assert(apps[i] != NULL);
+        snprintf(apps[i], 16, "App %02zu", i);
+    }
+    return apps;
+}
+
+static size_t random_size(void)
+{
+    int r = rand() % 100;
+    size_t k = r < 25 ? 300 + rand() % 400 : r < 85 ? 900 + rand() % 800 : 1900 + rand() % 700;
+    return k * 1024;
+}
+
+static size_t *app_sizes(size_t count)
+{
+    size_t *sizes = malloc(count * sizeof(size_t));
+    assert(sizes != NULL);
+    for (size_t i = 0; i < count; i++) {
+        sizes[i] = random_size();
+    }
+    return sizes;
+}
+
+static trace_t new_trace(const char *name, size_t app_count)
+{
+    trace_t t = {
+        .name = name,
+        .launches = malloc(s_len * sizeof(int)),
+        .len = s_len,
+        .apps = app_names(app_count),
+        .sizes = app_sizes(app_count),
+        .app_count = app_count,
+    };
+    assert(t.launches != NULL);
+    return t;
+}
+
+/* a few apps used every day, and a one-off launch of something else in one
+ * launch out of four */
+static trace_t trace_daily(void)
+{
+    trace_t t = new_trace("daily", 45);
+    for (size_t i = 0; i < t.len; i++) {
+        t.launches[i] = rand() % 4 == 0 ? 5 + rand() % 40 : rand() % 5;
+    }
+    return t;
+}
+
+/* popularity falling off as 1/rank over 30 apps */
+static trace_t trace_zipf(void)
+{
+    trace_t t = new_trace("zipf", 30);
+    double total = 0;
+    for (int r = 1; r <= 30; r++) {
+        total += 1.0 / r;
+    }
+    for (size_t i = 0; i < t.len; i++) {
+        double x = (double)rand() / RAND_MAX * total;
+        int r = 1;
+        while (r < 30 && (x -= 1.0 / r) > 0) {
+            r++;
+        }
+        t.launches[i] = r - 1;
+    }
+    return t;
+}
+
+/* four favourites that change every 250 launches, as games are finished,
+ * and a one-off in one launch out of ten */
+static trace_t trace_phases(void)
+{
+    trace_t t = new_trace("phases", 60);
+    for (size_t i = 0; i < t.len; i++) {
+        int base = (i / 250) * 2 % 40;
+        t.launches[i] = rand() % 10 == 0 ? 40 + rand() % 20 : base + rand() % 4;
+    }
+    return t;
+}
+
+/* four favourites, and now and then a run through eight new apps in a row,
+ * as when browsing the card */
+static trace_t trace_browse(void)
+{
+    trace_t t = new_trace("browse", 4 + 56);
+    size_t i = 0;
+    while (i < t.len) {
+        if (rand() % 40 == 0) {
+            int first = 4 + rand() % 48;
+            for (int j = 0; j < 8 && i < t.len; j++) {
+                t.launches[i++] = first + j;
+            }
+        } else {
+            t.launches[i++] = rand() % 4;
+        }
+    }
+    return t;
+}
+
+static trace_t trace_file(const char *filename)
+{
+    trace_t t = {.name = filename};
+    char line[256];
+    size_t capacity = 0;
+
+    FILE *f = fopen(filename, "r");
+    if (!f) {
+        fprintf(stderr, "cannot read %s\n", filename);
+        exit(2);
+    }
+    t.apps = malloc(MAX_APPS * sizeof(char *));
+    t.sizes = malloc(MAX_APPS * sizeof(size_t));
+    assert(t.apps != NULL && t.sizes != NULL);
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *tab = strchr(line, '\t');
+        size_t size = 0;
+        if (tab) {
+            *tab = '\0';
+            size = strtoul(tab + 1, NULL, 10);
+        }
+        if (!line[0]) {
+            continue;
+        }
+        size_t app = 0;
+        while (app < t.app_count && strcmp(t.apps[app], line) != 0) {
+            app++;
+        }
+        if (app == t.app_count) {
+            if (t.app_count == MAX_APPS) {
+                fprintf(stderr, "more than %d apps in %s\n", MAX_APPS, filename);
+                exit(2);
+            }
+            t.sizes[t.app_count] = size ? size : random_size();
+            t.apps[t.app_count++] = strdup(line);
+        }
+        if (t.len == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            t.launches = realloc(t.launches, capacity * sizeof(int));
+            assert(t.launches != NULL);
+        }
+        t.launches[t.len++] = app;
+    }
+    fclose(f);
+    return t;
+}
+
+/* the candidate whose app is launched again last, or never */
+static int victim_optimal(const trace_t *t, size_t pos, const int *held, const bool *candidates)
+{
+    int victim = 0;
+    size_t furthest = 0;
+    for (int i = 0; i < APP_SLOT_COUNT; i++) {
+        if (!candidates[i]) {
+            continue;
+        }
+        size_t next = pos + 1;
+        while (next < t->len && t->launches[next] != held[i]) {
+            next++;
+        }
+        if (next > furthest) {
+            furthest = next;
+            victim = i + 1;
+        }
+    }
+    return victim;
+}
+
+static int replay_victim(const bool *candidates, void *arg)
+{
+    replay_t *r = (replay_t *)arg;
+    return r->policy ? app_slots_victim(r->table, r->policy, candidates) :
+           victim_optimal(r->t, r->pos, r->held, candidates);
+}
+
+/* a flash copy, all that matters here is how much */
+static bool replay_move(struct app_store_t *store, int slot, uint32_t offset, void *arg)
+{
+    replay_t *r = (replay_t *)arg;
+    struct app_store_entry_t *e = &store->entries[slot - 1];
+    r->moved += app_store_extent(e->binary_len);
+    e->offset = offset;
+    e->size = app_store_region(store, offset);
+    return true;
+}
+
+/* the six 2M partitions: an app fits in any or in none */
+static result_t replay_fixed(const trace_t *t, const app_slot_policy_t *policy)
+{
+    struct app_slot_table_t table;
+    int held[APP_SLOT_COUNT];
+    bool candidates[APP_SLOT_COUNT] = {false};
+    result_t result = {0};
+    replay_t r = {.t = t, .policy = policy, .table = &table, .held = held};
+
+    memset(&table, 0, sizeof(table));
+    for (int i = 0; i < APP_SLOT_COUNT; i++) {
+        held[i] = -1;
+    }
+
+    for (size_t pos = 0; pos < t->len; pos++) {
+        int app = t->launches[pos];
+        int slot = 0, free_slot = 0, resident = 0;
+        for (int i = 0; i < LEGACY_SLOTS; i++) {
+            slot = !slot && held[i] == app ? i + 1 : slot;
+            free_slot = !free_slot && held[i] < 0 ? i + 1 : free_slot;
+            resident += held[i] >= 0;
+            candidates[i] = true;
+        }
+        result.resident += resident;
+
+        if (!slot) {
+            result.installs += 1;
+            if (t->sizes[app] > LEGACY_SLOT_SIZE) {
+                result.failed += 1;
+                continue;
+            }
+            r.pos = pos;
+            slot = free_slot ? free_slot : replay_victim(candidates, &r);
+        }
+
+        held[slot - 1] = app;
+        app_slots_launch(&table, slot, t->apps[app]);
+    }
+    return result;
+}
+
+/* the regions, as app_run and app_install use them */
+static result_t replay_pool(const trace_t *t, const app_slot_policy_t *policy)
+{
+    struct app_slot_table_t table;
+    struct app_store_t store;
+    int held[APP_SLOT_COUNT];
+    result_t result = {0};
+    replay_t r = {.t = t, .policy = policy, .table = &table, .held = held};
+
+    memset(&table, 0, sizeof(table));
+    app_store_init(&store, s_regions, s_region_count);
+    for (int i = 0; i < APP_SLOT_COUNT; i++) {
+        held[i] = -1;
+    }
+
+    for (size_t pos = 0; pos < t->len; pos++) {
+        int app = t->launches[pos];
+        int slot = app_store_find(&store, t->apps[app]);
+        for (int i = 0; i < APP_SLOT_COUNT; i++) {
+            result.resident += held[i] >= 0;
+        }
+        r.pos = pos;
+
+        if (!slot) {
+            result.installs += 1;
+            slot = app_store_free_slot(&store);
+            if (!slot) {
+                bool named[APP_SLOT_COUNT];
+                for (int i = 0; i < APP_SLOT_COUNT; i++) {
+                    named[i] = held[i] >= 0;
+                }
+                slot = replay_victim(named, &r);
+            }
+
+            bool evicted[APP_STORE_SLOTS] = {false};
+            bool placed = app_store_place(&store, slot, t->sizes[app], evicted,
+                    replay_victim, &r, replay_move, &r);
+            for (int i = 0; i < APP_STORE_SLOTS; i++) {
+                held[i] = evicted[i] ? -1 : held[i];
+            }
+            held[slot - 1] = -1;
+            if (!placed) {
+                result.failed += 1;
+                continue;
+            }
+            store.entries[slot - 1].binary_len = t->sizes[app];
+            snprintf(store.entries[slot - 1].name, APP_STORE_NAME_LEN, "%s", t->apps[app]);
+        }
+
+        held[slot - 1] = app;
+        app_slots_launch(&table, slot, t->apps[app]);
+    }
+    result.moved = r.moved;
+    return result;
+}
+
+static void print_row(const char *name, const char *scheme, const trace_t *traces, size_t trace_count,
+        const app_slot_policy_t *policy)
+{
+    char label[32];
+    snprintf(label, sizeof(label), "%s %s", name, scheme);
+    printf("%-16s", label);
+    for (size_t i = 0; i < trace_count; i++) {
+        const trace_t *t = &traces[i];
+        result_t r = strcmp(scheme, "6x2M") == 0 ? replay_fixed(t, policy) : replay_pool(t, policy);
+        double len = t->len ? t->len : 1;
+        printf(" %6.1f%% %5.1f%% %4.1f %6.1f", 100.0 * r.installs / len, 100.0 * r.failed / len,
+               r.resident / len, r.moved / 1048576.0 * 1000 / len);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const app_slot_policy_t *policies[] = {
+        &app_slot_policy_lru,
+        &app_slot_policy_lru2,
+        &app_slot_policy_weighted,
+        NULL,
+    };
+    trace_t traces[8];
+    size_t trace_count = 0;
+    int opt;
+
+    srand(1);
+    while ((opt = getopt(argc, argv, "n:r:t:")) != -1) {
+        switch (opt) {
+            case 'n':
+                s_len = strtol(optarg, NULL, 10);
+                break;
+            case 'r':
+                s_region_count = 0;
+                for (char *k = strtok(optarg, ","); k && s_region_count < APP_STORE_SLOTS; k = strtok(NULL, ",")) {
+                    s_regions[s_region_count++] = app_store_extent(strtoul(k, NULL, 10) * K);
+                }
+                break;
+            case 't':
+                if (trace_count < sizeof(traces) / sizeof(traces[0])) {
+                    traces[trace_count++] = trace_file(optarg);
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n launches] [-r K,K,...] [-t trace]...\n", argv[0]);
+                return 2;
+        }
+    }
+    if (trace_count == 0) {
+        if (s_len == 0) {
+            fprintf(stderr, "a trace needs launches\n");
+            return 2;
+        }
+        traces[trace_count++] = trace_daily();
+        traces[trace_count++] = trace_zipf();
+        traces[trace_count++] = trace_phases();
+        traces[trace_count++] = trace_browse();
+    }
+
+    printf("%-16s", "");
+    for (size_t i = 0; i < trace_count; i++) {
+        printf(" %-28.28s", traces[i].name);
+    }
+    printf("\n%-16s", "");
+    for (size_t i = 0; i < trace_count; i++) {
+        printf(" %7s %6s %4s %6s", "install", "failed", "apps", "MB/1k");
+    }
+    printf("\n");
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+        const char *name = policies[p] ? policies[p]->name : "optimal";
+        print_row(name, "6x2M", traces, trace_count, policies[p]);
+        print_row(name, "pool", traces, trace_count, policies[p]);
+    }
+    printf("default policy: %s\n", app_slot_policy->name);
+    return 0;
+}
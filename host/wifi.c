@@ -0,0 +1,135 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_wifi.h"
+#include "wifi.h"
+
+/* Wi-Fi stand-in that replays a fixed set of scan results. */
+
+static const wifi_ap_record_t s_canned[] = {
+    { .bssid = {0x02, 0, 0, 0, 0, 1}, .ssid = "HomeNetwork", .primary = 1, .rssi = -48, .authmode = WIFI_AUTH_WPA2_PSK },
+    { .bssid = {0x02, 0, 0, 0, 0, 2}, .ssid = "CoffeeShop", .primary = 6, .rssi = -71, .authmode = WIFI_AUTH_OPEN },
+    { .bssid = {0x02, 0, 0, 0, 0, 3}, .ssid = "Neighbor-5G", .primary = 11, .rssi = -83, .authmode = WIFI_AUTH_WPA_WPA2_PSK },
+    { .bssid = {0x02, 0, 0, 0, 0, 4}, .ssid = "Office", .primary = 3, .rssi = -60, .authmode = WIFI_AUTH_WPA2_PSK },
+    { .bssid = {0x02, 0, 0, 0, 0, 5}, .ssid = "Printer", .primary = 6, .rssi = -90, .authmode = WIFI_AUTH_WEP },
+};
+
+wifi_network_t **wifi_networks = NULL;
+size_t wifi_network_count = 0;
+
+static wifi_state_t s_state = WIFI_STATE_DISCONNECTED;
+static size_t s_scan_pos = sizeof(s_canned) / sizeof(s_canned[0]);
+static wifi_scan_done_callback_t s_scan_done = NULL;
+static void *s_scan_done_arg = NULL;
+static wifi_ap_record_t s_connected;
+
+
+void wifi_init(void)
+{
+}
+
+void wifi_enable(void)
+{
+    s_state = WIFI_STATE_DISCONNECTED;
+}
+
+void wifi_disable(void)
+{
+    s_state = WIFI_STATE_DISABLED;
+}
+
+wifi_state_t wifi_get_state(void)
+{
+    return s_state;
+}
+
+ip4_addr_t wifi_get_ip(void)
+{
+    ip4_addr_t ip = { .addr = 0x0a01a8c0 };
+    return ip;
+}
+
+size_t wifi_network_add(wifi_network_t *network)
+{
+    size_t i;
+    for (i = 0; i < wifi_network_count; i++) {
+        if (strcasecmp(network->ssid, wifi_networks[i]->ssid) < 0) {
+            break;
+        }
+    }
+    wifi_networks = realloc(wifi_networks, sizeof(wifi_network_t *) * (wifi_network_count + 1));
+    assert(wifi_networks != NULL);
+    memmove(&wifi_networks[i + 1], &wifi_networks[i], sizeof(wifi_network_t *) * (wifi_network_count - i));
+    wifi_networks[i] = malloc(sizeof(wifi_network_t));
+    assert(wifi_networks[i] != NULL);
+    memcpy(wifi_networks[i], network, sizeof(wifi_network_t));
+    wifi_network_count += 1;
+    return i;
+}
+
+int wifi_network_delete(wifi_network_t *network)
+{
+    int i;
+    for (i = 0; i < wifi_network_count; i++) {
+        if (wifi_networks[i] == network) {
+            break;
+        }
+    }
+    if (i >= wifi_network_count) {
+        return -1;
+    }
+    free(wifi_networks[i]);
+    memmove(&wifi_networks[i], &wifi_networks[i + 1], sizeof(wifi_network_t *) * (wifi_network_count - i - 1));
+    wifi_network_count -= 1;
+    return i;
+}
+
+void wifi_connect_network(wifi_network_t *network)
+{
+    memset(&s_connected, 0, sizeof(s_connected));
+    snprintf((char *)s_connected.ssid, sizeof(s_connected.ssid), "%s", network->ssid);
+    s_connected.primary = 1;
+    s_connected.rssi = -50;
+    s_state = WIFI_STATE_CONNECTED;
+}
+
+void wifi_register_scan_done_callback(wifi_scan_done_callback_t callback, void *arg)
+{
+    s_scan_done = callback;
+    s_scan_done_arg = arg;
+}
+
+void wifi_backup_config(void)
+{
+}
+
+void wifi_restore_config(void)
+{
+}
+
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *config, bool block)
+{
+    s_scan_pos = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *records)
+{
+    uint16_t n = 0;
+    while (n < *number && s_scan_pos < sizeof(s_canned) / sizeof(s_canned[0])) {
+        records[n++] = s_canned[s_scan_pos++];
+    }
+    *number = n;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *info)
+{
+    if (s_state != WIFI_STATE_CONNECTED) {
+        return ESP_FAIL;
+    }
+    *info = s_connected;
+    return ESP_OK;
+}
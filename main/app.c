@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <dirent.h>
 #include <limits.h>
 #include <stdbool.h>
@@ -8,32 +9,143 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
 #include "esp_ota_ops.h"
 #include "esp_partition.h"
 #include "esp_system.h"
-#include "nvs_flash.h"
+#include "esp_timer.h"
 
 #include "app.h"
-#include "frozen.h"
+#include "app_data.h"
+#include "app_file.h"
+#include "app_flash.h"
+#include "app_icons.h"
+#include "app_manifest.h"
+#include "app_slots.h"
+#include "app_store.h"
 #include "sdcard.h"
+#include "trace.h"
 
 
-#define NUM_OTA_PARTITIONS (6)
+#define NUM_OTA_PARTITIONS (APP_STORE_SLOTS)
 #define APP_DIR "/sdcard/apps"
-#define APPDATA_DIR "/spiffs/appdata"
-#define APP_HEADER_MAGIC (0x21505041)
-#define APP_HEADER_VERSION (1)
-#define APP_ICON_LEN (48 * 48 * 2)
+#define CATALOG_FILE APP_DATA_DIR "/catalog.idx"
+#define CATALOG_MAGIC (0x21474c43)
+#define CATALOG_VERSION (3)
+#define CATALOG_NONE (UINT32_MAX)
+#define CATALOG_UNKNOWN (UINT32_MAX - 1)
+#define SCAN_QUEUE_LENGTH (32)
+#define SLOT_RECORD_MAGIC (0x21414853)
+
+/*
+ * What a region holds: the binary of an .app file as the file was when
+ * it was installed. It is the first section of the slot's appdata, which
+ * goes with the region.
+ */
+struct slot_record_t {
+    uint32_t magic;
+    uint32_t binary_len;
+    uint32_t size;
+    uint32_t mtime;
+    uint8_t sha256[APP_FLASH_SHA256_LEN];
+    char name[256];
+};
+
+/* one app of an install batch */
+struct install_t {
+    const char *name;
+    int slot;
+    char filename[PATH_MAX];
+    FILE *app;
+    struct stat st;
+    struct slot_record_t record;
+    /* the binary, and where it goes */
+    app_flash_job_t job;
+    /* of the batch's binaries before this one */
+    size_t base;
+    bool reserved;
+    /* the region already holds the binary */
+    bool holds;
+    bool ok;
+};
 
-struct app_header_t {
+struct install_batch_t {
+    struct install_t *installs;
+    size_t count;
+    /* the slots of the batch, which no app of it evicts */
+    bool taken[APP_STORE_SLOTS];
+    struct app_slot_table_t table;
+    /* the binaries to copy, and whose they are */
+    app_flash_job_t *copies;
+    struct install_t **jobs;
+    /* what goes to the slot table */
+    int *slots;
+    const char **names;
+    size_t done;
+    size_t total;
+    size_t written;
+    app_progress_cb_t progress;
+    void *arg;
+};
+
+/*
+ * The catalog keeps what app_enumerate needs to know about every .app file
+ * and every slot, so a file is only opened again when its size or mtime
+ * changed and appN.json only when the slot changed hands. It stays in RAM
+ * and is mirrored to SPIFFS as: header, slots, entries, string arena.
+ */
+struct catalog_header_t {
     uint32_t magic;
     uint32_t version;
-    uint32_t header_len;
-    uint32_t json_len;
-    uint32_t icon_len;
-    uint32_t binary_len;
+    uint32_t count;
+    uint32_t arena_len;
 };
 
+/* strings are offsets into the arena, CATALOG_NONE when missing or invalid;
+ * the version of a file is only read, and then kept, once it is installed.
+ * version_key is that version parsed, for comparing */
+struct catalog_entry_t {
+    uint32_t size;
+    uint32_t mtime;
+    uint32_t name;
+    uint32_t version;
+    app_version_t version_key;
+};
+
+struct catalog_slot_t {
+    uint32_t name;
+    uint32_t version;
+    app_version_t version_key;
+};
+
+struct catalog_t {
+    struct catalog_slot_t slots[NUM_OTA_PARTITIONS];
+    struct catalog_entry_t *entries;
+    size_t count;
+    size_t entries_size;
+    char *arena;
+    size_t arena_len;
+    size_t arena_size;
+    int next_slot;
+};
+
+typedef bool (*catalog_emit_t)(const struct app_info_t *info, void *arg);
+
+struct app_scan_t {
+    QueueHandle_t queue;
+    SemaphoreHandle_t done;
+    volatile bool cancel;
+    volatile bool finished;
+};
+
+static struct catalog_t s_catalog;
+static bool s_catalog_loaded = false;
+static SemaphoreHandle_t s_catalog_mutex = NULL;
+
 
 static bool endswith(const char *str, const char *suffix)
 {
@@ -50,176 +162,94 @@ static void remove_end(char *str, size_t count)
     *(str + lenstr - count) = '\0';
 }
 
-static int cmp_app_info(const void *a, const void *b)
+/* the manifest of an .app file, read a chunk at a time */
+static bool app_manifest_read(const char *filename, struct app_manifest_t *manifest)
 {
-    struct app_info_t *aa = (struct app_info_t *)a;
-    struct app_info_t *bb = (struct app_info_t *)b;
-    return strcasecmp(aa->name, bb->name);
-}
-
-static char *app_json_fread(char *filename)
-{
-    char *json;
     FILE *f = fopen(filename, "rb");
     struct app_header_t header;
-    if (fread(&header, sizeof(struct app_header_t), 1, f) != 1 ||
-            header.magic != APP_HEADER_MAGIC ||
-            header.version != APP_HEADER_VERSION) {
+    app_section_t *section;
+    app_manifest_parser_t parser;
+    char buf[128];
+
+    if (!f) {
+        return false;
+    }
+    if (!app_header_read(f, &header) ||
+            !(section = app_section_open(f, &header, APP_SECTION_JSON))) {
         fclose(f);
-        return NULL;
+        return false;
     }
 
-    json = malloc(header.json_len + 1);
-    if (!json) return NULL;
-    if (fread(json, header.json_len, 1, f) != 1) {
-        fclose(f);
-        free(json);
-        return NULL;
+    bool ok = true;
+    app_manifest_begin(&parser, manifest);
+    for (size_t pos = 0; ok && pos < header.json_len; pos += sizeof(buf)) {
+        size_t n = header.json_len - pos < sizeof(buf) ? header.json_len - pos : sizeof(buf);
+        ok = app_section_read(section, buf, n) && app_manifest_feed(&parser, buf, n);
     }
-    json[header.json_len] = '\0';
+    app_section_close(section);
     fclose(f);
-    return json;
-}
-
-/* when comparison fails, right is considered newer */
-static int versioncmp(const char *left, const char *right)
-{
-    int lmajor = 0, lminor = 0, lpatch = 0;
-    int rmajor = 0, rminor = 0, rpatch = 0;
-    char *lpre = NULL, *rpre = NULL;
-
-    bool l_semver = !!strchr(left, '.');
-    bool r_semver = !!strchr(right, '.');
-
-    if (!l_semver && !r_semver) {
-        return strcmp(left, right);
-    } else if (l_semver && r_semver) {
-        char *ls = strdup(left);
-        char *rs = strdup(right);
-        if (ls == NULL || rs == NULL) abort();
-
-        char *rest = ls;
-        char *p = strtok_r(rest, ".", &rest);
-        if (p) {
-            lmajor = strtol(p, NULL, 10);
-            p = strtok_r(rest, ".", &rest);
-            if (p) {
-                lminor = strtol(p, NULL, 10);
-                p = strtok_r(rest, "-+", &rest);
-                if (p) {
-                    lpatch = strtol(p, NULL, 10);
-                    lpre = strtok_r(rest, "+", &rest);
-                }
-            }
-        }
-
-        rest = rs;
-        p = strtok_r(rest, ".", &rest);
-        if (p) {
-            rmajor = strtol(p, NULL, 10);
-            p = strtok_r(rest, ".", &rest);
-            if (p) {
-                rminor = strtol(p, NULL, 10);
-                p = strtok_r(rest, "-+", &rest);
-                if (p) {
-                    rpatch = strtol(p, NULL, 10);
-                    rpre = strtok_r(rest, "+", &rest);
-                }
-            }
-        }
-
-        int cmp = (lmajor > rmajor) - (lmajor < rmajor);
-        if (cmp) {
-            goto semver_done;
-        }
-
-        cmp = (lminor > rminor) - (lminor < rminor);
-        if (cmp) {
-            goto semver_done;
-        }
-
-        cmp = (lpatch > rpatch) - (lpatch < rpatch);
-        if (cmp) {
-            goto semver_done;
-        }
-
-        if (lpre && !rpre) {
-            cmp = -1;
-            goto semver_done;
-        } else if (!lpre && rpre) {
-            cmp = 1;
-            goto semver_done;
-        } else if (lpre && rpre) {
-            cmp = strcmp(lpre, rpre);
-            goto semver_done;
-        }
+    return ok && app_manifest_end(&parser);
+}
 
-semver_done:
-        free(ls);
-        free(rs);
-        return cmp;
-    } else {
-        return -1;
+/* the manifest installed with slot, in appdata */
+static bool slot_manifest_read(int slot, struct app_manifest_t *manifest)
+{
+    size_t len;
+    FILE *f = app_data_open(slot, APP_DATA_JSON, &len);
+    if (!f) {
+        return false;
     }
+    bool ok = app_manifest_fread(manifest, f, len);
+    fclose(f);
+    return ok;
 }
 
-static void update_mru(nvs_handle nvs, int slot)
+/* the slot an app that is not installed goes to: a free one, or the one
+ * the slot policy gives up; taken, when set, are slots it cannot have */
+static int pick_slot(const bool *occupied, const bool *taken)
 {
-    char mru[NUM_OTA_PARTITIONS + 1];
+    bool candidates[NUM_OTA_PARTITIONS];
     for (int i = 0; i < NUM_OTA_PARTITIONS; i++) {
-        mru[i] = '1' + i;
-    }
-    size_t len = sizeof(mru);
-    nvs_get_str(nvs, "mru", mru, &len);
-    char *p = strchr(mru, '0' + slot);
-    len = strlen(mru);
-    if (p) {
-        memmove(p, p + 1, len - (p - mru));
-        mru[len - 1] = '0' + slot;
-    } else {
-        mru[len] = '0' + slot;
+        if (!occupied[i] && !(taken && taken[i])) {
+            return i + 1;
+        }
+        candidates[i] = occupied[i] && !(taken && taken[i]);
     }
-    ESP_ERROR_CHECK(nvs_set_str(nvs, "mru", mru));
+
+    struct app_slot_table_t table;
+    app_slots_snapshot(&table);
+    return app_slots_victim(&table, app_slot_policy, candidates);
 }
 
-int app_get_slot(const char *name, bool *installed)
+/* 0 when the slot of an installed app is taken */
+static int find_slot(const char *name, const bool *taken, bool *installed)
 {
     int slot;
     if (installed) {
         *installed = false;
     }
 
-    nvs_handle nvs;
-    ESP_ERROR_CHECK(nvs_open("nvs", NVS_READWRITE, &nvs));
-
+    bool occupied[NUM_OTA_PARTITIONS] = {false};
     for (slot = 1; slot <= NUM_OTA_PARTITIONS; slot++) {
-        char key[5], value[256];
-        size_t len = sizeof(value);
-        snprintf(key, sizeof(key), "app%d", slot);
-        if (nvs_get_str(nvs, key, value, &len) != ESP_OK) {
+        char value[APP_STORE_NAME_LEN];
+        if (!app_store_name(slot, value, sizeof(value))) {
             continue;
         }
+        occupied[slot - 1] = true;
         if (strcmp(name, value) == 0) {
             if (installed) {
                 *installed = true;
             }
-            goto end;
+            return taken && taken[slot - 1] ? 0 : slot;
         }
     }
 
-    char mru[NUM_OTA_PARTITIONS + 1];
-    for (int i = 0; i < NUM_OTA_PARTITIONS; i++) {
-        mru[i] = '1' + i;
-    }
-    mru[NUM_OTA_PARTITIONS] = '\0';
-    size_t len = sizeof(mru);
-    nvs_get_str(nvs, "mru", mru, &len);
-
-    slot = mru[0] - '0';
+    return pick_slot(occupied, taken);
+}
 
-end:
-    nvs_close(nvs);
-    return slot;
+int app_get_slot(const char *name, bool *installed)
+{
+    return find_slot(name, NULL, installed);
 }
 
 void app_info(const char *name, struct app_info_t *info)
@@ -236,298 +266,1019 @@ void app_info(const char *name, struct app_info_t *info)
     info->available = stat(filename, &st) == 0;
 
     if (info->installed && info->available) {
+        struct app_manifest_t sdcard, installed;
+
         /* first get sdcard version */
-        char *json = app_json_fread(filename);
-        if (json == NULL) {
-            info->available = false;
-            return;
-        }
-        char *sdcard_version;
-        json_scanf(json, strlen(json), "{version: %Q}", &sdcard_version);
-        free(json);
-        if (sdcard_version == NULL) {
+        if (!app_manifest_read(filename, &sdcard) || sdcard.version == APP_MANIFEST_NONE) {
             info->available = false;
             return;
         }
 
         /* then get the installed version */
-        snprintf(filename, sizeof(filename), "%s/app%d.json", APPDATA_DIR, info->slot_num);
-        json = json_fread(filename);
-        if (json == NULL) {
-            free(sdcard_version);
-            info->installed = false;
-            return;
-        }
-        char *installed_version;
-        json_scanf(json, strlen(json), "{version: %Q}", &installed_version);
-        free(json);
-        if (installed_version == NULL) {
-            free(sdcard_version);
+        if (!slot_manifest_read(info->slot_num, &installed) || installed.version == APP_MANIFEST_NONE) {
             info->installed = false;
             return;
         }
 
         /* and compare them */
-        if (versioncmp(installed_version, sdcard_version) < 0) {
-            free(installed_version);
-            free(sdcard_version);
-            info->upgradable = true;
-            return;
+        info->upgradable = app_version_cmp(&installed.version_key, &sdcard.version_key) < 0;
+    }
+}
+
+static uint32_t catalog_add_string(struct catalog_t *c, const char *str)
+{
+    if (!str) {
+        return CATALOG_NONE;
+    }
+
+    size_t len = strlen(str) + 1;
+    if (c->arena_len + len > c->arena_size) {
+        c->arena_size = c->arena_size ? c->arena_size * 2 : 4096;
+        while (c->arena_len + len > c->arena_size) {
+            c->arena_size *= 2;
         }
-        free(installed_version);
-        free(sdcard_version);
+        c->arena = realloc(c->arena, c->arena_size);
+        assert(c->arena != NULL);
     }
 
-    return;
+    uint32_t offset = c->arena_len;
+    memcpy(c->arena + offset, str, len);
+    c->arena_len += len;
+    return offset;
 }
 
-struct app_info_t *app_enumerate(size_t *count)
+static const char *catalog_string(const struct catalog_t *c, uint32_t offset)
+{
+    return offset >= CATALOG_UNKNOWN ? NULL : c->arena + offset;
+}
+
+static void catalog_add_entry(struct catalog_t *c, const char *name, const struct stat *st, uint32_t version,
+        const app_version_t *version_key)
+{
+    if (c->count == c->entries_size) {
+        c->entries_size = c->entries_size ? c->entries_size * 2 : 64;
+        c->entries = realloc(c->entries, c->entries_size * sizeof(struct catalog_entry_t));
+        assert(c->entries != NULL);
+    }
+
+    struct catalog_entry_t *e = &c->entries[c->count++];
+    e->size = st->st_size;
+    e->mtime = st->st_mtime;
+    e->name = catalog_add_string(c, name);
+    e->version = version;
+    e->version_key = *version_key;
+}
+
+static void catalog_free(struct catalog_t *c)
+{
+    free(c->entries);
+    free(c->arena);
+    memset(c, 0, sizeof(struct catalog_t));
+}
+
+/* entries are kept in list order, case-insensitive with a tie breaker */
+static int cmp_names(const char *a, const char *b)
+{
+    int cmp = strcasecmp(a, b);
+    return cmp ? cmp : strcmp(a, b);
+}
+
+static const char *s_sort_arena;
+
+static int cmp_catalog_entry(const void *a, const void *b)
+{
+    const struct catalog_entry_t *aa = a;
+    const struct catalog_entry_t *bb = b;
+    return cmp_names(s_sort_arena + aa->name, s_sort_arena + bb->name);
+}
+
+static struct catalog_entry_t *catalog_find(const struct catalog_t *c, const char *name)
+{
+    size_t lo = 0, hi = c->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = cmp_names(name, c->arena + c->entries[mid].name);
+        if (cmp == 0) {
+            return &c->entries[mid];
+        } else if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+static bool catalog_load(struct catalog_t *c)
+{
+    struct catalog_header_t header;
+    struct stat st;
+    FILE *f = fopen(CATALOG_FILE, "rb");
+    if (!f) {
+        return false;
+    }
+
+    if (fstat(fileno(f), &st) != 0 ||
+            fread(&header, sizeof(header), 1, f) != 1 ||
+            header.magic != CATALOG_MAGIC ||
+            header.version != CATALOG_VERSION ||
+            fread(c->slots, sizeof(c->slots), 1, f) != 1) {
+        goto error;
+    }
+
+    /* the sizes are only believed if the rest of the file is exactly that
+     * long, so a damaged header cannot ask for more than is there */
+    size_t left = st.st_size - sizeof(header) - sizeof(c->slots);
+    if (st.st_size < (off_t)(sizeof(header) + sizeof(c->slots)) ||
+            header.count > left / sizeof(struct catalog_entry_t) ||
+            header.arena_len != left - header.count * sizeof(struct catalog_entry_t)) {
+        goto error;
+    }
+
+    c->entries_size = header.count;
+    c->arena_size = header.arena_len;
+    c->entries = malloc(header.count * sizeof(struct catalog_entry_t) + 1);
+    c->arena = malloc(header.arena_len + 1);
+    if (!c->entries || !c->arena) {
+        goto error;
+    }
+
+    if (fread(c->entries, sizeof(struct catalog_entry_t), header.count, f) != header.count ||
+            fread(c->arena, 1, header.arena_len, f) != header.arena_len) {
+        goto error;
+    }
+    c->count = header.count;
+    c->arena_len = header.arena_len;
+
+    /* a damaged file must not send us outside the arena */
+    for (size_t i = 0; i < c->count; i++) {
+        struct catalog_entry_t *e = &c->entries[i];
+        if (e->name >= c->arena_len ||
+                (e->version < CATALOG_UNKNOWN && e->version >= c->arena_len)) {
+            goto error;
+        }
+    }
+    for (int i = 0; i < NUM_OTA_PARTITIONS; i++) {
+        struct catalog_slot_t *slot = &c->slots[i];
+        if ((slot->name != CATALOG_NONE && slot->name >= c->arena_len) ||
+                (slot->version != CATALOG_NONE && slot->version >= c->arena_len)) {
+            goto error;
+        }
+    }
+    if (c->arena_len > 0 && c->arena[c->arena_len - 1] != '\0') {
+        goto error;
+    }
+
+    fclose(f);
+    return true;
+
+error:
+    fclose(f);
+    catalog_free(c);
+    return false;
+}
+
+static void catalog_save(const struct catalog_t *c)
+{
+    struct catalog_header_t header = {
+        .magic = CATALOG_MAGIC,
+        .version = CATALOG_VERSION,
+        .count = c->count,
+        .arena_len = c->arena_len,
+    };
+
+    FILE *f = fopen(CATALOG_FILE, "wb");
+    if (!f) {
+        return;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+            fwrite(c->slots, sizeof(c->slots), 1, f) != 1 ||
+            fwrite(c->entries, sizeof(struct catalog_entry_t), c->count, f) != c->count ||
+            fwrite(c->arena, 1, c->arena_len, f) != c->arena_len) {
+        fclose(f);
+        unlink(CATALOG_FILE);
+        return;
+    }
+    fclose(f);
+}
+
+/* the version of a manifest that was read, or CATALOG_NONE */
+static uint32_t catalog_add_version(struct catalog_t *c, const struct app_manifest_t *manifest, bool read,
+        app_version_t *key)
 {
-    struct app_info_t *info = NULL;
-    *count = 0;
+    memset(key, 0, sizeof(app_version_t));
+    if (!read || manifest->version == APP_MANIFEST_NONE) {
+        return CATALOG_NONE;
+    }
+    *key = manifest->version_key;
+    return catalog_add_string(c, app_manifest_string(manifest, manifest->version));
+}
+
+/* same result as app_info, from a catalog */
+static void catalog_info(const struct catalog_t *c, const char *name, const struct catalog_entry_t *e, struct app_info_t *info)
+{
+    const struct catalog_slot_t *slot = NULL;
 
-    /* first find all apps in flash */
-    nvs_handle nvs;
-    ESP_ERROR_CHECK(nvs_open("nvs", NVS_READWRITE, &nvs));
+    memset(info, 0, sizeof(struct app_info_t));
+    strncpy(info->name, name, sizeof(info->name) - 1);
+    info->slot_num = c->next_slot;
+    info->available = e != NULL;
 
     for (int i = 0; i < NUM_OTA_PARTITIONS; i++) {
-        char key[5], value[256];
-        size_t len = sizeof(value);
+        const char *slot_name = catalog_string(c, c->slots[i].name);
+        if (slot_name && strcmp(slot_name, name) == 0) {
+            slot = &c->slots[i];
+            info->slot_num = i + 1;
+            info->installed = true;
+            break;
+        }
+    }
+
+    if (info->installed && info->available) {
+        if (e->version >= CATALOG_UNKNOWN) {
+            info->available = false;
+        } else if (slot->version >= CATALOG_UNKNOWN) {
+            info->installed = false;
+        } else {
+            info->upgradable = app_version_cmp(&slot->version_key, &e->version_key) < 0;
+        }
+    }
+}
+
+/* adds the file to c, reusing what old knows about it while its size and
+ * mtime are unchanged; the version is read when needed and not known */
+static struct catalog_entry_t *catalog_update_entry(struct catalog_t *c, const struct catalog_t *old,
+        const char *name, const struct stat *st, bool need_version, bool *reused)
+{
+    char filename[PATH_MAX];
+    uint32_t version = CATALOG_UNKNOWN;
+    app_version_t version_key = {0};
+
+    struct catalog_entry_t *e = catalog_find(old, name);
+    *reused = e && e->size == (uint32_t)st->st_size && e->mtime == (uint32_t)st->st_mtime;
+    if (*reused && e->version < CATALOG_UNKNOWN) {
+        version = catalog_add_string(c, old->arena + e->version);
+        version_key = e->version_key;
+    } else if (*reused) {
+        version = e->version;
+    }
+
+    if (need_version && version == CATALOG_UNKNOWN) {
+        struct app_manifest_t manifest;
+        snprintf(filename, sizeof(filename), "%s/%s.app", APP_DIR, name);
+        bool read = app_manifest_read(filename, &manifest);
+        version = catalog_add_version(c, &manifest, read, &version_key);
+        *reused = false;
+    }
+
+    catalog_add_entry(c, name, st, version, &version_key);
+    return &c->entries[c->count - 1];
+}
+
+/*
+ * Brings the catalog up to date with NVS and the apps directory, opening
+ * only the files that are new or changed. Installed apps are handled
+ * first, then the directory in its own order. Each app is passed to emit as
+ * soon as it is known; when emit returns false the refresh is abandoned
+ * and the catalog left as it was. The catalog lock is held by the caller.
+ */
+static bool catalog_refresh(catalog_emit_t emit, void *arg)
+{
+    struct catalog_t *old = &s_catalog;
+    struct catalog_t c;
+    struct app_info_t info;
+    bool changed = false;
+    bool reused;
+    size_t reused_count = 0;
+    char filename[PATH_MAX];
+
+    if (!s_catalog_loaded) {
+        memset(old, 0, sizeof(struct catalog_t));
+        if (!catalog_load(old)) {
+            for (int i = 0; i < NUM_OTA_PARTITIONS; i++) {
+                old->slots[i].name = CATALOG_NONE;
+            }
+        }
+        s_catalog_loaded = true;
+    }
+    memset(&c, 0, sizeof(c));
 
-        snprintf(key, sizeof(key), "app%d", i + 1);
-        if (nvs_get_str(nvs, key, value, &len) != ESP_OK) {
+    /* first the slots */
+    for (int i = 0; i < NUM_OTA_PARTITIONS; i++) {
+        char value[APP_STORE_NAME_LEN];
+        const char *old_name = catalog_string(old, old->slots[i].name);
+
+        if (!app_store_name(i + 1, value, sizeof(value))) {
+            c.slots[i].name = CATALOG_NONE;
+            c.slots[i].version = CATALOG_NONE;
+            memset(&c.slots[i].version_key, 0, sizeof(app_version_t));
+            changed |= old_name != NULL;
             continue;
         }
 
-        info = realloc(info, sizeof(struct app_info_t) * (*count + 1));
-        app_info(value, &info[*count]);
-        *count += 1;
+        c.slots[i].name = catalog_add_string(&c, value);
+        if (old_name && strcmp(old_name, value) == 0) {
+            c.slots[i].version = catalog_add_string(&c, catalog_string(old, old->slots[i].version));
+            c.slots[i].version_key = old->slots[i].version_key;
+        } else {
+            struct app_manifest_t manifest;
+            bool read = slot_manifest_read(i + 1, &manifest);
+            c.slots[i].version = catalog_add_version(&c, &manifest, read, &c.slots[i].version_key);
+            changed = true;
+        }
+    }
+
+    bool occupied[NUM_OTA_PARTITIONS];
+    for (int i = 0; i < NUM_OTA_PARTITIONS; i++) {
+        occupied[i] = c.slots[i].name != CATALOG_NONE;
     }
+    c.next_slot = pick_slot(occupied, NULL);
 
-    nvs_close(nvs);
+    /* then the installed apps, which need the version on the card to tell
+     * upgrades */
+    for (int i = 0; i < NUM_OTA_PARTITIONS; i++) {
+        const char *name = catalog_string(&c, c.slots[i].name);
+        if (!name) {
+            continue;
+        }
+
+        bool duplicate = false;
+        for (int j = 0; j < i; j++) {
+            const char *other = catalog_string(&c, c.slots[j].name);
+            duplicate |= other && strcmp(other, name) == 0;
+        }
+        if (duplicate) {
+            continue;
+        }
+
+        struct stat st;
+        struct catalog_entry_t *e = NULL;
+        snprintf(filename, sizeof(filename), "%s/%s.app", APP_DIR, name);
+        if (stat(filename, &st) == 0) {
+            /* name points into the arena, which may move */
+            snprintf(filename, sizeof(filename), "%s", name);
+            e = catalog_update_entry(&c, old, filename, &st, true, &reused);
+            reused_count += reused;
+            changed |= !reused;
+            name = catalog_string(&c, c.slots[i].name);
+        }
 
-    /* next list all files in the apps directory */
+        if (emit) {
+            catalog_info(&c, name, e, &info);
+            if (!emit(&info, arg)) {
+                goto abandon;
+            }
+        }
+    }
+
+    /* and the rest of the apps directory */
     DIR *dir;
     struct dirent entry;
     struct dirent *result;
 
-    if ((dir = opendir(APP_DIR)) == NULL) {
-        goto sort;
+    if ((dir = opendir(APP_DIR)) != NULL) {
+        while (readdir_r(dir, &entry, &result) == 0 && result != NULL) {
+            if (entry.d_type != DT_REG || !endswith(entry.d_name, ".app")) {
+                continue;
+            }
+
+            struct stat st;
+            snprintf(filename, sizeof(filename), "%s/%s", APP_DIR, entry.d_name);
+            remove_end(entry.d_name, 4);
+
+            bool installed = false;
+            for (int i = 0; i < NUM_OTA_PARTITIONS; i++) {
+                const char *slot_name = catalog_string(&c, c.slots[i].name);
+                installed |= slot_name && strcmp(slot_name, entry.d_name) == 0;
+            }
+            if (installed || stat(filename, &st) != 0) {
+                continue;
+            }
+
+            struct catalog_entry_t *e = catalog_update_entry(&c, old, entry.d_name, &st, false, &reused);
+            reused_count += reused;
+            changed |= !reused;
+
+            if (emit) {
+                catalog_info(&c, entry.d_name, e, &info);
+                if (!emit(&info, arg)) {
+                    closedir(dir);
+                    goto abandon;
+                }
+            }
+        }
+        closedir(dir);
+    }
+
+    /* files that were removed */
+    changed |= reused_count != old->count;
+
+    s_sort_arena = c.arena;
+    qsort(c.entries, c.count, sizeof(struct catalog_entry_t), cmp_catalog_entry);
+
+    catalog_free(old);
+    s_catalog = c;
+
+    if (changed) {
+        catalog_save(&s_catalog);
+    }
+    return true;
+
+abandon:
+    catalog_free(&c);
+    return false;
+}
+
+static SemaphoreHandle_t catalog_mutex(void)
+{
+    /* after BOOT_APPS, see apps_step in boot.c */
+    if (!s_catalog_mutex) {
+        s_catalog_mutex = xSemaphoreCreateMutex();
+        assert(s_catalog_mutex != NULL);
+    }
+    return s_catalog_mutex;
+}
+
+/* makes the next refresh read the slot again */
+static void catalog_forget_slot(int slot)
+{
+    xSemaphoreTake(catalog_mutex(), portMAX_DELAY);
+    if (s_catalog_loaded) {
+        s_catalog.slots[slot - 1].name = CATALOG_NONE;
     }
+    xSemaphoreGive(catalog_mutex());
+}
+
+struct app_info_t *app_enumerate(size_t *count)
+{
+    TRACE_BEGIN("app_enumerate");
+    xSemaphoreTake(catalog_mutex(), portMAX_DELAY);
+    catalog_refresh(NULL, NULL);
+
+    const struct catalog_t *c = &s_catalog;
+    const char *orphans[NUM_OTA_PARTITIONS];
+    size_t num_orphans = 0;
 
-    while (readdir_r(dir, &entry, &result) == 0 && result != NULL) {
-        if (entry.d_type != DT_REG || !endswith(entry.d_name, ".app")) {
+    /* installed apps without a file on the sdcard, in list order */
+    for (int i = 0; i < NUM_OTA_PARTITIONS; i++) {
+        const char *name = catalog_string(c, c->slots[i].name);
+        if (!name || catalog_find(c, name)) {
             continue;
         }
-        remove_end(entry.d_name, 4);
 
-        int i;
-        for (i = 0; i < *count; i++) {
-            if (strcmp(info[i].name, entry.d_name) == 0) {
-                break;
-            }
+        bool duplicate = false;
+        for (size_t j = 0; j < num_orphans; j++) {
+            duplicate |= strcmp(orphans[j], name) == 0;
         }
-
-        if (i < *count) {
+        if (duplicate) {
             continue;
         }
 
-        info = realloc(info, sizeof(struct app_info_t) * (*count + 1));
-        app_info(entry.d_name, &info[*count]);
-        *count += 1;
+        size_t j = num_orphans++;
+        while (j > 0 && cmp_names(name, orphans[j - 1]) < 0) {
+            orphans[j] = orphans[j - 1];
+            j--;
+        }
+        orphans[j] = name;
     }
 
-    closedir(dir);
+    /* merge both, already sorted, into one allocation */
+    *count = c->count + num_orphans;
+    struct app_info_t *info = malloc(sizeof(struct app_info_t) * (*count > 0 ? *count : 1));
+    assert(info != NULL);
+
+    size_t i = 0, j = 0;
+    while (i < c->count || j < num_orphans) {
+        const char *name = i < c->count ? c->arena + c->entries[i].name : NULL;
+        if (j < num_orphans && (!name || cmp_names(orphans[j], name) < 0)) {
+            catalog_info(c, orphans[j], NULL, &info[i + j]);
+            j++;
+        } else {
+            catalog_info(c, name, &c->entries[i], &info[i + j]);
+            i++;
+        }
+    }
 
-sort:
-    qsort(info, *count, sizeof(struct app_info_t), cmp_app_info);
+    xSemaphoreGive(catalog_mutex());
+    TRACE_END("app_enumerate");
     return info;
 }
 
-bool app_install(const char *name, int slot)
+static bool scan_emit(const struct app_info_t *info, void *arg)
 {
-    nvs_handle nvs = 0;
-    char key[5];
-    const esp_partition_t *part;
-    char filename[PATH_MAX];
-    FILE *app = NULL, *out = NULL;
-    char *buf = NULL;
-    struct app_header_t header;
-    esp_ota_handle_t ota_handle;
+    app_scan_t *scan = (app_scan_t *)arg;
 
-    assert(slot > 0 && slot <= NUM_OTA_PARTITIONS);
+    while (!scan->cancel) {
+        if (xQueueSend(scan->queue, info, 50/portTICK_PERIOD_MS) == pdTRUE) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    part = esp_partition_find_first(ESP_PARTITION_TYPE_APP,
-        ESP_PARTITION_SUBTYPE_APP_OTA_MIN + slot, NULL);
-    if (!part) {
-        goto error;
+static void scan_task(void *arg)
+{
+    app_scan_t *scan = (app_scan_t *)arg;
+
+    TRACE_BEGIN("app_scan");
+    xSemaphoreTake(catalog_mutex(), portMAX_DELAY);
+    catalog_refresh(scan_emit, scan);
+    xSemaphoreGive(catalog_mutex());
+    TRACE_END("app_scan");
+
+    scan->finished = true;
+    xSemaphoreGive(scan->done);
+    vTaskDelete(NULL);
+}
+
+/* enumerates the apps on a background task, installed apps first; the
+ * results are picked up with app_scan_receive */
+app_scan_t *app_scan_start(void)
+{
+    app_scan_t *scan = calloc(1, sizeof(app_scan_t));
+    assert(scan != NULL);
+    scan->queue = xQueueCreate(SCAN_QUEUE_LENGTH, sizeof(struct app_info_t));
+    scan->done = xSemaphoreCreateBinary();
+    assert(scan->queue != NULL && scan->done != NULL);
+
+    catalog_mutex();
+    xTaskCreate(scan_task, "scan", 8192, scan, 4, NULL);
+    return scan;
+}
+
+/* returns the next app found, without waiting */
+bool app_scan_receive(app_scan_t *scan, struct app_info_t *info)
+{
+    return xQueueReceive(scan->queue, info, 0) == pdTRUE;
+}
+
+/* true once every app found has been received */
+bool app_scan_finished(app_scan_t *scan)
+{
+    return scan->finished && uxQueueMessagesWaiting(scan->queue) == 0;
+}
+
+/* cancels the scan if still running and frees it */
+void app_scan_stop(app_scan_t *scan)
+{
+    struct app_info_t info;
+
+    /* the task may be waiting for room in the queue */
+    scan->cancel = true;
+    do {
+        while (xQueueReceive(scan->queue, &info, 0) == pdTRUE) {
+        }
+    } while (xSemaphoreTake(scan->done, 10/portTICK_PERIOD_MS) != pdTRUE);
+    vSemaphoreDelete(scan->done);
+    vQueueDelete(scan->queue);
+    free(scan);
+}
+
+static bool slot_record_read(int slot, struct slot_record_t *record)
+{
+    if (!app_data_read(slot, APP_DATA_RECORD, record, sizeof(struct slot_record_t))) {
+        return false;
     }
+    record->name[sizeof(record->name) - 1] = '\0';
+    return record->magic == SLOT_RECORD_MAGIC;
+}
 
-    snprintf(filename, sizeof(filename), "%s/%s.app", APP_DIR, name);
-    if (!(app = fopen(filename, "rb"))) {
-        goto error;
+/* true when part still holds the binary the .app file held when it was
+ * installed, checked by hashing the partition; files with a checksum are
+ * matched by it rather than by their size and time */
+static bool slot_holds(const struct slot_record_t *record, const esp_partition_t *part, const char *name,
+        const struct stat *st, const struct app_header_t *header)
+{
+    uint8_t sha256[APP_FLASH_SHA256_LEN];
+
+    if (strcmp(record->name, name) != 0 || record->binary_len != header->binary_len) {
+        return false;
+    }
+    if (header->flags & APP_HEADER_SHA256) {
+        if (memcmp(record->sha256, header->binary_sha256, sizeof(sha256)) != 0) {
+            return false;
+        }
+    } else if (record->size != (uint32_t)st->st_size || record->mtime != (uint32_t)st->st_mtime) {
+        return false;
     }
+    return app_flash_hash(part, header->binary_len, sha256) &&
+           memcmp(sha256, record->sha256, sizeof(sha256)) == 0;
+}
 
-    if (fread(&header, sizeof(struct app_header_t), 1, app) != 1 ||
-            header.magic != APP_HEADER_MAGIC ||
-            header.version != APP_HEADER_VERSION) {
-        goto error;
+/* the slot policy's pick among the slots the store would evict, other
+ * than those of the install */
+static int install_victim(const bool *candidates, void *arg)
+{
+    const struct install_batch_t *batch = (const struct install_batch_t *)arg;
+    bool allowed[APP_STORE_SLOTS];
+    for (int i = 0; i < APP_STORE_SLOTS; i++) {
+        allowed[i] = candidates[i] && !batch->taken[i];
     }
+    return app_slots_victim(&batch->table, app_slot_policy, allowed);
+}
 
-    /* mark slot as free */
-    ESP_ERROR_CHECK(nvs_open("nvs", NVS_READWRITE, &nvs));
-    snprintf(key, sizeof(key), "app%d", slot);
-    nvs_erase_key(nvs, key);
-    ESP_ERROR_CHECK(nvs_commit(nvs));
-
-    /* copy json to appdata */
-    snprintf(filename, sizeof(filename), "%s/app%d.json", APPDATA_DIR, slot);
-    if (!(buf = malloc(header.json_len))) {
-        goto error;
+/* what a slot that lost its region leaves behind */
+static void slot_evicted(int slot)
+{
+    app_data_remove(slot);
+    catalog_forget_slot(slot);
+}
+
+/* a section of the .app file into appdata, through buf */
+static bool section_copy(FILE *app, const struct app_header_t *header, int id, FILE *out, void *buf, size_t buf_len)
+{
+    size_t len = app_section_len(header, id);
+    if (len == 0) {
+        return true;
     }
 
-    if (fread(buf, header.json_len, 1, app) != 1) {
-        goto error;
+    app_section_t *section = app_section_open(app, header, id);
+    bool ok = section != NULL;
+    for (size_t pos = 0; ok && pos < len; pos += buf_len) {
+        size_t n = len - pos < buf_len ? len - pos : buf_len;
+        ok = app_section_read(section, buf, n) && fwrite(buf, n, 1, out) == 1;
     }
+    app_section_close(section);
+    return ok;
+}
 
-    if (!(out = fopen(filename, "w"))) {
-        goto error;
+static void report(const struct install_batch_t *batch, app_progress_phase_t phase, size_t app, size_t done)
+{
+    if (batch->progress) {
+        app_progress_t event = {
+            .phase = phase,
+            .done = done,
+            .total = batch->total,
+            .written = batch->written,
+            .app = app,
+            .apps = batch->count,
+        };
+        batch->progress(&event, batch->arg);
     }
-    if (fwrite(buf, header.json_len, 1, out) != 1) {
-        goto error;
+}
+
+/* events of the flash copy, with done and written made those of the batch;
+ * the batch tells when it is done itself */
+static void install_progress(const app_progress_t *progress, void *arg)
+{
+    struct install_batch_t *batch = (struct install_batch_t *)arg;
+    struct install_t *install = batch->jobs[progress->app];
+
+    if (progress->phase == APP_PROGRESS_DONE || progress->phase == APP_PROGRESS_FAILED) {
+        batch->written += progress->written;
+        return;
     }
-    fclose(out);
-    out = NULL;
+    if (batch->progress) {
+        app_progress_t event = *progress;
+        event.done += install->base;
+        event.total = batch->total;
+        event.written += batch->written;
+        event.app = install - batch->installs;
+        event.apps = batch->count;
+        batch->progress(&event, batch->arg);
+    }
+}
 
-    /* copy icons to appdata */
-    snprintf(filename, sizeof(filename), "%s/app%d.icons", APPDATA_DIR, slot);
+/* opens the .app file and gives the slot a region the binary fits in;
+ * that stays where it was when it can, and other apps may have to go for
+ * it, but none of the batch */
+static bool install_prepare(struct install_batch_t *batch, struct install_t *install)
+{
+    struct app_header_t *header = &install->job.header;
+    esp_partition_t part;
+    uint32_t old_address = 0;
+    int slot = install->slot;
 
-    if (header.icon_len == 0) {
-        unlink(filename);
-    } else {
-        if (header.icon_len % APP_ICON_LEN != 0) {
-            goto error;
-        }
+    report(batch, APP_PROGRESS_PREPARE, install - batch->installs, batch->done);
 
-        size_t count = header.icon_len / APP_ICON_LEN;
+    snprintf(install->filename, sizeof(install->filename), "%s/%s.app", APP_DIR, install->name);
+    if (slot == 0 || stat(install->filename, &install->st) != 0 ||
+            !(install->app = fopen(install->filename, "rb"))) {
+        return false;
+    }
+    if (!app_header_read(install->app, header) || header->icon_len % APP_ICON_LEN != 0) {
+        return false;
+    }
 
-        if (!(buf = realloc(buf, APP_ICON_LEN))) {
-            goto error;
+    /* mark slot as free */
+    if (app_store_partition(slot, &part)) {
+        old_address = part.address;
+    }
+    bool evicted[APP_STORE_SLOTS];
+    install->reserved = app_store_reserve(slot, header->binary_len, evicted, install_victim, batch);
+    for (int i = 0; i < APP_STORE_SLOTS; i++) {
+        if (evicted[i]) {
+            slot_evicted(i + 1);
         }
+    }
+    catalog_forget_slot(slot);
+    if (!install->reserved || !app_store_partition(slot, &part)) {
+        return false;
+    }
 
-        if (!(out = fopen(filename, "wb"))) {
-            goto error;
-        }
+    /* what the region held, before the slot's appdata goes */
+    struct slot_record_t *record = &install->record;
+    bool recorded = part.address == old_address && slot_record_read(slot, record);
+    app_data_remove(slot);
 
-        for (int i = 0; i < count; i++) {
-            if (fread(buf, APP_ICON_LEN, 1, app) != 1) {
-                goto error;
-            }
-            if (fwrite(buf, APP_ICON_LEN, 1, out) != 1) {
-                goto error;
-            }
+    if (recorded && slot_holds(record, &part, install->name, &install->st, header)) {
+        install->holds = true;
+        memcpy(install->job.sha256, record->sha256, sizeof(record->sha256));
+        return true;
+    }
+
+    /* a partition holding another version of the app is mostly the same,
+     * one that held another app is rewritten whole */
+    install->job.delta = recorded && strcmp(record->name, install->name) == 0;
+    install->job.filename = install->filename;
+
+    memset(record, 0, sizeof(struct slot_record_t));
+    record->magic = SLOT_RECORD_MAGIC;
+    record->binary_len = header->binary_len;
+    record->size = install->st.st_size;
+    record->mtime = install->st.st_mtime;
+    snprintf(record->name, sizeof(record->name), "%s", install->name);
+    return true;
+}
+
+/* the record, json and icons to appdata, one file written once, and then
+ * the slot is marked with the app's name */
+static bool install_finish(struct install_t *install, char *buf)
+{
+    const struct app_header_t *header = &install->job.header;
+    FILE *out = NULL;
+    int slot = install->slot;
+
+    memcpy(install->record.sha256, install->job.sha256, sizeof(install->record.sha256));
+    uint32_t len[APP_DATA_SECTIONS] = {
+        [APP_DATA_RECORD] = sizeof(struct slot_record_t),
+        [APP_DATA_JSON] = header->json_len,
+        [APP_DATA_ICONS] = header->icon_len,
+    };
+    if (!install->app && !(install->app = fopen(install->filename, "rb"))) {
+        return false;
+    }
+    if (!(out = app_data_create(slot, len)) ||
+            fwrite(&install->record, sizeof(struct slot_record_t), 1, out) != 1 ||
+            !section_copy(install->app, header, APP_SECTION_JSON, out, buf, APP_ICON_LEN) ||
+            !section_copy(install->app, header, APP_SECTION_ICONS, out, buf, APP_ICON_LEN)) {
+        if (out) {
+            fclose(out);
+            app_data_remove(slot);
         }
+        return false;
+    }
+    fclose(out);
+
+    app_store_commit(slot, install->name, header->binary_len);
+    app_icons_forget(slot);
+    return true;
+}
 
-        fclose(out);
-        out = NULL;
+/*
+ * Installs a batch in three steps: every app gets its region and loses its
+ * appdata, then the binaries are copied in one go, the card read for the
+ * next while the flash is written for one, then each app gets its appdata
+ * and its name in the store. The slot table is written once at the end.
+ * A binary that does not match its checksum leaves its slot unbootable and
+ * is never marked. Returns how many were installed.
+ */
+static size_t install_batch(struct install_batch_t *batch, app_queue_stats_t *stats)
+{
+    int64_t start = esp_timer_get_time();
+    size_t copies = 0, bytes = 0;
+
+    TRACE_BEGIN("app_install");
+    TRACE_BEGIN("install prepare");
+    app_slots_snapshot(&batch->table);
+    for (size_t i = 0; i < batch->count; i++) {
+        struct install_t *install = &batch->installs[i];
+        install->ok = install_prepare(batch, install);
+        if (install->ok) {
+            batch->total += install->job.header.binary_len;
+        }
+        /* the card only takes a few open files */
+        if (batch->count > 1 && install->app) {
+            fclose(install->app);
+            install->app = NULL;
+        }
     }
 
-    /* copy binary to flash */
-    if (!(buf = realloc(buf, 4096))) {
-        goto error;
+    /* where each binary goes, once every slot has its region, as placing
+     * one may have moved another; apps already in place count as done */
+    for (size_t i = 0; i < batch->count; i++) {
+        struct install_t *install = &batch->installs[i];
+        if (!install->ok || install->holds) {
+            batch->done += install->ok ? install->job.header.binary_len : 0;
+        } else if (app_store_partition(install->slot, &install->job.part)) {
+            install->job.file = install->app;
+            batch->jobs[copies] = install;
+            batch->copies[copies++] = install->job;
+        } else {
+            install->ok = false;
+        }
+    }
+    for (size_t i = 0, base = batch->done; i < copies; i++) {
+        batch->jobs[i]->base = base;
+        base += batch->jobs[i]->job.header.binary_len;
+    }
+    TRACE_END("install prepare");
+
+    TRACE_BEGIN("install copy");
+    app_flash_copy(batch->copies, copies, install_progress, batch);
+    TRACE_END("install copy");
+
+    TRACE_BEGIN("install finish");
+    char *buf = malloc(APP_ICON_LEN);
+    assert(buf != NULL);
+    for (size_t i = 0; i < copies; i++) {
+        batch->jobs[i]->job = batch->copies[i];
+        batch->jobs[i]->ok = batch->copies[i].ok;
+        bytes += batch->copies[i].header.binary_len;
     }
 
-    ESP_ERROR_CHECK(esp_ota_begin(part, header.binary_len, &ota_handle));
-    while (true) {
-        size_t len = fread(buf, 1, 4096, app);
-        if (len == 0) {
-            break;
+    size_t installed = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        struct install_t *install = &batch->installs[i];
+        install->ok = install->ok && install_finish(install, buf);
+        if (install->ok) {
+            batch->slots[installed] = install->slot;
+            batch->names[installed++] = install->name;
+        } else if (install->reserved) {
+            app_store_release(install->slot);
+        }
+        if (install->app) {
+            fclose(install->app);
+            install->app = NULL;
         }
-        ESP_ERROR_CHECK(esp_ota_write(ota_handle, buf, len));
     }
-    ESP_ERROR_CHECK(esp_ota_end(ota_handle));
+    free(buf);
+
+    app_slots_installed_all(batch->slots, batch->names, installed);
+    TRACE_END("install finish");
+    TRACE_END("app_install");
+
+    uint32_t ms = (esp_timer_get_time() - start) / 1000;
+    if (stats) {
+        stats->installed = installed;
+        stats->failed = batch->count - installed;
+        stats->bytes = 0;
+        for (size_t i = 0; i < batch->count; i++) {
+            stats->bytes += batch->installs[i].ok ? batch->installs[i].job.header.binary_len : 0;
+        }
+        stats->written = batch->written;
+        stats->ms = ms;
+        /* of what was read from the card and went through the flash copy */
+        stats->kbps = ms > 0 ? (uint64_t)bytes * 1000 / 1024 / ms : 0;
+    }
 
-    fclose(app);
+    batch->done = batch->total;
+    report(batch, installed == batch->count ? APP_PROGRESS_DONE : APP_PROGRESS_FAILED,
+            batch->count - 1, installed == batch->count ? batch->total : 0);
+    return installed;
+}
 
-    /* mark slot with app name */
-    snprintf(key, sizeof(key), "app%d", slot);
-    ESP_ERROR_CHECK(nvs_set_str(nvs, key, name));
-    update_mru(nvs, slot);
-    ESP_ERROR_CHECK(nvs_commit(nvs));
-    nvs_close(nvs);
-    return false;
+static struct install_batch_t *install_batch_new(size_t count, app_progress_cb_t progress, void *arg)
+{
+    struct install_batch_t *batch = calloc(1, sizeof(struct install_batch_t));
+    assert(batch != NULL);
+    batch->installs = calloc(count, sizeof(struct install_t));
+    batch->copies = calloc(count, sizeof(app_flash_job_t));
+    batch->jobs = calloc(count, sizeof(struct install_t *));
+    batch->slots = calloc(count, sizeof(int));
+    batch->names = calloc(count, sizeof(const char *));
+    assert(batch->installs != NULL && batch->copies != NULL && batch->jobs != NULL &&
+           batch->slots != NULL && batch->names != NULL);
+    batch->count = count;
+    batch->progress = progress;
+    batch->arg = arg;
+    return batch;
+}
 
-error:
-    if (nvs) {
-        nvs_close(nvs);
-    }
-    if (app) {
-        fclose(app);
-    }
-    if (out) {
-        fclose(out);
+static void install_batch_free(struct install_batch_t *batch)
+{
+    free(batch->installs);
+    free(batch->copies);
+    free(batch->jobs);
+    free(batch->slots);
+    free(batch->names);
+    free(batch);
+}
+
+/* returns true when it failed */
+bool app_install(const char *name, int slot, app_progress_cb_t progress, void *arg)
+{
+    assert(slot > 0 && slot <= NUM_OTA_PARTITIONS);
+
+    struct install_batch_t *batch = install_batch_new(1, progress, arg);
+    batch->installs[0].name = name;
+    batch->installs[0].slot = slot;
+    batch->taken[slot - 1] = true;
+    size_t installed = install_batch(batch, NULL);
+    install_batch_free(batch);
+    return installed != 1;
+}
+
+/* installs or upgrades names as one batch, each to its own slot or to one
+ * that none of the others has; returns how many were installed */
+size_t app_install_queue(const char *const *names, size_t count, app_progress_cb_t progress, void *arg,
+        app_queue_stats_t *stats)
+{
+    if (count == 0) {
+        if (stats) {
+            memset(stats, 0, sizeof(app_queue_stats_t));
+        }
+        return 0;
     }
-    if (buf) {
-        free(buf);
+
+    struct install_batch_t *batch = install_batch_new(count, progress, arg);
+    for (size_t i = 0; i < count; i++) {
+        struct install_t *install = &batch->installs[i];
+        install->name = names[i];
+        install->slot = find_slot(names[i], batch->taken, NULL);
+        if (install->slot > 0) {
+            batch->taken[install->slot - 1] = true;
+        }
     }
-    return true;
+    size_t installed = install_batch(batch, stats);
+    install_batch_free(batch);
+    return installed;
 }
 
+/* the slot is what the store has in RAM, nothing is read from the card */
 void app_uninstall(const char *name)
 {
-    struct app_info_t info;
+    bool installed;
+    int slot = app_store_slot(name, &installed);
 
-    app_info(name, &info);
-    if (!info.installed) {
+    if (!installed) {
         return;
     }
 
-    DIR *dir;
-    struct dirent entry;
-    struct dirent *result;
-    char filename[PATH_MAX];
-    char prefix[64];
+    app_data_remove(slot);
+    app_store_release(slot);
+    catalog_forget_slot(slot);
+}
 
-    snprintf(prefix, sizeof(prefix), "%s/app%d.", APPDATA_DIR, info.slot_num);
-    if ((dir = opendir(APPDATA_DIR)) != NULL) {
-        while (readdir_r(dir, &entry, &result) == 0 && result != NULL) {
-            if (strncmp(entry.d_name, filename, strlen(filename)) == 0) {
-                snprintf(filename, sizeof(filename), "%s/%s", APPDATA_DIR, entry.d_name);
-                unlink(filename);
+/* an installed app that is not to be upgraded boots from what the store
+ * has in RAM; the card and appdata are only read to install, or to tell
+ * whether there is an upgrade when one is asked for */
+void app_run(const char *name, bool upgrade, app_progress_cb_t progress, void *arg)
+{
+    bool installed;
+    int slot = app_store_slot(name, &installed);
+
+    if (!installed || upgrade) {
+        struct app_info_t info;
+        app_info(name, &info);
+        if (!info.installed || (upgrade && info.available && info.upgradable)) {
+            if (app_install(name, info.slot_num, progress, arg)) {
+                return;
             }
         }
+        slot = info.slot_num;
+    }
+
+    app_slots_launched(slot, name);
+
+    esp_partition_t part;
+    if (!app_store_partition(slot, &part)) {
+        return;
     }
-    closedir(dir);
 
-    nvs_handle nvs;
-    ESP_ERROR_CHECK(nvs_open("nvs", NVS_READWRITE, &nvs));
-    char key[5];
-    snprintf(key, sizeof(key), "app%d", info.slot_num);
-    nvs_erase_key(nvs, key);
-    ESP_ERROR_CHECK(nvs_commit(nvs));
-    nvs_close(nvs);
+    esp_ota_set_boot_partition(&part);
+    esp_restart();
 }
 
-void app_run(const char *name, bool upgrade)
+/* reads the first icon of an app, from appdata when installed or from the
+ * .app file otherwise; returns false if there is none */
+bool app_read_icon(const struct app_info_t *info, void *buf)
 {
-    struct app_info_t info;
+    char filename[PATH_MAX];
+    struct app_header_t header;
+    app_section_t *section;
 
-    app_info(name, &info);
-    if (!info.installed || (upgrade && info.available && info.upgradable)) {
-        if (app_install(name, info.slot_num)) {
-            return;
-        }
+    if (info->installed) {
+        return app_data_read(info->slot_num, APP_DATA_ICONS, buf, APP_ICON_LEN);
+    } else if (!info->available) {
+        return false;
     }
 
-    nvs_handle nvs;
-    ESP_ERROR_CHECK(nvs_open("nvs", NVS_READWRITE, &nvs));
-    update_mru(nvs, info.slot_num);
-    ESP_ERROR_CHECK(nvs_commit(nvs));
-    nvs_close(nvs);
-
-    const esp_partition_t *part = esp_partition_find_first(
-        ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_MIN + info.slot_num, NULL);
+    snprintf(filename, sizeof(filename), "%s/%s.app", APP_DIR, info->name);
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        return false;
+    }
+    if (!app_header_read(f, &header) ||
+            header.icon_len < APP_ICON_LEN ||
+            !(section = app_section_open(f, &header, APP_SECTION_ICONS))) {
+        fclose(f);
+        return false;
+    }
 
-    esp_ota_set_boot_partition(part);
-    esp_restart();
+    bool result = app_section_read(section, buf, APP_ICON_LEN);
+    app_section_close(section);
+    fclose(f);
+    return result;
 }
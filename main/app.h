@@ -5,6 +5,9 @@
 #include <stdint.h>
 
 
+#define APP_ICON_SIZE (48)
+#define APP_ICON_LEN (APP_ICON_SIZE * APP_ICON_SIZE * 2)
+
 struct app_info_t {
     char name[256];
     int slot_num;
@@ -13,9 +16,54 @@ struct app_info_t {
     bool upgradable;
 };
 
+typedef struct app_scan_t app_scan_t;
+
+typedef enum {
+    APP_PROGRESS_PREPARE,
+    APP_PROGRESS_ERASE,
+    APP_PROGRESS_WRITE,
+    APP_PROGRESS_VERIFY,
+    APP_PROGRESS_DONE,
+    APP_PROGRESS_FAILED,
+} app_progress_phase_t;
+
+typedef struct app_progress_t {
+    app_progress_phase_t phase;
+    size_t done;
+    size_t total;
+    /* bytes erased and written so far, less than done when sectors of the
+     * partition already held the binary */
+    size_t written;
+    uint32_t kbps;
+    /* which of how many apps of a queue; done and total are of the binaries
+     * of all of them */
+    size_t app;
+    size_t apps;
+} app_progress_t;
+
+typedef struct app_queue_stats_t {
+    size_t installed;
+    size_t failed;
+    /* of the binaries installed, and what of them had to be written */
+    size_t bytes;
+    size_t written;
+    uint32_t ms;
+    uint32_t kbps;
+} app_queue_stats_t;
+
+/* called on the installing task, the UI task for the App List */
+typedef void (*app_progress_cb_t)(const app_progress_t *progress, void *arg);
+
 struct app_info_t *app_enumerate(size_t *count);
+app_scan_t *app_scan_start(void);
+bool app_scan_receive(app_scan_t *scan, struct app_info_t *info);
+bool app_scan_finished(app_scan_t *scan);
+void app_scan_stop(app_scan_t *scan);
 int app_get_slot(const char *name, bool *installed);
 void app_info(const char *name, struct app_info_t *info);
-bool app_install(const char *name, int slot);
+bool app_install(const char *name, int slot, app_progress_cb_t progress, void *arg);
+size_t app_install_queue(const char *const *names, size_t count, app_progress_cb_t progress, void *arg,
+        app_queue_stats_t *stats);
 void app_uninstall(const char *name);
-void app_run(const char *name, bool upgrade);
+void app_run(const char *name, bool upgrade, app_progress_cb_t progress, void *arg);
+bool app_read_icon(const struct app_info_t *info, void *buf);
@@ -0,0 +1,208 @@
+#include <dirent.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "app_data.h"
+#include "app_store.h"
+
+/* present once the appdata directory is in this layout */
+#define LAYOUT_FILE APP_DATA_DIR "/layout"
+#define COPY_CHUNK (512)
+
+
+static void slot_filename(int slot, char *filename, size_t len)
+{
+    snprintf(filename, len, "%s/slot%d.dat", APP_DATA_DIR, slot);
+}
+
+/* the header of f, checked against the size of the file */
+static bool header_read(FILE *f, struct app_data_header_t *header)
+{
+    size_t total = sizeof(struct app_data_header_t);
+    if (fread(header, sizeof(struct app_data_header_t), 1, f) != 1 ||
+            header->magic != APP_DATA_MAGIC || header->version != APP_DATA_VERSION) {
+        return false;
+    }
+    for (int i = 0; i < APP_DATA_SECTIONS; i++) {
+        total += header->len[i];
+    }
+    return fseek(f, 0, SEEK_END) == 0 && ftell(f) == (long)total;
+}
+
+/* slotN.dat positioned at the start of section, NULL if there is none */
+FILE *app_data_open(int slot, int section, size_t *len)
+{
+    char filename[PATH_MAX];
+    struct app_data_header_t header;
+
+    slot_filename(slot, filename, sizeof(filename));
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        return NULL;
+    }
+    if (!header_read(f, &header)) {
+        fclose(f);
+        return NULL;
+    }
+
+    long offset = sizeof(struct app_data_header_t);
+    for (int i = 0; i < section; i++) {
+        offset += header.len[i];
+    }
+    if (fseek(f, offset, SEEK_SET) != 0) {
+        fclose(f);
+        return NULL;
+    }
+    *len = header.len[section];
+    return f;
+}
+
+/* the first len bytes of section, false if it is shorter */
+bool app_data_read(int slot, int section, void *buf, size_t len)
+{
+    size_t section_len;
+    FILE *f = app_data_open(slot, section, &section_len);
+    if (!f) {
+        return false;
+    }
+    bool ok = section_len >= len && fread(buf, len, 1, f) == 1;
+    fclose(f);
+    return ok;
+}
+
+/* slotN.dat with its header written; the caller writes the sections in
+ * order, len[] bytes each, and closes it */
+FILE *app_data_create(int slot, const uint32_t *len)
+{
+    char filename[PATH_MAX];
+    struct app_data_header_t header = {
+        .magic = APP_DATA_MAGIC,
+        .version = APP_DATA_VERSION,
+    };
+    memcpy(header.len, len, sizeof(header.len));
+
+    slot_filename(slot, filename, sizeof(filename));
+    FILE *f = fopen(filename, "wb");
+    if (f && fwrite(&header, sizeof(header), 1, f) != 1) {
+        fclose(f);
+        unlink(filename);
+        return NULL;
+    }
+    return f;
+}
+
+void app_data_remove(int slot)
+{
+    char filename[PATH_MAX];
+    slot_filename(slot, filename, sizeof(filename));
+    unlink(filename);
+}
+
+static bool copy_file(FILE *out, const char *filename, size_t len)
+{
+    char buf[COPY_CHUNK];
+    FILE *f = len ? fopen(filename, "rb") : NULL;
+    bool ok = !len || f;
+    for (size_t pos = 0; ok && pos < len; pos += sizeof(buf)) {
+        size_t n = len - pos < sizeof(buf) ? len - pos : sizeof(buf);
+        ok = fread(buf, n, 1, f) == 1 && fwrite(buf, n, 1, out) == 1;
+    }
+    if (f) {
+        fclose(f);
+    }
+    return ok;
+}
+
+/* appN.json, appN.icons and slotN.sha of an installed app become slotN.dat */
+static void migrate_slot(int slot)
+{
+    /* short, as this runs on the main task's stack */
+    char filenames[APP_DATA_SAVE][32];
+    char name[APP_STORE_NAME_LEN];
+    uint32_t len[APP_DATA_SECTIONS] = {0};
+    bool exists[APP_DATA_SAVE];
+    struct stat st;
+
+    snprintf(filenames[APP_DATA_RECORD], sizeof(filenames[0]), "%s/slot%d.sha", APP_DATA_DIR, slot);
+    snprintf(filenames[APP_DATA_JSON], sizeof(filenames[0]), "%s/app%d.json", APP_DATA_DIR, slot);
+    snprintf(filenames[APP_DATA_ICONS], sizeof(filenames[0]), "%s/app%d.icons", APP_DATA_DIR, slot);
+
+    bool found = false;
+    for (int i = 0; i < APP_DATA_SAVE; i++) {
+        exists[i] = stat(filenames[i], &st) == 0;
+        len[i] = exists[i] ? st.st_size : 0;
+        found |= exists[i];
+    }
+    if (!found) {
+        return;
+    }
+
+    if (app_store_name(slot, name, sizeof(name)) && len[APP_DATA_JSON] > 0) {
+        FILE *out = app_data_create(slot, len);
+        bool ok = out != NULL;
+        for (int i = 0; ok && i < APP_DATA_SAVE; i++) {
+            ok = copy_file(out, filenames[i], len[i]);
+        }
+        if (out) {
+            fclose(out);
+        }
+        if (!ok) {
+            app_data_remove(slot);
+        }
+    }
+
+    for (int i = 0; i < APP_DATA_SAVE; i++) {
+        if (exists[i]) {
+            unlink(filenames[i]);
+        }
+    }
+}
+
+/* true for what older launchers left in appdata */
+static bool legacy_file(const char *name)
+{
+    size_t len = strlen(name);
+    return (strncmp(name, "app", 3) == 0 &&
+            ((len > 5 && strcmp(name + len - 5, ".json") == 0) ||
+             (len > 6 && strcmp(name + len - 6, ".icons") == 0))) ||
+           (strncmp(name, "slot", 4) == 0 && len > 4 && strcmp(name + len - 4, ".sha") == 0);
+}
+
+/* called once at startup, after app_store_boot_check: the first time, the
+ * files of installed apps are packed and everything else of the old
+ * layout goes, which uninstalls may have left behind */
+void app_data_boot_check(void)
+{
+    struct stat st;
+    if (stat(LAYOUT_FILE, &st) == 0) {
+        return;
+    }
+
+    for (int slot = 1; slot <= APP_STORE_SLOTS; slot++) {
+        migrate_slot(slot);
+    }
+
+    DIR *dir = opendir(APP_DATA_DIR);
+    struct dirent entry;
+    struct dirent *result;
+    while (dir && readdir_r(dir, &entry, &result) == 0 && result != NULL) {
+        if (legacy_file(entry.d_name)) {
+            char filename[PATH_MAX];
+            snprintf(filename, sizeof(filename), "%s/%s", APP_DATA_DIR, entry.d_name);
+            unlink(filename);
+        }
+    }
+    if (dir) {
+        closedir(dir);
+    }
+
+    FILE *f = fopen(LAYOUT_FILE, "w");
+    if (f) {
+        fprintf(f, "%d\n", APP_DATA_VERSION);
+        fclose(f);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * What the launcher keeps on SPIFFS for an installed app: one file per
+ * slot, slotN.dat, holding a header and then the sections one after the
+ * other, so installing writes it in one go and uninstalling unlinks it.
+ * Launchers before kept appN.json, appN.icons and slotN.sha instead, which
+ * app_data_boot_check packs once.
+ */
+
+#define APP_DATA_DIR "/spiffs/appdata"
+#define APP_DATA_MAGIC (0x21544144)
+#define APP_DATA_VERSION (2)
+
+enum {
+    /* what the region holds, see app.c */
+    APP_DATA_RECORD,
+    APP_DATA_JSON,
+    APP_DATA_ICONS,
+    /* kept for the app's own saves, none are written yet */
+    APP_DATA_SAVE,
+    APP_DATA_SECTIONS,
+};
+
+struct app_data_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t len[APP_DATA_SECTIONS];
+};
+
+/* slots are numbered from 1; a file cut short is treated as missing */
+FILE *app_data_open(int slot, int section, size_t *len);
+bool app_data_read(int slot, int section, void *buf, size_t len);
+FILE *app_data_create(int slot, const uint32_t *len);
+void app_data_remove(int slot);
+void app_data_boot_check(void);
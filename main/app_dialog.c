@@ -1,26 +1,215 @@
+#include <stdio.h>
 #include <string.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
 #include "app.h"
+#include "app_icons.h"
 #include "display.h"
+#include "periodic.h"
 #include "ui_dialog.h"
 
 
-static struct app_info_t *s_app_info = NULL;
-static size_t s_app_count = 0;
+/* apps received per poll, so a fast scan cannot stall the UI */
+#define SCAN_BATCH (32)
+#define INFO_BLOCK_SIZE (32)
+
+/* list items point into these, so they are never moved while more apps
+ * arrive */
+typedef struct info_block_t {
+    struct info_block_t *next;
+    size_t count;
+    struct app_info_t info[INFO_BLOCK_SIZE];
+} info_block_t;
+
+static info_block_t *s_info_blocks = NULL;
+static app_scan_t *s_scan = NULL;
+static char *s_active_name = NULL;
+static uint32_t s_icons_generation = 0;
+
+static struct app_info_t *app_info_new(void)
+{
+    if (!s_info_blocks || s_info_blocks->count == INFO_BLOCK_SIZE) {
+        info_block_t *block = malloc(sizeof(info_block_t));
+        assert(block != NULL);
+        block->next = s_info_blocks;
+        block->count = 0;
+        s_info_blocks = block;
+    }
+    return &s_info_blocks->info[s_info_blocks->count++];
+}
+
+static void app_info_free_all(void)
+{
+    while (s_info_blocks) {
+        info_block_t *next = s_info_blocks->next;
+        free(s_info_blocks);
+        s_info_blocks = next;
+    }
+}
+
+static void app_list_stop_scan(void)
+{
+    if (s_scan) {
+        app_scan_stop(s_scan);
+        s_scan = NULL;
+    }
+}
+
+typedef struct install_ui_t {
+    ui_dialog_t *parent;
+    ui_dialog_t *d;
+    ui_label_t *label;
+    ui_progress_t *bar;
+    /* kept on screen a moment, to be read */
+    bool linger;
+} install_ui_t;
+
+/* shows install progress, the dialog is only created once there is some */
+static void app_install_progress(const app_progress_t *progress, void *arg)
+{
+    install_ui_t *ui = (install_ui_t *)arg;
+
+    if (!ui->d) {
+        rect_t r = {
+            .x = fb->width/2 - 200/2,
+            .y = fb->height/2 - 70/2,
+            .width = 200,
+            .height = 70,
+        };
+        ui->d = ui_dialog_new(ui->parent, r, "Installing");
+
+        rect_t lr = {
+            .x = 0,
+            .y = 4,
+            .width = ui->d->cr.width,
+            .height = 16,
+        };
+        ui->label = ui_dialog_add_label(ui->d, lr, NULL);
+
+        rect_t pr = {
+            .x = 4,
+            .y = 24,
+            .width = ui->d->cr.width - 8,
+            .height = 12,
+        };
+        ui->bar = ui_dialog_add_progress(ui->d, pr);
+        ui_dialog_show(ui->d);
+    }
+
+    char s[64];
+    switch (progress->phase) {
+        case APP_PROGRESS_PREPARE:
+            if (progress->apps > 1) {
+                snprintf(s, sizeof(s), "Preparing %u of %u...", (unsigned)(progress->app + 1),
+                        (unsigned)progress->apps);
+            } else {
+                snprintf(s, sizeof(s), "Copying app data...");
+            }
+            break;
+        case APP_PROGRESS_ERASE:
+            snprintf(s, sizeof(s), "Erasing flash...");
+            break;
+        case APP_PROGRESS_WRITE:
+            if (progress->apps > 1) {
+                snprintf(s, sizeof(s), "App %u of %u, %u KB/s", (unsigned)(progress->app + 1),
+                        (unsigned)progress->apps, (unsigned)progress->kbps);
+            } else {
+                snprintf(s, sizeof(s), "Writing %u of %u KB, %u KB/s", (unsigned)(progress->done / 1024),
+                        (unsigned)(progress->total / 1024), (unsigned)progress->kbps);
+            }
+            break;
+        case APP_PROGRESS_VERIFY:
+            snprintf(s, sizeof(s), "Verifying...");
+            break;
+        case APP_PROGRESS_DONE:
+            if (progress->written < progress->total) {
+                snprintf(s, sizeof(s), "Done, %u of %u KB changed", (unsigned)(progress->written / 1024),
+                        (unsigned)(progress->total / 1024));
+            } else {
+                snprintf(s, sizeof(s), "Done");
+            }
+            break;
+        case APP_PROGRESS_FAILED:
+            snprintf(s, sizeof(s), "Install failed");
+            break;
+    }
+    ui_label_set_text(ui->label, s);
+    ui_progress_set(ui->bar, progress->done, progress->total);
+    ui_dialog_update(ui->d);
+    ui->linger = progress->phase == APP_PROGRESS_FAILED;
+}
+
+static void app_install_done(install_ui_t *ui)
+{
+    if (ui->d) {
+        if (ui->linger) {
+            vTaskDelay(1500/portTICK_PERIOD_MS);
+        }
+        ui_dialog_close(ui->d);
+        ui_dialog_destroy(ui->d);
+        ui->d = NULL;
+    }
+}
 
 static void app_popup_install(ui_list_item_t *item, void *arg)
 {
     struct app_info_t *info = (struct app_info_t *)arg;
+    install_ui_t ui = {
+        .parent = item->list->d,
+    };
 
-    app_install(info->name, info->slot_num);
+    app_list_stop_scan();
+    app_install(info->name, info->slot_num, app_install_progress, &ui);
+    app_install_done(&ui);
+    item->list->hide = true;
+}
+
+/* every upgradable app of the App List, in one install */
+static void app_popup_upgrade_all(ui_list_item_t *item, void *arg)
+{
+    ui_list_t *apps = (ui_list_t *)arg;
+    install_ui_t ui = {
+        .parent = item->list->d,
+    };
+
+    app_list_stop_scan();
+    const char **names = malloc(sizeof(const char *) * (apps->item_count > 0 ? apps->item_count : 1));
+    assert(names != NULL);
+    size_t count = 0;
+    for (int i = 0; i < apps->item_count; i++) {
+        struct app_info_t *info = (struct app_info_t *)apps->items[i]->arg;
+        if (info->installed && info->upgradable) {
+            names[count++] = info->name;
+        }
+    }
+
+    app_queue_stats_t stats;
+    app_install_queue(names, count, app_install_progress, &ui, &stats);
+    free(names);
+    if (ui.d) {
+        char s[64];
+        snprintf(s, sizeof(s), "Upgraded %u of %u, %u KB/s", (unsigned)stats.installed,
+                (unsigned)(stats.installed + stats.failed), (unsigned)stats.kbps);
+        ui_label_set_text(ui.label, s);
+        ui_dialog_update(ui.d);
+        ui.linger = true;
+    }
+    app_install_done(&ui);
     item->list->hide = true;
 }
 
 static void app_popup_run(ui_list_item_t *item, void *arg)
 {
     struct app_info_t *info = (struct app_info_t *)arg;
+    install_ui_t ui = {
+        .parent = item->list->d,
+    };
 
-    app_run(info->name, false);
+    app_list_stop_scan();
+    app_run(info->name, false, app_install_progress, &ui);
+    app_install_done(&ui);
     item->list->hide = true;
 }
 
@@ -28,6 +217,7 @@ static void app_popup_uninstall(ui_list_item_t *item, void *arg)
 {
     struct app_info_t *info = (struct app_info_t *)arg;
 
+    app_list_stop_scan();
     app_uninstall(info->name);
     item->list->hide = true;
 }
@@ -64,6 +254,7 @@ static void app_list_select(ui_list_item_t *item, void *arg)
     }
     if (info->installed && info->upgradable) {
         ui_list_append_text(list, "Upgrade", app_popup_install, info);
+        ui_list_append_text(list, "Upgrade all", app_popup_upgrade_all, item->list);
     }
     ui_dialog_showmodal(d);
     ui_dialog_destroy(d);
@@ -73,39 +264,114 @@ static void app_list_select(ui_list_item_t *item, void *arg)
 
 static void fill_app_list(ui_list_t *list)
 {
-    char *active_name = NULL;
-    if (s_app_info) {
+    app_list_stop_scan();
+
+    if (list->active && !s_active_name) {
         struct app_info_t *selected_info = (struct app_info_t *)list->active->arg;
-        active_name = strdup(selected_info->name);
-        free(s_app_info);
+        s_active_name = strdup(selected_info->name);
     }
 
     while (list->item_count > 0) {
         ui_list_remove(list, -1);
     }
+    list->active = NULL;
+    app_info_free_all();
 
-    s_app_info = app_enumerate(&s_app_count);
+    s_scan = app_scan_start();
+    ui_list_set_status(list, "Scanning...");
+}
 
-    for (int i = 0; i < s_app_count; i++) {
-        char buf[269];
-        if (s_app_info[i].installed && s_app_info[i].upgradable) {
-            snprintf(buf, sizeof(buf), "%s [Upgradable]", s_app_info[i].name);
-        } else if (s_app_info[i].installed) {
-            snprintf(buf, sizeof(buf), "%s [Installed]", s_app_info[i].name); 
+static int cmp_names(const char *a, const char *b)
+{
+    int cmp = strcasecmp(a, b);
+    return cmp ? cmp : strcmp(a, b);
+}
+
+/* inserts an app where it belongs in the sorted list */
+static void app_list_insert(ui_list_t *list, const struct app_info_t *src)
+{
+    struct app_info_t *info = app_info_new();
+    memcpy(info, src, sizeof(struct app_info_t));
+
+    char buf[269];
+    if (info->installed && info->upgradable) {
+        snprintf(buf, sizeof(buf), "%s [Upgradable]", info->name);
+    } else if (info->installed) {
+        snprintf(buf, sizeof(buf), "%s [Installed]", info->name);
+    } else {
+        strncpy(buf, info->name, sizeof(buf));
+        buf[sizeof(buf) - 1] = '\0';
+    }
+
+    int lo = 0, hi = list->item_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        struct app_info_t *other = (struct app_info_t *)list->items[mid]->arg;
+        if (cmp_names(other->name, info->name) <= 0) {
+            lo = mid + 1;
         } else {
-            strncpy(buf, s_app_info[i].name, sizeof(buf));
-            buf[sizeof(buf) - 1] = '\0';
-        }
-        ui_list_item_t *item = ui_list_append_text(list, buf, app_list_select, &s_app_info[i]);
-        if (active_name && strcmp(active_name, s_app_info[i].name) == 0) {
-            list->active = item;
+            hi = mid;
         }
     }
-    if (active_name) {
-        free(active_name);
+
+    /* until the user moves, the selection stays on the first app, and the
+     * rows on screen stay where they are */
+    bool at_top = !list->active || list->active == list->items[0];
+    if (list->filter_len == 0 && lo < list->first_index) {
+        list->first_index += 1;
     }
 
-    list->dirty = true;
+    ui_list_item_t *item = ui_list_insert_text(list, lo, buf, app_list_select, info);
+    if (s_active_name && strcmp(s_active_name, info->name) == 0) {
+        list->active = item;
+        free(s_active_name);
+        s_active_name = NULL;
+    } else if (at_top && !s_active_name) {
+        list->active = list->items[0];
+    }
+}
+
+/* moves apps found by the scan into the list */
+static void app_list_scan_poll(periodic_handle_t handle, void *arg)
+{
+    ui_list_t *list = (ui_list_t *)arg;
+    struct app_info_t info;
+
+    if (!s_scan) {
+        return;
+    }
+
+    for (int i = 0; i < SCAN_BATCH && app_scan_receive(s_scan, &info); i++) {
+        app_list_insert(list, &info);
+    }
+
+    if (app_scan_finished(s_scan)) {
+        app_list_stop_scan();
+        ui_list_set_status(list, NULL);
+        if (s_active_name) {
+            free(s_active_name);
+            s_active_name = NULL;
+        }
+    }
+}
+
+static gbuf_t *app_list_icon(ui_list_item_t *item)
+{
+    return app_icons_get((struct app_info_t *)item->arg);
+}
+
+/* redraws the list once icons requested by the last draw have arrived */
+static void app_list_icons_refresh(periodic_handle_t handle, void *arg)
+{
+    ui_list_t *list = (ui_list_t *)arg;
+
+    uint32_t generation = app_icons_generation();
+    if (generation != s_icons_generation) {
+        s_icons_generation = generation;
+        if (list->show_icons) {
+            list->dirty = true;
+        }
+    }
 }
 
 void app_list_dialog(ui_list_item_t *item, void *arg)
@@ -125,12 +391,24 @@ void app_list_dialog(ui_list_item_t *item, void *arg)
         .height = d->cr.height,
     };
     ui_list_t *list = ui_dialog_add_list(d, lr);
+    list->filterable = true;
+    list->icon = app_list_icon;
+    list->icon_size = APP_ICON_SIZE;
+    list->show_icons = true;
     fill_app_list(list);
+
+    s_icons_generation = app_icons_generation();
+    periodic_handle_t scan_handle = periodic_register(50/portTICK_PERIOD_MS, app_list_scan_poll, list);
+    periodic_handle_t handle = periodic_register(100/portTICK_PERIOD_MS, app_list_icons_refresh, list);
     ui_dialog_showmodal(d);
+    periodic_unregister(handle);
+    periodic_unregister(scan_handle);
+    app_list_stop_scan();
     ui_dialog_destroy(d);
 
-    if (s_app_info) {
-        free(s_app_info);
-        s_app_info = NULL;
+    app_info_free_all();
+    if (s_active_name) {
+        free(s_active_name);
+        s_active_name = NULL;
     }
 }
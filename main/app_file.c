@@ -0,0 +1,197 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rom/miniz.h"
+
+#include "app_file.h"
+
+/* what precedes the sections in version 1 files, whatever header_len says */
+#define APP_HEADER_V1_LEN (offsetof(struct app_header_t, stored))
+#define APP_HEADER_V2_LEN (offsetof(struct app_header_t, flags))
+#define SECTION_READ_BUFFER (4096)
+
+struct app_section_t {
+    FILE *f;
+    uint32_t compression;
+    size_t stored_remaining;
+    size_t remaining;
+    /* inflated bytes land in dict, which tinfl also uses as its window */
+    tinfl_decompressor *inflator;
+    uint8_t *in;
+    size_t in_pos;
+    size_t in_len;
+    uint8_t *dict;
+    size_t dict_pos;
+    size_t out_pos;
+    size_t out_len;
+    bool done;
+};
+
+
+/* reads and checks a header of any supported version, f is left at the
+ * first section */
+bool app_header_read(FILE *f, struct app_header_t *header)
+{
+    memset(header, 0, sizeof(struct app_header_t));
+    if (fread(header, APP_HEADER_V1_LEN, 1, f) != 1 ||
+            header->magic != APP_HEADER_MAGIC ||
+            header->version < 1 || header->version > APP_HEADER_VERSION) {
+        return false;
+    }
+
+    if (header->version == 1) {
+        header->header_len = APP_HEADER_V1_LEN;
+        for (int i = 0; i < APP_SECTIONS; i++) {
+            header->stored[i].compression = APP_COMPRESSION_NONE;
+            header->stored[i].stored_len = app_section_len(header, i);
+        }
+        return true;
+    }
+
+    size_t len = header->header_len < sizeof(struct app_header_t) ? header->header_len : sizeof(struct app_header_t);
+    if (header->header_len < APP_HEADER_V2_LEN ||
+            fread(header->stored, len - APP_HEADER_V1_LEN, 1, f) != 1 ||
+            fseek(f, header->header_len, SEEK_SET) != 0) {
+        return false;
+    }
+    for (int i = 0; i < APP_SECTIONS; i++) {
+        uint32_t compression = header->stored[i].compression;
+        if (compression != APP_COMPRESSION_NONE && compression != APP_COMPRESSION_DEFLATE) {
+            return false;
+        }
+        if (compression == APP_COMPRESSION_NONE && header->stored[i].stored_len != app_section_len(header, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t app_section_len(const struct app_header_t *header, int section)
+{
+    switch (section) {
+        case APP_SECTION_JSON:
+            return header->json_len;
+        case APP_SECTION_ICONS:
+            return header->icon_len;
+        default:
+            return header->binary_len;
+    }
+}
+
+app_section_t *app_section_open(FILE *f, const struct app_header_t *header, int section)
+{
+    long offset = header->header_len;
+    for (int i = 0; i < section; i++) {
+        offset += header->stored[i].stored_len;
+    }
+    if (fseek(f, offset, SEEK_SET) != 0) {
+        return NULL;
+    }
+
+    app_section_t *s = calloc(1, sizeof(app_section_t));
+    assert(s != NULL);
+    s->f = f;
+    s->compression = header->stored[section].compression;
+    s->stored_remaining = header->stored[section].stored_len;
+    s->remaining = app_section_len(header, section);
+
+    if (s->compression == APP_COMPRESSION_DEFLATE) {
+        s->inflator = malloc(sizeof(tinfl_decompressor));
+        s->in = malloc(SECTION_READ_BUFFER);
+        s->dict = malloc(TINFL_LZ_DICT_SIZE);
+        assert(s->inflator != NULL && s->in != NULL && s->dict != NULL);
+        tinfl_init(s->inflator);
+    }
+    return s;
+}
+
+/* inflates into dict until some output is there, returns false at the end
+ * of the stream or on corrupt data */
+static bool section_inflate(app_section_t *s)
+{
+    while (s->out_len == 0) {
+        if (s->done) {
+            return false;
+        }
+
+        if (s->in_pos == s->in_len && s->stored_remaining > 0) {
+            size_t n = s->stored_remaining < SECTION_READ_BUFFER ? s->stored_remaining : SECTION_READ_BUFFER;
+            if (fread(s->in, n, 1, s->f) != 1) {
+                return false;
+            }
+            s->in_pos = 0;
+            s->in_len = n;
+            s->stored_remaining -= n;
+        }
+
+        /* tinfl wraps around dict, so it is never handed more than the
+         * space up to the end */
+        size_t in_bytes = s->in_len - s->in_pos;
+        size_t out_bytes = TINFL_LZ_DICT_SIZE - s->dict_pos;
+        mz_uint32 flags = TINFL_FLAG_PARSE_ZLIB_HEADER;
+        if (s->stored_remaining > 0) {
+            flags |= TINFL_FLAG_HAS_MORE_INPUT;
+        }
+        tinfl_status status = tinfl_decompress(s->inflator, s->in + s->in_pos, &in_bytes,
+                s->dict, s->dict + s->dict_pos, &out_bytes, flags);
+
+        s->in_pos += in_bytes;
+        s->out_pos = s->dict_pos;
+        s->out_len = out_bytes;
+        s->dict_pos = (s->dict_pos + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+
+        if (status < TINFL_STATUS_DONE) {
+            return false;
+        }
+        if (status == TINFL_STATUS_DONE) {
+            s->done = true;
+        } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && s->stored_remaining == 0 && s->in_pos == s->in_len) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* reads the next len bytes of the section, false if there are not as many
+ * or the section is corrupt */
+bool app_section_read(app_section_t *s, void *dst, size_t len)
+{
+    if (len > s->remaining) {
+        return false;
+    }
+
+    if (s->compression == APP_COMPRESSION_NONE) {
+        if (len > 0 && fread(dst, len, 1, s->f) != 1) {
+            return false;
+        }
+        s->remaining -= len;
+        return true;
+    }
+
+    uint8_t *p = dst;
+    while (len > 0) {
+        if (!section_inflate(s)) {
+            return false;
+        }
+        size_t n = len < s->out_len ? len : s->out_len;
+        memcpy(p, s->dict + s->out_pos, n);
+        s->out_pos += n;
+        s->out_len -= n;
+        s->remaining -= n;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+void app_section_close(app_section_t *s)
+{
+    if (s) {
+        free(s->inflator);
+        free(s->in);
+        free(s->dict);
+        free(s);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * .app files: a header, then the JSON manifest, the icons and the app
+ * binary. Version 2 headers describe how each section is stored, so that
+ * sections can be deflated (zlib format, see tools/mkapp.py), and may carry
+ * the SHA-256 of the binary. Sections are read through app_section_t, which
+ * inflates as it goes with a fixed amount of memory whatever the section
+ * size.
+ */
+
+#define APP_HEADER_MAGIC (0x21505041)
+#define APP_HEADER_VERSION (2)
+#define APP_HEADER_SHA256 (1 << 0)
+
+enum {
+    APP_SECTION_JSON,
+    APP_SECTION_ICONS,
+    APP_SECTION_BINARY,
+    APP_SECTIONS,
+};
+
+enum {
+    APP_COMPRESSION_NONE,
+    APP_COMPRESSION_DEFLATE,
+};
+
+/* the lengths are those of the sections as the launcher uses them; fields
+ * past header_len read as 0 */
+struct app_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_len;
+    uint32_t json_len;
+    uint32_t icon_len;
+    uint32_t binary_len;
+    /* version 2 */
+    struct {
+        uint32_t compression;
+        uint32_t stored_len;
+    } stored[APP_SECTIONS];
+    /* version 2 with a checksum */
+    uint32_t flags;
+    uint8_t binary_sha256[32];
+};
+
+typedef struct app_section_t app_section_t;
+
+bool app_header_read(FILE *f, struct app_header_t *header);
+size_t app_section_len(const struct app_header_t *header, int section);
+app_section_t *app_section_open(FILE *f, const struct app_header_t *header, int section);
+bool app_section_read(app_section_t *s, void *dst, size_t len);
+void app_section_close(app_section_t *s);
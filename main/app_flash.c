@@ -0,0 +1,358 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_heap_caps.h"
+#include "esp_image_format.h"
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
+
+#include "trace.h"
+
+#include "app_flash.h"
+
+/*
+ * Copies app binaries from the SD card to OTA partitions with the reads
+ * and the flash writes overlapped: a reader task fills a ring of buffers
+ * while a writer task drains them into the partitions. Both go through the
+ * jobs in order, so the reader is already on the next binary while the
+ * writer finishes and verifies one. The caller's task only passes progress
+ * events on.
+ *
+ * The SHA-256 of the binary is taken on the way and, when the .app header
+ * has one, checked before the copy counts as done, as is the image in the
+ * partition, full copy or delta; a partition that got bad data has its
+ * first sector erased, so that it cannot be booted.
+ *
+ * A delta copy compares each sector with the partition first and only
+ * erases and writes the ones that differ. Sector erases are much slower
+ * than the 64K block erases of a full copy, so it only pays when most of
+ * the partition is expected to match.
+ *
+ * Partitions are written directly rather than through esp_ota_begin, which
+ * erases what the image will take up front and so leaves a delta copy
+ * nothing to compare with.
+ */
+
+/* DMA capable, so the SD driver can read straight into them */
+#define FLASH_BUFFERS (3)
+#define FLASH_BUFFER_SIZE (16 * 1024)
+#define FLASH_EVENTS (8)
+
+typedef struct flash_chunk_t {
+    int index;
+    size_t len;
+} flash_chunk_t;
+
+typedef struct flash_copy_t {
+    app_flash_job_t *jobs;
+    size_t count;
+    /* of the job being written */
+    app_flash_job_t *job;
+    mbedtls_sha256_context sha;
+    uint8_t *sector;
+    size_t written;
+    uint8_t *buffers[FLASH_BUFFERS];
+    QueueHandle_t free;
+    QueueHandle_t full;
+    QueueHandle_t events;
+    SemaphoreHandle_t reader_done;
+    SemaphoreHandle_t writer_done;
+} flash_copy_t;
+
+
+static void flash_post(flash_copy_t *copy, app_progress_phase_t phase, size_t done, uint32_t kbps)
+{
+    app_progress_t progress = {
+        .phase = phase,
+        .done = done,
+        .total = copy->job->header.binary_len,
+        .written = copy->written,
+        .kbps = kbps,
+        .app = copy->job - copy->jobs,
+        .apps = copy->count,
+    };
+    xQueueSend(copy->events, &progress, portMAX_DELAY);
+}
+
+/* the binary of job, a chunk at a time; an empty chunk tells the writer
+ * the file is short or corrupt, and the rest of the job is skipped */
+static void reader_job(flash_copy_t *copy, app_flash_job_t *job)
+{
+    size_t remaining = job->header.binary_len;
+    app_section_t *src = NULL;
+    FILE *f = job->file ? job->file : fopen(job->filename, "rb");
+    if (f) {
+        src = app_section_open(f, &job->header, APP_SECTION_BINARY);
+    }
+
+    while (remaining > 0) {
+        flash_chunk_t chunk;
+        xQueueReceive(copy->free, &chunk.index, portMAX_DELAY);
+
+        chunk.len = remaining < FLASH_BUFFER_SIZE ? remaining : FLASH_BUFFER_SIZE;
+        if (!src || !app_section_read(src, copy->buffers[chunk.index], chunk.len)) {
+            chunk.len = 0;
+        }
+        xQueueSend(copy->full, &chunk, portMAX_DELAY);
+        if (chunk.len == 0) {
+            break;
+        }
+        remaining -= chunk.len;
+    }
+
+    app_section_close(src);
+    if (f && f != job->file) {
+        fclose(f);
+    }
+}
+
+static void reader_task(void *arg)
+{
+    flash_copy_t *copy = (flash_copy_t *)arg;
+
+    for (size_t i = 0; i < copy->count; i++) {
+        TRACE_BEGIN("flash read");
+        reader_job(copy, &copy->jobs[i]);
+        TRACE_END("flash read");
+    }
+
+    xSemaphoreGive(copy->reader_done);
+    vTaskDelete(NULL);
+}
+
+/* writes the sectors of data that differ from the partition at offset,
+ * erasing each run of them at once */
+static esp_err_t flash_write_changed(flash_copy_t *copy, size_t offset, const uint8_t *data, size_t len)
+{
+    size_t pos = 0;
+    while (pos < len) {
+        size_t start = pos;
+        size_t n = 0;
+        while (pos < len) {
+            n = len - pos < SPI_FLASH_SEC_SIZE ? len - pos : SPI_FLASH_SEC_SIZE;
+            esp_err_t err = esp_partition_read(&copy->job->part, offset + pos, copy->sector, n);
+            if (err != ESP_OK) {
+                return err;
+            }
+            if (memcmp(copy->sector, data + pos, n) == 0) {
+                break;
+            }
+            pos += n;
+        }
+
+        if (pos > start) {
+            size_t erase_len = (pos - start + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1);
+            esp_err_t err = esp_partition_erase_range(&copy->job->part, offset + start, erase_len);
+            if (err == ESP_OK) {
+                err = esp_partition_write(&copy->job->part, offset + start, data + start, pos - start);
+            }
+            if (err != ESP_OK) {
+                return err;
+            }
+            copy->written += pos - start;
+        }
+
+        /* past the sector that matched */
+        pos += pos < len ? n : 0;
+    }
+    return ESP_OK;
+}
+
+/* writes the chunks of one job; they are all taken from the reader, even
+ * once the job failed */
+static void writer_job(flash_copy_t *copy, app_flash_job_t *job)
+{
+    const esp_partition_t *part = &job->part;
+    size_t len = job->header.binary_len;
+    size_t done = 0;
+    uint32_t kbps = 0;
+    esp_err_t err = ESP_OK;
+
+    copy->job = job;
+    copy->written = 0;
+    mbedtls_sha256_init(&copy->sha);
+    mbedtls_sha256_starts(&copy->sha, 0);
+
+    if (len > part->size) {
+        err = ESP_ERR_INVALID_SIZE;
+    } else if (!job->delta) {
+        /* as much of the partition as the image needs */
+        flash_post(copy, APP_PROGRESS_ERASE, 0, 0);
+        size_t erase_len = (len + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1);
+        err = esp_partition_erase_range(part, 0, erase_len);
+    }
+
+    int64_t start = esp_timer_get_time();
+    while (done < len) {
+        flash_chunk_t chunk;
+        xQueueReceive(copy->full, &chunk, portMAX_DELAY);
+        if (chunk.len == 0) {
+            err = ESP_FAIL;
+            break;
+        }
+
+        uint8_t *buf = copy->buffers[chunk.index];
+        if (err == ESP_OK) {
+            mbedtls_sha256_update(&copy->sha, buf, chunk.len);
+            if (job->delta) {
+                err = flash_write_changed(copy, done, buf, chunk.len);
+            } else {
+                err = esp_partition_write(part, done, buf, chunk.len);
+                copy->written += chunk.len;
+            }
+        }
+        xQueueSend(copy->free, &chunk.index, portMAX_DELAY);
+        done += chunk.len;
+
+        if (err == ESP_OK) {
+            int64_t elapsed = esp_timer_get_time() - start;
+            kbps = elapsed > 0 ? (uint64_t)done * 1000000 / 1024 / elapsed : 0;
+            flash_post(copy, APP_PROGRESS_WRITE, done, kbps);
+        }
+    }
+
+    if (err == ESP_OK) {
+        flash_post(copy, APP_PROGRESS_VERIFY, done, kbps);
+        mbedtls_sha256_finish(&copy->sha, job->sha256);
+        if ((job->header.flags & APP_HEADER_SHA256) &&
+                memcmp(job->sha256, job->header.binary_sha256, APP_FLASH_SHA256_LEN) != 0) {
+            err = ESP_ERR_INVALID_CRC;
+        }
+    }
+    mbedtls_sha256_free(&copy->sha);
+
+    if (err == ESP_OK) {
+        /* what esp_ota_end would check; a delta copy too, as it would
+         * otherwise only have the header's SHA-256, if any, behind it */
+        esp_partition_pos_t pos = {
+            .offset = part->address,
+            .size = part->size,
+        };
+        esp_image_metadata_t data;
+        err = esp_image_verify(ESP_IMAGE_VERIFY_SILENT, &pos, &data);
+    }
+
+    if (err != ESP_OK && copy->written > 0) {
+        /* without its image header the partition cannot be booted */
+        esp_partition_erase_range(part, 0, SPI_FLASH_SEC_SIZE);
+    }
+
+    job->ok = err == ESP_OK;
+    job->written = copy->written;
+    flash_post(copy, job->ok ? APP_PROGRESS_DONE : APP_PROGRESS_FAILED, done, kbps);
+}
+
+static void writer_task(void *arg)
+{
+    flash_copy_t *copy = (flash_copy_t *)arg;
+
+    for (size_t i = 0; i < copy->count; i++) {
+        TRACE_BEGIN("flash write");
+        writer_job(copy, &copy->jobs[i]);
+        TRACE_END("flash write");
+    }
+    xSemaphoreTake(copy->reader_done, portMAX_DELAY);
+
+    xSemaphoreGive(copy->writer_done);
+    vTaskDelete(NULL);
+}
+
+/* copies the binary of each job to its partition and fills in its sha256,
+ * ok and written; a binary must match the SHA-256 of its header when that
+ * has one. progress is called on the calling task, with app the index of
+ * the job; the files are opened and inflated on the reader task. Returns
+ * how many jobs succeeded */
+size_t app_flash_copy(app_flash_job_t *jobs, size_t count, app_progress_cb_t progress, void *arg)
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    flash_copy_t *copy = calloc(1, sizeof(flash_copy_t));
+    assert(copy != NULL);
+    copy->jobs = jobs;
+    copy->count = count;
+    copy->job = &jobs[0];
+    copy->sector = malloc(SPI_FLASH_SEC_SIZE);
+    assert(copy->sector != NULL);
+
+    /* one slot per buffer, so sends to these never block */
+    copy->free = xQueueCreate(FLASH_BUFFERS, sizeof(int));
+    copy->full = xQueueCreate(FLASH_BUFFERS, sizeof(flash_chunk_t));
+    copy->events = xQueueCreate(FLASH_EVENTS, sizeof(app_progress_t));
+    copy->reader_done = xSemaphoreCreateBinary();
+    copy->writer_done = xSemaphoreCreateBinary();
+    assert(copy->free != NULL && copy->full != NULL && copy->events != NULL &&
+           copy->reader_done != NULL && copy->writer_done != NULL);
+
+    for (int i = 0; i < FLASH_BUFFERS; i++) {
+        copy->buffers[i] = heap_caps_malloc(FLASH_BUFFER_SIZE, MALLOC_CAP_DMA);
+        assert(copy->buffers[i] != NULL);
+        xQueueSend(copy->free, &i, 0);
+    }
+
+    xTaskCreate(reader_task, "flash_rd", 4096, copy, 5, NULL);
+    xTaskCreate(writer_task, "flash_wr", 4096, copy, 5, NULL);
+
+    size_t finished = 0, ok = 0;
+    while (finished < count) {
+        app_progress_t event;
+        xQueueReceive(copy->events, &event, portMAX_DELAY);
+        if (event.phase == APP_PROGRESS_DONE || event.phase == APP_PROGRESS_FAILED) {
+            finished += 1;
+            ok += event.phase == APP_PROGRESS_DONE;
+        }
+        if (progress) {
+            progress(&event, arg);
+        }
+    }
+    xSemaphoreTake(copy->writer_done, portMAX_DELAY);
+
+    free(copy->sector);
+    for (int i = 0; i < FLASH_BUFFERS; i++) {
+        heap_caps_free(copy->buffers[i]);
+    }
+    vQueueDelete(copy->free);
+    vQueueDelete(copy->full);
+    vQueueDelete(copy->events);
+    vSemaphoreDelete(copy->reader_done);
+    vSemaphoreDelete(copy->writer_done);
+    free(copy);
+
+    return ok;
+}
+
+/* the SHA-256 of the first len bytes of part, returns true on success */
+bool app_flash_hash(const esp_partition_t *part, size_t len, uint8_t *sha256)
+{
+    if (len > part->size) {
+        return false;
+    }
+
+    uint8_t *buf = malloc(SPI_FLASH_SEC_SIZE);
+    assert(buf != NULL);
+
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+
+    esp_err_t err = ESP_OK;
+    for (size_t pos = 0; pos < len && err == ESP_OK; pos += SPI_FLASH_SEC_SIZE) {
+        size_t n = len - pos < SPI_FLASH_SEC_SIZE ? len - pos : SPI_FLASH_SEC_SIZE;
+        err = esp_partition_read(part, pos, buf, n);
+        mbedtls_sha256_update(&sha, buf, n);
+    }
+
+    mbedtls_sha256_finish(&sha, sha256);
+    mbedtls_sha256_free(&sha);
+    free(buf);
+    return err == ESP_OK;
+}
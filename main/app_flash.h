@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "esp_partition.h"
+
+#include "app.h"
+#include "app_file.h"
+
+
+#define APP_FLASH_SHA256_LEN (32)
+
+/* the binary of an .app file going to part; a delta copy only writes the
+ * sectors that differ. file is read from when set, and left open, else
+ * filename is opened */
+typedef struct app_flash_job_t {
+    const char *filename;
+    FILE *file;
+    struct app_header_t header;
+    esp_partition_t part;
+    bool delta;
+    /* set by the copy */
+    bool ok;
+    size_t written;
+    uint8_t sha256[APP_FLASH_SHA256_LEN];
+} app_flash_job_t;
+
+size_t app_flash_copy(app_flash_job_t *jobs, size_t count, app_progress_cb_t progress, void *arg);
+bool app_flash_hash(const esp_partition_t *part, size_t len, uint8_t *sha256);
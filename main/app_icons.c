@@ -0,0 +1,171 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "display.h"
+
+#include "app.h"
+#include "app_icons.h"
+
+
+/* 32 icons is 144K; allocations that large are served from PSRAM */
+#define CACHE_ENTRIES (32)
+#define QUEUE_LENGTH (8)
+
+typedef enum {
+    ICON_EMPTY,
+    ICON_LOADING,
+    ICON_READY,
+    ICON_MISSING,
+} icon_state_t;
+
+typedef struct icon_entry_t {
+    struct app_info_t info;
+    icon_state_t state;
+    /* forgotten while being loaded, dropped once it is */
+    bool stale;
+    uint32_t last_used;
+    gbuf_t g;
+} icon_entry_t;
+
+static icon_entry_t *s_entries = NULL;
+static uint8_t *s_pixels = NULL;
+static SemaphoreHandle_t s_mutex = NULL;
+static QueueHandle_t s_queue = NULL;
+static uint32_t s_clock = 0;
+static volatile uint32_t s_generation = 0;
+
+
+static void icons_task(void *arg)
+{
+    uint8_t *buf = malloc(APP_ICON_LEN);
+    assert(buf != NULL);
+
+    while (true) {
+        icon_entry_t *entry;
+        if (xQueueReceive(s_queue, &entry, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        /* the entry stays ICON_LOADING, so its info cannot change under us */
+        bool found = app_read_icon(&entry->info, buf);
+
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        if (found) {
+            memcpy(entry->g.data, buf, APP_ICON_LEN);
+        }
+        entry->state = entry->stale ? ICON_EMPTY : found ? ICON_READY : ICON_MISSING;
+        entry->stale = false;
+        xSemaphoreGive(s_mutex);
+
+        s_generation += 1;
+    }
+}
+
+void app_icons_init(void)
+{
+    s_entries = calloc(CACHE_ENTRIES, sizeof(icon_entry_t));
+    assert(s_entries != NULL);
+    s_pixels = malloc(CACHE_ENTRIES * APP_ICON_LEN);
+    assert(s_pixels != NULL);
+
+    for (int i = 0; i < CACHE_ENTRIES; i++) {
+        icon_entry_t *entry = &s_entries[i];
+        entry->g.width = APP_ICON_SIZE;
+        entry->g.height = APP_ICON_SIZE;
+        entry->g.bytes_per_pixel = 2;
+        entry->g.endian = fb->endian;
+        entry->g.data = s_pixels + i * APP_ICON_LEN;
+    }
+
+    s_mutex = xSemaphoreCreateMutex();
+    assert(s_mutex != NULL);
+    s_queue = xQueueCreate(QUEUE_LENGTH, sizeof(icon_entry_t *));
+    assert(s_queue != NULL);
+
+    xTaskCreate(icons_task, "icons", 4096, NULL, 4, NULL);
+}
+
+static bool same_icon(const struct app_info_t *a, const struct app_info_t *b)
+{
+    return a->installed == b->installed &&
+           (!a->installed || a->slot_num == b->slot_num) &&
+           strcmp(a->name, b->name) == 0;
+}
+
+/* returns the cached icon, or NULL after queueing it to be loaded */
+gbuf_t *app_icons_get(const struct app_info_t *info)
+{
+    gbuf_t *g = NULL;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+
+    s_clock += 1;
+
+    icon_entry_t *victim = NULL;
+    for (int i = 0; i < CACHE_ENTRIES; i++) {
+        icon_entry_t *entry = &s_entries[i];
+        if (entry->state != ICON_EMPTY && same_icon(&entry->info, info)) {
+            entry->last_used = s_clock;
+            if (entry->state == ICON_READY) {
+                g = &entry->g;
+            }
+            goto done;
+        }
+        /* least recently used entry that is not being loaded */
+        if (entry->state != ICON_LOADING &&
+                (!victim || entry->state == ICON_EMPTY ||
+                 (victim->state != ICON_EMPTY && entry->last_used < victim->last_used))) {
+            victim = entry;
+        }
+    }
+
+    if (victim) {
+        memcpy(&victim->info, info, sizeof(struct app_info_t));
+        victim->last_used = s_clock;
+        victim->state = ICON_LOADING;
+        if (xQueueSend(s_queue, &victim, 0) != pdTRUE) {
+            /* loader is behind, ask again on the next draw */
+            victim->state = ICON_EMPTY;
+        }
+    }
+
+done:
+    xSemaphoreGive(s_mutex);
+    return g;
+}
+
+/* drops the icon of the app installed in slot, called when another
+ * install of an app went there, as the name and slot stay the same on a
+ * reinstall or an upgrade; nothing is cached before app_icons_init */
+void app_icons_forget(int slot)
+{
+    if (!s_entries) {
+        return;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    for (int i = 0; i < CACHE_ENTRIES; i++) {
+        icon_entry_t *entry = &s_entries[i];
+        if (entry->state == ICON_EMPTY || !entry->info.installed || entry->info.slot_num != slot) {
+            continue;
+        }
+        if (entry->state == ICON_LOADING) {
+            entry->stale = true;
+        } else {
+            entry->state = ICON_EMPTY;
+        }
+    }
+    xSemaphoreGive(s_mutex);
+
+    s_generation += 1;
+}
+
+/* changes whenever an icon has been loaded or forgotten */
+uint32_t app_icons_generation(void)
+{
+    return s_generation;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "app.h"
+#include "graphics.h"
+
+
+void app_icons_init(void);
+gbuf_t *app_icons_get(const struct app_info_t *info);
+void app_icons_forget(int slot);
+uint32_t app_icons_generation(void);
@@ -0,0 +1,528 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "app_manifest.h"
+
+#define CHUNK_SIZE (128)
+
+/* the tokenizer's states, see app_manifest_feed */
+enum {
+    PARSE_VALUE,
+    PARSE_FIRST_VALUE,
+    PARSE_KEY,
+    PARSE_FIRST_KEY,
+    PARSE_COLON,
+    PARSE_NEXT,
+    PARSE_STRING,
+    PARSE_LITERAL,
+    PARSE_DONE,
+    PARSE_ERROR,
+};
+
+/* a prerelease has 63 bits, see app_version_t */
+#define PRE_BITS (63)
+#define PRE_NUMERIC (1)
+#define PRE_ALNUM (2)
+#define PRE_NUMBER_MAX (0x3fff)
+#define RELEASE_PART_MAX (0x1fffff)
+
+
+void app_manifest_begin(app_manifest_parser_t *parser, struct app_manifest_t *manifest)
+{
+    memset(parser, 0, sizeof(app_manifest_parser_t));
+    parser->manifest = manifest;
+    parser->state = PARSE_VALUE;
+
+    manifest->name = APP_MANIFEST_NONE;
+    manifest->version = APP_MANIFEST_NONE;
+    manifest->description = APP_MANIFEST_NONE;
+    manifest->arena_len = 0;
+    memset(&manifest->version_key, 0, sizeof(app_version_t));
+}
+
+/* what a character can be part of, looked up as the tokenizer runs over
+ * a whole run of them at a time */
+#define CHAR_SPACE (1 << 0)
+#define CHAR_LITERAL (1 << 1)
+/* in a string, anything but a quote, a backslash or a control character */
+#define CHAR_PLAIN (1 << 2)
+
+static const uint8_t s_char_class[256] = {
+    ['\t'] = CHAR_SPACE,
+    ['\n'] = CHAR_SPACE,
+    ['\r'] = CHAR_SPACE,
+    [' '] = CHAR_SPACE | CHAR_PLAIN,
+    ['!'] = CHAR_PLAIN,
+    ['#' ... '*'] = CHAR_PLAIN,
+    ['+'] = CHAR_LITERAL | CHAR_PLAIN,
+    [','] = CHAR_PLAIN,
+    ['-' ... '.'] = CHAR_LITERAL | CHAR_PLAIN,
+    ['/'] = CHAR_PLAIN,
+    ['0' ... '9'] = CHAR_LITERAL | CHAR_PLAIN,
+    [':' ... '@'] = CHAR_PLAIN,
+    ['A' ... 'Z'] = CHAR_LITERAL | CHAR_PLAIN,
+    ['['] = CHAR_PLAIN,
+    [']' ... '`'] = CHAR_PLAIN,
+    ['a' ... 'z'] = CHAR_LITERAL | CHAR_PLAIN,
+    ['{' ... 0xff] = CHAR_PLAIN,
+};
+
+static bool is_space(char c)
+{
+    return s_char_class[(uint8_t)c] & CHAR_SPACE;
+}
+
+static bool is_literal(char c)
+{
+    return s_char_class[(uint8_t)c] & CHAR_LITERAL;
+}
+
+/* the field a top level key fills in, NULL for those nobody reads */
+static uint16_t *key_field(app_manifest_parser_t *parser)
+{
+    struct app_manifest_t *m = parser->manifest;
+    if (parser->depth != 1 || parser->key_len >= APP_MANIFEST_KEY_LEN) {
+        return NULL;
+    }
+    parser->key[parser->key_len] = '\0';
+    if (strcmp(parser->key, "name") == 0) {
+        return &m->name;
+    } else if (strcmp(parser->key, "version") == 0) {
+        return &m->version;
+    } else if (strcmp(parser->key, "description") == 0) {
+        return &m->description;
+    }
+    return NULL;
+}
+
+static void emit(app_manifest_parser_t *parser, char c)
+{
+    struct app_manifest_t *m = parser->manifest;
+    if (parser->is_key) {
+        if (parser->key_len < APP_MANIFEST_KEY_LEN) {
+            parser->key[parser->key_len++] = c;
+        }
+    } else if (parser->field && m->arena_len < APP_MANIFEST_ARENA_LEN - 1) {
+        m->arena[m->arena_len++] = c;
+    }
+}
+
+/* \u escapes come out as UTF-8; surrogates and NUL as '?' */
+static void emit_unicode(app_manifest_parser_t *parser, uint16_t cp)
+{
+    if (cp == 0 || (cp >= 0xd800 && cp < 0xe000)) {
+        emit(parser, '?');
+    } else if (cp < 0x80) {
+        emit(parser, cp);
+    } else if (cp < 0x800) {
+        emit(parser, 0xc0 | cp >> 6);
+        emit(parser, 0x80 | (cp & 0x3f));
+    } else {
+        emit(parser, 0xe0 | cp >> 12);
+        emit(parser, 0x80 | (cp >> 6 & 0x3f));
+        emit(parser, 0x80 | (cp & 0x3f));
+    }
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static void start_string(app_manifest_parser_t *parser, bool is_key)
+{
+    struct app_manifest_t *m = parser->manifest;
+
+    parser->is_key = is_key;
+    parser->escape = 0;
+    if (is_key) {
+        parser->key_len = 0;
+        parser->field = NULL;
+    } else if (parser->field && m->arena_len >= APP_MANIFEST_ARENA_LEN) {
+        /* not even room for an empty string */
+        parser->field = NULL;
+    }
+    parser->start = m->arena_len;
+    parser->state = PARSE_STRING;
+}
+
+static void end_string(app_manifest_parser_t *parser)
+{
+    struct app_manifest_t *m = parser->manifest;
+
+    if (parser->is_key) {
+        parser->field = key_field(parser);
+        parser->state = PARSE_COLON;
+        return;
+    }
+    if (parser->field) {
+        m->arena[m->arena_len++] = '\0';
+        *parser->field = parser->start;
+        parser->field = NULL;
+    }
+    parser->state = PARSE_NEXT;
+}
+
+static void open_container(app_manifest_parser_t *parser, bool object)
+{
+    if (parser->depth == APP_MANIFEST_MAX_DEPTH) {
+        parser->state = PARSE_ERROR;
+        return;
+    }
+    if (object) {
+        parser->objects |= 1u << parser->depth;
+    } else {
+        parser->objects &= ~(1u << parser->depth);
+    }
+    parser->depth += 1;
+    parser->field = NULL;
+    parser->state = object ? PARSE_FIRST_KEY : PARSE_FIRST_VALUE;
+}
+
+static void close_container(app_manifest_parser_t *parser, bool object)
+{
+    bool top_object = parser->objects & (1u << (parser->depth - 1));
+    if (top_object != object) {
+        parser->state = PARSE_ERROR;
+        return;
+    }
+    parser->depth -= 1;
+    parser->state = parser->depth == 0 ? PARSE_DONE : PARSE_NEXT;
+}
+
+static void parse_char(app_manifest_parser_t *parser, char c)
+{
+    switch (parser->state) {
+        case PARSE_STRING:
+            if (parser->escape == 1) {
+                const char *from = "\"\\/bfnrt";
+                const char *to = "\"\\/\b\f\n\r\t";
+                const char *p = c ? strchr(from, c) : NULL;
+                if (c == 'u') {
+                    parser->escape = 2;
+                    parser->unicode = 0;
+                } else if (p) {
+                    emit(parser, to[p - from]);
+                    parser->escape = 0;
+                } else {
+                    parser->state = PARSE_ERROR;
+                }
+            } else if (parser->escape > 1) {
+                int d = hex_digit(c);
+                if (d < 0) {
+                    parser->state = PARSE_ERROR;
+                    return;
+                }
+                parser->unicode = parser->unicode << 4 | d;
+                if (++parser->escape == 6) {
+                    emit_unicode(parser, parser->unicode);
+                    parser->escape = 0;
+                }
+            } else if (c == '\\') {
+                parser->escape = 1;
+            } else if (c == '"') {
+                end_string(parser);
+            } else if ((unsigned char)c < 0x20) {
+                parser->state = PARSE_ERROR;
+            } else {
+                emit(parser, c);
+            }
+            return;
+
+        case PARSE_LITERAL:
+            if (is_literal(c)) {
+                return;
+            }
+            /* the character after a number or true/false/null */
+            parser->state = PARSE_NEXT;
+            break;
+
+        default:
+            break;
+    }
+
+    if (is_space(c)) {
+        return;
+    }
+
+    switch (parser->state) {
+        case PARSE_FIRST_VALUE:
+            if (c == ']') {
+                close_container(parser, false);
+                return;
+            }
+            /* fall through */
+        case PARSE_VALUE:
+            if (c == '{') {
+                open_container(parser, true);
+            } else if (parser->depth == 0) {
+                /* a manifest is an object */
+                parser->state = PARSE_ERROR;
+            } else if (c == '[') {
+                open_container(parser, false);
+            } else if (c == '"') {
+                start_string(parser, false);
+            } else if (is_literal(c)) {
+                parser->field = NULL;
+                parser->state = PARSE_LITERAL;
+            } else {
+                parser->state = PARSE_ERROR;
+            }
+            break;
+
+        case PARSE_FIRST_KEY:
+            if (c == '}') {
+                close_container(parser, true);
+                return;
+            }
+            /* fall through */
+        case PARSE_KEY:
+            if (c == '"') {
+                start_string(parser, true);
+            } else {
+                parser->state = PARSE_ERROR;
+            }
+            break;
+
+        case PARSE_COLON:
+            parser->state = c == ':' ? PARSE_VALUE : PARSE_ERROR;
+            break;
+
+        case PARSE_NEXT:
+            if (c == ',') {
+                bool object = parser->objects & (1u << (parser->depth - 1));
+                parser->state = object ? PARSE_KEY : PARSE_VALUE;
+            } else if (c == '}' || c == ']') {
+                close_container(parser, c == '}');
+            } else {
+                parser->state = PARSE_ERROR;
+            }
+            break;
+
+        default:
+            /* anything but space after the end, or after an error */
+            parser->state = PARSE_ERROR;
+            break;
+    }
+}
+
+/* the plain characters of a string, up to a quote, a backslash or a
+ * control character, copied where they go on the way */
+static size_t string_run(app_manifest_parser_t *parser, const char *buf, size_t len)
+{
+    struct app_manifest_t *m = parser->manifest;
+    char *out = NULL;
+    size_t room = 0;
+    if (parser->is_key) {
+        out = parser->key + parser->key_len;
+        room = APP_MANIFEST_KEY_LEN - parser->key_len;
+    } else if (parser->field && m->arena_len < APP_MANIFEST_ARENA_LEN - 1) {
+        out = m->arena + m->arena_len;
+        room = APP_MANIFEST_ARENA_LEN - 1 - m->arena_len;
+    }
+
+    size_t n = 0;
+    size_t copy = len < room ? len : room;
+    while (n < copy && s_char_class[(uint8_t)buf[n]] & CHAR_PLAIN) {
+        out[n] = buf[n];
+        n++;
+    }
+    if (parser->is_key) {
+        parser->key_len += n;
+    } else if (out) {
+        m->arena_len += n;
+    }
+
+    /* what does not fit, or is not kept */
+    while (n < len && s_char_class[(uint8_t)buf[n]] & CHAR_PLAIN) {
+        n++;
+    }
+    return n;
+}
+
+/* false once the input can no longer be a manifest. Runs of string
+ * characters, space and literals are taken in one go, everything else a
+ * character at a time */
+bool app_manifest_feed(app_manifest_parser_t *parser, const char *buf, size_t len)
+{
+    size_t i = 0;
+    while (i < len && parser->state != PARSE_ERROR) {
+        if (parser->state == PARSE_STRING) {
+            i += parser->escape ? 0 : string_run(parser, buf + i, len - i);
+        } else if (parser->state == PARSE_LITERAL) {
+            while (i < len && is_literal(buf[i])) {
+                i++;
+            }
+        } else {
+            while (i < len && is_space(buf[i])) {
+                i++;
+            }
+        }
+        if (i < len) {
+            parse_char(parser, buf[i++]);
+        }
+    }
+    return parser->state != PARSE_ERROR;
+}
+
+/* true if the whole input was a manifest, which is then complete */
+bool app_manifest_end(app_manifest_parser_t *parser)
+{
+    struct app_manifest_t *m = parser->manifest;
+    if (parser->state != PARSE_DONE) {
+        return false;
+    }
+    if (m->version != APP_MANIFEST_NONE) {
+        app_version_parse(m->arena + m->version, &m->version_key);
+    }
+    return true;
+}
+
+bool app_manifest_parse(struct app_manifest_t *manifest, const char *json, size_t len)
+{
+    app_manifest_parser_t parser;
+    app_manifest_begin(&parser, manifest);
+    app_manifest_feed(&parser, json, len);
+    return app_manifest_end(&parser);
+}
+
+/* len bytes of f, in chunks on the stack */
+bool app_manifest_fread(struct app_manifest_t *manifest, FILE *f, size_t len)
+{
+    app_manifest_parser_t parser;
+    char buf[CHUNK_SIZE];
+
+    app_manifest_begin(&parser, manifest);
+    for (size_t pos = 0; pos < len; pos += sizeof(buf)) {
+        size_t n = len - pos < sizeof(buf) ? len - pos : sizeof(buf);
+        if (fread(buf, n, 1, f) != 1 || !app_manifest_feed(&parser, buf, n)) {
+            return false;
+        }
+    }
+    return app_manifest_end(&parser);
+}
+
+const char *app_manifest_string(const struct app_manifest_t *manifest, uint16_t field)
+{
+    return field == APP_MANIFEST_NONE ? NULL : manifest->arena + field;
+}
+
+static uint32_t parse_part(const char **p)
+{
+    uint32_t n = 0;
+    while (**p >= '0' && **p <= '9') {
+        n = n < RELEASE_PART_MAX ? n * 10 + (**p - '0') : n;
+        (*p)++;
+    }
+    return n < RELEASE_PART_MAX ? n : RELEASE_PART_MAX;
+}
+
+/* 6 bits in ASCII order, 0 ends an identifier */
+static uint64_t pre_char(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return 2 + c - '0';
+    } else if (c >= 'A' && c <= 'Z') {
+        return 12 + c - 'A';
+    } else if (c >= 'a' && c <= 'z') {
+        return 38 + c - 'a';
+    }
+    return 1;
+}
+
+/* numeric identifiers take 16 bits, below any alphanumeric one; those take
+ * 2 bits and 6 per character and to end it. An identifier that is cut
+ * short is the last */
+static uint64_t parse_pre(const char *p)
+{
+    uint64_t pre = 0;
+    int bits = PRE_BITS;
+
+    while (*p && *p != '+' && bits > 0) {
+        const char *end = p;
+        bool numeric = true;
+        while (*end && *end != '.' && *end != '+') {
+            numeric &= *end >= '0' && *end <= '9';
+            end++;
+        }
+
+        if (end == p) {
+            /* empty, as in 1.0.0-a..b */
+        } else if (numeric) {
+            if (bits < 16) {
+                break;
+            }
+            uint32_t n = 0;
+            for (const char *q = p; q < end; q++) {
+                n = n < PRE_NUMBER_MAX ? n * 10 + (*q - '0') : n;
+            }
+            bits -= 16;
+            pre |= (uint64_t)(PRE_NUMERIC << 14 | (n < PRE_NUMBER_MAX ? n : PRE_NUMBER_MAX)) << bits;
+        } else {
+            bits -= 2;
+            pre |= (uint64_t)PRE_ALNUM << bits;
+            for (const char *q = p; q < end; q++) {
+                if (bits < 6) {
+                    return pre;
+                }
+                bits -= 6;
+                pre |= pre_char(*q) << bits;
+            }
+            bits = bits < 6 ? 0 : bits - 6;
+        }
+
+        p = *end == '.' ? end + 1 : end;
+    }
+    return pre;
+}
+
+void app_version_parse(const char *version, app_version_t *key)
+{
+    memset(key, 0, sizeof(app_version_t));
+
+    if (!strchr(version, '.')) {
+        for (int i = 0; i < 16 && version[i]; i++) {
+            uint64_t c = version[i] & 0x7f;
+            if (i < 8) {
+                key->release |= c << (56 - 8 * i);
+            } else {
+                key->pre |= c << (56 - 8 * (i - 8));
+            }
+        }
+        return;
+    }
+
+    const char *p = version;
+    uint64_t major = parse_part(&p);
+    p += *p == '.';
+    uint64_t minor = parse_part(&p);
+    p += *p == '.';
+    uint64_t patch = parse_part(&p);
+    key->release = 1ull << 63 | major << 42 | minor << 21 | patch;
+
+    /* whatever follows the patch up to a prerelease or build */
+    while (*p && *p != '-' && *p != '+') {
+        p++;
+    }
+    key->pre = *p == '-' ? parse_pre(p + 1) : UINT64_MAX;
+}
+
+int app_version_cmp(const app_version_t *left, const app_version_t *right)
+{
+    if (left->release != right->release) {
+        return left->release < right->release ? -1 : 1;
+    }
+    if (left->pre != right->pre) {
+        return left->pre < right->pre ? -1 : 1;
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * An app's JSON manifest as the launcher needs it, parsed in one pass
+ * without allocating: the input can come in chunks of any size, the
+ * strings that are kept are copied into an arena in the struct, and the
+ * version is also kept as a key that compares the way versions do.
+ */
+
+#define APP_MANIFEST_ARENA_LEN (320)
+#define APP_MANIFEST_KEY_LEN (16)
+/* nesting the tokenizer follows, deeper manifests are invalid */
+#define APP_MANIFEST_MAX_DEPTH (32)
+
+/* a field that is missing or not a string */
+#define APP_MANIFEST_NONE (UINT16_MAX)
+
+/*
+ * Compares as a 128-bit number. Versions with a dot are semver: release
+ * holds the top bit, then major, minor and patch in 21 bits each, and pre
+ * the prerelease identifiers, packed so that they keep semver precedence,
+ * or all ones when there are none. Identifiers that do not fit in the 63
+ * bits are left out. Build metadata is ignored. Any other version compares
+ * as a string, by its first 16 bytes, and below all semver versions.
+ */
+typedef struct app_version_t {
+    uint64_t release;
+    uint64_t pre;
+} app_version_t;
+
+/* strings are offsets into the arena, truncated to what fits there */
+struct app_manifest_t {
+    uint16_t name;
+    uint16_t version;
+    uint16_t description;
+    uint16_t arena_len;
+    app_version_t version_key;
+    char arena[APP_MANIFEST_ARENA_LEN];
+};
+
+/* the tokenizer between chunks */
+typedef struct app_manifest_parser_t {
+    struct app_manifest_t *manifest;
+    uint8_t state;
+    uint8_t depth;
+    /* a bit per level, set for objects */
+    uint32_t objects;
+    /* a string being read, and where it goes */
+    bool is_key;
+    uint16_t *field;
+    uint16_t start;
+    uint8_t escape;
+    uint16_t unicode;
+    char key[APP_MANIFEST_KEY_LEN];
+    uint8_t key_len;
+} app_manifest_parser_t;
+
+void app_manifest_begin(app_manifest_parser_t *parser, struct app_manifest_t *manifest);
+bool app_manifest_feed(app_manifest_parser_t *parser, const char *buf, size_t len);
+bool app_manifest_end(app_manifest_parser_t *parser);
+
+bool app_manifest_parse(struct app_manifest_t *manifest, const char *json, size_t len);
+bool app_manifest_fread(struct app_manifest_t *manifest, FILE *f, size_t len);
+const char *app_manifest_string(const struct app_manifest_t *manifest, uint16_t field);
+
+void app_version_parse(const char *version, app_version_t *key);
+int app_version_cmp(const app_version_t *left, const app_version_t *right);
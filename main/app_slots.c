@@ -0,0 +1,336 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "nvs_flash.h"
+
+#include "sdkconfig.h"
+
+#include "app_slots.h"
+#include "app_store.h"
+
+#define SLOT_TABLE_KEY "slots"
+#define SLOT_TABLE_MAGIC (0x21544c53)
+
+static struct app_slot_table_t s_table;
+static bool s_table_loaded = false;
+static SemaphoreHandle_t s_table_mutex = NULL;
+
+
+/* plain LRU, what the launcher always did */
+static int victim_lru(const struct app_slot_table_t *table, const bool *candidates)
+{
+    int victim = -1;
+    for (int i = 0; i < APP_SLOT_COUNT; i++) {
+        if (!candidates[i]) {
+            continue;
+        }
+        if (victim < 0 || table->slots[i].last[0] < table->slots[victim].last[0]) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+/* LRU-2: the slot whose second to last launch is the oldest, so that an
+ * app launched once goes before one launched twice, however recently */
+static int victim_lru2(const struct app_slot_table_t *table, const bool *candidates)
+{
+    int victim = -1;
+    for (int i = 0; i < APP_SLOT_COUNT; i++) {
+        if (!candidates[i]) {
+            continue;
+        }
+        const struct app_slot_usage_t *u = &table->slots[i];
+        const struct app_slot_usage_t *v = &table->slots[victim < 0 ? i : victim];
+        if (victim < 0 || u->last[1] < v->last[1] || (u->last[1] == v->last[1] && u->last[0] < v->last[0])) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+/* the fewest launches, aged, and of those the least recent */
+static int victim_weighted(const struct app_slot_table_t *table, const bool *candidates)
+{
+    int victim = -1;
+    for (int i = 0; i < APP_SLOT_COUNT; i++) {
+        if (!candidates[i]) {
+            continue;
+        }
+        const struct app_slot_usage_t *u = &table->slots[i];
+        const struct app_slot_usage_t *v = &table->slots[victim < 0 ? i : victim];
+        if (victim < 0 || u->launches < v->launches || (u->launches == v->launches && u->last[0] < v->last[0])) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+const app_slot_policy_t app_slot_policy_lru = {
+    .name = "lru",
+    .victim = victim_lru,
+};
+
+const app_slot_policy_t app_slot_policy_lru2 = {
+    .name = "lru-2",
+    .victim = victim_lru2,
+};
+
+const app_slot_policy_t app_slot_policy_weighted = {
+    .name = "weighted",
+    .victim = victim_weighted,
+};
+
+#if defined(CONFIG_LAUNCHER_SLOT_POLICY_LRU)
+const app_slot_policy_t *app_slot_policy = &app_slot_policy_lru;
+#elif defined(CONFIG_LAUNCHER_SLOT_POLICY_LRU2)
+const app_slot_policy_t *app_slot_policy = &app_slot_policy_lru2;
+#else
+const app_slot_policy_t *app_slot_policy = &app_slot_policy_weighted;
+#endif
+
+/* FNV-1a, never 0 */
+uint32_t app_slots_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (const char *p = name; *p; p++) {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+/* the table as the "mru" string of older launchers left it: the slots in
+ * the order they were used, each launched once. Their apps are those the
+ * store took over from the app%d keys */
+static void slots_from_mru(nvs_handle nvs, struct app_slot_table_t *table)
+{
+    /* there were six slots then, one digit each */
+    char mru[16] = "123456";
+    size_t len = sizeof(mru);
+    nvs_get_str(nvs, "mru", mru, &len);
+
+    for (int i = 0; mru[i]; i++) {
+        int slot = mru[i] - '0';
+        char value[APP_STORE_NAME_LEN];
+        if (slot < 1 || slot > APP_SLOT_COUNT || !app_store_name(slot, value, sizeof(value))) {
+            continue;
+        }
+        struct app_slot_usage_t *u = &table->slots[slot - 1];
+        u->name_hash = app_slots_hash(value);
+        u->launches = 1;
+        u->last[0] = ++table->clock;
+    }
+}
+
+static void table_load(nvs_handle nvs, struct app_slot_table_t *table)
+{
+    size_t len = sizeof(struct app_slot_table_t);
+    if (nvs_get_blob(nvs, SLOT_TABLE_KEY, table, &len) == ESP_OK &&
+            len == sizeof(struct app_slot_table_t) && table->magic == SLOT_TABLE_MAGIC) {
+        return;
+    }
+
+    memset(table, 0, sizeof(struct app_slot_table_t));
+    table->magic = SLOT_TABLE_MAGIC;
+    slots_from_mru(nvs, table);
+    ESP_ERROR_CHECK(nvs_set_blob(nvs, SLOT_TABLE_KEY, table, sizeof(struct app_slot_table_t)));
+    nvs_erase_key(nvs, "mru");
+    ESP_ERROR_CHECK(nvs_commit(nvs));
+}
+
+/* the store's lock may be taken while this one is held, never the other
+ * way round; the policy picks from a snapshot for that */
+static SemaphoreHandle_t table_mutex(void)
+{
+    /* first called on BOOT_APPS, see apps_step in boot.c */
+    if (!s_table_mutex) {
+        s_table_mutex = xSemaphoreCreateMutex();
+        assert(s_table_mutex != NULL);
+    }
+    return s_table_mutex;
+}
+
+/* the table in RAM, read from NVS on first use; the lock is held */
+static struct app_slot_table_t *table_get(void)
+{
+    if (!s_table_loaded) {
+        nvs_handle nvs;
+        ESP_ERROR_CHECK(nvs_open("nvs", NVS_READWRITE, &nvs));
+        table_load(nvs, &s_table);
+        nvs_close(nvs);
+        s_table_loaded = true;
+    }
+    return &s_table;
+}
+
+/* one blob and one commit for each change */
+static void table_write(const struct app_slot_table_t *table)
+{
+    nvs_handle nvs;
+    ESP_ERROR_CHECK(nvs_open("nvs", NVS_READWRITE, &nvs));
+    ESP_ERROR_CHECK(nvs_set_blob(nvs, SLOT_TABLE_KEY, table, sizeof(struct app_slot_table_t)));
+    ESP_ERROR_CHECK(nvs_commit(nvs));
+    nvs_close(nvs);
+}
+
+/* records that slot now holds name; the app it held before becomes a ghost
+ * and name gets its history back if it was one */
+static void slot_assign(struct app_slot_table_t *table, int slot, uint32_t hash)
+{
+    struct app_slot_usage_t *u = &table->slots[slot - 1];
+    if (u->name_hash == hash) {
+        return;
+    }
+
+    struct app_slot_usage_t evicted = *u;
+    memset(u, 0, sizeof(struct app_slot_usage_t));
+    u->name_hash = hash;
+
+    /* the ghost taken back, or the oldest one, makes room for evicted */
+    int end = APP_SLOT_GHOSTS - 1;
+    bool found = false;
+    for (int i = 0; i < APP_SLOT_GHOSTS && !found; i++) {
+        if (table->ghosts[i].name_hash == hash) {
+            *u = table->ghosts[i];
+            end = i;
+            found = true;
+        }
+    }
+    if (evicted.name_hash) {
+        memmove(&table->ghosts[1], &table->ghosts[0], end * sizeof(struct app_slot_usage_t));
+        table->ghosts[0] = evicted;
+    } else if (found) {
+        memmove(&table->ghosts[end], &table->ghosts[end + 1], (APP_SLOT_GHOSTS - 1 - end) * sizeof(struct app_slot_usage_t));
+        memset(&table->ghosts[APP_SLOT_GHOSTS - 1], 0, sizeof(struct app_slot_usage_t));
+    }
+}
+
+void app_slots_assign(struct app_slot_table_t *table, int slot, const char *name)
+{
+    slot_assign(table, slot, app_slots_hash(name));
+}
+
+void app_slots_launch(struct app_slot_table_t *table, int slot, const char *name)
+{
+    app_slots_assign(table, slot, name);
+
+    table->clock += 1;
+    if (table->clock % APP_SLOT_AGE_PERIOD == 0) {
+        for (int i = 0; i < APP_SLOT_COUNT; i++) {
+            table->slots[i].launches /= 2;
+        }
+        for (int i = 0; i < APP_SLOT_GHOSTS; i++) {
+            table->ghosts[i].launches /= 2;
+        }
+    }
+
+    struct app_slot_usage_t *u = &table->slots[slot - 1];
+    u->launches += 1;
+    u->last[1] = u->last[0];
+    u->last[0] = table->clock;
+}
+
+/* 0 if there is no candidate */
+int app_slots_victim(const struct app_slot_table_t *table, const app_slot_policy_t *policy, const bool *candidates)
+{
+    return policy->victim(table, candidates) + 1;
+}
+
+/* a copy of the table as it is now, for the policy to pick from */
+void app_slots_snapshot(struct app_slot_table_t *table)
+{
+    xSemaphoreTake(table_mutex(), portMAX_DELAY);
+    *table = *table_get();
+    xSemaphoreGive(table_mutex());
+}
+
+/* slot was installed with name */
+void app_slots_installed(int slot, const char *name)
+{
+    app_slots_installed_all(&slot, &name, 1);
+}
+
+/* slots[i] was installed with names[i], written back once for all */
+void app_slots_installed_all(const int *slots, const char *const *names, size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    xSemaphoreTake(table_mutex(), portMAX_DELAY);
+    struct app_slot_table_t *table = table_get();
+    for (size_t i = 0; i < count; i++) {
+        assert(slots[i] > 0 && slots[i] <= APP_SLOT_COUNT);
+        app_slots_assign(table, slots[i], names[i]);
+    }
+    table_write(table);
+    xSemaphoreGive(table_mutex());
+}
+
+/* name is about to boot from slot */
+void app_slots_launched(int slot, const char *name)
+{
+    assert(slot > 0 && slot <= APP_SLOT_COUNT);
+
+    xSemaphoreTake(table_mutex(), portMAX_DELAY);
+    struct app_slot_table_t *table = table_get();
+    app_slots_launch(table, slot, name);
+    table_write(table);
+    xSemaphoreGive(table_mutex());
+}
+
+/* called once at startup, after app_store_boot_check: the table follows
+ * the store, which is what boots. Slots the store has another app in are
+ * assigned it, those it has none in give up their history to the ghosts,
+ * and the clock is never behind a launch */
+void app_slots_boot_check(void)
+{
+    uint32_t hashes[APP_SLOT_COUNT];
+    for (int i = 0; i < APP_SLOT_COUNT; i++) {
+        char name[APP_STORE_NAME_LEN];
+        hashes[i] = app_store_name(i + 1, name, sizeof(name)) ? app_slots_hash(name) : 0;
+    }
+
+    xSemaphoreTake(table_mutex(), portMAX_DELAY);
+    struct app_slot_table_t *table = table_get();
+    struct app_slot_table_t old = *table;
+
+    for (int i = 0; i < APP_SLOT_COUNT; i++) {
+        struct app_slot_usage_t *u = &table->slots[i];
+        if (hashes[i]) {
+            slot_assign(table, i + 1, hashes[i]);
+        } else if (u->name_hash) {
+            memmove(&table->ghosts[1], &table->ghosts[0], (APP_SLOT_GHOSTS - 1) * sizeof(struct app_slot_usage_t));
+            table->ghosts[0] = *u;
+            memset(u, 0, sizeof(struct app_slot_usage_t));
+        }
+    }
+
+    /* a ghost of an app that is installed again is stale */
+    for (int i = 0; i < APP_SLOT_COUNT; i++) {
+        for (int j = 0; table->slots[i].name_hash && j < APP_SLOT_GHOSTS; j++) {
+            if (table->ghosts[j].name_hash == table->slots[i].name_hash) {
+                memmove(&table->ghosts[j], &table->ghosts[j + 1], (APP_SLOT_GHOSTS - 1 - j) * sizeof(struct app_slot_usage_t));
+                memset(&table->ghosts[APP_SLOT_GHOSTS - 1], 0, sizeof(struct app_slot_usage_t));
+                j -= 1;
+            }
+        }
+    }
+
+    for (int i = 0; i < APP_SLOT_COUNT + APP_SLOT_GHOSTS; i++) {
+        const struct app_slot_usage_t *u = i < APP_SLOT_COUNT ? &table->slots[i] : &table->ghosts[i - APP_SLOT_COUNT];
+        if (u->last[0] > table->clock) {
+            table->clock = u->last[0];
+        }
+    }
+
+    if (memcmp(&old, table, sizeof(struct app_slot_table_t)) != 0) {
+        table_write(table);
+    }
+    xSemaphoreGive(table_mutex());
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "app_store.h"
+
+/*
+ * Which OTA slot a newly launched app replaces. Every slot keeps how often
+ * and when its app was launched, and a few apps that were replaced keep
+ * theirs, so an app used every day that was pushed out once comes back with
+ * its history. A policy picks the slot to give up from these. The table is
+ * kept in RAM, read from NVS once and written back as one blob with one
+ * commit by each change.
+ */
+
+#define APP_SLOT_COUNT (APP_STORE_SLOTS)
+#define APP_SLOT_GHOSTS (8)
+
+/* launches are halved every APP_SLOT_AGE_PERIOD launches, so apps that were
+ * popular once do not stay forever */
+#define APP_SLOT_AGE_PERIOD (32)
+
+/* clock values are launch numbers, 0 for never; name_hash is 0 for none */
+struct app_slot_usage_t {
+    uint32_t name_hash;
+    uint32_t launches;
+    uint32_t last[2];
+};
+
+struct app_slot_table_t {
+    uint32_t magic;
+    uint32_t clock;
+    struct app_slot_usage_t slots[APP_SLOT_COUNT];
+    /* the apps replaced most recently come first */
+    struct app_slot_usage_t ghosts[APP_SLOT_GHOSTS];
+};
+
+typedef struct app_slot_policy_t {
+    const char *name;
+    /* the index of the slot to replace among candidates[], -1 if none */
+    int (*victim)(const struct app_slot_table_t *table, const bool *candidates);
+} app_slot_policy_t;
+
+extern const app_slot_policy_t app_slot_policy_lru;
+extern const app_slot_policy_t app_slot_policy_lru2;
+extern const app_slot_policy_t app_slot_policy_weighted;
+
+/* the one set in menuconfig */
+extern const app_slot_policy_t *app_slot_policy;
+
+/* slots are numbered from 1, as everywhere else */
+uint32_t app_slots_hash(const char *name);
+void app_slots_assign(struct app_slot_table_t *table, int slot, const char *name);
+void app_slots_launch(struct app_slot_table_t *table, int slot, const char *name);
+int app_slots_victim(const struct app_slot_table_t *table, const app_slot_policy_t *policy, const bool *candidates);
+
+/* the table of this launcher */
+void app_slots_snapshot(struct app_slot_table_t *table);
+void app_slots_installed(int slot, const char *name);
+void app_slots_installed_all(const int *slots, const char *const *names, size_t count);
+void app_slots_launched(int slot, const char *name);
+void app_slots_boot_check(void);
@@ -0,0 +1,438 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_image_format.h"
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#include "nvs_flash.h"
+#include "rom/crc.h"
+
+#include "app_store.h"
+
+#define STORE_MAGIC (0x21545341)
+#define STORE_LABEL "appstore"
+
+/* older launchers had six 2M partitions where the pool is now */
+#define LEGACY_SLOTS (6)
+#define LEGACY_SLOT_SIZE (0x200000)
+
+static struct app_store_t s_store;
+static bool s_store_loaded = false;
+static SemaphoreHandle_t s_store_mutex = NULL;
+static const esp_partition_t *s_table = NULL;
+/* the ota_N partitions of the pool, and their sizes as the table has them */
+static const esp_partition_t *s_regions[APP_STORE_SLOTS];
+static uint32_t s_region_sizes[APP_STORE_SLOTS];
+
+
+/* regions are the sizes of the partitions of the pool, in order */
+void app_store_init(struct app_store_t *store, const uint32_t *regions, size_t count)
+{
+    assert(count <= APP_STORE_SLOTS);
+    memset(store, 0, sizeof(struct app_store_t));
+    store->magic = STORE_MAGIC;
+    for (size_t i = 0; i < count; i++) {
+        store->regions[i] = regions[i];
+        store->pool_size += regions[i];
+    }
+}
+
+/* whole 64K blocks, which is also what the flash MMU maps */
+size_t app_store_extent(size_t len)
+{
+    return (len + APP_STORE_ALIGN - 1) & ~(APP_STORE_ALIGN - 1);
+}
+
+/* the size of the region starting at offset, 0 if none does */
+size_t app_store_region(const struct app_store_t *store, uint32_t offset)
+{
+    uint32_t pos = 0;
+    for (int i = 0; i < APP_STORE_SLOTS && store->regions[i]; pos += store->regions[i++]) {
+        if (pos == offset) {
+            return store->regions[i];
+        }
+    }
+    return 0;
+}
+
+int app_store_find(const struct app_store_t *store, const char *name)
+{
+    for (int i = 0; i < APP_STORE_SLOTS; i++) {
+        const struct app_store_entry_t *e = &store->entries[i];
+        if (e->size > 0 && e->name[0] && strcmp(e->name, name) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/* a slot without a region, or else one with a region but no app */
+int app_store_free_slot(const struct app_store_t *store)
+{
+    int slot = 0;
+    for (int i = 0; i < APP_STORE_SLOTS; i++) {
+        const struct app_store_entry_t *e = &store->entries[i];
+        if (e->size == 0) {
+            return i + 1;
+        }
+        if (!e->name[0] && !slot) {
+            slot = i + 1;
+        }
+    }
+    return slot;
+}
+
+static bool region_taken(const struct app_store_t *store, uint32_t offset)
+{
+    for (int i = 0; i < APP_STORE_SLOTS; i++) {
+        if (store->entries[i].size > 0 && store->entries[i].offset == offset) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* best fit: the smallest free region that holds len, the first of those */
+bool app_store_fit(const struct app_store_t *store, size_t len, uint32_t *offset)
+{
+    size_t need = app_store_extent(len);
+    size_t best = SIZE_MAX;
+    uint32_t pos = 0;
+
+    for (int i = 0; i < APP_STORE_SLOTS && store->regions[i]; pos += store->regions[i++]) {
+        if (store->regions[i] >= need && store->regions[i] < best && !region_taken(store, pos)) {
+            best = store->regions[i];
+            *offset = pos;
+        }
+    }
+    return best != SIZE_MAX;
+}
+
+/* a move that frees a region of len bytes or more: the app of the smallest
+ * such region that fits a smaller free one, and where it goes; false if no
+ * app does */
+bool app_store_next_move(const struct app_store_t *store, size_t len, int *slot, uint32_t *offset)
+{
+    size_t need = app_store_extent(len);
+    int best = -1;
+
+    for (int i = 0; i < APP_STORE_SLOTS; i++) {
+        const struct app_store_entry_t *e = &store->entries[i];
+        uint32_t to;
+        if (e->size >= need && e->name[0] && (best < 0 || e->size < store->entries[best].size) &&
+                app_store_fit(store, e->binary_len, &to) && app_store_region(store, to) < e->size) {
+            best = i;
+            *offset = to;
+        }
+    }
+    if (best >= 0) {
+        *slot = best + 1;
+    }
+    return best >= 0;
+}
+
+/* gives slot a region for len bytes: the one it has if that is big enough,
+ * else the smallest free one that is. When there is none, an app in a big
+ * enough region is moved to a smaller free one if it fits there, and else
+ * one of those apps is evicted, which victim picks. move does the moving
+ * and updates the entry. The slot loses its name */
+bool app_store_place(struct app_store_t *store, int slot, size_t len, bool *evicted,
+        app_store_victim_cb_t victim, void *arg, app_store_move_cb_t move, void *move_arg)
+{
+    struct app_store_entry_t *e = &store->entries[slot - 1];
+    size_t need = app_store_extent(len);
+
+    e->name[0] = '\0';
+    e->binary_len = 0;
+    if (e->size >= need) {
+        return true;
+    }
+    e->size = 0;
+
+    while (!app_store_fit(store, need, &e->offset)) {
+        int move_slot;
+        uint32_t offset;
+        if (app_store_next_move(store, need, &move_slot, &offset)) {
+            if (!move(store, move_slot, offset, move_arg)) {
+                return false;
+            }
+            continue;
+        }
+
+        bool candidates[APP_STORE_SLOTS];
+        bool any = false;
+        for (int i = 0; i < APP_STORE_SLOTS; i++) {
+            candidates[i] = i != slot - 1 && store->entries[i].size >= need;
+            any = any || candidates[i];
+        }
+        /* also when the app is bigger than any region */
+        if (!any) {
+            return false;
+        }
+        int v = victim(candidates, arg);
+        if (v < 1 || v > APP_STORE_SLOTS || !candidates[v - 1]) {
+            return false;
+        }
+        memset(&store->entries[v - 1], 0, sizeof(struct app_store_entry_t));
+        evicted[v - 1] = true;
+    }
+    e->size = app_store_region(store, e->offset);
+    return true;
+}
+
+static SemaphoreHandle_t store_mutex(void)
+{
+    /* first called on BOOT_APPS, see apps_step in boot.c */
+    if (!s_store_mutex) {
+        s_store_mutex = xSemaphoreCreateMutex();
+        assert(s_store_mutex != NULL);
+    }
+    return s_store_mutex;
+}
+
+static uint32_t store_checksum(const struct app_store_t *store)
+{
+    uint32_t crc = crc32_le(0, (const uint8_t *)store, offsetof(struct app_store_t, checksum));
+    return crc32_le(crc, (const uint8_t *)store->regions,
+            sizeof(struct app_store_t) - offsetof(struct app_store_t, regions));
+}
+
+/* the table is kept twice in its partition, written in turns, so that one
+ * is always whole; one for other regions than those flashed is no good */
+static bool store_read_copy(int copy, struct app_store_t *store)
+{
+    return esp_partition_read(s_table, copy * SPI_FLASH_SEC_SIZE, store, sizeof(struct app_store_t)) == ESP_OK &&
+           store->magic == STORE_MAGIC &&
+           memcmp(store->regions, s_region_sizes, sizeof(s_region_sizes)) == 0 &&
+           store->checksum == store_checksum(store);
+}
+
+static void store_write(struct app_store_t *store)
+{
+    store->sequence += 1;
+    store->checksum = store_checksum(store);
+
+    size_t offset = (store->sequence % 2) * SPI_FLASH_SEC_SIZE;
+    ESP_ERROR_CHECK(esp_partition_erase_range(s_table, offset, SPI_FLASH_SEC_SIZE));
+    ESP_ERROR_CHECK(esp_partition_write(s_table, offset, store, sizeof(struct app_store_t)));
+}
+
+/* the partition of the region at offset */
+static const esp_partition_t *store_region(uint32_t offset)
+{
+    uint32_t pos = 0;
+    for (int i = 0; i < APP_STORE_SLOTS && s_regions[i]; pos += s_region_sizes[i++]) {
+        if (pos == offset) {
+            return s_regions[i];
+        }
+    }
+    return NULL;
+}
+
+/* apps of the six 2M partitions stay where they are, if the image there is
+ * valid and a region starts there that holds it; their app%d keys go */
+static void store_migrate(struct app_store_t *store)
+{
+    nvs_handle nvs;
+    ESP_ERROR_CHECK(nvs_open("nvs", NVS_READWRITE, &nvs));
+
+    for (int slot = 1; slot <= LEGACY_SLOTS; slot++) {
+        char key[5], value[APP_STORE_NAME_LEN];
+        size_t len = sizeof(value);
+        snprintf(key, sizeof(key), "app%d", slot);
+        esp_err_t err = nvs_get_str(nvs, key, value, &len);
+        nvs_erase_key(nvs, key);
+        if (err != ESP_OK) {
+            continue;
+        }
+
+        uint32_t offset = (slot - 1) * LEGACY_SLOT_SIZE;
+        const esp_partition_t *region = store_region(offset);
+        if (!region) {
+            continue;
+        }
+        esp_partition_pos_t pos = {
+            .offset = region->address,
+            .size = region->size,
+        };
+        esp_image_metadata_t data;
+        if (esp_image_verify(ESP_IMAGE_VERIFY_SILENT, &pos, &data) != ESP_OK) {
+            continue;
+        }
+
+        struct app_store_entry_t *e = &store->entries[slot - 1];
+        e->offset = offset;
+        e->size = region->size;
+        e->binary_len = data.image_len;
+        snprintf(e->name, sizeof(e->name), "%s", value);
+    }
+
+    ESP_ERROR_CHECK(nvs_commit(nvs));
+    nvs_close(nvs);
+}
+
+/* the table in RAM, read or made on first use; the lock is held. The
+ * regions are the ota_N partitions, which partitions.csv puts one after
+ * the other */
+static struct app_store_t *store_get(void)
+{
+    if (s_store_loaded) {
+        return &s_store;
+    }
+
+    s_table = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, APP_STORE_SUBTYPE, STORE_LABEL);
+    assert(s_table != NULL && s_table->size >= 2 * SPI_FLASH_SEC_SIZE);
+    size_t count = 0;
+    for (int n = 1; n <= APP_STORE_SLOTS; n++) {
+        const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_APP,
+                ESP_PARTITION_SUBTYPE_APP_OTA_0 + n, NULL);
+        if (!part) {
+            break;
+        }
+        assert(count == 0 || part->address == s_regions[count - 1]->address + s_region_sizes[count - 1]);
+        s_regions[count] = part;
+        s_region_sizes[count++] = part->size;
+    }
+    assert(count > 0);
+
+    struct app_store_t *copy = malloc(sizeof(struct app_store_t));
+    assert(copy != NULL);
+    bool valid = store_read_copy(0, &s_store);
+    if (store_read_copy(1, copy) && (!valid || copy->sequence > s_store.sequence)) {
+        s_store = *copy;
+        valid = true;
+    }
+    free(copy);
+
+    if (!valid) {
+        app_store_init(&s_store, s_region_sizes, count);
+        store_migrate(&s_store);
+        store_write(&s_store);
+    }
+    s_store_loaded = true;
+    return &s_store;
+}
+
+/* copies an app to a free region a block at a time. The region it leaves
+ * is only read, and the table only points at the copy once it is whole,
+ * so a power cut loses the copy and nothing else */
+static bool store_move(struct app_store_t *store, int slot, uint32_t offset, void *arg)
+{
+    struct app_store_entry_t *e = &store->entries[slot - 1];
+    const esp_partition_t *from = store_region(e->offset);
+    const esp_partition_t *to = store_region(offset);
+    size_t len = app_store_extent(e->binary_len);
+    uint8_t *buf = malloc(SPI_FLASH_SEC_SIZE);
+    assert(buf != NULL);
+
+    esp_err_t err = esp_partition_erase_range(to, 0, len);
+    for (size_t pos = 0; pos < len && err == ESP_OK; pos += SPI_FLASH_SEC_SIZE) {
+        err = esp_partition_read(from, pos, buf, SPI_FLASH_SEC_SIZE);
+        if (err == ESP_OK) {
+            err = esp_partition_write(to, pos, buf, SPI_FLASH_SEC_SIZE);
+        }
+    }
+    free(buf);
+
+    if (err != ESP_OK) {
+        return false;
+    }
+    e->offset = offset;
+    e->size = to->size;
+    store_write(store);
+    return true;
+}
+
+/* the slot holding name, or else a free one; 0 when all hold apps */
+int app_store_slot(const char *name, bool *installed)
+{
+    xSemaphoreTake(store_mutex(), portMAX_DELAY);
+    struct app_store_t *store = store_get();
+    int slot = app_store_find(store, name);
+    if (installed) {
+        *installed = slot > 0;
+    }
+    if (!slot) {
+        slot = app_store_free_slot(store);
+    }
+    xSemaphoreGive(store_mutex());
+    return slot;
+}
+
+/* the app slot holds, false if none */
+bool app_store_name(int slot, char *name, size_t len)
+{
+    xSemaphoreTake(store_mutex(), portMAX_DELAY);
+    const struct app_store_entry_t *e = &store_get()->entries[slot - 1];
+    bool named = e->size > 0 && e->name[0];
+    if (named) {
+        snprintf(name, len, "%s", e->name);
+    }
+    xSemaphoreGive(store_mutex());
+    return named;
+}
+
+/* the ota_N partition of the slot's region, false if it has none */
+bool app_store_partition(int slot, esp_partition_t *part)
+{
+    xSemaphoreTake(store_mutex(), portMAX_DELAY);
+    const struct app_store_entry_t *e = &store_get()->entries[slot - 1];
+    bool found = e->size > 0;
+    if (found) {
+        *part = *store_region(e->offset);
+    }
+    xSemaphoreGive(store_mutex());
+    return found;
+}
+
+/* a region for len bytes in slot, see app_store_place; evicted[] tells
+ * which other slots had to go. The slot holds no app until committed */
+bool app_store_reserve(int slot, size_t len, bool *evicted, app_store_victim_cb_t victim, void *arg)
+{
+    assert(slot > 0 && slot <= APP_STORE_SLOTS);
+
+    xSemaphoreTake(store_mutex(), portMAX_DELAY);
+    struct app_store_t *store = store_get();
+    memset(evicted, 0, APP_STORE_SLOTS * sizeof(bool));
+    bool placed = app_store_place(store, slot, len, evicted, victim, arg, store_move, NULL);
+    store_write(store);
+    xSemaphoreGive(store_mutex());
+    return placed;
+}
+
+void app_store_commit(int slot, const char *name, size_t binary_len)
+{
+    xSemaphoreTake(store_mutex(), portMAX_DELAY);
+    struct app_store_t *store = store_get();
+    struct app_store_entry_t *e = &store->entries[slot - 1];
+    assert(e->size >= binary_len);
+    e->binary_len = binary_len;
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    store_write(store);
+    xSemaphoreGive(store_mutex());
+}
+
+/* frees the region of slot */
+void app_store_release(int slot)
+{
+    xSemaphoreTake(store_mutex(), portMAX_DELAY);
+    struct app_store_t *store = store_get();
+    memset(&store->entries[slot - 1], 0, sizeof(struct app_store_entry_t));
+    store_write(store);
+    xSemaphoreGive(store_mutex());
+}
+
+/* called once at startup, so that the table is read, or the apps of older
+ * launchers taken over, before anything asks for a slot */
+void app_store_boot_check(void)
+{
+    xSemaphoreTake(store_mutex(), portMAX_DELAY);
+    store_get();
+    xSemaphoreGive(store_mutex());
+}
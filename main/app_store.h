@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_partition.h"
+
+/*
+ * Where installed app binaries live: the ota_1 to ota_15 partitions of
+ * partitions.csv, of a few sizes and one after the other, are the regions
+ * of one pool. A slot is an entry of the store's table and holds its app in
+ * whichever region fits it best, so slot numbers are not partition
+ * numbers. The table is kept in the "appstore" partition and replaces the
+ * app%d NVS keys of older launchers.
+ *
+ * The partition table is never written: the bootloader only boots what it
+ * lists, so the regions are the partitions as flashed.
+ */
+
+/* ota_1 to ota_15 at most, ota_0 is the launcher */
+#define APP_STORE_SLOTS (15)
+#define APP_STORE_ALIGN (0x10000)
+#define APP_STORE_NAME_LEN (240)
+#define APP_STORE_SUBTYPE (0x40)
+
+/* size is that of the region, 0 for a free slot; a slot being installed
+ * has a region but no name yet */
+struct app_store_entry_t {
+    uint32_t offset;
+    uint32_t size;
+    uint32_t binary_len;
+    char name[APP_STORE_NAME_LEN];
+};
+
+/* offsets are from the start of the first region; regions past the last
+ * are 0 */
+struct app_store_t {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t pool_size;
+    uint32_t checksum;
+    uint32_t regions[APP_STORE_SLOTS];
+    struct app_store_entry_t entries[APP_STORE_SLOTS];
+};
+
+/* picks a slot to evict among candidates[slot - 1], 0 if none will do */
+typedef int (*app_store_victim_cb_t)(const bool *candidates, void *arg);
+
+/* moves the app of slot to the region at offset and updates its entry,
+ * false if that failed and it stayed where it was */
+typedef bool (*app_store_move_cb_t)(struct app_store_t *store, int slot, uint32_t offset, void *arg);
+
+/* the allocator, on a table in RAM; slots are numbered from 1 */
+void app_store_init(struct app_store_t *store, const uint32_t *regions, size_t count);
+size_t app_store_extent(size_t len);
+size_t app_store_region(const struct app_store_t *store, uint32_t offset);
+int app_store_find(const struct app_store_t *store, const char *name);
+int app_store_free_slot(const struct app_store_t *store);
+bool app_store_fit(const struct app_store_t *store, size_t len, uint32_t *offset);
+bool app_store_next_move(const struct app_store_t *store, size_t len, int *slot, uint32_t *offset);
+bool app_store_place(struct app_store_t *store, int slot, size_t len, bool *evicted,
+        app_store_victim_cb_t victim, void *arg, app_store_move_cb_t move, void *move_arg);
+
+/* the store on flash */
+int app_store_slot(const char *name, bool *installed);
+bool app_store_name(int slot, char *name, size_t len);
+bool app_store_partition(int slot, esp_partition_t *part);
+bool app_store_reserve(int slot, size_t len, bool *evicted, app_store_victim_cb_t victim, void *arg);
+void app_store_commit(int slot, const char *name, size_t binary_len);
+void app_store_release(int slot);
+void app_store_boot_check(void);
@@ -0,0 +1,193 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+#include "nvs_flash.h"
+#include "esp_err.h"
+#include "esp_spiffs.h"
+#include "esp_timer.h"
+
+#include "display.h"
+#include "backlight.h"
+#include "keypad.h"
+#include "sdcard.h"
+#include "wifi.h"
+
+#include "app_data.h"
+#include "app_icons.h"
+#include "app_slots.h"
+#include "app_store.h"
+#include "boot.h"
+#include "splash.h"
+#include "trace.h"
+
+#define BOOT_STAGES (10)
+#define PRIORITY_FOREGROUND (5)
+/* below the launcher task, so they do not hold up the home screen */
+#define PRIORITY_BACKGROUND (2)
+
+typedef struct boot_step_t {
+    const char *name;
+    /* NULL for stages marked from elsewhere */
+    void (*init)(void);
+    uint32_t needs;
+    bool background;
+    BaseType_t core;
+    uint32_t stack;
+} boot_step_t;
+
+static void display_step(void);
+static void nvs_step(void);
+static void sdcard_step(void);
+static void spiffs_step(void);
+static void apps_step(void);
+
+/* in the order of the bits; the card shares its SPI bus with the display,
+ * so it is set up once the home screen has been drawn, and the launcher
+ * task draws nothing else until it is. Wi-Fi stays on the core its driver
+ * runs on. The status bar registers a periodic callback, which only the
+ * launcher task may do, so it is brought up there */
+static const boot_step_t s_steps[BOOT_STAGES] = {
+    {"display", display_step, 0, false, 1, 4096},
+    {"keypad", keypad_init, 0, false, 0, 2048},
+    {"nvs", nvs_step, 0, false, 0, 4096},
+    {"sdcard", sdcard_step, BOOT_HOME, false, 1, 4096},
+    {"spiffs", spiffs_step, 0, true, 0, 4096},
+    {"apps", apps_step, BOOT_NVS | BOOT_SPIFFS, true, 1, 8192},
+    {"wifi", wifi_init, BOOT_NVS, true, 0, 4096},
+    {"statusbar", NULL, BOOT_DISPLAY | BOOT_SDCARD | BOOT_WIFI, false, 0, 0},
+    {"icons", app_icons_init, BOOT_DISPLAY, false, 1, 2048},
+    {"home", NULL, BOOT_DISPLAY | BOOT_KEYPAD, false, 0, 0},
+};
+
+static EventGroupHandle_t s_group = NULL;
+static int64_t s_start_us;
+static int64_t s_began_us[BOOT_STAGES];
+static int64_t s_done_us[BOOT_STAGES];
+static bool s_reported = false;
+/* when the splash was on the display, 0 without one */
+static int64_t s_splash_us = 0;
+
+
+/* the splash before the backlight, so that nothing else shows first */
+static void display_step(void)
+{
+    display_init();
+    if (splash_show()) {
+        s_splash_us = esp_timer_get_time();
+    }
+    backlight_init();
+}
+
+static void nvs_step(void)
+{
+    ESP_ERROR_CHECK(nvs_flash_init());
+}
+
+static void sdcard_step(void)
+{
+    sdcard_init("/sdcard");
+}
+
+/* formats the partition the first time, which takes a while */
+static void spiffs_step(void)
+{
+    esp_vfs_spiffs_conf_t conf = {
+      .base_path = "/spiffs",
+      .partition_label = NULL,
+      .max_files = 5,
+      .format_if_mount_failed = true,
+    };
+
+    ESP_ERROR_CHECK(esp_vfs_spiffs_register(&conf));
+}
+
+/* the store, the slot table and the catalog create their locks on first
+ * use without one: the store and the table are first used here, and
+ * nothing reaches any of them before this stage is done, as app_list_entry
+ * waits for it; app_scan_start creates the catalog's before its task
+ * can race for it */
+static void apps_step(void)
+{
+    app_store_boot_check();
+    app_slots_boot_check();
+    app_data_boot_check();
+}
+
+/* when each stage began and was done, in ms from boot_start */
+static void boot_report(void)
+{
+    printf("boot stage      began   done\n");
+    for (int i = 0; i < BOOT_STAGES; i++) {
+        printf("boot %-10s %6.1f %6.1f\n", s_steps[i].name, (s_began_us[i] - s_start_us) / 1000.0,
+                (s_done_us[i] - s_start_us) / 1000.0);
+    }
+
+    /* the first thing on the display, the splash or else the home screen */
+    int home = __builtin_ctz(BOOT_HOME);
+    printf("boot first pixel %.1f, %s\n", ((s_splash_us ? s_splash_us : s_done_us[home]) - s_start_us) / 1000.0,
+            s_splash_us ? "splash" : "home");
+}
+
+static void stage_done(int i)
+{
+    s_done_us[i] = esp_timer_get_time();
+    EventBits_t bits = xEventGroupSetBits(s_group, 1 << i);
+    if ((bits & BOOT_ALL) == BOOT_ALL && !__atomic_exchange_n(&s_reported, true, __ATOMIC_RELAXED)) {
+        boot_report();
+    }
+}
+
+static void stage_task(void *arg)
+{
+    int i = (intptr_t)arg;
+    const boot_step_t *step = &s_steps[i];
+
+    if (step->needs) {
+        xEventGroupWaitBits(s_group, step->needs, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+    s_began_us[i] = esp_timer_get_time();
+    TRACE_BEGIN(step->name);
+    step->init();
+    TRACE_END(step->name);
+    stage_done(i);
+
+    vTaskDelete(NULL);
+}
+
+/* called once, by app_main */
+void boot_start(void)
+{
+    s_group = xEventGroupCreate();
+    assert(s_group != NULL);
+    s_start_us = esp_timer_get_time();
+
+    for (int i = 0; i < BOOT_STAGES; i++) {
+        const boot_step_t *step = &s_steps[i];
+        if (step->init) {
+            xTaskCreatePinnedToCore(stage_task, step->name, step->stack, (void *)(intptr_t)i,
+                    step->background ? PRIORITY_BACKGROUND : PRIORITY_FOREGROUND, NULL, step->core);
+        }
+    }
+}
+
+void boot_wait(uint32_t stages)
+{
+    xEventGroupWaitBits(s_group, stages, pdFALSE, pdTRUE, portMAX_DELAY);
+}
+
+bool boot_ready(uint32_t stages)
+{
+    return (xEventGroupGetBits(s_group) & stages) == stages;
+}
+
+/* for stages done outside of here, by the launcher task */
+void boot_mark(boot_stage_t stage)
+{
+    int i = __builtin_ctz(stage);
+    TRACE_INSTANT(s_steps[i].name, 0);
+    s_began_us[i] = s_start_us;
+    stage_done(i);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * What app_main brings up, each stage on its own task once the stages it
+ * needs are up, so that those which do not need each other run at the same
+ * time. The ones the home screen and the menu do not need run in the
+ * background, and whatever needs them waits for them with boot_wait.
+ */
+
+typedef enum {
+    BOOT_DISPLAY = 1 << 0,
+    BOOT_KEYPAD = 1 << 1,
+    BOOT_NVS = 1 << 2,
+    BOOT_SDCARD = 1 << 3,
+    BOOT_SPIFFS = 1 << 4,
+    /* the app store, slot table and appdata checked */
+    BOOT_APPS = 1 << 5,
+    BOOT_WIFI = 1 << 6,
+    /* this and BOOT_HOME are marked by the launcher task */
+    BOOT_STATUSBAR = 1 << 7,
+    BOOT_ICONS = 1 << 8,
+    BOOT_HOME = 1 << 9,
+    BOOT_ALL = (1 << 10) - 1,
+} boot_stage_t;
+
+void boot_start(void);
+void boot_wait(uint32_t stages);
+bool boot_ready(uint32_t stages);
+void boot_mark(boot_stage_t stage);
@@ -5,72 +5,69 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "nvs_flash.h"
-#include "esp_err.h"
-#include "esp_spiffs.h"
 
 #include "display.h"
-#include "backlight.h"
 #include "keypad.h"
-#include "sdcard.h"
-#include "wifi.h"
 
-#include "app.h"
 #include "app_dialog.h"
+#include "boot.h"
 #include "graphics.h"
 #include "tf.h"
 #include "OpenSans_Regular_11X12.h"
 #include "periodic.h"
+#include "qoi.h"
+#include "render_stats.h"
+#include "splash.h"
 #include "statusbar.h"
+#include "trace.h"
 #include "ui_dialog.h"
 #include "wifi_dialog.h"
 
+#define WALLPAPER_PATH "/sdcard/launcher/wallpaper.qoi"
+#define TRACE_PATH "/sdcard/launcher/trace.txt"
 
 static void launcher_task(void *arg);
 
-void app_main(void)
+/* the menu entries wait for what they need, which the home screen does not */
+static void app_list_entry(ui_list_item_t *item, void *arg)
 {
-    display_init();
-    backlight_init();
-
-    tf_t *tf = tf_new(&font_OpenSans_Regular_11X12, 0xFFFF, 240, TF_ALIGN_CENTER | TF_WORDWRAP);
-    const char *s;
-    tf_metrics_t m;
-    point_t p;
-
-    s = "Initializing...";
-    m = tf_get_str_metrics(tf, s);
-    p.x = DISPLAY_WIDTH/2 - tf->width/2;
-    p.y = DISPLAY_HEIGHT/2 - m.height/2;
-    tf_draw_str(fb, tf, s, p);
-    display_update();
-
-    keypad_init();
-    ESP_ERROR_CHECK(nvs_flash_init());
-    sdcard_init("/sdcard");
-
-    esp_vfs_spiffs_conf_t conf = {
-      .base_path = "/spiffs",
-      .partition_label = NULL,
-      .max_files = 5,
-      .format_if_mount_failed = true,
-    };
-
-    ESP_ERROR_CHECK(esp_vfs_spiffs_register(&conf));
-    wifi_init();
-    statusbar_init();
+    boot_wait(BOOT_SDCARD | BOOT_APPS | BOOT_ICONS);
+    app_list_dialog(item, arg);
+}
 
-    tf_free(tf);
+static void wifi_entry(ui_list_item_t *item, void *arg)
+{
+    boot_wait(BOOT_WIFI);
+    wifi_configuration_dialog(item, arg);
+}
 
+void app_main(void)
+{
+#ifdef CONFIG_TRACE
+    trace_init();
+#endif
+    TRACE_BEGIN("app_main");
+    boot_start();
     xTaskCreate(launcher_task, "launcher", 8192, NULL, 5, NULL);
+    TRACE_END("app_main");
 }
 
-static void launcher_task(void *arg)
+#ifdef CONFIG_TRACE
+/* to the card when there is one, else to the console */
+static void trace_save(void)
 {
-    tf_t *tf = tf_new(&font_OpenSans_Regular_11X12, 0xFFFF, 240, TF_ALIGN_CENTER | TF_WORDWRAP);
-
-    QueueHandle_t keypad = keypad_get_queue();
+    FILE *f = boot_ready(BOOT_SDCARD) ? fopen(TRACE_PATH, "w") : NULL;
+    trace_dump(f ? f : stdout);
+    if (f) {
+        fclose(f);
+        printf("trace written to %s\n", TRACE_PATH);
+    }
+}
+#endif
 
+/* the wallpaper is left out until the card is up */
+static void draw_home(tf_t *tf, bool wallpaper)
+{
     char *s = "Press Menu button for the menu.";
     tf_metrics_t m = tf_get_str_metrics(tf, s);
     point_t p = {
@@ -78,20 +75,80 @@ static void launcher_task(void *arg)
         .y = fb->height/2 - m.height/2,
     };
     memset(fb->data + fb->width * 16 * fb->bytes_per_pixel, 0, fb->width * (fb->height - 32) * fb->bytes_per_pixel);
+    if (wallpaper) {
+        point_t origin = {
+            .x = 0,
+            .y = 16,
+        };
+        qoi_draw(fb, origin, WALLPAPER_PATH);
+    }
     tf_draw_str(fb, tf, s, p);
     display_update();
+}
+
+/* periodic callbacks are only registered from this task, so the status bar
+ * is brought up here once what it shows is */
+static void statusbar_boot(void)
+{
+    if (!boot_ready(BOOT_STATUSBAR) && boot_ready(BOOT_SDCARD | BOOT_WIFI)) {
+        statusbar_init();
+        boot_mark(BOOT_STATUSBAR);
+    }
+}
+
+static void launcher_task(void *arg)
+{
+    tf_t *tf = tf_new(&font_OpenSans_Regular_11X12, 0xFFFF, 240, TF_ALIGN_CENTER | TF_WORDWRAP);
+
+    boot_wait(BOOT_DISPLAY | BOOT_KEYPAD);
+    QueueHandle_t keypad = keypad_get_queue();
+
+    /* the card is only set up after this, a splash stays up until the
+     * wallpaper can be drawn */
+    bool wallpaper = false;
+    if (!splash_shown()) {
+        draw_home(tf, wallpaper);
+    }
+    boot_mark(BOOT_HOME);
+    bool snapshot = false;
 
     while (true) {
         keypad_info_t keys;
         while (true) {
+            /* the rest of the home screen, as what it needs comes up */
+            if (!wallpaper && boot_ready(BOOT_SDCARD)) {
+                wallpaper = true;
+                draw_home(tf, wallpaper);
+            }
+            statusbar_boot();
+            /* once per boot, when the home screen is complete */
+            if (!snapshot && wallpaper && boot_ready(BOOT_STATUSBAR)) {
+                splash_save();
+                snapshot = true;
+            }
             if (keypad_queue_receive(keypad, &keys, 50/portTICK_RATE_MS)) {
                 if (keys.pressed & KEYPAD_MENU) {
                     break;
                 }
+#ifdef CONFIG_GRAPHICS_RENDER_STATS
+                if (keys.pressed & KEYPAD_SELECT) {
+                    render_stats_dump(stdout);
+                    render_stats_reset();
+                }
+#endif
+#ifdef CONFIG_TRACE
+                if (keys.pressed & KEYPAD_START) {
+                    trace_save();
+                }
+#endif
             }
             periodic_tick();
         }
 
+        /* the menu is drawn over the bus the card may still be being set
+         * up on, so it waits for the card, as the status bar does */
+        boot_wait(BOOT_SDCARD);
+        statusbar_boot();
         rect_t r = {
             .x = DISPLAY_WIDTH/2 - 240/2,
             .y = DISPLAY_HEIGHT/2 - 180/2,
@@ -108,8 +165,8 @@ static void launcher_task(void *arg)
             .height = 180 - 2,
         };
         ui_list_t *list = ui_dialog_add_list(d, lr);
-        ui_list_append_text(list, "App List", app_list_dialog, NULL);
-        ui_list_append_text(list, "Wi-Fi Configuration", wifi_configuration_dialog, NULL);
+        ui_list_append_text(list, "App List", app_list_entry, NULL);
+        ui_list_append_text(list, "Wi-Fi Configuration", wifi_entry, NULL);
         ui_dialog_showmodal(d);
         ui_dialog_destroy(d);
     }
@@ -0,0 +1,167 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#include "rom/crc.h"
+
+#include "display.h"
+
+#include "qoi.h"
+#include "splash.h"
+#include "statusbar.h"
+#include "trace.h"
+
+#define SPLASH_MAGIC (0x48534c53)
+#define SPLASH_LABEL "splash"
+
+/* at the start of the partition, the image follows; written last, so that
+ * an interrupted write leaves no splash rather than half of one. The
+ * image is the framebuffer below the status bar, whose Wi-Fi bars follow
+ * the signal and would change it on most boots */
+struct splash_header_t {
+    uint32_t magic;
+    uint32_t len;
+    /* of the framebuffer the image was made from */
+    uint32_t crc;
+    uint32_t reserved;
+};
+
+typedef struct splash_write_t {
+    const esp_partition_t *part;
+    struct splash_header_t header;
+    uint8_t *image;
+} splash_write_t;
+
+static uint32_t s_crc = 0;
+static bool s_shown = false;
+static bool s_saving = false;
+
+
+static const esp_partition_t *splash_partition(void)
+{
+    return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, SPLASH_SUBTYPE, SPLASH_LABEL);
+}
+
+/* the part of the framebuffer kept, without copying it */
+static gbuf_t splash_rows(void)
+{
+    gbuf_t g = *fb;
+    g.height = fb->height - STATUSBAR_HEIGHT;
+    g.data = fb->data + STATUSBAR_HEIGHT * fb->width * fb->bytes_per_pixel;
+    return g;
+}
+
+static uint32_t rows_crc(const gbuf_t *g)
+{
+    return crc32_le(0, g->data, g->width * g->height * g->bytes_per_pixel);
+}
+
+/* draws the snapshot and puts it on the display, true if there was one */
+bool splash_show(void)
+{
+    const esp_partition_t *part = splash_partition();
+    struct splash_header_t header;
+    if (!part || esp_partition_read(part, 0, &header, sizeof(header)) != ESP_OK ||
+            header.magic != SPLASH_MAGIC || header.len > part->size - sizeof(header)) {
+        return false;
+    }
+
+    uint8_t *image = malloc(header.len);
+    assert(image != NULL);
+    bool ok = false;
+    if (esp_partition_read(part, sizeof(header), image, header.len) == ESP_OK) {
+        FILE *f = fmemopen(image, header.len, "rb");
+        qoi_t *q = f ? qoi_open(f) : NULL;
+        if (q && q->width == fb->width && q->height == fb->height - STATUSBAR_HEIGHT) {
+            point_t origin = {
+                .x = 0,
+                .y = STATUSBAR_HEIGHT,
+            };
+            ok = qoi_decode_rows(q, fb, origin, q->height);
+        }
+        if (q) {
+            qoi_close(q);
+        }
+        if (f) {
+            fclose(f);
+        }
+    }
+    free(image);
+
+    if (ok) {
+        display_update();
+        TRACE_INSTANT("splash", header.len);
+        s_crc = header.crc;
+        s_shown = true;
+    }
+    return ok;
+}
+
+/* whether the display still shows what splash_show put there, which the
+ * launcher leaves until it can draw the whole home screen */
+bool splash_shown(void)
+{
+    return s_shown;
+}
+
+static void write_task(void *arg)
+{
+    splash_write_t *w = (splash_write_t *)arg;
+    size_t len = sizeof(w->header) + w->header.len;
+    size_t erase = (len + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1);
+
+    TRACE_BEGIN("splash write");
+    if (esp_partition_erase_range(w->part, 0, erase) == ESP_OK &&
+            esp_partition_write(w->part, sizeof(w->header), w->image, w->header.len) == ESP_OK) {
+        esp_partition_write(w->part, 0, &w->header, sizeof(w->header));
+    }
+    TRACE_END("splash write");
+
+    free(w->image);
+    free(w);
+    s_saving = false;
+    vTaskDelete(NULL);
+}
+
+/* snapshots the display if it changed since the snapshot shown or last
+ * saved; the flash is written on a task of its own. A change to the
+ * wallpaper or the theme shows in the CRC, the status bar is left out. A
+ * screen that does not compress to fit erases the snapshot */
+void splash_save(void)
+{
+    const esp_partition_t *part = splash_partition();
+    gbuf_t rows = splash_rows();
+    uint32_t crc = rows_crc(&rows);
+    if (!part || s_saving || crc == s_crc) {
+        return;
+    }
+
+    splash_write_t *w = calloc(1, sizeof(splash_write_t));
+    assert(w != NULL);
+    w->part = part;
+    w->image = malloc(part->size - sizeof(w->header));
+    assert(w->image != NULL);
+
+    TRACE_BEGIN("splash encode");
+    w->header.len = qoi_encode(&rows, w->image, part->size - sizeof(w->header));
+    TRACE_END("splash encode");
+
+    s_crc = crc;
+    if (w->header.len == 0) {
+        esp_partition_erase_range(part, 0, SPI_FLASH_SEC_SIZE);
+        free(w->image);
+        free(w);
+        return;
+    }
+    w->header.magic = SPLASH_MAGIC;
+    w->header.crc = crc;
+
+    s_saving = true;
+    xTaskCreate(write_task, "splash", 2048, w, 1, NULL);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdbool.h>
+
+/*
+ * The home screen as it was last complete, kept QOI-compressed in the
+ * splash partition and put on the display right after display_init, until
+ * the launcher has drawn the live one.
+ */
+
+#define SPLASH_SUBTYPE (0x41)
+
+bool splash_show(void);
+bool splash_shown(void);
+void splash_save(void);
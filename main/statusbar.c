@@ -10,11 +10,10 @@
 #include "periodic.h"
 #include "statusbar.h"
 #include "tf.h"
+#include "trace.h"
 #include "wifi.h"
 
 
-#define STATUSBAR_HEIGHT (16)
-
 typedef struct {
     bool sdcard_present;
     wifi_state_t wifi_state;
@@ -77,7 +76,9 @@ static void statusbar_update(periodic_handle_t handle, void *arg)
     tf_draw_glyph(fb, s_icons, FONT_ICON_SPEAKER3, p);
     p.x -= 16;
 
+    TRACE_BEGIN("display flush");
     display_update_rect(s_rect);
+    TRACE_END("display flush");
 }
 
 void statusbar_init(void)
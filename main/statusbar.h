@@ -2,4 +2,7 @@
 
 #include "graphics.h"
 
+/* the rows at the top of the framebuffer it draws in */
+#define STATUSBAR_HEIGHT (16)
+
 void statusbar_init(void);
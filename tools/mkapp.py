@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+#
+# Packs an app for the launcher: a JSON manifest, the app binary and any
+# number of 48x48 icons into an .app file. Sections are deflated when that
+# makes them smaller and the SHA-256 of the binary is stored for the
+# launcher to check as it installs (header version 2); --v1 writes the old
+# uncompressed format for launchers that predate it.
+#
+import PIL.Image
+import argparse
+import hashlib
+import struct
+import zlib
+
+APP_HEADER_MAGIC = 0x21505041
+APP_ICON_SIZE = 48
+
+COMPRESSION_NONE = 0
+COMPRESSION_DEFLATE = 1
+
+HEADER_SHA256 = 1 << 0
+
+
+def icon_rgb565(filename):
+    image = PIL.Image.open(filename).convert('RGB')
+    if image.size != (APP_ICON_SIZE, APP_ICON_SIZE):
+        raise SystemExit("%s: icons must be %dx%d" % (filename, APP_ICON_SIZE, APP_ICON_SIZE))
+    out = bytearray()
+    for r, g, b in image.getdata():
+        out += struct.pack('>H', (r & 0xf8) << 8 | (g & 0xfc) << 3 | b >> 3)
+    return bytes(out)
+
+
+def store(data):
+    deflated = zlib.compress(data, 9)
+    if len(deflated) < len(data):
+        return COMPRESSION_DEFLATE, deflated
+    return COMPRESSION_NONE, data
+
+
+parser = argparse.ArgumentParser()
+parser.add_argument('--v1', action='store_true', help="write an uncompressed version 1 file")
+parser.add_argument('manifest')
+parser.add_argument('binary')
+parser.add_argument('output')
+parser.add_argument('icons', nargs='*')
+args = parser.parse_args()
+
+sections = [
+    open(args.manifest, 'rb').read(),
+    b''.join(icon_rgb565(icon) for icon in args.icons),
+    open(args.binary, 'rb').read(),
+]
+
+if args.v1:
+    header = struct.pack('<6I', APP_HEADER_MAGIC, 1, 24, *[len(s) for s in sections])
+    stored = sections
+else:
+    stored = [store(s) for s in sections]
+    header = struct.pack('<6I', APP_HEADER_MAGIC, 2, 84, *[len(s) for s in sections])
+    for compression, data in stored:
+        header += struct.pack('<2I', compression, len(data))
+    header += struct.pack('<I', HEADER_SHA256) + hashlib.sha256(sections[2]).digest()
+    stored = [data for _, data in stored]
+
+f = open(args.output, 'wb')
+f.write(header)
+for data in stored:
+    f.write(data)
+f.close()
+
+total = sum(len(s) for s in sections)
+print("%s: %d bytes, %d uncompressed" % (args.output, len(header) + sum(len(s) for s in stored), total))
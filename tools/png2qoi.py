@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+#
+# Converts an image to QOI for the launcher's qoi decoder. Colors are
+# reduced to RGB565 first: the display cannot show more, and the repeated
+# colors compress much better.
+#
+import PIL.Image
+import struct
+import sys
+
+QOI_OP_INDEX = 0x00
+QOI_OP_DIFF = 0x40
+QOI_OP_LUMA = 0x80
+QOI_OP_RUN = 0xc0
+QOI_OP_RGB = 0xfe
+
+
+def to_rgb565(pixel):
+    r, g, b = pixel
+    r = (r & 0xf8) | (r >> 5)
+    g = (g & 0xfc) | (g >> 6)
+    b = (b & 0xf8) | (b >> 5)
+    return (r, g, b)
+
+
+def encode(width, height, pixels):
+    out = bytearray(b'qoif')
+    out += struct.pack('>IIBB', width, height, 3, 0)
+
+    index = [(0, 0, 0)] * 64
+    prev = (0, 0, 0)
+    run = 0
+    last = len(pixels) - 1
+    for i, px in enumerate(pixels):
+        if px == prev:
+            run += 1
+            if run == 62 or i == last:
+                out.append(QOI_OP_RUN | (run - 1))
+                run = 0
+            continue
+
+        if run > 0:
+            out.append(QOI_OP_RUN | (run - 1))
+            run = 0
+
+        r, g, b = px
+        h = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64
+        if index[h] == px:
+            out.append(QOI_OP_INDEX | h)
+        else:
+            index[h] = px
+            vr = (r - prev[0] + 128) % 256 - 128
+            vg = (g - prev[1] + 128) % 256 - 128
+            vb = (b - prev[2] + 128) % 256 - 128
+            vg_r = vr - vg
+            vg_b = vb - vg
+            if -2 <= vr <= 1 and -2 <= vg <= 1 and -2 <= vb <= 1:
+                out.append(QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2))
+            elif -32 <= vg <= 31 and -8 <= vg_r <= 7 and -8 <= vg_b <= 7:
+                out.append(QOI_OP_LUMA | (vg + 32))
+                out.append((vg_r + 8) << 4 | (vg_b + 8))
+            else:
+                out.append(QOI_OP_RGB)
+                out += bytes(px)
+        prev = px
+
+    out += b'\x00' * 7 + b'\x01'
+    return out
+
+
+if len(sys.argv) != 3:
+    print("usage: %s input output.qoi" % sys.argv[0])
+    sys.exit(1)
+
+image = PIL.Image.open(sys.argv[1]).convert('RGB')
+width, height = image.size
+pixels = [to_rgb565(px) for px in image.getdata()]
+
+f = open(sys.argv[2], 'wb')
+f.write(encode(width, height, pixels))
+f.close()
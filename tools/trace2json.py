@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+#
+# Converts a trace dump of the launcher, written with Start on the home
+# screen when built with CONFIG_TRACE, into a Chrome trace for
+# chrome://tracing or ui.perfetto.dev. Each task gets a track of its own,
+# named after the outermost spans it began, as a task deleted leaves its
+# handle to the next one; the core an event was recorded on is in its args.
+#
+import json
+import sys
+
+
+def convert(lines):
+    records = []
+    for line in lines:
+        if line.startswith('#') or not line.strip():
+            continue
+        fields = line.rstrip('\n').split(' ', 5)
+        if len(fields) < 6:
+            continue
+        ph, core, ts, task, arg, name = fields
+        records.append((float(ts), ph, int(core), task, int(arg), name))
+    records.sort(key=lambda r: r[0])
+
+    tids = {}
+    names = {}
+    depth = {}
+    events = []
+    for ts, ph, core, task, arg, name in records:
+        tid = tids.setdefault(task, len(tids) + 1)
+        event = {'name': name, 'ts': ts, 'pid': 1, 'tid': tid, 'args': {'cpu': core}}
+        if ph == 'B':
+            outer = names.setdefault(tid, [])
+            if depth.get(tid, 0) == 0 and name not in outer:
+                outer.append(name)
+            depth[tid] = depth.get(tid, 0) + 1
+            event['ph'] = 'B'
+        elif ph == 'E':
+            # its begin was overwritten in the ring
+            if depth.get(tid, 0) == 0:
+                continue
+            depth[tid] -= 1
+            event['ph'] = 'E'
+        else:
+            event['ph'] = 'i'
+            event['s'] = 't'
+            event['args']['value'] = arg
+        events.append(event)
+
+    for task, tid in tids.items():
+        outer = names.get(tid, ['task'])
+        name = ', '.join(outer[:3]) + (', ...' if len(outer) > 3 else '')
+        events.append({'name': 'thread_name', 'ph': 'M', 'pid': 1, 'tid': tid,
+                       'args': {'name': '%s (%s)' % (name, task)}})
+    events.append({'name': 'process_name', 'ph': 'M', 'pid': 1, 'args': {'name': 'launcher'}})
+    return {'traceEvents': events, 'displayTimeUnit': 'ms'}
+
+
+if len(sys.argv) != 3:
+    print("usage: %s trace.txt trace.json" % sys.argv[0])
+    sys.exit(1)
+
+f = open(sys.argv[1])
+trace = convert(f)
+f.close()
+
+f = open(sys.argv[2], 'w')
+json.dump(trace, f)
+f.close()